@@ -1,11 +1,32 @@
+//  sdf_cb.h е RenderConstants һ
 cbuffer ConstantBuffer : register(b0)
 {
     float4 g_Time;
     float4 g_Resolution;
     int4 g_Switch; //һЩãֱӦرջڱΡ⡢չ
     float2 g_Factor; //洢rayMarching󲽽ӰӲ̶
+    float2 g_FactorPad;
+    int4 g_Scene; //xΪÿ㶼ҪָyΪBVHڵΪ0ʱʹõmap()
+    int4 g_Cone; //xΪ׶ԤͨķֿشС0ʾرգyΪg_ConeDepthÿеķֿ
+    float4 g_Relax; //xΪraycast()ĳɳڲӣ1Ϊͨ׷
+    int4 g_Heatmap; //xΪʾͼ(SDF_HEATMAP_*)0ʾ棬yΪɫֵӦmap()
+    float4 g_Temporal; //xΪ1ʱߴһ֡g_PrevHitsͶӰеǰyΪһ֡g_Time.x
+    int4 g_Lighting; //xΪg_LightingSamplesÿǵر߳0ʾؼӰͻڱΣyΪÿеĲ
+    int4 g_Accumulate; //xΪ1ʱѶĲƽg_AccumulationУyΪ֮ǰƽĲzΪ1ʱֻʾg_Accumulation
+    float4 g_Camera; //xyzΪؼ֡λãwΪ1ʱg_CameraTargetΪ0ʱg_Time.x
+    float4 g_CameraTarget; //xyzΪؼ֡ĵ
+    float4 g_PrevCamera; //g_Temporal.yһ֡g_Camera
+    float4 g_PrevCameraTarget; //g_Temporal.yһ֡g_CameraTarget
+    int4 g_Occupancy; //xΪg_OccupancyBitsϸһÿߵĸ0ʾرտհԾyΪ
+    float4 g_OccupancyGrid; //xyzΪg_OccupancyBitsͽǣwΪϸһӵı߳
+    int4 g_Probes; //xyzΪն̽ÿϵĸ0ʾʹù̶չ
+    float4 g_ProbeOrigin; //xyzΪ(0, 0, 0)̽λãwΪg_ProbeDistanceе
+    float4 g_ProbeSpacing; //xyzΪ̽ļ࣬wΪɫ뿪ƫ
 }
 
+// ǰظmap()ĴxΪraycastyΪcalcNormalzΪcalcAOwΪcalcSoftshadow
+static uint4 s_Evaluations = uint4(0, 0, 0, 0);
+
 float dot2(in float2 v)
 {
     return dot(v, v);
@@ -156,7 +177,12 @@ float opRound(float sdf, float thickness)
     return sdf - thickness;
 }
 
-float2 map(float3 pos)  //sdfֵ
+#include "SDFNoise.hlsli"
+#include "SDFTape.hlsli"
+#include "SDFOccupancy.hlsli"
+
+//ó
+float2 mapBuiltin(float3 pos)  //sdfֵ
 {
     // ذ
     // float2 res = float2(pos.y, 0.0);
@@ -219,6 +245,22 @@ float2 map(float3 pos)  //
     return res;
 }
 
+float2 map(float3 pos)  //sdfֵʹϴĳָ
+{
+    if (g_Scene.y > 0) //BVHʱֻΧбȵǰ
+        return mapBvh(pos);
+    if (g_Scene.x > 0)
+        return mapTape(pos);
+    return mapBuiltin(pos);
+}
+
+// ߵļ㷽ʽ(SDF_NORMALS_*)sdf_ps.hlslɫָδָʱʹĬϷʽ
+#ifndef SDF_NORMALS
+#define SDF_NORMALS SDF_NORMALS_DEFAULT
+#endif
+
+#include "SDFDual.hlsli"
+
 // Ӱ
 float calcSoftshadow(in float3 ro, in float3 rd, float mint, float maxt, float k) //sdfӰ
 {
@@ -227,6 +269,7 @@ float calcSoftshadow(in float3 ro, in float3 rd, float mint, float maxt, float k
     for (float t = mint; t < maxt;)
     {
         float h = map(ro + rd * t); //ȡǰ㵽ľ
+        s_Evaluations.w++;
         if (h < 0.001)
             return 0.0;
         float y = h * h / (2.0 * ph); 
@@ -241,12 +284,29 @@ float calcSoftshadow(in float3 ro, in float3 rd, float mint, float maxt, float k
 // 㷨
 float3 calcNormal(float3 p, float t)   //SDF˵߿ͨԾ볡ֵݶȼõ
 {
+#if SDF_NORMALS == SDF_NORMALS_DUAL
+    // żǰԶ΢֣һμͬʱõݶ
+    s_Evaluations.y += 1;
+    return normalize(mapDual(p).d);
+#else
     float eps = 0.0001;
     eps += eps / 10 * t;
+#if SDF_NORMALS == SDF_NORMALS_TETRAHEDRON
+    // ĸ㷽ĺͼΪݶȷֻ4map()
+    const float2 k = float2(1, -1);
+    s_Evaluations.y += 4;
+    return normalize(k.xyy * map(p + k.xyy * eps).x +
+                     k.yyx * map(p + k.yyx * eps).x +
+                     k.yxy * map(p + k.yxy * eps).x +
+                     k.xxx * map(p + k.xxx * eps).x);
+#else
     const float2 h = float2(eps, 0);
+    s_Evaluations.y += 6;
     return normalize(float3(map(p + h.xyy).x - map(p - h.xyy).x,
                             map(p + h.yxy).x - map(p - h.yxy).x,
                             map(p + h.yyx).x - map(p - h.yyx).x));
+#endif
+#endif
 }
 
 // 㻷ڱ
@@ -259,6 +319,7 @@ float calcAO(in float3 pos, in float3 nor)
     {
         float h = 0.01 + 0.12 * float(i) / 4.0;
         float d = map(pos + h * nor).x;
+        s_Evaluations.z++;
         occ += (h - d) * decay;
         decay *= 0.95;
         if (occ > 0.35)
@@ -266,3 +327,235 @@ float calcAO(in float3 pos, in float3 nor)
     }
     return clamp(1.0 - 3.0 * occ, 0.0, 1.0) * (0.5 + 0.5 * nor.y);
 }
+
+// Ͷ䣬PS()ͽֱʹͨ(sdf_lighting_cs.hlsl)
+// g_Relax.x1ʱʹóɳ׷(Keinert et al. 2014, "Enhanced Sphere Tracing")
+// ÿǰomegaľ룬ľཻԽ˱棬
+// ʱ˻һͨһ֮ٳɳ
+// g_Occupancy.xΪ0ʱλռĿհ׸УҹߵӴΪֹ֪ǿյģ
+// һĿհ׸(CPU汾RayMarch::Skip())Ծ벽mnumε
+float2 raycast(float3 ro, float3 rd, int mnum, float tmin)
+{
+    float2 res = float2(-1.0, -1.0);
+
+    //н
+    float tmax = SDF_RAY_END;
+    
+    //н
+    //ʼн룬׶ԤͨʱֿڵĿհ
+    float t = tmin;
+    //ɳӺһλ
+    float omega = g_Relax.x;
+    float prevT = t;
+    float prevH = 0.0;
+    for (int i = 0; i < mnum && t < tmax; i++)
+    {
+        //ɳʱֻһľ֪ǿյģӱ˳Ĺ߲ٴԽ
+        if (g_Occupancy.x != 0 && prevH >= 0.0)
+        {
+            float2 cell = occupancySpan(ro, rd, t, tmax);
+            float known = omega > 1.0 ? prevT + abs(prevH) : t;
+            if (cell.y > t && cell.x <= known)
+            {
+                t = cell.y;
+                prevT = t;
+                prevH = 0.0;
+                continue;
+            }
+        }
+
+        float2 h = map(ro + rd * t);
+        s_Evaluations.x++;
+        if (omega > 1.0 && abs(h.x) + abs(prevH) < abs(t - prevT))
+        {
+            t = prevT + prevH;
+            omega = 1.0;
+            continue;
+        }
+        if (abs(h.x) < (0.0001 * t))
+        {
+            res = float2(t, h.y);
+            break;
+        }
+        prevT = t;
+        prevH = h.x;
+        t += h.x * omega;
+    }
+    
+    return res;
+}
+
+// ۻĶ(CPU汾src/cpu/Accumulation.cpp)ƫưڵHaltonУ0λ
+float radicalInverse(uint index, uint base)
+{
+    float result = 0.0;
+    float digit = 1.0 / float(base);
+    for (float scale = digit; index > 0; index /= base, scale *= digit)
+        result += float(index % base) * scale;
+    return result;
+}
+
+float2 halton(uint index, uint baseX, uint baseY)
+{
+    return frac(float2(radicalInverse(index, baseX), radicalInverse(index, baseY)) + 0.5);
+}
+
+// ڵƫƣΧ[-0.5, 0.5)y£posHһ
+float2 sampleJitter()
+{
+    if (g_Accumulate.x == 0)
+        return float2(0.0, 0.0);
+    return halton(uint(g_Accumulate.y), 2, 3) - 0.5;
+}
+
+// ڵλԲϵƫƣͬӳ䱣еķֲ
+float2 lightJitter()
+{
+    if (g_Accumulate.x == 0)
+        return float2(0.0, 0.0);
+    float2 o = 2.0 * halton(uint(g_Accumulate.y), 5, 7) - 1.0;
+    if (all(o == 0.0))
+        return float2(0.0, 0.0);
+    const float quarter = 0.78539816;
+    float r, theta;
+    if (abs(o.x) > abs(o.y))
+    {
+        r = o.x;
+        theta = quarter * (o.y / o.x);
+    }
+    else
+    {
+        r = o.y;
+        theta = 2.0 * quarter - quarter * (o.x / o.y);
+    }
+    return r * float2(cos(theta), sin(theta));
+}
+
+// ķʱƶ
+// xzƽԲ˶,yƶ
+float3 keyLightDir()
+{
+    float an = fmod(g_Time.x, 6.28);
+    float3 lig = normalize(float3(2 * sin(an), 1.5 + cos(an), 2 * cos(an)));
+    // ۻģʽ·ֲһ򳡾ԲϣõԴӰ
+    float2 jitter = lightJitter();
+    if (any(jitter != 0.0))
+    {
+        float3 tangent = normalize(cross(lig, float3(0.0, 1.0, 0.0)));
+        float3 bitangent = cross(tangent, lig);
+        lig = normalize(lig + SDF_ACCUMULATE_LIGHT_RADIUS * (jitter.x * tangent + jitter.y * bitangent));
+    }
+    return lig;
+}
+
+// ӰͻڱΣxΪڱΣyΪӰzΪչ߹Ӱ
+// Ӧg_SwitchرյΪ1sdf::CalcLightingTerms (src/cpu/Renderer.cpp)һ
+float3 calcLightingTerms(float3 pos, float3 nor, float3 rd)
+{
+    float3 terms = float3(1.0, 1.0, 1.0);
+    if (g_Switch.w == 1)
+        terms.x = calcAO(pos, nor);
+    if (g_Switch.y == 1)
+        terms.y = calcSoftshadow(pos, keyLightDir(), 0.02, 2.5, g_Factor.y);
+    if (g_Switch.z == 1)
+        terms.z = calcSoftshadow(pos, reflect(rd, nor), 0.02, 2.5, g_Factor.y);
+    return terms;
+}
+
+// ͼɫTurboɫĶʽϣsdf::HeatmapColor (src/cpu/Instrumentation.cpp)һ
+float3 heatmapColor(uint count, uint scale)
+{
+    const float4 kRed4 = float4(0.13572138, 4.61539260, -42.66032258, 132.13108234);
+    const float4 kGreen4 = float4(0.09140261, 2.19418839, 4.84296658, -14.18503333);
+    const float4 kBlue4 = float4(0.10667330, 12.64194608, -60.58204836, 110.36276771);
+    const float2 kRed2 = float2(-152.94239396, 59.28637943);
+    const float2 kGreen2 = float2(4.27729857, 2.82956604);
+    const float2 kBlue2 = float2(-89.90310912, 27.34824973);
+
+    float x = saturate(float(count) / float(max(scale, 1u)));
+    float4 v4 = float4(1.0, x, x * x, x * x * x);
+    float2 v2 = v4.zw * v4.z;
+    return saturate(float3(dot(v4, kRed4) + dot(v2, kRed2), dot(v4, kGreen4) + dot(v2, kGreen2), dot(v4, kBlue4) + dot(v2, kBlue2)));
+}
+
+// g_Heatmap.xѡҪʾļ
+uint selectEvaluations(uint4 counts)
+{
+    switch (g_Heatmap.x)
+    {
+        case SDF_HEATMAP_PRIMARY:
+            return counts.x;
+        case SDF_HEATMAP_NORMAL:
+            return counts.y;
+        case SDF_HEATMAP_AO:
+            return counts.z;
+        case SDF_HEATMAP_SHADOW:
+            return counts.w;
+        default:
+            return counts.x + counts.y + counts.z + counts.w;
+    }
+}
+
+// rota
+void getLookAtCamera(float3 ro, float3 ta, out float3 uu, out float3 vv, out float3 ww)
+{
+    // forward vector,ϵZ
+    ww = normalize(ta - ro);
+    // up vectorõϵX
+    uu = normalize(cross(ww, float3(0.0, 1.0, 0.0)));
+    // ϵY
+    vv = normalize(cross(uu, ww));
+}
+
+// camera.wΪ1ʱǹؼ֡timeʱ̵Ļ
+void getCameraAt(float4 camera, float4 target, float time, out float3 ro, out float3 uu, out float3 vv, out float3 ww)
+{
+    if (camera.w != 0.0)
+    {
+        ro = camera.xyz;
+        getLookAtCamera(ro, target.xyz, uu, vv, ww);
+        return;
+    }
+    // ˶ animaton
+    float an = 0.5 * (time - 10.0);
+    // λ ray origin 
+    ro = float3(4.0 * cos(an), 0.4, 4.0 * sin(an));
+    // Ŀλ lookat-target
+    getLookAtCamera(ro, float3(0.0, 0.0, 0.0), uu, vv, ww);
+}
+
+// PS()׶Ԥͨ(sdf_cone_cs.hlsl)
+void getCamera(out float3 ro, out float3 uu, out float3 vv, out float3 ww)
+{
+    getCameraAt(g_Camera, g_CameraTarget, g_Time.x, ro, uu, vv, ww);
+}
+
+// һ֡ʱͶӰһ֡е
+void getPreviousCamera(out float3 ro, out float3 uu, out float3 vv, out float3 ww)
+{
+    getCameraAt(g_PrevCamera, g_PrevCameraTarget, g_Temporal.y, ro, uu, vv, ww);
+}
+
+// ߷fragCoordԭĻ½
+float3 cameraRay(float2 fragCoord, float3 uu, float3 vv, float3 ww)
+{
+    // ĻΪĻϵԭ㣬xyᵥλһ£õǰϵµλ
+    float2 p = (2.0 * fragCoord - g_Resolution.xy) / g_Resolution.y;
+    return normalize(p.x * uu + p.y * vv + 1.5 * ww);
+}
+
+// cameraRay()任߾posλãԭĻϽǣSV_POSITIONһ
+// posʱfalse
+bool projectCamera(float3 pos, float3 ro, float3 uu, float3 vv, float3 ww, out float2 pixel)
+{
+    float3 d = pos - ro;
+    float z = dot(d, ww);
+    pixel = float2(0.0, 0.0);
+    if (z <= 0.0)
+        return false;
+
+    float2 p = 1.5 * float2(dot(d, uu), dot(d, vv)) / z;
+    float2 fragCoord = 0.5 * (p * g_Resolution.y + g_Resolution.xy);
+    pixel = float2(fragCoord.x, g_Resolution.y - fragCoord.y);
+    return true;
+}
@@ -0,0 +1,503 @@
+// Forward-mode automatic differentiation of map(): every value carries its gradient with respect to the
+// sample position, so mapDual() returns the distance and the normal direction in one pass.
+// Used by calcNormal() in the SDF_NORMALS_DUAL permutation. Mirrors sdf::Dual (src/cpu/Dual.h): min, max,
+// abs and the branches pass on the gradient of the operand they pick.
+//
+// The primitives only translate, so inside them the local position still has the identity as its
+// Jacobian and they take it as a plain float3. Domain operators rotate or mirror the position, and
+// mapTapeRangeDual() turns the gradients of their subtrees back into the outer frame.
+
+struct Dual
+{
+    float v;
+    float3 d;   // gradient of v
+};
+
+Dual dual(float v, float3 d)
+{
+    Dual r;
+    r.v = v;
+    r.d = d;
+    return r;
+}
+
+Dual dualConst(float v)
+{
+    return dual(v, float3(0, 0, 0));
+}
+
+Dual dualX(float3 p)
+{
+    return dual(p.x, float3(1, 0, 0));
+}
+
+Dual dualY(float3 p)
+{
+    return dual(p.y, float3(0, 1, 0));
+}
+
+Dual dualZ(float3 p)
+{
+    return dual(p.z, float3(0, 0, 1));
+}
+
+Dual dAdd(Dual a, Dual b)
+{
+    return dual(a.v + b.v, a.d + b.d);
+}
+
+Dual dSub(Dual a, Dual b)
+{
+    return dual(a.v - b.v, a.d - b.d);
+}
+
+Dual dMul(Dual a, Dual b)
+{
+    return dual(a.v * b.v, a.d * b.v + b.d * a.v);
+}
+
+Dual dAddC(Dual a, float c)
+{
+    return dual(a.v + c, a.d);
+}
+
+Dual dMulC(Dual a, float c)
+{
+    return dual(a.v * c, a.d * c);
+}
+
+Dual dNeg(Dual a)
+{
+    return dual(-a.v, -a.d);
+}
+
+Dual dMin(Dual a, Dual b)
+{
+    return a.v < b.v ? a : b;
+}
+
+Dual dMax(Dual a, Dual b)
+{
+    return a.v < b.v ? b : a;
+}
+
+Dual dMinC(Dual a, float c)
+{
+    return a.v < c ? a : dualConst(c);
+}
+
+Dual dMaxC(Dual a, float c)
+{
+    return a.v < c ? dualConst(c) : a;
+}
+
+Dual dClamp(Dual a, float lo, float hi)
+{
+    return dMinC(dMaxC(a, lo), hi);
+}
+
+Dual dAbs(Dual a)
+{
+    return a.v < 0.0 ? dNeg(a) : a;
+}
+
+// length() of a zero vector has no derivative; take 0 rather than inf * 0.
+Dual dSqrt(Dual a)
+{
+    float s = sqrt(a.v);
+    return dual(s, s > 0.0 ? a.d * (0.5 / s) : float3(0, 0, 0));
+}
+
+Dual dLength(Dual x, Dual y)
+{
+    return dSqrt(dAdd(dMul(x, x), dMul(y, y)));
+}
+
+Dual dLength(Dual x, Dual y, Dual z)
+{
+    return dSqrt(dAdd(dAdd(dMul(x, x), dMul(y, y)), dMul(z, z)));
+}
+
+Dual dLerp(Dual a, Dual b, Dual t)
+{
+    return dAdd(a, dMul(dSub(b, a), t));
+}
+
+// length(max(q, 0)) + min(max(q.x, max(q.y, q.z)), 0), the box distance of the corner offset q.
+Dual dBoxCorner(Dual x, Dual y, Dual z)
+{
+    Dual outside = dLength(dMaxC(x, 0.0), dMaxC(y, 0.0), dMaxC(z, 0.0));
+    return dAdd(outside, dMinC(dMax(x, dMax(y, z)), 0.0));
+}
+
+Dual dsdPlane(float3 p, float3 n)
+{
+    return dual(dot(p, n), n);
+}
+
+Dual dsdSphere(float3 p, float s)
+{
+    return dAddC(dLength(dualX(p), dualY(p), dualZ(p)), -s);
+}
+
+Dual dsdTorus(float3 p, float2 t)
+{
+    Dual q = dAddC(dLength(dualX(p), dualZ(p)), -t.x);
+    return dAddC(dLength(q, dualY(p)), -t.y);
+}
+
+Dual dsdCylinder(float3 p, float2 h, int mode)
+{
+    Dual radial;
+    Dual axial;
+    switch (mode)
+    {
+        case 0:
+            radial = dLength(dualX(p), dualY(p));
+            axial = dualZ(p);
+            break;
+        case 1:
+            radial = dLength(dualY(p), dualZ(p));
+            axial = dualX(p);
+            break;
+        default:
+            radial = dLength(dualX(p), dualZ(p));
+            axial = dualY(p);
+            break;
+    }
+    Dual dx = dAddC(dAbs(radial), -h.x);
+    Dual dy = dAddC(dAbs(axial), -h.y);
+    return dAdd(dMinC(dMax(dx, dy), 0.0), dLength(dMaxC(dx, 0.0), dMaxC(dy, 0.0)));
+}
+
+Dual dsdBox(float3 p, float3 b)
+{
+    return dBoxCorner(dAddC(dAbs(dualX(p)), -b.x), dAddC(dAbs(dualY(p)), -b.y), dAddC(dAbs(dualZ(p)), -b.z));
+}
+
+Dual dsdBoxFrame(float3 p0, float3 b, float e)
+{
+    Dual px = dAddC(dAbs(dualX(p0)), -b.x);
+    Dual py = dAddC(dAbs(dualY(p0)), -b.y);
+    Dual pz = dAddC(dAbs(dualZ(p0)), -b.z);
+    e /= 2;
+    Dual qx = dAddC(dAbs(dAddC(px, e)), -e);
+    Dual qy = dAddC(dAbs(dAddC(py, e)), -e);
+    Dual qz = dAddC(dAbs(dAddC(pz, e)), -e);
+
+    return dMin(dMin(dBoxCorner(px, qy, qz), dBoxCorner(qx, py, qz)), dBoxCorner(qx, qy, pz));
+}
+
+Dual dsdOctahedron(float3 p0, float s)
+{
+    Dual px = dAbs(dualX(p0));
+    Dual py = dAbs(dualY(p0));
+    Dual pz = dAbs(dualZ(p0));
+    Dual m = dAddC(dAdd(dAdd(px, py), pz), -s);
+
+    Dual qx, qy, qz;
+    if (3.0 * px.v < m.v)
+    {
+        qx = px;
+        qy = py;
+        qz = pz;
+    }
+    else if (3.0 * py.v < m.v)
+    {
+        qx = py;
+        qy = pz;
+        qz = px;
+    }
+    else if (3.0 * pz.v < m.v)
+    {
+        qx = pz;
+        qy = px;
+        qz = py;
+    }
+    else
+        return dMulC(m, 0.57735027);
+
+    Dual k = dClamp(dMulC(dAddC(dSub(qz, qy), s), 0.5), 0.0, s);
+    return dLength(qx, dAdd(dAddC(qy, -s), k), dSub(qz, k));
+}
+
+Dual dopSmoothUnion(Dual d1, Dual d2, float k)
+{
+    Dual h = dClamp(dAddC(dMulC(dSub(d2, d1), 0.5 / k), 0.5), 0.0, 1.0);
+    return dSub(dLerp(d2, d1, h), dMulC(dMul(h, dAddC(dNeg(h), 1.0)), k));
+}
+
+Dual dopSmoothSubtraction(Dual d1, Dual d2, float k)
+{
+    Dual h = dClamp(dAddC(dMulC(dAdd(d2, d1), -0.5 / k), 0.5), 0.0, 1.0);
+    return dAdd(dLerp(d2, dNeg(d1), h), dMulC(dMul(h, dAddC(dNeg(h), 1.0)), k));
+}
+
+Dual dopSmoothIntersection(Dual d1, Dual d2, float k)
+{
+    Dual h = dClamp(dAddC(dMulC(dSub(d2, d1), -0.5 / k), 0.5), 0.0, 1.0);
+    return dAdd(dLerp(d2, d1, h), dMulC(dMul(h, dAddC(dNeg(h), 1.0)), k));
+}
+
+// The displacement only depends on the time, it moves the value and keeps the gradient.
+Dual dopDisplace(Dual d1)
+{
+    float an = fmod(g_Time.x, 6.28);
+    return dAddC(d1, 0.2 * sin(3 * an));
+}
+
+Dual mapBuiltinDual(float3 pos)
+{
+    Dual res = dsdPlane(pos, float3(0, 1, 0));
+    Dual tmp[5];
+
+    tmp[0] = dsdCylinder(pos - float3(0, 0.3, 1.5), float2(0.3, 0.3), 0);
+    tmp[1] = dsdCylinder(pos - float3(0, 0.3, 1.5), float2(0.3, 0.3), 1);
+    res = dMin(res, dMax(tmp[0], tmp[1]));
+
+    tmp[0] = dsdBoxFrame(pos - float3(1, 0.3, 0.5), float3(0.3, 0.3, 0.3), 0.06);
+    tmp[1] = dsdOctahedron(pos - float3(1, 0.3, 0.5), 0.3);
+    res = dMin(res, dMin(tmp[0], tmp[1]));
+
+    static const float3 blobCenters[4] = { float3(-1, 0.3, 0), float3(-1.5, 0.9, 0), float3(-0.5, 0.9, 0), float3(-1, 1.5, 0) };
+    for (int i = 0; i < 4; i++)
+    {
+        tmp[i] = dsdSphere(pos - blobCenters[i], 0.35);
+        if (tmp[i].v < res.v)
+            tmp[i] = dMin(dopDisplace(tmp[i]), tmp[i]);
+    }
+    res = dMin(res, dopSmoothUnion(tmp[0], tmp[1], 0.25));
+    res = dMin(res, dopSmoothUnion(tmp[0], tmp[2], 0.25));
+    res = dMin(res, dopSmoothUnion(tmp[3], tmp[1], 0.25));
+    res = dMin(res, dopSmoothUnion(tmp[3], tmp[2], 0.25));
+
+    res = dMin(res, dsdTorus(pos - float3(1.0, 0.3, -0.5), float2(0.27, 0.03)));
+    res = dMin(res, dsdTorus(pos - float3(0.3, 0.3, -0.5), float2(0.27, 0.03)));
+    res = dMin(res, dsdTorus(pos - float3(0.0, 0.6, -0.5), float2(0.27, 0.03)));
+    res = dMin(res, dsdTorus(pos - float3(.65, 0.6, -0.5), float2(0.27, 0.03)));
+    res = dMin(res, dsdTorus(pos - float3(1.3, 0.6, -0.5), float2(0.27, 0.03)));
+
+    tmp[0] = dAddC(dsdBox(pos - float3(-1, 0.3, 1), float3(0.3, 0.3, 0.3)), -0.1);
+    tmp[1] = dsdBox(pos - float3(-1, 0.6, 1), float3(0.3, 0.15, 0.15));
+    res = dMin(res, dMax(tmp[0], dNeg(tmp[1])));
+
+    return res;
+}
+
+Dual tapePrimitiveDual(TapeInstruction ins, float3 pos)
+{
+    float3 p = pos - float3(ins.params[0], ins.params[1], ins.params[2]);
+
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_PLANE:
+            return dAddC(dsdPlane(pos, float3(ins.params[0], ins.params[1], ins.params[2])), -ins.params[3]);
+        case SDF_OP_SPHERE:
+            return dsdSphere(p, ins.params[3]);
+        case SDF_OP_BOX:
+            return dsdBox(p, float3(ins.params[3], ins.params[4], ins.params[5]));
+        case SDF_OP_BOX_FRAME:
+            return dsdBoxFrame(p, float3(ins.params[3], ins.params[4], ins.params[5]), ins.params[6]);
+        case SDF_OP_TORUS:
+            return dsdTorus(p, float2(ins.params[3], ins.params[4]));
+        case SDF_OP_CYLINDER:
+            return dsdCylinder(p, float2(ins.params[3], ins.params[4]), int((ins.code >> 8) & 0xff));
+        case SDF_OP_OCTAHEDRON:
+            return dsdOctahedron(p, ins.params[3]);
+        default:
+            return dualConst(1e10);
+    }
+}
+
+Dual tapeBinaryDual(TapeInstruction ins, Dual a, Dual b)
+{
+    float k = ins.params[0];
+
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_UNION:
+            return dMin(a, b);
+        case SDF_OP_SUBTRACTION:
+            return dMax(a, dNeg(b));
+        case SDF_OP_INTERSECTION:
+            return dMax(a, b);
+        case SDF_OP_SMOOTH_UNION:
+            return dopSmoothUnion(a, b, k);
+        case SDF_OP_SMOOTH_SUBTRACTION:
+            return dopSmoothSubtraction(b, a, k);
+        case SDF_OP_SMOOTH_INTERSECTION:
+            return dopSmoothIntersection(a, b, k);
+        default:
+            return a;
+    }
+}
+
+Dual tapeUnaryDual(TapeInstruction ins, Dual d, float3 p)
+{
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_ROUND:
+            return dAddC(d, -ins.params[0]);
+        case SDF_OP_DISPLACE:
+            if ((ins.code >> 8) & SDF_DISPLACE_KEYFRAMED)
+                return dAddC(d, ins.params[0]);
+            return dAddC(d, ins.params[0] * sin(ins.params[1] * fmod(g_Time.x, 6.28)));
+        case SDF_OP_DISPLACE_NOISE: {
+            float4 n = valueFbmGradient(p * ins.params[1], int(ins.params[2])) * ins.params[0];
+            return dual(d.v + n.x, d.d + n.yzw * ins.params[1]);
+        }
+        default:
+            return d;
+    }
+}
+
+// Gradient in the frame outside a domain operator from the gradient in a candidate's local frame:
+// the transpose of the candidate's rotation or mirroring.
+float3 tapeDomainGradient(TapeInstruction ins, float3 pos, uint candidate, float3 g)
+{
+    if ((ins.code & 0xff) == SDF_OP_REPEAT_POLAR)
+    {
+        float sector = tapePolarSector(ins, pos, candidate != 0);
+        float s, c;
+        sincos(sector * SDF_TWO_PI / ins.params[3], s, c);
+        if (tapePolarMirrored(ins, sector))
+            g.z = -g.z;
+        return float3(g.x * c - g.z * s, g.y, g.x * s + g.z * c);
+    }
+
+    if (((ins.code >> 8) & SDF_REPEAT_MIRROR) == 0)
+        return g;
+
+    uint bit = 0;
+    [unroll]
+    for (uint axis = 0; axis < 3; axis++)
+    {
+        if (ins.params[axis] > 0)
+        {
+            if (tapeIsOdd(tapeRepeatCell(ins, axis, pos[axis], ((candidate >> bit) & 1) != 0)))
+                g[axis] = -g[axis];
+            bit++;
+        }
+    }
+    return g;
+}
+
+struct TapeDomainDual
+{
+    float3 pos;
+    uint begin;
+    uint candidate;
+    Dual res;
+};
+
+// Same stack machine as mapTapeRange(), without the materials. The bound of the skipped instances
+// has no gradient: it is only reached away from the surfaces.
+Dual mapTapeRangeDual(float3 pos, uint first, uint count)
+{
+    Dual stack[SDF_TAPE_MAX_STACK];
+    int sp = 0;
+    TapeDomainDual domains[SDF_TAPE_MAX_DOMAIN];
+    int dp = 0;
+    float3 p = pos;
+
+    for (uint i = first; i < first + count; i++)
+    {
+        TapeInstruction ins = g_Tape[i];
+        uint op = ins.code & 0xff;
+
+        if (op < SDF_OP_FIRST_BINARY)
+        {
+            stack[sp] = tapePrimitiveDual(ins, p);
+            sp++;
+        }
+        else if (op < SDF_OP_FIRST_UNARY)
+        {
+            sp--;
+            stack[sp - 1] = tapeBinaryDual(ins, stack[sp - 1], stack[sp]);
+        }
+        else if (op < SDF_OP_FIRST_DOMAIN)
+        {
+            stack[sp - 1] = tapeUnaryDual(ins, stack[sp - 1], p);
+        }
+        else if (op != SDF_OP_DOMAIN_END)
+        {
+            domains[dp].pos = p;
+            domains[dp].begin = i;
+            domains[dp].candidate = 0;
+            domains[dp].res = dualConst(1e10);
+            dp++;
+            p = tapeDomainPosition(ins, p, 0);
+        }
+        else
+        {
+            TapeInstruction domain = g_Tape[domains[dp - 1].begin];
+            sp--;
+            Dual d = stack[sp];
+            d.d = tapeDomainGradient(domain, domains[dp - 1].pos, domains[dp - 1].candidate, d.d);
+            domains[dp - 1].res = dMin(domains[dp - 1].res, d);
+            domains[dp - 1].candidate++;
+            if (domains[dp - 1].candidate < tapeDomainCandidates(domain))
+            {
+                p = tapeDomainPosition(domain, domains[dp - 1].pos, domains[dp - 1].candidate);
+                i = domains[dp - 1].begin;
+            }
+            else
+            {
+                p = domains[dp - 1].pos;
+                stack[sp] = dMin(domains[dp - 1].res, dualConst(tapeDomainBound(domain, p)));
+                sp++;
+                dp--;
+            }
+        }
+    }
+
+    return sp > 0 ? stack[0] : dualConst(1e10);
+}
+
+Dual mapBvhDual(float3 pos)
+{
+    Dual res = mapTapeRangeDual(pos, 0, (uint) g_Scene.x);
+
+    uint stack[SDF_BVH_MAX_STACK];
+    int sp = 0;
+    uint index = 0;
+
+    for (;;)
+    {
+        BvhNode node = g_Bvh[index];
+        if (bvhBoxDistance(pos, node) < res.v)
+        {
+            if (node.count > 0)
+            {
+                res = dMin(res, mapTapeRangeDual(pos, node.offset, node.count));
+            }
+            else
+            {
+                uint left = index + 1;
+                uint right = node.offset;
+                bool leftFirst = bvhBoxDistance(pos, g_Bvh[left]) <= bvhBoxDistance(pos, g_Bvh[right]);
+                stack[sp] = leftFirst ? right : left;
+                sp++;
+                index = leftFirst ? left : right;
+                continue;
+            }
+        }
+
+        if (sp == 0)
+            break;
+        sp--;
+        index = stack[sp];
+    }
+
+    return res;
+}
+
+// map() with the gradient of the distance, picks the same scene as map().
+Dual mapDual(float3 pos)
+{
+    if (g_Scene.y > 0)
+        return mapBvhDual(pos);
+    if (g_Scene.x > 0)
+        return mapTapeRangeDual(pos, 0, (uint) g_Scene.x);
+    return mapBuiltinDual(pos);
+}
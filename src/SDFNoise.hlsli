@@ -0,0 +1,245 @@
+// Procedural value and gradient noise, the shader version of src/cpu/Noise.h, which describes the hash
+// and the noises. Every function computes the same operations in the same order as its C++ counterpart,
+// so the CPU and the GPU renderers see the same patterns. Included by SDF.hlsli.
+
+#include "sdf_cb.h"
+
+float noiseMod(float x, float period)
+{
+    return x - floor((x + 0.5) * (1.0 / period)) * period;
+}
+
+float noisePermute(float x)
+{
+    return noiseMod((x * 34.0 + 1.0) * x, 289.0);
+}
+
+float noiseCell(float cell, float period)
+{
+    return noiseMod(period > 0.0 ? noiseMod(cell, period) : cell, 289.0);
+}
+
+float noiseFade(float t)
+{
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+// Derivative of noiseFade().
+float noiseFadeDerivative(float t)
+{
+    return 30.0 * t * t * (t * (t - 2.0) + 1.0);
+}
+
+float noiseHash(float x, float y)
+{
+    return noisePermute(noisePermute(x) + y);
+}
+
+float noiseHash(float x, float y, float z)
+{
+    return noisePermute(noisePermute(noisePermute(x) + y) + z);
+}
+
+float noiseValue(float hash)
+{
+    return hash * (2.0 / 289.0) - 1.0;
+}
+
+float3 noiseGradient(float hash)
+{
+    float h = hash * (1.0 / 7.0);
+    float x = frac(h) * 2.0 - 1.0;
+    float y = frac(floor(h) * (1.0 / 7.0)) * 2.0 - 1.0;
+    float z = 1.0 - abs(x) - abs(y);
+    bool fold = z < 0.0;
+    float fx = (1.0 - abs(y)) * (x < 0.0 ? -1.0 : 1.0);
+    float fy = (1.0 - abs(x)) * (y < 0.0 ? -1.0 : 1.0);
+    return normalize(float3(fold ? fx : x, fold ? fy : y, z));
+}
+
+float valueNoise(float2 p, float period)
+{
+    float2 i = floor(p);
+    float2 f = float2(noiseFade(p.x - i.x), noiseFade(p.y - i.y));
+    float x0 = noiseCell(i.x, period), x1 = noiseCell(i.x + 1.0, period);
+    float y0 = noiseCell(i.y, period), y1 = noiseCell(i.y + 1.0, period);
+
+    float a = lerp(noiseValue(noiseHash(x0, y0)), noiseValue(noiseHash(x1, y0)), f.x);
+    float b = lerp(noiseValue(noiseHash(x0, y1)), noiseValue(noiseHash(x1, y1)), f.x);
+    return lerp(a, b, f.y);
+}
+
+float valueNoise(float3 p, float period)
+{
+    float3 i = floor(p);
+    float3 f = float3(noiseFade(p.x - i.x), noiseFade(p.y - i.y), noiseFade(p.z - i.z));
+    float x0 = noiseCell(i.x, period), x1 = noiseCell(i.x + 1.0, period);
+    float y0 = noiseCell(i.y, period), y1 = noiseCell(i.y + 1.0, period);
+    float z0 = noiseCell(i.z, period), z1 = noiseCell(i.z + 1.0, period);
+
+    float a = lerp(noiseValue(noiseHash(x0, y0, z0)), noiseValue(noiseHash(x1, y0, z0)), f.x);
+    float b = lerp(noiseValue(noiseHash(x0, y1, z0)), noiseValue(noiseHash(x1, y1, z0)), f.x);
+    float c = lerp(noiseValue(noiseHash(x0, y0, z1)), noiseValue(noiseHash(x1, y0, z1)), f.x);
+    float d = lerp(noiseValue(noiseHash(x0, y1, z1)), noiseValue(noiseHash(x1, y1, z1)), f.x);
+    return lerp(lerp(a, b, f.y), lerp(c, d, f.y), f.z);
+}
+
+// valueNoise() and its gradient in yzw, for mapDual(). The value is the same trilinear blend written as a
+// polynomial of the faded coordinates, so it may differ from valueNoise() in the last bits.
+float4 valueNoiseGradient(float3 p, float period)
+{
+    float3 i = floor(p);
+    float3 r = p - i;
+    float3 f = float3(noiseFade(r.x), noiseFade(r.y), noiseFade(r.z));
+    float3 df = float3(noiseFadeDerivative(r.x), noiseFadeDerivative(r.y), noiseFadeDerivative(r.z));
+    float x0 = noiseCell(i.x, period), x1 = noiseCell(i.x + 1.0, period);
+    float y0 = noiseCell(i.y, period), y1 = noiseCell(i.y + 1.0, period);
+    float z0 = noiseCell(i.z, period), z1 = noiseCell(i.z + 1.0, period);
+
+    float a = noiseValue(noiseHash(x0, y0, z0));
+    float b = noiseValue(noiseHash(x1, y0, z0));
+    float c = noiseValue(noiseHash(x0, y1, z0));
+    float d = noiseValue(noiseHash(x1, y1, z0));
+    float e = noiseValue(noiseHash(x0, y0, z1));
+    float g = noiseValue(noiseHash(x1, y0, z1));
+    float h = noiseValue(noiseHash(x0, y1, z1));
+    float k = noiseValue(noiseHash(x1, y1, z1));
+
+    float kx = b - a, ky = c - a, kz = e - a;
+    float kxy = a - b - c + d, kyz = a - c - e + h, kzx = a - b - e + g;
+    float kxyz = -a + b + c - d + e - g - h + k;
+    float v = a + kx * f.x + ky * f.y + kz * f.z + kxy * f.x * f.y + kyz * f.y * f.z + kzx * f.z * f.x + kxyz * f.x * f.y * f.z;
+    float3 grad = df * float3(
+        kx + kxy * f.y + kzx * f.z + kxyz * f.y * f.z,
+        ky + kyz * f.z + kxy * f.x + kxyz * f.z * f.x,
+        kz + kzx * f.x + kyz * f.y + kxyz * f.x * f.y);
+    return float4(v, grad);
+}
+
+float gradientNoise(float2 p, float period)
+{
+    float2 i = floor(p);
+    float2 r = p - i;
+    float x0 = noiseCell(i.x, period), x1 = noiseCell(i.x + 1.0, period);
+    float y0 = noiseCell(i.y, period), y1 = noiseCell(i.y + 1.0, period);
+
+    float2 f = float2(noiseFade(r.x), noiseFade(r.y));
+    float a = lerp(dot(noiseGradient(noiseHash(x0, y0)).xy, r), dot(noiseGradient(noiseHash(x1, y0)).xy, r - float2(1, 0)), f.x);
+    float b = lerp(dot(noiseGradient(noiseHash(x0, y1)).xy, r - float2(0, 1)), dot(noiseGradient(noiseHash(x1, y1)).xy, r - float2(1, 1)), f.x);
+    return lerp(a, b, f.y);
+}
+
+float gradientNoise(float3 p, float period)
+{
+    float3 i = floor(p);
+    float3 r = p - i;
+    float x0 = noiseCell(i.x, period), x1 = noiseCell(i.x + 1.0, period);
+    float y0 = noiseCell(i.y, period), y1 = noiseCell(i.y + 1.0, period);
+    float z0 = noiseCell(i.z, period), z1 = noiseCell(i.z + 1.0, period);
+    float3 s = r - 1.0;
+
+    float3 f = float3(noiseFade(r.x), noiseFade(r.y), noiseFade(r.z));
+    float a = lerp(dot(noiseGradient(noiseHash(x0, y0, z0)), float3(r.x, r.y, r.z)), dot(noiseGradient(noiseHash(x1, y0, z0)), float3(s.x, r.y, r.z)), f.x);
+    float b = lerp(dot(noiseGradient(noiseHash(x0, y1, z0)), float3(r.x, s.y, r.z)), dot(noiseGradient(noiseHash(x1, y1, z0)), float3(s.x, s.y, r.z)), f.x);
+    float c = lerp(dot(noiseGradient(noiseHash(x0, y0, z1)), float3(r.x, r.y, s.z)), dot(noiseGradient(noiseHash(x1, y0, z1)), float3(s.x, r.y, s.z)), f.x);
+    float d = lerp(dot(noiseGradient(noiseHash(x0, y1, z1)), float3(r.x, s.y, s.z)), dot(noiseGradient(noiseHash(x1, y1, z1)), float3(s.x, s.y, s.z)), f.x);
+    return lerp(lerp(a, b, f.y), lerp(c, d, f.y), f.z);
+}
+
+// Fractal sums like sdf::Fbm(): the octaves double the frequency and the period and halve the amplitude,
+// and the sum is divided by the total amplitude.
+float valueFbm(float2 p, int octaves, float period)
+{
+    float sum = 0.0;
+    float amplitude = 1.0;
+    float total = 0.0;
+    float frequency = 1.0;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        sum += valueNoise(p * frequency, period * frequency) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return total > 0.0 ? sum * (1.0 / total) : sum;
+}
+
+float valueFbm(float3 p, int octaves, float period)
+{
+    float sum = 0.0;
+    float amplitude = 1.0;
+    float total = 0.0;
+    float frequency = 1.0;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        sum += valueNoise(p * frequency, period * frequency) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return total > 0.0 ? sum * (1.0 / total) : sum;
+}
+
+float gradientFbm(float2 p, int octaves, float period)
+{
+    float sum = 0.0;
+    float amplitude = 1.0;
+    float total = 0.0;
+    float frequency = 1.0;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        sum += gradientNoise(p * frequency, period * frequency) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return total > 0.0 ? sum * (1.0 / total) : sum;
+}
+
+float gradientFbm(float3 p, int octaves, float period)
+{
+    float sum = 0.0;
+    float amplitude = 1.0;
+    float total = 0.0;
+    float frequency = 1.0;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        sum += gradientNoise(p * frequency, period * frequency) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return total > 0.0 ? sum * (1.0 / total) : sum;
+}
+
+// valueFbm() with its gradient in yzw.
+float4 valueFbmGradient(float3 p, int octaves)
+{
+    float4 sum = float4(0, 0, 0, 0);
+    float amplitude = 1.0;
+    float total = 0.0;
+    float frequency = 1.0;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        float4 n = valueNoiseGradient(p * frequency, 0.0);
+        sum += float4(n.x, n.yzw * frequency) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return total > 0.0 ? sum * (1.0 / total) : sum;
+}
+
+// Offset of SDF_OP_DISPLACE_NOISE, sdf::NoiseDisplacement().
+float noiseDisplacement(float3 p, float amplitude, float frequency, int octaves)
+{
+    return valueFbm(p * frequency, octaves, 0.0) * amplitude;
+}
+
+// Scale of the floor color, sdf::FloorPattern().
+float floorPattern(float2 xz)
+{
+    float v = saturate(gradientFbm(xz * SDF_FLOOR_NOISE_FREQUENCY, SDF_FLOOR_NOISE_OCTAVES, 0.0) * 1.2 + 0.5);
+    float v2 = v * v;
+    return 0.02 + 0.6 * v2 * v2;
+}
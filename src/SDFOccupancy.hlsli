@@ -0,0 +1,74 @@
+// Empty-space skipping, the shader version of sdf::OccupancyGrid (src/cpu/OccupancyGrid.h), which
+// describes the grid; the layout of g_OccupancyBits is described in sdf_cb.h. occupancySpan() follows
+// OccupancyGrid::FindEmptySpan() step for step, so both renderers jump the same. Included by SDF.hlsli.
+
+#include "sdf_cb.h"
+
+StructuredBuffer<uint> g_OccupancyBits : register(t6);
+
+bool occupancyBit(int level, int3 cell)
+{
+    uint first = 0;
+    for (int l = 0; l < level; l++)
+    {
+        uint m = uint(g_Occupancy.x >> (g_Occupancy.y - 1 - l));
+        first += (m * m * m + 31) / 32;
+    }
+    uint n = uint(g_Occupancy.x >> (g_Occupancy.y - 1 - level));
+    uint index = (uint(cell.z) * n + uint(cell.y)) * n + uint(cell.x);
+    return ((g_OccupancyBits[first + (index >> 5)] >> (index & 31)) & 1) != 0;
+}
+
+// (entry, exit) of the coarsest clear cell around ro + rd * t, false when there is none.
+bool occupancyCell(float3 ro, float3 rd, float t, out float2 span)
+{
+    span = float2(1.0, 0.0);
+
+    // Position in cells of the finest level.
+    float3 p = (ro + rd * t - g_OccupancyGrid.xyz) / g_OccupancyGrid.w;
+    float size = float(g_Occupancy.x);
+    if (!(all(p >= 0.0) && all(p < size)))
+        return false;
+    int3 finest = min(int3(p), g_Occupancy.x - 1);
+
+    for (int level = 0; level < g_Occupancy.y; level++)
+    {
+        int shift = g_Occupancy.y - 1 - level;
+        int3 cell = finest >> shift;
+        if (occupancyBit(level, cell))
+            continue;
+
+        // Where the ray enters and leaves the slabs of the cell.
+        float side = g_OccupancyGrid.w * float(1 << shift);
+        float3 cellMin = g_OccupancyGrid.xyz + float3(cell) * side;
+        float entry = -1e30;
+        float exit = 1e30;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (rd[axis] == 0.0)
+                continue;
+            float t0 = (cellMin[axis] - ro[axis]) / rd[axis];
+            float t1 = (cellMin[axis] + side - ro[axis]) / rd[axis];
+            entry = max(entry, min(t0, t1));
+            exit = min(exit, max(t0, t1));
+        }
+        span = float2(entry, max(exit, t) + SDF_OCCUPANCY_SKIP_MARGIN * g_OccupancyGrid.w);
+        return true;
+    }
+
+    return false;
+}
+
+// Ray distances (entry, exit) of the run of clear cells from ro + rd * t, x > y when there is none.
+float2 occupancySpan(float3 ro, float3 rd, float t, float tmax)
+{
+    float2 span;
+    if (g_Occupancy.x == 0 || !occupancyCell(ro, rd, t, span))
+        return float2(1.0, 0.0);
+
+    // The DDA goes on through the clear cells that follow.
+    float2 next;
+    for (int cells = 1; cells < SDF_OCCUPANCY_MAX_CELLS && span.y < tmax && occupancyCell(ro, rd, span.y, next); cells++)
+        span.y = next.y;
+    return span;
+}
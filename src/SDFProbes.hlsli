@@ -0,0 +1,102 @@
+// Irradiance probes, the shader version of sdf::ProbeGrid::Sample() (src/cpu/ProbeGrid.h), which
+// describes the grid; the layout of the maps is described in sdf_cb.h. The lookups follow the CPU ones
+// step for step, so both renderers light the same. Included by sdf_ps.hlsl after SDF.hlsli.
+
+#include "sdf_cb.h"
+
+StructuredBuffer<float4> g_ProbeIrradiance : register(t7);
+StructuredBuffer<float2> g_ProbeDistance : register(t8);
+
+float2 signNotZero(float2 v)
+{
+    return float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+float2 octEncode(float3 dir)
+{
+    float2 p = dir.xy / (abs(dir.x) + abs(dir.y) + abs(dir.z));
+    if (dir.z < 0.0)
+        p = (1.0 - abs(p.yx)) * signNotZero(p);
+    return p;
+}
+
+// The fixed diffuse sky term of render().
+float3 skyIrradiance(float3 nor)
+{
+    return 0.60 * sqrt(clamp(0.5 + 0.5 * nor.y, 0.0, 1.0)) * float3(0.4, 0.6, 1.15);
+}
+
+// Bilinear lookup of dir in the n x n texels of a map starting at first.
+float4 probeIrradianceTexel(uint first, int n, float3 dir)
+{
+    float2 uv = (octEncode(dir) * 0.5 + 0.5) * float(n - 2) + 0.5;
+    int2 c = clamp(int2(floor(uv)), 0, n - 2);
+    float2 f = clamp(uv - float2(c), 0.0, 1.0);
+    uint i = first + uint(c.y * n + c.x);
+    return lerp(lerp(g_ProbeIrradiance[i], g_ProbeIrradiance[i + 1], f.x),
+                lerp(g_ProbeIrradiance[i + n], g_ProbeIrradiance[i + n + 1], f.x), f.y);
+}
+
+float2 probeDistanceTexel(uint first, int n, float3 dir)
+{
+    float2 uv = (octEncode(dir) * 0.5 + 0.5) * float(n - 2) + 0.5;
+    int2 c = clamp(int2(floor(uv)), 0, n - 2);
+    float2 f = clamp(uv - float2(c), 0.0, 1.0);
+    uint i = first + uint(c.y * n + c.x);
+    return lerp(lerp(g_ProbeDistance[i], g_ProbeDistance[i + 1], f.x),
+                lerp(g_ProbeDistance[i + n], g_ProbeDistance[i + n + 1], f.x), f.y);
+}
+
+// Irradiance at pos with the normal nor, seen along rd, from the 8 probes around it; the fixed sky term
+// where none of them holds light.
+float3 probeIrradiance(float3 pos, float3 nor, float3 rd)
+{
+    const int irradianceTexels = SDF_PROBE_IRRADIANCE_SIZE + 2;
+    const int distanceTexels = SDF_PROBE_DISTANCE_SIZE + 2;
+
+    // The point is pushed off the surface, mostly towards the viewer.
+    float3 biased = pos + (nor * 0.2 - rd * 0.8) * g_ProbeSpacing.w;
+    float3 cell = (biased - g_ProbeOrigin.xyz) / g_ProbeSpacing.xyz;
+    int3 base = clamp(int3(floor(cell)), 0, g_Probes.xyz - 2);
+    float3 alpha = clamp(cell - float3(base), 0.0, 1.0);
+
+    float3 sum = float3(0.0, 0.0, 0.0);
+    float weightSum = 0.0;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        int3 offset = int3(corner & 1, (corner >> 1) & 1, corner >> 2);
+        int3 index = base + offset;
+        uint probe = uint((index.z * g_Probes.y + index.y) * g_Probes.x + index.x);
+        uint irradianceFirst = probe * uint(irradianceTexels * irradianceTexels);
+        if (!(g_ProbeIrradiance[irradianceFirst].w > 0.0))
+            continue;
+
+        // Probes on the side of the surface the normal points to.
+        float3 probePos = g_ProbeOrigin.xyz + float3(index) * g_ProbeSpacing.xyz;
+        float facing = (dot(normalize(probePos - pos), nor) + 1.0) * 0.5;
+        float weight = facing * facing + 0.2;
+
+        // Chebyshev's bound on the probability that the probe sees the point.
+        float3 fromProbe = biased - probePos;
+        float d = length(fromProbe);
+        float2 moments = probeDistanceTexel(probe * uint(distanceTexels * distanceTexels), distanceTexels,
+                                            d > 1e-6 ? fromProbe / d : nor);
+        if (d > moments.x)
+        {
+            float variance = abs(moments.x * moments.x - moments.y);
+            float visibility = variance / (variance + (d - moments.x) * (d - moments.x));
+            weight *= max(visibility * visibility * visibility, 0.05);
+        }
+
+        weight = max(weight, 1e-6);
+        if (weight < SDF_PROBE_MIN_WEIGHT)
+            weight *= weight * weight / (SDF_PROBE_MIN_WEIGHT * SDF_PROBE_MIN_WEIGHT);
+        float3 trilinear = lerp(1.0 - alpha, alpha, float3(offset));
+        weight *= trilinear.x * trilinear.y * trilinear.z;
+
+        sum += weight * probeIrradianceTexel(irradianceFirst, irradianceTexels, nor).xyz;
+        weightSum += weight;
+    }
+
+    return weightSum > 0.0 ? sum / weightSum : skyIrradiance(nor);
+}
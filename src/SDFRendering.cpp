@@ -15,37 +15,67 @@ bool SDFRendering::InitPipeLine()
 		.setRegisterSpace(0)
 		.setVisibility(nvrhi::ShaderType::All)
 		.addItem(nvrhi::BindingLayoutItem::VolatileConstantBuffer(0))
-		.addItem(nvrhi::BindingLayoutItem::Sampler(0))
-		.addItem(nvrhi::BindingLayoutItem::Texture_SRV(0));
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(4))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(7))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(8))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(1))
+		.addItem(nvrhi::BindingLayoutItem::Texture_UAV(2));
 
 	bindingLayoutDesc.visibility = nvrhi::ShaderType::Pixel;
 	m_BindingLayout = m_Device->createBindingLayout(bindingLayoutDesc);
 
+	// ׶Ԥͨÿֿһ׶壬дعߵʼн
+	nvrhi::BindingLayoutDesc coneLayoutDesc = nvrhi::BindingLayoutDesc()
+		.setRegisterSpace(0)
+		.setVisibility(nvrhi::ShaderType::Compute)
+		.addItem(nvrhi::BindingLayoutItem::VolatileConstantBuffer(0))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0));
+	m_ConeBindingLayout = m_Device->createBindingLayout(coneLayoutDesc);
+
+	// ֱʹͨÿһдӰͻڱ
+	nvrhi::BindingLayoutDesc lightingLayoutDesc = nvrhi::BindingLayoutDesc()
+		.setRegisterSpace(0)
+		.setVisibility(nvrhi::ShaderType::Compute)
+		.addItem(nvrhi::BindingLayoutItem::VolatileConstantBuffer(0))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6))
+		.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0));
+	m_LightingBindingLayout = m_Device->createBindingLayout(lightingLayoutDesc);
+
 	m_VertexShader = shaderFactory.CreateShader("sdf_vs.hlsl", "VS", nullptr, nvrhi::ShaderType::Vertex);
-	m_PixelShader = shaderFactory.CreateShader("sdf_ps.hlsl", "PS", nullptr, nvrhi::ShaderType::Pixel);
+	// ÿַ߼㷽ʽ(SDF_NORMALS_*)Ӧһɫ
+	for (int normals = SDF_NORMALS_CENTRAL; normals <= SDF_NORMALS_DUAL; normals++)
+	{
+		std::vector<ShaderMacro> macros = { ShaderMacro("SDF_NORMALS", std::to_string(normals)) };
+		m_PixelShaders[normals] = shaderFactory.CreateShader("sdf_ps.hlsl", "PS", &macros, nvrhi::ShaderType::Pixel);
+		if (!m_PixelShaders[normals])
+			return false;
+	}
+	m_ConeShader = shaderFactory.CreateShader("sdf_cone_cs.hlsl", "CS", nullptr, nvrhi::ShaderType::Compute);
+	m_LightingShader = shaderFactory.CreateShader("sdf_lighting_cs.hlsl", "CS", nullptr, nvrhi::ShaderType::Compute);
 	
-	if (!m_VertexShader || !m_PixelShader) {
+	if (!m_VertexShader || !m_ConeShader || !m_LightingShader) {
 		return false;
 	}
 
-	auto texture = textureCache->LoadTextureFromFile(
-		"F:/ͼѧϰ/SDFRendering/SDFRendering/src/Texture/noise0.jpg",
-		true, nullptr, m_CommandList
-	);
-	m_Texture = texture->texture;
-
-	nvrhi::SamplerDesc samplerDesc;
-	samplerDesc.setAllFilters(true); // Թˣmin/mag/mip
-	samplerDesc.addressU = nvrhi::SamplerAddressMode::Wrap;
-	samplerDesc.addressV = nvrhi::SamplerAddressMode::Wrap;
-	samplerDesc.addressW = nvrhi::SamplerAddressMode::Wrap;
-	samplerDesc.mipBias = 0.0f;
-	samplerDesc.maxAnisotropy = 1.0f;
-	samplerDesc.borderColor = nvrhi::Color(0.0f);
-	m_Sampler = GetDevice()->createSampler(samplerDesc);
-
-	m_ConstantBuffer = m_Device->createBuffer(nvrhi::BufferDesc().setByteSize(sizeof(RenderConstants)).
-		setStructStride(sizeof(RenderConstants)).
+	m_ConePipeline = m_Device->createComputePipeline(nvrhi::ComputePipelineDesc()
+		.setComputeShader(m_ConeShader)
+		.addBindingLayout(m_ConeBindingLayout));
+	m_LightingPipeline = m_Device->createComputePipeline(nvrhi::ComputePipelineDesc()
+		.setComputeShader(m_LightingShader)
+		.addBindingLayout(m_LightingBindingLayout));
+
+	m_ConstantBuffer = m_Device->createBuffer(nvrhi::BufferDesc().setByteSize(sizeof(sdf::RenderConstants)).
+		setStructStride(sizeof(sdf::RenderConstants)).
 		setInitialState(nvrhi::ResourceStates::ConstantBuffer).
 		setIsConstantBuffer(true).
 		setKeepInitialState(true).
@@ -121,7 +151,7 @@ void SDFRendering::Render(nvrhi::IFramebuffer* framebuffer) {
 		pipelineDesc.inputLayout = m_InputLayout;
 		pipelineDesc.bindingLayouts = { m_BindingLayout };
 		pipelineDesc.VS = m_VertexShader;
-		pipelineDesc.PS = m_PixelShader;
+		pipelineDesc.PS = m_PixelShaders[m_Normals];
 		pipelineDesc.renderState.depthStencilState.depthTestEnable = false;
 		pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
 
@@ -130,18 +160,162 @@ void SDFRendering::Render(nvrhi::IFramebuffer* framebuffer) {
 		
 	}
 
-	RenderConstants renderConstants;
+	// йؼ֡һֵ仯ָдBVHָÿ֡ϴһ
+	if (m_Animation.IsAnimated())
+		m_Animation.Evaluate(delta, m_Bvh);
+	if (m_TapeDirty || m_Bvh.IsDirty() || !m_TapeBuffer)
+		UploadTape();
+	UpdateOccupancy();
+
+	const nvrhi::FramebufferInfoEx& fbinfo = framebuffer->getFramebufferInfo();
+
+	sdf::RenderConstants renderConstants;
 	renderConstants.g_Time = float4(delta, 0, 0, 0);
-	renderConstants.g_Resolution = float4((float)framebuffer->getFramebufferInfo().width, (float)framebuffer->getFramebufferInfo().height, 0, 0);
+	renderConstants.g_Resolution = float4((float)fbinfo.width, (float)fbinfo.height, 0, 0);
 	renderConstants.g_Switch = int4(1, 1, 1, 1);
 	renderConstants.g_Factor = float2(256.0f, 20.0f);
-	delta = delta + 0.001f;
-	m_CommandList->writeBuffer(m_ConstantBuffer, &renderConstants, sizeof(RenderConstants));
+	renderConstants.g_FactorPad = float2(0.0f);
+	renderConstants.g_Scene = int4(int(m_Bvh.GetGlobalInstructionCount()), int(m_Bvh.GetNodes().size()), 0, 0);
+	renderConstants.g_Cone = sdf::GetConeConstants(m_EnableConePrepass ? SDF_CONE_TILE_SIZE : 0, int(fbinfo.width));
+	renderConstants.g_Relax = float4(m_Relaxation, 0, 0, 0);
+	renderConstants.g_Heatmap = int4(m_HeatmapMode, m_HeatmapScale, 0, 0);
+	m_Animation.GetCameraConstants(delta, renderConstants.g_Camera, renderConstants.g_CameraTarget);
+	m_Occupancy.GetConstants(renderConstants.g_Occupancy, renderConstants.g_OccupancyGrid);
+	bool probesUpdated = UpdateProbes(renderConstants);
+	m_Probes.GetConstants(renderConstants.g_Probes, renderConstants.g_ProbeOrigin, renderConstants.g_ProbeSpacing);
+
+	// лۻ洰ڴС´֮ǰкۻ֮ʧЧ
+	int2 resolution = int2(int(fbinfo.width), int(fbinfo.height));
+	if (!m_HitBuffers[0] || any(resolution != m_HitResolution))
+	{
+		for (nvrhi::BufferHandle& buffer : m_HitBuffers)
+		{
+			buffer = m_Device->createBuffer(nvrhi::BufferDesc()
+				.setByteSize(std::max<size_t>(size_t(resolution.x) * size_t(resolution.y), 1) * sizeof(float2))
+				.setStructStride(sizeof(float2))
+				.setCanHaveUAVs(true)
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true)
+				.setDebugName("PrimaryHits"));
+		}
+		m_AccumulationTexture = m_Device->createTexture(nvrhi::TextureDesc()
+			.setWidth(uint32_t(std::max(resolution.x, 1)))
+			.setHeight(uint32_t(std::max(resolution.y, 1)))
+			.setFormat(nvrhi::Format::RGBA32_FLOAT)
+			.setIsUAV(true)
+			.setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+			.setKeepInitialState(true)
+			.setDebugName("Accumulation"));
+		m_HitResolution = resolution;
+		m_HitsValid = false;
+		m_AccumulatedSamples = 0;
+		m_BindingSets.Clear();
+	}
+	renderConstants.g_Temporal = sdf::GetTemporalConstants(m_EnableTemporal && m_HitsValid, m_HitTime);
+	renderConstants.g_PrevCamera = m_HitCamera;
+	renderConstants.g_PrevCameraTarget = m_HitCameraTarget;
+	renderConstants.g_Lighting = sdf::GetLightingConstants(m_LightingScale, int(fbinfo.width));
+
+	// 治ʱ(ʱ䶼)ÿ֡ۻһĲκβ仯ӵ0¿ʼ
+	// ֻʾۻټ
+	// ̽¸ı˹գͬ¿ʼ
+	renderConstants.g_Accumulate = int4(0);
+	bool sameImage = sdf::IsSameImage(renderConstants, m_AccumulationConstants);
+	if (!sameImage)
+		m_ProbeUpdates = 0;
+	if (!m_EnableAccumulation || !sameImage || probesUpdated)
+		m_AccumulatedSamples = 0;
+	bool converged = m_AccumulatedSamples >= SDF_ACCUMULATE_MAX_SAMPLES;
+	renderConstants.g_Accumulate = sdf::GetAccumulateConstants(m_EnableAccumulation, m_AccumulatedSamples, converged);
+	m_AccumulationConstants = renderConstants;
+	m_HitTime = delta;
+	m_HitCamera = renderConstants.g_Camera;
+	m_HitCameraTarget = renderConstants.g_CameraTarget;
+
+	if (!m_Paused)
+		delta = delta + 0.001f;
+	m_CommandList->writeBuffer(m_ConstantBuffer, &renderConstants, sizeof(sdf::RenderConstants));
+
+	// ֿ洰ڴС仯ʱ´
+	int2 coneTiles = sdf::GetConeTileCount(renderConstants);
+	size_t coneBytes = std::max<size_t>(size_t(coneTiles.x) * size_t(coneTiles.y), 1) * sizeof(float);
+	if (!m_ConeBuffer || m_ConeBuffer->getDesc().byteSize < coneBytes)
+	{
+		m_ConeBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+			.setByteSize(coneBytes)
+			.setStructStride(sizeof(float))
+			.setCanHaveUAVs(true)
+			.setInitialState(nvrhi::ResourceStates::ShaderResource)
+			.setKeepInitialState(true)
+			.setDebugName("ConeDepth"));
+
+		m_BindingSets.Clear();
+	}
+
+	if (coneTiles.x > 0 && !converged)
+	{
+		nvrhi::BindingSetDesc coneSetDesc;
+		coneSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_TapeBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_BvhBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_ConeBuffer));
+
+		nvrhi::ComputeState coneState;
+		coneState.pipeline = m_ConePipeline;
+		coneState.bindings = { m_BindingSets.GetOrCreateBindingSet(coneSetDesc, m_ConeBindingLayout) };
+		m_CommandList->setComputeState(coneState);
+		m_CommandList->dispatch(
+			(coneTiles.x + SDF_CONE_GROUP_SIZE - 1) / SDF_CONE_GROUP_SIZE,
+			(coneTiles.y + SDF_CONE_GROUP_SIZE - 1) / SDF_CONE_GROUP_SIZE);
+	}
+
+	// 洰ڴСͽ仯ʱ´
+	int2 lightingSamples = sdf::GetLightingSampleCount(renderConstants);
+	size_t lightingBytes = std::max<size_t>(size_t(lightingSamples.x) * size_t(lightingSamples.y), 1) * sizeof(sdf::LightingSample);
+	if (!m_LightingBuffer || m_LightingBuffer->getDesc().byteSize < lightingBytes)
+	{
+		m_LightingBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+			.setByteSize(lightingBytes)
+			.setStructStride(sizeof(sdf::LightingSample))
+			.setCanHaveUAVs(true)
+			.setInitialState(nvrhi::ResourceStates::ShaderResource)
+			.setKeepInitialState(true)
+			.setDebugName("LightingSamples"));
+
+		m_BindingSets.Clear();
+	}
+
+	if (lightingSamples.x > 0 && !converged)
+	{
+		nvrhi::BindingSetDesc lightingSetDesc;
+		lightingSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_TapeBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_BvhBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_ConeBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_OccupancyBuffer))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_LightingBuffer));
+
+		nvrhi::ComputeState lightingState;
+		lightingState.pipeline = m_LightingPipeline;
+		lightingState.bindings = { m_BindingSets.GetOrCreateBindingSet(lightingSetDesc, m_LightingBindingLayout) };
+		m_CommandList->setComputeState(lightingState);
+		m_CommandList->dispatch(
+			(lightingSamples.x + SDF_LIGHTING_GROUP_SIZE - 1) / SDF_LIGHTING_GROUP_SIZE,
+			(lightingSamples.y + SDF_LIGHTING_GROUP_SIZE - 1) / SDF_LIGHTING_GROUP_SIZE);
+	}
 
 	nvrhi::BindingSetDesc bindingSetDesc;
 	bindingSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer))
-		.addItem(nvrhi::BindingSetItem::Sampler(0,m_Sampler))
-		.addItem(nvrhi::BindingSetItem::Texture_SRV(0,m_Texture));
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_TapeBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_BvhBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_ConeBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_HitBuffers[m_HitIndex]))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_LightingBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_OccupancyBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(7, m_ProbeIrradianceBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(8, m_ProbeDistanceBuffer))
+		.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_HitBuffers[1 - m_HitIndex]))
+		.addItem(nvrhi::BindingSetItem::Texture_UAV(2, m_AccumulationTexture));
 
 	nvrhi::BindingSetHandle bindingSet = m_BindingSets.GetOrCreateBindingSet(bindingSetDesc, m_BindingLayout);
 
@@ -149,7 +323,7 @@ void SDFRendering::Render(nvrhi::IFramebuffer* framebuffer) {
 	state.pipeline = m_GraphicsPipeline;
 	state.bindings = { bindingSet };
 	state.framebuffer = framebuffer;
-	state.viewport.addViewportAndScissorRect(framebuffer->getFramebufferInfo().getViewport());
+	state.viewport.addViewportAndScissorRect(fbinfo.getViewport());
 	state.indexBuffer = nvrhi::IndexBufferBinding().setFormat(nvrhi::Format::R32_UINT);
 	state.vertexBuffers.push_back(nvrhi::VertexBufferBinding());
 	state.indexBuffer.buffer = indicesBuffer;
@@ -161,12 +335,314 @@ void SDFRendering::Render(nvrhi::IFramebuffer* framebuffer) {
 
 	m_CommandList->drawIndexed(nvrhi::DrawArguments().setVertexCount(6));
 
+	// ֡дгΪһ֡g_PrevHits֡дУһ֡
+	if (!converged)
+	{
+		m_HitIndex = 1 - m_HitIndex;
+		m_HitsValid = true;
+		if (m_EnableAccumulation)
+			m_AccumulatedSamples++;
+	}
+
 	m_CommandList->close();
 	GetDevice()->executeCommandList(m_CommandList);
 
 }
 
+bool SDFRendering::LoadScene(const std::filesystem::path& sceneFileName)
+{
+	vfs::NativeFileSystem fs;
+	sdf::Tape tape;
+	std::unique_ptr<sdf::CsgCamera> camera;
+
+	// ָļؼ֡Ǿֹĳ
+	if (sceneFileName.extension() == ".tape")
+	{
+		if (!sdf::LoadTape(fs, sceneFileName, tape))
+			return false;
+	}
+	else
+	{
+		std::unique_ptr<sdf::CsgNode> root = sdf::LoadCsgScene(fs, sceneFileName, &camera);
+		if (!root || !sdf::CompileTape(*root, tape))
+			return false;
+	}
+
+	sdf::SceneBvh bvh;
+	if (!bvh.Build(tape))
+	{
+		log::error("SDF scene %s has a malformed tape", sceneFileName.generic_string().c_str());
+		return false;
+	}
+
+	m_Tape = std::move(tape);
+	m_Bvh = std::move(bvh);
+	m_Animation.Bind(m_Tape, camera.get());
+	m_TapeDirty = true;
+	m_Occupancy = sdf::OccupancyGrid();
+	m_OccupancyRegions.clear();
+	m_Probes.Reset();
+	m_ProbeUpdates = 0;
+	m_HitsValid = false;
+	m_AccumulatedSamples = 0;
+	m_ScenePath = sceneFileName;
+
+	std::error_code ec;
+	m_SceneWriteTime = std::filesystem::last_write_time(sceneFileName, ec);
+
+	log::info("Loaded SDF scene %s: %d instructions, stack depth %u, %u objects in the BVH, %d animation tracks",
+		sceneFileName.generic_string().c_str(), int(m_Tape.Size()), m_Tape.maxStackDepth, m_Bvh.GetObjectCount(),
+		int(m_Animation.GetTrackCount()));
+	return true;
+}
+
+// Hлmap()ôͼرաͶ䡢ߡڱΡӰ
+// Nл߼㷽ʽĲ֡塢ż
+// Tеʱ
+// LлӰͻڱεķֱʣȫֱʡ1/21/4
+// PͣAؾֹĽۻ
+// OռĿհԾ(-occupancyָС)
+// Gطն̽ķ(-probesָÿ֡µ̽)
+bool SDFRendering::KeyboardUpdate(int key, int scancode, int action, int mods)
+{
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
+	{
+		m_HeatmapMode = (m_HeatmapMode + 1) % (SDF_HEATMAP_SHADOW + 1);
+		return true;
+	}
+	if (key == GLFW_KEY_N && action == GLFW_PRESS)
+	{
+		SetNormals((m_Normals + 1) % (SDF_NORMALS_DUAL + 1));
+		return true;
+	}
+	if (key == GLFW_KEY_T && action == GLFW_PRESS)
+	{
+		m_EnableTemporal = !m_EnableTemporal;
+		return true;
+	}
+	if (key == GLFW_KEY_L && action == GLFW_PRESS)
+	{
+		m_LightingScale = m_LightingScale >= 4 ? 1 : m_LightingScale * 2;
+		return true;
+	}
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	{
+		m_Paused = !m_Paused;
+		return true;
+	}
+	if (key == GLFW_KEY_A && action == GLFW_PRESS)
+	{
+		m_EnableAccumulation = !m_EnableAccumulation;
+		return true;
+	}
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+	{
+		m_EnableOccupancy = !m_EnableOccupancy;
+		return true;
+	}
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+	{
+		m_EnableProbes = !m_EnableProbes;
+		return true;
+	}
+	return false;
+}
+
+void SDFRendering::SetNormals(int normals)
+{
+	if (normals < SDF_NORMALS_CENTRAL || normals > SDF_NORMALS_DUAL || normals == m_Normals)
+		return;
+	m_Normals = normals;
+	m_GraphicsPipeline = nullptr;
+	m_AccumulatedSamples = 0;
+}
+
+void SDFRendering::SetOccupancy(int size)
+{
+	m_OccupancySize = std::max(size, 0);
+	m_Occupancy = sdf::OccupancyGrid();
+	m_OccupancyRegions.clear();
+}
+
+void SDFRendering::SetProbes(int budget)
+{
+	m_ProbeBudget = std::max(budget, 0);
+	m_Probes = sdf::ProbeGrid();
+	m_ProbeUpdates = 0;
+}
+
+void SDFRendering::Animate(float fElapsedTimeSeconds)
+{
+	GetDeviceManager()->SetInformativeWindowTitle("g_WindowTitle");
+
+	ReloadSceneIfModified(fElapsedTimeSeconds);
+}
+
+// ļ޸ĺԶ±룬±ɫ
+void SDFRendering::ReloadSceneIfModified(float fElapsedTimeSeconds)
+{
+	if (m_ScenePath.empty())
+		return;
+
+	m_SceneCheckTimer += fElapsedTimeSeconds;
+	if (m_SceneCheckTimer < 0.5f)
+		return;
+	m_SceneCheckTimer = 0.0f;
+
+	std::error_code ec;
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(m_ScenePath, ec);
+	if (ec || writeTime == m_SceneWriteTime)
+		return;
+
+	// ʧʱһεĳ
+	if (!LoadScene(m_ScenePath))
+		m_SceneWriteTime = writeTime;
+}
+
+// ϴBVHźָBVHڵ㣬嶯ϰΧ
+void SDFRendering::UploadTape()
+{
+	m_Bvh.Refit(&m_OccupancyRegions);
+
+	auto upload = [this](nvrhi::BufferHandle& buffer, const void* data, size_t count, size_t stride, const char* name)
+	{
+		size_t byteSize = std::max<size_t>(count, 1) * stride;
+
+		if (!buffer || buffer->getDesc().byteSize < byteSize)
+		{
+			buffer = m_Device->createBuffer(nvrhi::BufferDesc()
+				.setByteSize(byteSize)
+				.setStructStride(uint32_t(stride))
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true)
+				.setDebugName(name));
+
+			m_BindingSets.Clear();
+		}
+
+		if (count > 0)
+			m_CommandList->writeBuffer(buffer, data, count * stride);
+	};
 
+	const std::vector<sdf::TapeInstruction>& instructions = m_Bvh.GetInstructions();
+	const std::vector<sdf::BvhNode>& nodes = m_Bvh.GetNodes();
+	upload(m_TapeBuffer, instructions.data(), instructions.size(), sizeof(sdf::TapeInstruction), "SceneTape");
+	upload(m_BvhBuffer, nodes.data(), nodes.size(), sizeof(sdf::BvhNode), "SceneBvh");
+
+	m_TapeDirty = false;
+	m_AccumulatedSamples = 0;
+}
+
+// ռֻ֮·ƶʱλƵϴΪg_OccupancyBits
+// رʱգg_Occupancy.xΪ0
+void SDFRendering::UpdateOccupancy()
+{
+	sdf::SceneMap map;
+	map.bvh = &m_Bvh;
+	map.time = delta;
+
+	bool changed = false;
+	if (m_OccupancySize > 0 && m_EnableOccupancy)
+	{
+		if (m_Occupancy.Empty())
+		{
+			// óλֻڸЧmap()ܱȵľ
+			sdf::OccupancyGridDesc desc;
+			desc.size = m_OccupancySize;
+			desc.margin = m_Bvh.GetInstructions().empty() ? sdf::c_DefaultSceneOvershoot : 0.0f;
+			changed = m_Occupancy.Build(m_Executor, map, desc);
+			if (!changed)
+				m_OccupancySize = 0;
+		}
+		else
+		{
+			if (m_OccupancyTime != delta)
+				sdf::GetTimeDependentRegions(map, m_OccupancyRegions);
+			m_Occupancy.Update(m_Executor, map, m_OccupancyRegions);
+			changed = !m_OccupancyRegions.empty();
+		}
+		m_OccupancyTime = delta;
+	}
+	else if (!m_Occupancy.Empty())
+	{
+		m_Occupancy = sdf::OccupancyGrid();
+	}
+	m_OccupancyRegions.clear();
+
+	const std::vector<uint32_t>& words = m_Occupancy.GetWords();
+	size_t byteSize = std::max<size_t>(words.size(), 1) * sizeof(uint32_t);
+	if (!m_OccupancyBuffer || m_OccupancyBuffer->getDesc().byteSize < byteSize)
+	{
+		m_OccupancyBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+			.setByteSize(byteSize)
+			.setStructStride(sizeof(uint32_t))
+			.setInitialState(nvrhi::ResourceStates::ShaderResource)
+			.setKeepInitialState(true)
+			.setDebugName("OccupancyBits"));
+
+		m_BindingSets.Clear();
+		changed = !words.empty();
+	}
+
+	if (changed)
+		m_CommandList->writeBuffer(m_OccupancyBuffer, words.data(), words.size() * sizeof(uint32_t));
+}
+
+// ̽뿪ÿ֡֡Ĺøm_ProbeBudget̽룬ϴΪg_ProbeIrradianceg_ProbeDistance
+// 澲ֹʱc_ProbeSettlePassesֺֹͣýۻرʱգg_Probes.xΪ0
+// ̽Ƿı
+bool SDFRendering::UpdateProbes(const sdf::RenderConstants& constants)
+{
+	constexpr uint32_t c_ProbeSettlePasses = 16;
+
+	bool changed = false;
+	if (m_ProbeBudget > 0 && m_EnableProbes)
+	{
+		if (m_Probes.Empty() && !m_Probes.Init(sdf::ProbeGridDesc()))
+			m_ProbeBudget = 0;
+		else if (m_ProbeUpdates < c_ProbeSettlePasses * m_Probes.GetProbeCount())
+		{
+			sdf::SceneMap map;
+			map.bvh = &m_Bvh;
+			map.time = delta;
+			m_ProbeUpdates += m_Probes.Update(m_Executor, map, constants, uint32_t(m_ProbeBudget));
+			changed = true;
+		}
+	}
+	else if (!m_Probes.Empty())
+	{
+		m_Probes = sdf::ProbeGrid();
+		m_ProbeUpdates = 0;
+		changed = true;
+	}
+
+	auto upload = [this, changed](nvrhi::BufferHandle& buffer, const void* data, size_t count, size_t stride, const char* name)
+	{
+		size_t byteSize = std::max<size_t>(count, 1) * stride;
+		bool created = false;
+		if (!buffer || buffer->getDesc().byteSize < byteSize)
+		{
+			buffer = m_Device->createBuffer(nvrhi::BufferDesc()
+				.setByteSize(byteSize)
+				.setStructStride(uint32_t(stride))
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true)
+				.setDebugName(name));
+
+			m_BindingSets.Clear();
+			created = true;
+		}
+
+		if ((changed || created) && count > 0)
+			m_CommandList->writeBuffer(buffer, data, count * stride);
+	};
+
+	const std::vector<float4>& irradiance = m_Probes.GetIrradiance();
+	const std::vector<float2>& distance = m_Probes.GetDistance();
+	upload(m_ProbeIrradianceBuffer, irradiance.data(), irradiance.size(), sizeof(float4), "ProbeIrradiance");
+	upload(m_ProbeDistanceBuffer, distance.data(), distance.size(), sizeof(float2), "ProbeDistance");
+	return changed;
+}
 
 
 #ifdef WIN32
@@ -190,8 +666,54 @@ int main(int __argc, const char** __argv)
 		return 1;
 	}
 
+	std::filesystem::path scenePath;
+	bool conePrepass = true;
+	bool temporal = true;
+	int lightingScale = 1;
+	bool accumulation = true;
+	bool paused = false;
+	float relaxation = SDF_RAY_RELAXATION;
+	int normals = SDF_NORMALS_DEFAULT;
+	int occupancy = 0;
+	int probes = 0;
+	for (int i = 1; i < __argc; i++)
+	{
+		if (!strcmp(__argv[i], "-scene") && i + 1 < __argc)
+			scenePath = __argv[++i];
+		else if (!strcmp(__argv[i], "-nocone"))
+			conePrepass = false;
+		else if (!strcmp(__argv[i], "-notemporal"))
+			temporal = false;
+		else if (!strcmp(__argv[i], "-lighting") && i + 1 < __argc)
+			lightingScale = atoi(__argv[++i]);
+		else if (!strcmp(__argv[i], "-noaccumulate"))
+			accumulation = false;
+		else if (!strcmp(__argv[i], "-pause"))
+			paused = true;
+		else if (!strcmp(__argv[i], "-relax") && i + 1 < __argc)
+			relaxation = float(atof(__argv[++i]));
+		else if (!strcmp(__argv[i], "-normals") && i + 1 < __argc)
+			normals = atoi(__argv[++i]);
+		else if (!strcmp(__argv[i], "-occupancy") && i + 1 < __argc)
+			occupancy = atoi(__argv[++i]);
+		else if (!strcmp(__argv[i], "-probes") && i + 1 < __argc)
+			probes = atoi(__argv[++i]);
+	}
+
 	{
 		SDFRendering example(deviceManager);
+		example.SetConePrepass(conePrepass);
+		example.SetTemporalReuse(temporal);
+		example.SetLightingScale(lightingScale);
+		example.SetAccumulation(accumulation);
+		example.SetPaused(paused);
+		example.SetRelaxation(relaxation);
+		example.SetNormals(normals);
+		example.SetOccupancy(occupancy);
+		example.SetProbes(probes);
+		if (!scenePath.empty() && !example.LoadScene(scenePath))
+			log::warning("Falling back to the built-in SDF scene");
+
 		if (example.InitPipeLine())
 		{
 			deviceManager->AddRenderPassToBack(&example);
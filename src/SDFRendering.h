@@ -9,7 +9,6 @@
 #include <memory>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/BindingCache.h>
-#include <donut/engine/TextureCache.h>
 #include <donut/engine/Scene.h>
 #include <donut/engine/SceneGraph.h>
 #include <wrl.h>
@@ -33,6 +32,19 @@ using namespace donut::render;
 #include <donut/shaders/light_cb.h>
 #include <donut/shaders/view_cb.h>
 
+#include "cpu/Accumulation.h"
+#include "cpu/Bvh.h"
+#include "cpu/ConePrepass.h"
+#include "cpu/LightingPass.h"
+#include "cpu/OccupancyGrid.h"
+#include "cpu/ProbeGrid.h"
+#include "cpu/Renderer.h"
+#include "cpu/SceneAnimation.h"
+#include "cpu/Tape.h"
+#include "cpu/TemporalReuse.h"
+
+#include <taskflow/taskflow.hpp>
+
 
 class SDFRendering : public app::IRenderPass
 {
@@ -40,8 +52,6 @@ class SDFRendering : public app::IRenderPass
 public:
 
 	SDFRendering(app::DeviceManager* deviceManager) :IRenderPass(deviceManager),m_BindingSets(deviceManager->GetDevice()) {
-		auto fs = std::make_shared<donut::vfs::NativeFileSystem>();
-		textureCache = std::make_shared<donut::engine::TextureCache>(deviceManager->GetDevice(),fs,nullptr);
 	};
 	struct Vertex
 	{
@@ -49,18 +59,27 @@ public:
 		float2 uv;
 	};
 
-	struct RenderConstants
-	{
-		float4 g_Time;
-		float4 g_Resolution;
-		int4 g_Switch;
-		float2 g_Factor;
-	};
-
-
-
-
 	bool InitPipeLine();
+	bool LoadScene(const std::filesystem::path& sceneFileName);
+	void SetConePrepass(bool enable) { m_EnableConePrepass = enable; }
+	// Starts the primary rays at the reprojected hits of the previous frame, see src/cpu/TemporalReuse.h.
+	void SetTemporalReuse(bool enable) { m_EnableTemporal = enable; }
+	// Pixels per side of a soft shadow and AO sample, 1 evaluates them per pixel, see src/cpu/LightingPass.h.
+	void SetLightingScale(int scale) { m_LightingScale = std::max(scale, 1); }
+	// Averages jittered samples over the frames while the image stays the same, see src/cpu/Accumulation.h.
+	void SetAccumulation(bool enable) { m_EnableAccumulation = enable; }
+	// Stops the animation, so that the accumulation can converge.
+	void SetPaused(bool paused) { m_Paused = paused; }
+	// Step factor of the over-relaxed sphere tracing, 1 for plain sphere tracing.
+	void SetRelaxation(float omega) { m_Relaxation = omega; }
+	// SDF_NORMALS_* permutation of the pixel shader.
+	void SetNormals(int normals);
+	// Cells per side of the occupancy grid the rays jump across empty space with, 0 disables it, see
+	// src/cpu/OccupancyGrid.h.
+	void SetOccupancy(int size);
+	// Probes of the irradiance grid traced per frame for the bounced diffuse light, 0 keeps the fixed sky
+	// light, see src/cpu/ProbeGrid.h.
+	void SetProbes(int budget);
 	void Render(nvrhi::IFramebuffer* framebuffer) override;
 
 	void BackBufferResizing() override
@@ -68,28 +87,85 @@ public:
 		m_Pipeline = nullptr;
 	}
 
-	void Animate(float fElapsedTimeSeconds) override
-	{
-		GetDeviceManager()->SetInformativeWindowTitle("g_WindowTitle");
-	}
+	void Animate(float fElapsedTimeSeconds) override;
+	bool KeyboardUpdate(int key, int scancode, int action, int mods) override;
+
 protected:
+	void ReloadSceneIfModified(float fElapsedTimeSeconds);
+	void UploadTape();
+	void UpdateOccupancy();
+	bool UpdateProbes(const sdf::RenderConstants& constants);
+
 	float delta = 0.0f;
 	nvrhi::DeviceHandle m_Device;
 	nvrhi::ShaderHandle m_VertexShader;
-	nvrhi::ShaderHandle m_PixelShader;
+	nvrhi::ShaderHandle m_PixelShaders[SDF_NORMALS_DUAL + 1];
 	nvrhi::GraphicsPipelineHandle m_Pipeline;
 	nvrhi::CommandListHandle m_CommandList;
 
 	nvrhi::BufferHandle vertexBuffer;
 	nvrhi::BufferHandle indicesBuffer;
 	nvrhi::BufferHandle m_ConstantBuffer;
-	nvrhi::SamplerHandle m_Sampler;
-	nvrhi::TextureHandle m_Texture;
 
 	nvrhi::InputLayoutHandle m_InputLayout;
 	nvrhi::GraphicsPipelineHandle m_GraphicsPipeline;
 	nvrhi::BindingLayoutHandle m_BindingLayout;
 	BindingCache m_BindingSets;
-	std::shared_ptr<donut::engine::TextureCache> textureCache;
+
+	std::filesystem::path m_ScenePath;
+	std::filesystem::file_time_type m_SceneWriteTime;
+	float m_SceneCheckTimer = 0.0f;
+	sdf::Tape m_Tape;
+	sdf::SceneBvh m_Bvh;
+	sdf::SceneAnimation m_Animation;  // tracks of the scene, evaluated into m_Bvh every frame
+	bool m_TapeDirty = false;
+	nvrhi::BufferHandle m_TapeBuffer;
+	nvrhi::BufferHandle m_BvhBuffer;
+
+	bool m_EnableConePrepass = true;
+	float m_Relaxation = SDF_RAY_RELAXATION;
+	int m_Normals = SDF_NORMALS_DEFAULT;
+	int m_HeatmapMode = SDF_HEATMAP_OFF;
+	int m_HeatmapScale = 256;
+	nvrhi::ShaderHandle m_ConeShader;
+	nvrhi::ComputePipelineHandle m_ConePipeline;
+	nvrhi::BindingLayoutHandle m_ConeBindingLayout;
+	nvrhi::BufferHandle m_ConeBuffer;
+
+	bool m_EnableTemporal = true;
+	nvrhi::BufferHandle m_HitBuffers[2];  // g_PrevHits and g_Hits, swapped every frame
+	int m_HitIndex = 0;                    // m_HitBuffers[m_HitIndex] holds the hits of the previous frame
+	int2 m_HitResolution = int2(0);
+	float m_HitTime = 0.0f;
+	float4 m_HitCamera = float4(0.f);        // g_Camera and g_CameraTarget of the previous frame
+	float4 m_HitCameraTarget = float4(0.f);
+	bool m_HitsValid = false;
+
+	int m_LightingScale = 1;
+	nvrhi::ShaderHandle m_LightingShader;
+	nvrhi::ComputePipelineHandle m_LightingPipeline;
+	nvrhi::BindingLayoutHandle m_LightingBindingLayout;
+	nvrhi::BufferHandle m_LightingBuffer;
+
+	bool m_Paused = false;
+	bool m_EnableAccumulation = true;
+	nvrhi::TextureHandle m_AccumulationTexture;  // g_Accumulation, recreated with the hit buffers
+	int m_AccumulatedSamples = 0;                // 0 starts over with the next frame
+	sdf::RenderConstants m_AccumulationConstants = {};
+
+	int m_OccupancySize = 0;
+	bool m_EnableOccupancy = true;
+	tf::Executor m_Executor;                    // classifies the cells of m_Occupancy
+	sdf::OccupancyGrid m_Occupancy;             // of m_Bvh at m_OccupancyTime, rebuilt while empty
+	std::vector<box3> m_OccupancyRegions;       // where objects moved since the grid was updated
+	float m_OccupancyTime = 0.0f;
+	nvrhi::BufferHandle m_OccupancyBuffer;
+
+	int m_ProbeBudget = 0;
+	bool m_EnableProbes = true;
+	sdf::ProbeGrid m_Probes;                    // traced on m_Executor, initialized while empty
+	uint32_t m_ProbeUpdates = 0;                // probes updated since the image last changed
+	nvrhi::BufferHandle m_ProbeIrradianceBuffer;
+	nvrhi::BufferHandle m_ProbeDistanceBuffer;
 };
 
@@ -0,0 +1,320 @@
+// GPU interpreter for the scene tape compiled by sdf::CompileTape (src/cpu/Tape.cpp).
+// Included by SDF.hlsli after the primitive library; must stay in sync with sdf::EvaluateTape
+// and sdf::EvaluateBvh (src/cpu/Bvh.h).
+
+#include "sdf_cb.h"
+
+StructuredBuffer<TapeInstruction> g_Tape : register(t1);
+StructuredBuffer<BvhNode> g_Bvh : register(t2);
+
+float tapePrimitive(TapeInstruction ins, float3 pos)
+{
+    float3 c = float3(ins.params[0], ins.params[1], ins.params[2]);
+    float3 p = pos - c;
+
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_PLANE:
+            return sdPlane(pos, c) - ins.params[3];
+        case SDF_OP_SPHERE:
+            return sdSphere(p, ins.params[3]);
+        case SDF_OP_BOX:
+            return sdBox(p, float3(ins.params[3], ins.params[4], ins.params[5]));
+        case SDF_OP_BOX_FRAME:
+            return sdBoxFrame(p, float3(ins.params[3], ins.params[4], ins.params[5]), ins.params[6]);
+        case SDF_OP_TORUS:
+            return sdTorus(p, float2(ins.params[3], ins.params[4]));
+        case SDF_OP_CYLINDER:
+            return sdCylinder(p, float2(ins.params[3], ins.params[4]), (ins.code >> 8) & 0xff);
+        case SDF_OP_OCTAHEDRON:
+            return sdOctahedron(p, ins.params[3]);
+        default:
+            return 1e10;
+    }
+}
+
+// Union-like operators keep the material of the closer operand, intersections the farther one,
+// subtractions the material of the first operand.
+float2 tapeBinary(TapeInstruction ins, float2 a, float2 b)
+{
+    float k = ins.params[0];
+
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_UNION:
+            return float2(opUnion(a.x, b.x), a.x < b.x ? a.y : b.y);
+        case SDF_OP_SUBTRACTION:
+            return float2(opSubtraction(a.x, b.x), a.y);
+        case SDF_OP_INTERSECTION:
+            return float2(opIntersection(a.x, b.x), a.x > b.x ? a.y : b.y);
+        case SDF_OP_SMOOTH_UNION:
+            return float2(opSmoothUnion(a.x, b.x, k), a.x < b.x ? a.y : b.y);
+        case SDF_OP_SMOOTH_SUBTRACTION:
+            return float2(opSmoothSubtraction(b.x, a.x, k), a.y);
+        case SDF_OP_SMOOTH_INTERSECTION:
+            return float2(opSmoothIntersection(a.x, b.x, k), a.x > b.x ? a.y : b.y);
+        default:
+            return a;
+    }
+}
+
+float tapeUnary(TapeInstruction ins, float d, float3 p)
+{
+    switch (ins.code & 0xff)
+    {
+        case SDF_OP_ROUND:
+            return opRound(d, ins.params[0]);
+        case SDF_OP_DISPLACE:
+            if ((ins.code >> 8) & SDF_DISPLACE_KEYFRAMED)
+                return d + ins.params[0];
+            return d + ins.params[0] * sin(ins.params[1] * fmod(g_Time.x, 6.28));
+        case SDF_OP_DISPLACE_NOISE:
+            return d + noiseDisplacement(p, ins.params[0], ins.params[1], int(ins.params[2]));
+        default:
+            return d;
+    }
+}
+
+// Domain operators, the same candidates and bounds as sdf::GetDomainPosition() and sdf::GetDomainBound().
+
+#define SDF_TWO_PI 6.28318531
+
+uint tapeDomainCandidates(TapeInstruction ins)
+{
+    if ((ins.code & 0xff) == SDF_OP_REPEAT_POLAR)
+        return 2;
+
+    uint count = 1;
+    [unroll]
+    for (uint axis = 0; axis < 3; axis++)
+        count *= ins.params[axis] > 0 ? 2 : 1;
+    return count;
+}
+
+bool tapeIsOdd(float cell)
+{
+    return cell - 2 * floor(cell * 0.5) > 0.5;
+}
+
+// Nearest cell along a repeated axis, or its neighbour on the side of p.
+float tapeRepeatCell(TapeInstruction ins, uint axis, float p, bool neighbour)
+{
+    float period = ins.params[axis];
+    float limit = (ins.code & 0xff) == SDF_OP_REPEAT_LIMITED ? ins.params[3 + axis] : 1e30;
+    float cell = clamp(floor(p * (1.0 / period) + 0.5), -limit, limit);
+    if (neighbour)
+        cell = clamp(cell + (p - cell * period < 0 ? -1 : 1), -limit, limit);
+    return cell;
+}
+
+// Nearest sector around the polar axis, or its neighbour on the side of pos.
+float tapePolarSector(TapeInstruction ins, float3 pos, bool neighbour)
+{
+    float width = SDF_TWO_PI / ins.params[3];
+    float angle = atan2(pos.z - ins.params[2], pos.x - ins.params[0]);
+    float sector = floor(angle * (1.0 / width) + 0.5);
+    if (neighbour)
+        sector += angle - sector * width < 0 ? -1 : 1;
+    return sector;
+}
+
+bool tapePolarMirrored(TapeInstruction ins, float sector)
+{
+    return ((ins.code >> 8) & SDF_REPEAT_MIRROR) != 0 && tapeIsOdd(sector - ins.params[3] * floor(sector / ins.params[3]));
+}
+
+float3 tapeDomainPosition(TapeInstruction ins, float3 pos, uint candidate)
+{
+    bool mirror = ((ins.code >> 8) & SDF_REPEAT_MIRROR) != 0;
+
+    if ((ins.code & 0xff) == SDF_OP_REPEAT_POLAR)
+    {
+        float sector = tapePolarSector(ins, pos, candidate != 0);
+        float s, c;
+        sincos(sector * SDF_TWO_PI / ins.params[3], s, c);
+        float3 d = pos - float3(ins.params[0], ins.params[1], ins.params[2]);
+        float3 local = float3(d.x * c + d.z * s, d.y, d.z * c - d.x * s);
+        if (tapePolarMirrored(ins, sector))
+            local.z = -local.z;
+        return local;
+    }
+
+    uint bit = 0;
+    [unroll]
+    for (uint axis = 0; axis < 3; axis++)
+    {
+        float period = ins.params[axis];
+        if (period > 0)
+        {
+            float cell = tapeRepeatCell(ins, axis, pos[axis], ((candidate >> bit) & 1) != 0);
+            bit++;
+            float local = pos[axis] - cell * period;
+            pos[axis] = mirror && tapeIsOdd(cell) ? -local : local;
+        }
+    }
+    return pos;
+}
+
+// Lower bound of the distance to the instances none of the candidates covers.
+float tapeDomainBound(TapeInstruction ins, float3 pos)
+{
+    if ((ins.code & 0xff) == SDF_OP_REPEAT_POLAR)
+    {
+        if (ins.params[3] < 3)
+            return 1e10;
+
+        float width = SDF_TWO_PI / ins.params[3];
+        float angle = atan2(pos.z - ins.params[2], pos.x - ins.params[0]);
+        float offset = angle - floor(angle * (1.0 / width) + 0.5) * width;
+        return length(pos.xz - float2(ins.params[0], ins.params[2])) * sin(min(abs(offset) + 0.5 * width - 1e-4, 0.25 * SDF_TWO_PI));
+    }
+
+    bool limited = (ins.code & 0xff) == SDF_OP_REPEAT_LIMITED;
+    float3 axisDistance = 1e10;
+    float3 gap = 0;
+    [unroll]
+    for (uint axis = 0; axis < 3; axis++)
+    {
+        float period = ins.params[axis];
+        if (period > 0)
+        {
+            float cell = tapeRepeatCell(ins, axis, pos[axis], false);
+            float offset = pos[axis] - cell * period;
+            float d = abs(offset);
+            float behind = d + 0.5 * period;
+            float beyond = 1.5 * period - d;
+            if (limited)
+            {
+                float limit = ins.params[3 + axis];
+                float side = offset < 0 ? -1 : 1;
+                behind = abs(cell - side) <= limit ? behind : 1e10;
+                beyond = abs(cell + 2 * side) <= limit ? beyond : 1e10;
+                gap[axis] = max(d - 0.5 * period, 0);
+            }
+            axisDistance[axis] = min(behind, beyond);
+        }
+    }
+
+    float3 bound = axisDistance * axisDistance + dot(gap, gap) - gap * gap;
+    return sqrt(min(bound.x, min(bound.y, bound.z)));
+}
+
+// Evaluation state of an open domain operator.
+struct TapeDomain
+{
+    float3 pos;         // sample position outside the operator
+    uint begin;         // index of the operator in g_Tape
+    uint candidate;
+    float2 res;         // union of the candidates so far
+};
+
+float2 mapTapeRange(float3 pos, uint first, uint count)
+{
+    float2 stack[SDF_TAPE_MAX_STACK];
+    int sp = 0;
+    TapeDomain domains[SDF_TAPE_MAX_DOMAIN];
+    int dp = 0;
+    float3 p = pos;
+
+    for (uint i = first; i < first + count; i++)
+    {
+        TapeInstruction ins = g_Tape[i];
+        uint op = ins.code & 0xff;
+
+        if (op < SDF_OP_FIRST_BINARY)
+        {
+            stack[sp] = float2(tapePrimitive(ins, p), float(ins.code >> 16));
+            sp++;
+        }
+        else if (op < SDF_OP_FIRST_UNARY)
+        {
+            sp--;
+            stack[sp - 1] = tapeBinary(ins, stack[sp - 1], stack[sp]);
+        }
+        else if (op < SDF_OP_FIRST_DOMAIN)
+        {
+            stack[sp - 1].x = tapeUnary(ins, stack[sp - 1].x, p);
+        }
+        else if (op != SDF_OP_DOMAIN_END)
+        {
+            domains[dp].pos = p;
+            domains[dp].begin = i;
+            domains[dp].candidate = 0;
+            domains[dp].res = float2(1e10, -1.0);
+            dp++;
+            p = tapeDomainPosition(ins, p, 0);
+        }
+        else
+        {
+            // Evaluates the subtree again for the next candidate, or closes the operator.
+            TapeInstruction domain = g_Tape[domains[dp - 1].begin];
+            sp--;
+            domains[dp - 1].res = opU(domains[dp - 1].res, stack[sp]);
+            domains[dp - 1].candidate++;
+            if (domains[dp - 1].candidate < tapeDomainCandidates(domain))
+            {
+                p = tapeDomainPosition(domain, domains[dp - 1].pos, domains[dp - 1].candidate);
+                i = domains[dp - 1].begin;
+            }
+            else
+            {
+                p = domains[dp - 1].pos;
+                stack[sp] = float2(min(domains[dp - 1].res.x, tapeDomainBound(domain, p)), domains[dp - 1].res.y);
+                sp++;
+                dp--;
+            }
+        }
+    }
+
+    return sp > 0 ? stack[0] : float2(1e10, -1.0);
+}
+
+float2 mapTape(float3 pos)
+{
+    return mapTapeRange(pos, 0, (uint) g_Scene.x);
+}
+
+float bvhBoxDistance(float3 pos, BvhNode node)
+{
+    return sdBox(pos - 0.5 * (node.boundsMin + node.boundsMax), 0.5 * (node.boundsMax - node.boundsMin));
+}
+
+// g_Tape holds the always evaluated prefix (g_Scene.x instructions) followed by the objects of the BVH leaves.
+// Only objects whose boxes are closer than the best distance so far are evaluated.
+float2 mapBvh(float3 pos)
+{
+    float2 res = mapTapeRange(pos, 0, (uint) g_Scene.x);
+
+    uint stack[SDF_BVH_MAX_STACK];
+    int sp = 0;
+    uint index = 0;
+
+    for (;;)
+    {
+        BvhNode node = g_Bvh[index];
+        if (bvhBoxDistance(pos, node) < res.x)
+        {
+            if (node.count > 0)
+            {
+                res = opU(res, mapTapeRange(pos, node.offset, node.count));
+            }
+            else
+            {
+                uint left = index + 1;
+                uint right = node.offset;
+                bool leftFirst = bvhBoxDistance(pos, g_Bvh[left]) <= bvhBoxDistance(pos, g_Bvh[right]);
+                stack[sp] = leftFirst ? right : left;
+                sp++;
+                index = leftFirst ? left : right;
+                continue;
+            }
+        }
+
+        if (sp == 0)
+            break;
+        sp--;
+        index = stack[sp];
+    }
+
+    return res;
+}
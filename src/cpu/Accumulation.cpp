@@ -0,0 +1,77 @@
+#include "Accumulation.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace sdf
+{
+	namespace
+	{
+		float RadicalInverse(uint32_t index, uint32_t base)
+		{
+			float result = 0.f;
+			float digit = 1.f / float(base);
+			for (float scale = digit; index > 0; index /= base, scale *= digit)
+				result += float(index % base) * scale;
+			return result;
+		}
+
+		// Point of the Halton sequence shifted by half a period, so that index 0 sits at (0.5, 0.5).
+		float2 Halton(uint32_t index, uint32_t baseX, uint32_t baseY)
+		{
+			float x = RadicalInverse(index, baseX) + 0.5f;
+			float y = RadicalInverse(index, baseY) + 0.5f;
+			return float2(x - std::floor(x), y - std::floor(y));
+		}
+	}
+
+	int4 GetAccumulateConstants(bool enable, int sampleIndex, bool resolveOnly)
+	{
+		if (!enable)
+			return int4(0);
+		return int4(1, sampleIndex, resolveOnly ? 1 : 0, 0);
+	}
+
+	float2 GetSampleJitter(const RenderConstants& constants)
+	{
+		if (constants.g_Accumulate.x == 0)
+			return float2(0.f);
+		return Halton(uint32_t(constants.g_Accumulate.y), 2, 3) - 0.5f;
+	}
+
+	float2 GetLightJitter(const RenderConstants& constants)
+	{
+		if (constants.g_Accumulate.x == 0)
+			return float2(0.f);
+
+		// Concentric mapping of the square onto the disc (Shirley and Chiu, 1997), which keeps the
+		// stratification of the sequence.
+		const float2 o = 2.0f * Halton(uint32_t(constants.g_Accumulate.y), 5, 7) - 1.0f;
+		if (o.x == 0.f && o.y == 0.f)
+			return float2(0.f);
+		const float quarter = 0.78539816f;
+		float r, theta;
+		if (std::abs(o.x) > std::abs(o.y))
+		{
+			r = o.x;
+			theta = quarter * (o.y / o.x);
+		}
+		else
+		{
+			r = o.y;
+			theta = 2.0f * quarter - quarter * (o.x / o.y);
+		}
+		return r * float2(std::cos(theta), std::sin(theta));
+	}
+
+	bool IsSameImage(const RenderConstants& a, const RenderConstants& b)
+	{
+		RenderConstants x = a;
+		RenderConstants y = b;
+		x.g_Accumulate = y.g_Accumulate = int4(0);
+		x.g_Temporal = y.g_Temporal = float4(0.f);
+		x.g_PrevCamera = y.g_PrevCamera = float4(0.f);
+		x.g_PrevCameraTarget = y.g_PrevCameraTarget = float4(0.f);
+		return std::memcmp(&x, &y, sizeof(RenderConstants)) == 0;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// CPU port of the progressive accumulation of sdf_ps.hlsl.
+//
+// A still image doesn't need to be rendered again every frame: each frame instead adds one sample per
+// pixel to a running mean, jittering the ray inside the pixel and the key light over a small disc, so
+// the spare frames go into antialiasing and area light shadows. The jitter follows a Halton sequence
+// (bases 2 and 3 for the pixel, 5 and 7 for the light) shifted by half a period, which leaves sample 0
+// at the center of the pixel and of the light. The layout of g_Accumulate is described next to
+// SDF_ACCUMULATE_MAX_SAMPLES in sdf_cb.h, AccumulationImage in Renderer.h holds the mean.
+
+#include "Renderer.h"
+
+namespace sdf
+{
+	// g_Accumulate for the sample that follows sampleIndex averaged ones; enable = false renders every frame
+	// anew, resolveOnly shows the mean without adding a sample.
+	int4 GetAccumulateConstants(bool enable, int sampleIndex, bool resolveOnly = false);
+
+	// Offset of the sample's ray from the center of the pixel in [-0.5, 0.5), y down like the pixel
+	// positions of RenderPixel(). 0 for sample 0 and when g_Accumulate.x is 0.
+	float2 GetSampleJitter(const RenderConstants& constants);
+
+	// Offset of the key light on the unit disc, scaled by SDF_ACCUMULATE_LIGHT_RADIUS in
+	// GetKeyLightDirection(). 0 for sample 0 and when g_Accumulate.x is 0.
+	float2 GetLightJitter(const RenderConstants& constants);
+
+	// True when a and b render the same image apart from g_Accumulate, g_Temporal and g_PrevCamera*, so
+	// that samples of one can be averaged with samples of the other.
+	bool IsSameImage(const RenderConstants& a, const RenderConstants& b);
+}
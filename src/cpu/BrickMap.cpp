@@ -0,0 +1,331 @@
+#include "BrickMap.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		constexpr int c_CellVoxels = BrickMap::c_BrickSize - 1;
+		constexpr size_t c_BrickSamples = size_t(BrickMap::c_BrickSize) * BrickMap::c_BrickSize * BrickMap::c_BrickSize;
+
+		template<typename F> F LoadRow(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StoreRow(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		int3 FloorToInt(const float3& v)
+		{
+			return int3(int(std::floor(v.x)), int(std::floor(v.y)), int(std::floor(v.z)));
+		}
+	}
+
+	bool BrickMap::Bake(tf::Executor& executor, const SceneMap& map, const BrickMapDesc& desc)
+	{
+		// Rows of the block are evaluated as packets.
+		return Bake(executor, [&map](const float3& origin, float step, int count, float* distances)
+		{
+			for (int z = 0; z < count; z++)
+			{
+				for (int y = 0; y < count; y++)
+				{
+					const float3 start = origin + float3(0.f, float(y), float(z)) * step;
+					float* row = distances + (size_t(z) * count + size_t(y)) * count;
+					int x = 0;
+					for (; x + WidthOf<FloatN> <= count; x += WidthOf<FloatN>)
+					{
+						alignas(32) float xs[WidthOf<FloatN>];
+						for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+							xs[lane] = start.x + float(x + lane) * step;
+						StoreRow(row + x, map.Evaluate(Vec3<FloatN>(LoadRow<FloatN>(xs), FloatN(start.y), FloatN(start.z))).x);
+					}
+					for (; x < count; x++)
+						row[x] = map(float3(start.x + float(x) * step, start.y, start.z)).x;
+				}
+			}
+		}, desc);
+	}
+
+	bool BrickMap::Bake(tf::Executor& executor, const BrickMapField& field, const BrickMapDesc& desc)
+	{
+		if (desc.bits != 8 && desc.bits != 16)
+		{
+			log::error("Brick maps hold 8 or 16 bit samples, not %d", desc.bits);
+			return false;
+		}
+
+		const float3 extent = desc.bounds.diagonal();
+		if (!(desc.voxelSize > 0.f) || !(extent.x > 0.f && extent.y > 0.f && extent.z > 0.f) || !IsFinite(desc.bounds))
+		{
+			log::error("Can't bake a brick map of an empty region");
+			return false;
+		}
+
+		const float cellSize = desc.voxelSize * float(c_CellVoxels);
+		const float halfDiagonal = 0.5f * cellSize * std::sqrt(3.0f);
+
+		m_Origin = desc.bounds.m_mins;
+		m_GridSize = max(-FloorToInt(-extent / cellSize), int3(1));
+		m_VoxelSize = desc.voxelSize;
+		m_Bits = desc.bits;
+		// A kept cell's center is within halfDiagonal + band of the surface, its corners another halfDiagonal away.
+		m_Range = desc.band + 2.0f * halfDiagonal;
+
+		const size_t cellCount = size_t(m_GridSize.x) * size_t(m_GridSize.y) * size_t(m_GridSize.z);
+		m_CellDistances.assign(cellCount, 0.f);
+
+		// The cell centers go to the field in blocks of c_BrickSize^3 too, the last ones overhanging the grid.
+		const int3 blocks = (m_GridSize + (c_BrickSize - 1)) / c_BrickSize;
+		tf::Taskflow centers;
+		centers.for_each_index_dynamic(0, blocks.x * blocks.y * blocks.z, 1, [&](int block)
+		{
+			const int3 first = int3(block % blocks.x, block / blocks.x % blocks.y, block / (blocks.x * blocks.y)) * c_BrickSize;
+			float distances[c_BrickSamples];
+			field(m_Origin + (float3(first) + 0.5f) * cellSize, cellSize, c_BrickSize, distances);
+
+			for (int z = 0; z < c_BrickSize; z++)
+			{
+				for (int y = 0; y < c_BrickSize; y++)
+				{
+					for (int x = 0; x < c_BrickSize; x++)
+					{
+						const int3 cell = first + int3(x, y, z);
+						if (all(cell < m_GridSize))
+							m_CellDistances[GetCellIndex(cell)] = distances[(z * c_BrickSize + y) * c_BrickSize + x];
+					}
+				}
+			}
+		}, 1);
+		executor.run(centers).wait();
+
+		// The field changes by at most the distance moved, so no point of a cell is closer to the surface
+		// than |d(center)| - halfDiagonal. Only the cells where that can be within the band need a brick.
+		m_Indirection.assign(cellCount, c_EmptyCell);
+		std::vector<int3> brickCells;
+		for (int z = 0; z < m_GridSize.z; z++)
+		{
+			for (int y = 0; y < m_GridSize.y; y++)
+			{
+				for (int x = 0; x < m_GridSize.x; x++)
+				{
+					size_t index = GetCellIndex(int3(x, y, z));
+					float d = m_CellDistances[index];
+					if (std::fabs(d) <= halfDiagonal + desc.band)
+					{
+						m_Indirection[index] = uint32_t(brickCells.size());
+						brickCells.push_back(int3(x, y, z));
+					}
+					else
+					{
+						m_CellDistances[index] = d > 0.f ? d - halfDiagonal : d + halfDiagonal;
+					}
+				}
+			}
+		}
+
+		m_BrickCount = uint32_t(brickCells.size());
+		m_Samples.assign(size_t(m_BrickCount) * c_BrickSamples * size_t(m_Bits / 8), 0);
+
+		tf::Taskflow bricks;
+		bricks.for_each_index_dynamic(0u, m_BrickCount, 1u, [&](uint32_t brick)
+		{
+			const float3 cellMin = m_Origin + float3(brickCells[brick]) * cellSize;
+			float distances[c_BrickSamples];
+			field(cellMin, m_VoxelSize, c_BrickSize, distances);
+
+			const size_t first = size_t(brick) * c_BrickSamples;
+			for (size_t i = 0; i < c_BrickSamples; i++)
+				StoreSample(first + i, distances[i]);
+		}, 16u);
+		executor.run(bricks).wait();
+
+		return true;
+	}
+
+	void BrickMap::StoreSample(size_t index, float distance)
+	{
+		float normalized = clamp(distance / m_Range, -1.0f, 1.0f);
+		if (m_Bits == 8)
+		{
+			int8_t q = int8_t(std::lround(normalized * 127.0f));
+			std::memcpy(&m_Samples[index], &q, sizeof(q));
+		}
+		else
+		{
+			int16_t q = int16_t(std::lround(normalized * 32767.0f));
+			std::memcpy(&m_Samples[index * 2], &q, sizeof(q));
+		}
+	}
+
+	float BrickMap::LoadSample(size_t index) const
+	{
+		if (m_Bits == 8)
+		{
+			int8_t q;
+			std::memcpy(&q, &m_Samples[index], sizeof(q));
+			return float(q) * (m_Range / 127.0f);
+		}
+
+		int16_t q;
+		std::memcpy(&q, &m_Samples[index * 2], sizeof(q));
+		return float(q) * (m_Range / 32767.0f);
+	}
+
+	float BrickMap::Sample(const float3& pos) const
+	{
+		if (Empty())
+			return 1e10f;
+
+		const box3 bounds = GetBounds();
+		const float3 p = bounds.clamp(pos);
+		const float outside = length(pos - p);
+
+		const float3 voxel = (p - m_Origin) / m_VoxelSize;
+		const int3 cell = clamp(FloorToInt(voxel / float(c_CellVoxels)), int3(0), m_GridSize - 1);
+		const size_t cellIndex = GetCellIndex(cell);
+		const uint32_t brick = m_Indirection[cellIndex];
+		if (brick == c_EmptyCell)
+			return m_CellDistances[cellIndex] + outside;
+
+		const float3 f = voxel - float3(cell * c_CellVoxels);
+		const int3 i = clamp(FloorToInt(f), int3(0), int3(c_BrickSize - 2));
+		const float3 t = saturate(f - float3(i));
+
+		const size_t base = size_t(brick) * c_BrickSamples + (size_t(i.z) * c_BrickSize + size_t(i.y)) * c_BrickSize + size_t(i.x);
+		const size_t dy = c_BrickSize;
+		const size_t dz = size_t(c_BrickSize) * c_BrickSize;
+
+		float c00 = lerp(LoadSample(base), LoadSample(base + 1), t.x);
+		float c10 = lerp(LoadSample(base + dy), LoadSample(base + dy + 1), t.x);
+		float c01 = lerp(LoadSample(base + dz), LoadSample(base + dz + 1), t.x);
+		float c11 = lerp(LoadSample(base + dz + dy), LoadSample(base + dz + dy + 1), t.x);
+		float d = lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z);
+
+		return d + outside;
+	}
+
+	box3 BrickMap::GetBounds() const
+	{
+		return box3(m_Origin, m_Origin + float3(m_GridSize) * (m_VoxelSize * float(c_CellVoxels)));
+	}
+
+	size_t BrickMap::GetMemorySize() const
+	{
+		return m_Indirection.size() * sizeof(uint32_t) + m_CellDistances.size() * sizeof(float) + m_Samples.size();
+	}
+
+	bool BrickMap::Save(const std::filesystem::path& fileName) const
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		BrickMapFileHeader header;
+		header.bits = uint32_t(m_Bits);
+		header.brickSize = c_BrickSize;
+		header.gridSize[0] = m_GridSize.x;
+		header.gridSize[1] = m_GridSize.y;
+		header.gridSize[2] = m_GridSize.z;
+		header.brickCount = m_BrickCount;
+		header.origin[0] = m_Origin.x;
+		header.origin[1] = m_Origin.y;
+		header.origin[2] = m_Origin.z;
+		header.voxelSize = m_VoxelSize;
+		header.range = m_Range;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(m_Indirection.data()), m_Indirection.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(m_CellDistances.data()), m_CellDistances.size() * sizeof(float));
+		file.write(reinterpret_cast<const char*>(m_Samples.data()), m_Samples.size());
+
+		return file.good();
+	}
+
+	bool BrickMap::Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+	{
+		std::shared_ptr<vfs::IBlob> data = fs.readFile(fileName);
+		if (!data)
+		{
+			log::error("Couldn't read file %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		BrickMapFileHeader header;
+		if (data->size() < sizeof(header))
+		{
+			log::error("%s is not an SDF brick map file", fileName.generic_string().c_str());
+			return false;
+		}
+
+		std::memcpy(&header, data->data(), sizeof(header));
+		if (header.magic != BrickMapFileHeader::c_Magic || header.version != BrickMapFileHeader::c_Version)
+		{
+			log::error("%s is not an SDF brick map file of version %u", fileName.generic_string().c_str(), BrickMapFileHeader::c_Version);
+			return false;
+		}
+
+		const bool validHeader = (header.bits == 8 || header.bits == 16) && header.brickSize == c_BrickSize
+			&& header.gridSize[0] > 0 && header.gridSize[1] > 0 && header.gridSize[2] > 0 && header.voxelSize > 0.f && header.range > 0.f;
+		const size_t cellCount = validHeader ? size_t(header.gridSize[0]) * size_t(header.gridSize[1]) * size_t(header.gridSize[2]) : 0;
+		const size_t sampleBytes = size_t(header.brickCount) * c_BrickSamples * (header.bits / 8);
+		const size_t expectedSize = sizeof(header) + cellCount * (sizeof(uint32_t) + sizeof(float)) + sampleBytes;
+		if (!validHeader || data->size() < expectedSize)
+		{
+			log::error("SDF brick map file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(data->data()) + sizeof(header);
+		std::vector<uint32_t> indirection(cellCount);
+		std::memcpy(indirection.data(), bytes, cellCount * sizeof(uint32_t));
+		bytes += cellCount * sizeof(uint32_t);
+
+		for (uint32_t brick : indirection)
+		{
+			if (brick != c_EmptyCell && brick >= header.brickCount)
+			{
+				log::error("SDF brick map file %s is corrupt", fileName.generic_string().c_str());
+				return false;
+			}
+		}
+
+		m_Indirection = std::move(indirection);
+		m_CellDistances.resize(cellCount);
+		std::memcpy(m_CellDistances.data(), bytes, cellCount * sizeof(float));
+		bytes += cellCount * sizeof(float);
+		m_Samples.assign(bytes, bytes + sampleBytes);
+
+		m_Bits = int(header.bits);
+		m_GridSize = int3(header.gridSize[0], header.gridSize[1], header.gridSize[2]);
+		m_BrickCount = header.brickCount;
+		m_Origin = float3(header.origin[0], header.origin[1], header.origin[2]);
+		m_VoxelSize = header.voxelSize;
+		m_Range = header.range;
+
+		return true;
+	}
+}
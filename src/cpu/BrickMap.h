@@ -0,0 +1,114 @@
+#pragma once
+
+// Baked sparse brick map of the distance field.
+//
+// The baked region is divided into cells of c_BrickSize - 1 voxels. Every cell that the surface may
+// come within the narrow band of gets a brick of c_BrickSize^3 distance samples on its voxel corners.
+// Neighbouring bricks repeat their shared border, so trilinear filtering always reads a single brick.
+// A coarse indirection grid maps cells to bricks; the other cells only keep a conservative distance,
+// enough to sphere trace across them. Samples are quantized to 8 or 16 bits over [-range, range].
+//
+// A lookup costs the same however deep the CSG tree behind it is, which makes baking worthwhile for
+// the static parts of a scene.
+
+#include "Renderer.h"
+
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	struct BrickMapDesc
+	{
+		box3 bounds = box3(float3(-2.5f, -0.5f, -2.5f), float3(2.5f, 2.0f, 2.5f));
+		float voxelSize = 0.02f;
+		float band = 0.1f;      // distance from the surface that must still be filtered from bricks
+		int bits = 8;           // 8 or 16
+	};
+
+	// Binary brick map file: the header, the indirection grid (uint32 per cell, x fastest), the cell
+	// distances (float per cell) and the bricks (c_BrickSize^3 samples of bits / 8 bytes each), little endian.
+	struct BrickMapFileHeader
+	{
+		static constexpr uint32_t c_Magic = 0x42464453; // "SDFB"
+		static constexpr uint32_t c_Version = 1;
+
+		uint32_t magic = c_Magic;
+		uint32_t version = c_Version;
+		uint32_t bits = 0;
+		uint32_t brickSize = 0;
+		int32_t gridSize[3] = {};
+		uint32_t brickCount = 0;
+		float origin[3] = {};
+		float voxelSize = 0.f;
+		float range = 0.f;
+	};
+
+	// Writes the distances of a block of count^3 points, origin + int3(x, y, z) * step, to
+	// distances[(z * count + y) * count + x]. The field must not change faster than the distance
+	// moved, like an exact distance does.
+	using BrickMapField = std::function<void(const float3& origin, float step, int count, float* distances)>;
+
+	class BrickMap
+	{
+	public:
+		static constexpr int c_BrickSize = 8;
+		static constexpr uint32_t c_EmptyCell = ~0u;
+
+		// Samples map at time map.time on the executor's workers. Fails on an empty region or bits other than 8 and 16.
+		bool Bake(tf::Executor& executor, const SceneMap& map, const BrickMapDesc& desc);
+		// Same for any other field, called from the executor's workers.
+		bool Bake(tf::Executor& executor, const BrickMapField& field, const BrickMapDesc& desc);
+
+		bool Save(const std::filesystem::path& fileName) const;
+		bool Load(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName);
+
+		// Trilinearly filtered distance inside the bricks, the cell's conservative distance elsewhere.
+		// Points outside the baked region add their distance to it.
+		float Sample(const float3& pos) const;
+
+		bool Empty() const { return m_Indirection.empty(); }
+		int3 GetGridSize() const { return m_GridSize; }
+		uint32_t GetCellCount() const { return uint32_t(m_Indirection.size()); }
+		uint32_t GetBrickCount() const { return m_BrickCount; }
+		int GetBits() const { return m_Bits; }
+		float GetVoxelSize() const { return m_VoxelSize; }
+		float GetRange() const { return m_Range; }
+		box3 GetBounds() const;
+		// Bytes of the indirection grid, the cell distances and the bricks.
+		size_t GetMemorySize() const;
+
+		// Brick of a cell or c_EmptyCell, for cells in [0, GetGridSize()).
+		uint32_t GetBrick(const int3& cell) const { return m_Indirection[GetCellIndex(cell)]; }
+
+	private:
+		size_t GetCellIndex(const int3& cell) const
+		{
+			return (size_t(cell.z) * size_t(m_GridSize.y) + size_t(cell.y)) * size_t(m_GridSize.x) + size_t(cell.x);
+		}
+
+		void StoreSample(size_t index, float distance);
+		float LoadSample(size_t index) const;
+
+		float3 m_Origin = float3(0.f);
+		int3 m_GridSize = int3(0);
+		float m_VoxelSize = 0.f;
+		float m_Range = 0.f;
+		int m_Bits = 8;
+		uint32_t m_BrickCount = 0;
+		std::vector<uint32_t> m_Indirection;
+		std::vector<float> m_CellDistances;
+		std::vector<uint8_t> m_Samples;
+	};
+}
@@ -0,0 +1,412 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace sdf
+{
+	namespace
+	{
+		const float c_Infinity = std::numeric_limits<float>::infinity();
+
+		float Volume(const box3& box)
+		{
+			if (!IsFinite(box))
+				return c_Infinity;
+			float3 d = max(box.diagonal(), float3(0.f));
+			return d.x * d.y * d.z;
+		}
+
+		box3 PrimitiveBounds(const TapeInstruction& ins)
+		{
+			const float* a = ins.params;
+			float3 c(a[0], a[1], a[2]);
+			float3 e;
+
+			switch (GetOpcode(ins))
+			{
+			case SDF_OP_SPHERE:
+			case SDF_OP_OCTAHEDRON:
+				e = float3(a[3]);
+				break;
+			case SDF_OP_BOX:
+			case SDF_OP_BOX_FRAME:
+				e = float3(a[3], a[4], a[5]);
+				break;
+			case SDF_OP_TORUS:
+				e = float3(a[3] + a[4], a[4], a[3] + a[4]);
+				break;
+			case SDF_OP_CYLINDER:
+				switch (GetFlags(ins))
+				{
+				case 0: e = float3(a[3], a[3], a[4]); break;
+				case 1: e = float3(a[4], a[3], a[3]); break;
+				default: e = float3(a[3], a[4], a[3]); break;
+				}
+				break;
+			default:
+				return box3(float3(-c_Infinity), float3(c_Infinity));
+			}
+
+			return box3(c - abs(e), c + abs(e));
+		}
+
+		// The field of every operator is bounded below by one of the operands or their minimum,
+		// so the bounds follow the operand that provides that bound.
+		box3 BinaryBounds(const TapeInstruction& ins, const box3& a, const box3& b)
+		{
+			switch (GetOpcode(ins))
+			{
+			case SDF_OP_UNION:
+				return a | b;
+			case SDF_OP_SMOOTH_UNION:
+				// The smooth minimum undershoots min() by at most k/4.
+				return (a | b).grow(0.25f * std::abs(ins.params[0]));
+			case SDF_OP_INTERSECTION:
+			case SDF_OP_SMOOTH_INTERSECTION:
+				// max(a, b) is not bounded by the distance to the intersection of the boxes, only by either box.
+				return Volume(a) <= Volume(b) ? a : b;
+			default:
+				return a;
+			}
+		}
+
+		box3 UnaryBounds(const TapeInstruction& ins, const box3& d)
+		{
+			// round subtracts the thickness, displace and noise add at most the amplitude.
+			return d.grow(std::abs(ins.params[0]));
+		}
+
+		// Union of the child's bounds over all instances.
+		box3 DomainBounds(const TapeInstruction& ins, const box3& child)
+		{
+			const float* a = ins.params;
+			if (GetOpcode(ins) == SDF_OP_REPEAT_POLAR)
+			{
+				// Every rotation about the axis, as far out as the farthest corner.
+				float radius = 0.f;
+				for (int corner = 0; corner < 4; corner++)
+				{
+					float2 xz((corner & 1) ? child.m_maxs.x : child.m_mins.x, (corner & 2) ? child.m_maxs.z : child.m_mins.z);
+					radius = std::max(radius, length(xz));
+				}
+				return box3(float3(a[0] - radius, a[1] + child.m_mins.y, a[2] - radius),
+					float3(a[0] + radius, a[1] + child.m_maxs.y, a[2] + radius));
+			}
+
+			box3 bounds = child;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (!(a[axis] > 0.f))
+					continue;
+
+				if (GetFlags(ins) & SDF_REPEAT_MIRROR)
+				{
+					bounds.m_mins[axis] = std::min(child.m_mins[axis], -child.m_maxs[axis]);
+					bounds.m_maxs[axis] = std::max(child.m_maxs[axis], -child.m_mins[axis]);
+				}
+
+				float reach = GetOpcode(ins) == SDF_OP_REPEAT_LIMITED ? a[3 + axis] * a[axis] : c_Infinity;
+				bounds.m_mins[axis] -= reach;
+				bounds.m_maxs[axis] += reach;
+			}
+			return bounds;
+		}
+
+		box3 ComputeBounds(const TapeInstruction* code, uint32_t count)
+		{
+			box3 stack[SDF_TAPE_MAX_STACK];
+			int sp = 0;
+			uint32_t domains[SDF_TAPE_MAX_DOMAIN];
+			int dp = 0;
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const TapeInstruction& ins = code[i];
+				uint32_t opcode = GetOpcode(ins);
+
+				if (opcode < SDF_OP_FIRST_BINARY)
+				{
+					stack[sp++] = PrimitiveBounds(ins);
+				}
+				else if (opcode < SDF_OP_FIRST_UNARY)
+				{
+					sp--;
+					stack[sp - 1] = BinaryBounds(ins, stack[sp - 1], stack[sp]);
+				}
+				else if (opcode < SDF_OP_FIRST_DOMAIN)
+				{
+					stack[sp - 1] = UnaryBounds(ins, stack[sp - 1]);
+				}
+				else if (opcode != SDF_OP_DOMAIN_END)
+				{
+					domains[dp++] = i;
+				}
+				else
+				{
+					stack[sp - 1] = DomainBounds(code[domains[--dp]], stack[sp - 1]);
+				}
+			}
+
+			return sp > 0 ? stack[0] : box3::empty();
+		}
+	}
+
+	bool SceneBvh::Build(const Tape& tape)
+	{
+		m_Instructions.clear();
+		m_InstructionObject.clear();
+		m_Objects.clear();
+		m_Nodes.clear();
+		m_Parents.clear();
+		m_DirtyObjects.clear();
+		m_GlobalDirty = false;
+		m_SourceToInstruction.assign(tape.Size(), c_InvalidIndex);
+		m_GlobalInstructionCount = 0;
+		m_MaxStackDepth = 0;
+
+		if (tape.Empty())
+			return true;
+
+		// First instruction of the subtree that ends at every instruction. Domain operators start the
+		// subtree that their SDF_OP_DOMAIN_END closes.
+		const std::vector<TapeInstruction>& code = tape.instructions;
+		std::vector<uint32_t> subtreeStart(code.size());
+		{
+			uint32_t stack[SDF_TAPE_MAX_STACK];
+			int sp = 0;
+			// Open domain operators and the stack depth at each of them.
+			std::pair<uint32_t, int> domains[SDF_TAPE_MAX_DOMAIN];
+			int dp = 0;
+			for (uint32_t i = 0; i < uint32_t(code.size()); i++)
+			{
+				uint32_t opcode = GetOpcode(code[i]);
+				if (opcode < SDF_OP_FIRST_BINARY)
+				{
+					if (sp >= SDF_TAPE_MAX_STACK)
+						return false;
+					stack[sp++] = i;
+				}
+				else if (opcode < SDF_OP_FIRST_UNARY)
+				{
+					if (sp < 2 || (dp > 0 && sp - 2 < domains[dp - 1].second))
+						return false;
+					sp--;
+				}
+				else if (opcode < SDF_OP_FIRST_DOMAIN)
+				{
+					if (sp < 1)
+						return false;
+				}
+				else if (opcode != SDF_OP_DOMAIN_END)
+				{
+					if (dp >= SDF_TAPE_MAX_DOMAIN)
+						return false;
+					domains[dp++] = { i, sp };
+					subtreeStart[i] = i;
+					continue;
+				}
+				else
+				{
+					// The repeated subtree leaves exactly one entry.
+					if (dp < 1 || sp != domains[dp - 1].second + 1)
+						return false;
+					stack[sp - 1] = domains[--dp].first;
+				}
+
+				subtreeStart[i] = stack[sp - 1];
+			}
+
+			if (sp != 1 || dp != 0)
+				return false;
+		}
+
+		// Split the tape at the top-level unions, the ranges are [first, last].
+		std::vector<std::pair<uint32_t, uint32_t>> ranges;
+		std::vector<std::pair<uint32_t, uint32_t>> pending = { { 0u, uint32_t(code.size()) - 1 } };
+		while (!pending.empty())
+		{
+			auto [first, last] = pending.back();
+			pending.pop_back();
+
+			if (GetOpcode(code[last]) == SDF_OP_UNION)
+			{
+				uint32_t rightFirst = subtreeStart[last - 1];
+				pending.push_back({ first, rightFirst - 1 });
+				pending.push_back({ rightFirst, last - 1 });
+			}
+			else
+				ranges.push_back({ first, last });
+		}
+		std::sort(ranges.begin(), ranges.end());
+
+		// Copies the source range and returns the stack depth it needs.
+		auto append = [&](uint32_t first, uint32_t last, int object)
+		{
+			uint32_t depth = 0;
+			uint32_t maxDepth = 0;
+			for (uint32_t i = first; i <= last; i++)
+			{
+				uint32_t opcode = GetOpcode(code[i]);
+				if (opcode < SDF_OP_FIRST_BINARY)
+					maxDepth = std::max(maxDepth, ++depth);
+				else if (opcode < SDF_OP_FIRST_UNARY)
+					depth--;
+
+				m_SourceToInstruction[i] = uint32_t(m_Instructions.size());
+				m_Instructions.push_back(code[i]);
+				m_InstructionObject.push_back(object);
+			}
+			return maxDepth;
+		};
+
+		// Unbounded objects first, folded with unions into the global prefix.
+		std::vector<std::pair<uint32_t, uint32_t>> boundedRanges;
+		uint32_t globalObjects = 0;
+		for (const auto& [first, last] : ranges)
+		{
+			if (IsFinite(ComputeBounds(&code[first], last - first + 1)))
+			{
+				boundedRanges.push_back({ first, last });
+				continue;
+			}
+
+			m_MaxStackDepth = std::max(m_MaxStackDepth, append(first, last, -1) + (globalObjects > 0 ? 1 : 0));
+			if (globalObjects++ > 0)
+			{
+				TapeInstruction ins = {};
+				ins.code = MakeInstructionCode(SDF_OP_UNION, 0, 0);
+				m_Instructions.push_back(ins);
+				m_InstructionObject.push_back(-1);
+			}
+		}
+		m_GlobalInstructionCount = uint32_t(m_Instructions.size());
+
+		for (const auto& [first, last] : boundedRanges)
+		{
+			Object object;
+			object.first = uint32_t(m_Instructions.size());
+			object.count = last - first + 1;
+			m_MaxStackDepth = std::max(m_MaxStackDepth, append(first, last, int(m_Objects.size())));
+			object.bounds = ComputeBounds(&m_Instructions[object.first], object.count);
+			m_Objects.push_back(object);
+		}
+
+		if (!m_Objects.empty())
+		{
+			std::vector<uint32_t> order(m_Objects.size());
+			std::iota(order.begin(), order.end(), 0u);
+			m_Nodes.reserve(m_Objects.size() * 2 - 1);
+			m_Parents.reserve(m_Objects.size() * 2 - 1);
+			BuildNode(order.data(), uint32_t(order.size()), c_InvalidIndex);
+		}
+
+		return true;
+	}
+
+	uint32_t SceneBvh::BuildNode(uint32_t* objects, uint32_t count, uint32_t parent)
+	{
+		uint32_t index = uint32_t(m_Nodes.size());
+		m_Nodes.push_back(BvhNode());
+		m_Parents.push_back(parent);
+
+		box3 bounds = box3::empty();
+		box3 centers = box3::empty();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			bounds |= m_Objects[objects[i]].bounds;
+			centers |= m_Objects[objects[i]].bounds.center();
+		}
+
+		if (count == 1)
+		{
+			Object& object = m_Objects[objects[0]];
+			object.leaf = index;
+			m_Nodes[index].offset = object.first;
+			m_Nodes[index].count = object.count;
+		}
+		else
+		{
+			// Median split along the longest axis of the centers keeps the tree balanced,
+			// so its depth stays within SDF_BVH_MAX_STACK.
+			float3 extent = centers.diagonal();
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+			uint32_t half = count / 2;
+			std::nth_element(objects, objects + half, objects + count, [this, axis](uint32_t a, uint32_t b) {
+				return m_Objects[a].bounds.center()[axis] < m_Objects[b].bounds.center()[axis];
+			});
+
+			BuildNode(objects, half, index);
+			uint32_t right = BuildNode(objects + half, count - half, index);
+			m_Nodes[index].offset = right;
+			m_Nodes[index].count = 0;
+		}
+
+		m_Nodes[index].boundsMin = bounds.m_mins;
+		m_Nodes[index].boundsMax = bounds.m_maxs;
+		return index;
+	}
+
+	uint32_t SceneBvh::GetInstructionIndex(uint32_t sourceIndex) const
+	{
+		return sourceIndex < m_SourceToInstruction.size() ? m_SourceToInstruction[sourceIndex] : c_InvalidIndex;
+	}
+
+	void SceneBvh::SetParameters(uint32_t sourceIndex, const float params[7])
+	{
+		uint32_t index = GetInstructionIndex(sourceIndex);
+		if (index == c_InvalidIndex)
+			return;
+
+		std::memcpy(m_Instructions[index].params, params, sizeof(m_Instructions[index].params));
+
+		int object = m_InstructionObject[index];
+		if (object >= 0)
+			m_DirtyObjects.push_back(uint32_t(object));
+		else
+			m_GlobalDirty = true;
+	}
+
+	uint32_t SceneBvh::Refit(std::vector<box3>* changed)
+	{
+		uint32_t updated = 0;
+
+		if (changed && m_GlobalDirty)
+			changed->push_back(box3(float3(-c_Infinity), float3(c_Infinity)));
+		m_GlobalDirty = false;
+
+		for (uint32_t objectIndex : m_DirtyObjects)
+		{
+			Object& object = m_Objects[objectIndex];
+			const box3 previous = object.bounds;
+			object.bounds = ComputeBounds(&m_Instructions[object.first], object.count);
+			if (changed)
+				changed->push_back(previous | object.bounds);
+
+			uint32_t index = object.leaf;
+			box3 bounds = object.bounds;
+			while (index != c_InvalidIndex)
+			{
+				BvhNode& node = m_Nodes[index];
+				if (node.count == 0)
+					bounds = box3(m_Nodes[index + 1].boundsMin, m_Nodes[index + 1].boundsMax)
+						| box3(m_Nodes[node.offset].boundsMin, m_Nodes[node.offset].boundsMax);
+
+				// Ancestors of an unchanged node are already correct.
+				if (all(node.boundsMin == bounds.m_mins) && all(node.boundsMax == bounds.m_maxs))
+					break;
+
+				node.boundsMin = bounds.m_mins;
+				node.boundsMax = bounds.m_maxs;
+				updated++;
+				index = m_Parents[index];
+			}
+		}
+
+		m_DirtyObjects.clear();
+		return updated;
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+// Bounding volume hierarchy over the objects of a scene tape.
+//
+// The operands of the top-level unions are split into objects. Every object gets a box that the
+// field never undercuts: the object's distance is at least the signed distance to the box.
+// Objects without finite bounds (the floor plane) are folded into a global prefix that is always
+// evaluated; the rest go into a BVH, and a point only evaluates the objects whose boxes are closer
+// than the best distance found so far. The result is the same as the full tape, only the cost now
+// follows the local object density instead of the scene size. The one exception are repeated objects
+// (SDF_OP_REPEAT*): away from their surfaces the full tape clamps them to a bound of the instances it
+// skipped, which can be below the distance to their box, so the BVH may return the larger, still
+// conservative, box distance there.
+//
+// The node layout (BvhNode in sdf_cb.h) and the object tape are uploaded as they are and traversed
+// by mapBvh() in SDFTape.hlsli.
+
+#include "Tape.h"
+
+#include <vector>
+
+namespace sdf
+{
+	class SceneBvh
+	{
+	public:
+		static constexpr uint32_t c_InvalidIndex = ~0u;
+
+		bool Build(const Tape& tape);
+
+		// Global prefix followed by the instructions of every bounded object.
+		const std::vector<TapeInstruction>& GetInstructions() const { return m_Instructions; }
+		uint32_t GetGlobalInstructionCount() const { return m_GlobalInstructionCount; }
+		const std::vector<BvhNode>& GetNodes() const { return m_Nodes; }
+		uint32_t GetObjectCount() const { return uint32_t(m_Objects.size()); }
+		uint32_t GetMaxStackDepth() const { return m_MaxStackDepth; }
+
+		// Position of a source tape instruction in GetInstructions(), c_InvalidIndex for the top-level unions.
+		uint32_t GetInstructionIndex(uint32_t sourceIndex) const;
+
+		// Animation: replaces the parameters of a source tape instruction. The bounds of its object
+		// are updated by the next Refit().
+		void SetParameters(uint32_t sourceIndex, const float params[7]);
+
+		// Recomputes the bounds of the modified objects and their ancestors, returns the number of nodes updated.
+		// changed, when not null, receives the regions the surfaces may have moved within: the bounds of
+		// every modified object before and after, or an unbounded box when the global prefix was modified.
+		uint32_t Refit(std::vector<box3>* changed = nullptr);
+
+		bool IsDirty() const { return !m_DirtyObjects.empty() || m_GlobalDirty; }
+
+	private:
+		struct Object
+		{
+			uint32_t first = 0;
+			uint32_t count = 0;
+			uint32_t leaf = 0;
+			box3 bounds;
+		};
+
+		uint32_t BuildNode(uint32_t* objects, uint32_t count, uint32_t parent);
+
+		std::vector<TapeInstruction> m_Instructions;
+		std::vector<uint32_t> m_SourceToInstruction;
+		std::vector<int> m_InstructionObject;
+		uint32_t m_GlobalInstructionCount = 0;
+		uint32_t m_MaxStackDepth = 0;
+
+		std::vector<Object> m_Objects;
+		std::vector<BvhNode> m_Nodes;
+		std::vector<uint32_t> m_Parents;
+		std::vector<uint32_t> m_DirtyObjects;
+		bool m_GlobalDirty = false;
+	};
+
+	// Signed distance to a node's box. Inside an object the field is still at least the (negative)
+	// distance to the box boundary, so this bounds the field everywhere.
+	template<typename F> F BoxDistance(const Vec3<F>& pos, const BvhNode& node)
+	{
+		Vec3<F> c = Splat<F>(0.5f * (node.boundsMin.x + node.boundsMax.x), 0.5f * (node.boundsMin.y + node.boundsMax.y),
+			0.5f * (node.boundsMin.z + node.boundsMax.z));
+		Vec3<F> e = Splat<F>(0.5f * (node.boundsMax.x - node.boundsMin.x), 0.5f * (node.boundsMax.y - node.boundsMin.y),
+			0.5f * (node.boundsMax.z - node.boundsMin.z));
+		return sdBox(pos - c, e);
+	}
+
+	// Traversal of EvaluateBvh(), from res of the global prefix. evaluateLeaf(node) returns map() of a leaf's instructions.
+	template<typename F, typename EvaluateLeaf> Vec2<F> TraverseBvh(const SceneBvh& bvh, const Vec3<F>& pos, Vec2<F> res,
+		const EvaluateLeaf& evaluateLeaf)
+	{
+		const BvhNode* nodes = bvh.GetNodes().data();
+		if (bvh.GetNodes().empty())
+			return res;
+
+		uint32_t stack[SDF_BVH_MAX_STACK];
+		int sp = 0;
+		uint32_t index = 0;
+
+		for (;;)
+		{
+			const BvhNode& node = nodes[index];
+			if (any(BoxDistance(pos, node) < res.x))
+			{
+				if (node.count > 0)
+				{
+					res = opU(res, evaluateLeaf(node));
+				}
+				else
+				{
+					// Nearer child first, so the far one is more likely to be culled when it is popped.
+					uint32_t left = index + 1;
+					uint32_t right = node.offset;
+					bool leftFirst = lane(BoxDistance(pos, nodes[left]), 0) <= lane(BoxDistance(pos, nodes[right]), 0);
+					stack[sp++] = leftFirst ? right : left;
+					index = leftFirst ? left : right;
+					continue;
+				}
+			}
+
+			if (sp == 0)
+				break;
+			index = stack[--sp];
+		}
+
+		return res;
+	}
+
+	// CPU version of mapBvh(). A packet descends into a node when any of its lanes can still improve.
+	template<typename F> Vec2<F> EvaluateBvh(const SceneBvh& bvh, const Vec3<F>& pos, float time)
+	{
+		const TapeInstruction* code = bvh.GetInstructions().data();
+		return TraverseBvh(bvh, pos, EvaluateTape(code, bvh.GetGlobalInstructionCount(), pos, time),
+			[&](const BvhNode& leaf) { return EvaluateTape(code + leaf.offset, leaf.count, pos, time); });
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// CPU port of the camera of getCamera() in SDF.hlsli: the orbit, or the keyframed camera of g_Camera.
+
+#include "ShaderTypes.h"
+
+namespace sdf
+{
+	struct Camera
+	{
+		float3 origin;      // ro
+		float3 right;       // uu
+		float3 up;          // vv
+		float3 forward;     // ww
+		float focalLength = 1.5f;
+
+		static Camera LookAt(const float3& origin, const float3& target, float focalLength = 1.5f)
+		{
+			Camera camera;
+			camera.origin = origin;
+			camera.forward = normalize(target - origin);
+			camera.right = normalize(cross(camera.forward, float3(0.f, 1.f, 0.f)));
+			camera.up = normalize(cross(camera.right, camera.forward));
+			camera.focalLength = focalLength;
+			return camera;
+		}
+
+		// Same animation as the shader: the camera circles the origin at radius 4.
+		static Camera Orbit(float time)
+		{
+			float an = 0.5f * (time - 10.0f);
+			return LookAt(float3(4.0f * std::cos(an), 0.4f, 4.0f * std::sin(an)), float3(0.f));
+		}
+
+		// The keyframed camera when camera.w is set, the orbit at the time otherwise.
+		static Camera FromConstants(const float4& camera, const float4& target, float time)
+		{
+			return camera.w != 0.f ? LookAt(camera.xyz(), target.xyz()) : Orbit(time);
+		}
+
+		// Camera of the frame, like getCamera().
+		static Camera Current(const RenderConstants& constants)
+		{
+			return FromConstants(constants.g_Camera, constants.g_CameraTarget, constants.g_Time.x);
+		}
+
+		// Camera of the frame of g_Temporal, like getPreviousCamera().
+		static Camera Previous(const RenderConstants& constants)
+		{
+			return FromConstants(constants.g_PrevCamera, constants.g_PrevCameraTarget, constants.g_Temporal.y);
+		}
+
+		// Converts a pixel position (origin at the top-left corner, y down) to the shader's
+		// fragCoord (origin at the bottom-left) and then to the normalized screen point p.
+		static float2 ScreenPoint(const float2& pixel, const float2& resolution)
+		{
+			float2 fragCoord = float2(pixel.x, resolution.y - pixel.y);
+			return (2.0f * fragCoord - resolution) / resolution.y;
+		}
+
+		float3 RayDirection(const float2& p) const
+		{
+			return normalize(p.x * right + p.y * up + focalLength * forward);
+		}
+
+		float3 PixelRay(const float2& pixel, const float2& resolution) const
+		{
+			return RayDirection(ScreenPoint(pixel, resolution));
+		}
+
+		// Inverse of PixelRay(): the pixel position whose ray passes through p. False behind the camera.
+		bool Project(const float3& p, const float2& resolution, float2& pixel) const
+		{
+			float3 d = p - origin;
+			float z = dot(d, forward);
+			if (z <= 0.f)
+				return false;
+
+			float2 screen = focalLength * float2(dot(d, right), dot(d, up)) / z;
+			float2 fragCoord = 0.5f * (screen * resolution.y + resolution);
+			pixel = float2(fragCoord.x, resolution.y - fragCoord.y);
+			return true;
+		}
+	};
+}
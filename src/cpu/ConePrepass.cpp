@@ -0,0 +1,121 @@
+#include "ConePrepass.h"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sdf
+{
+	int4 GetConeConstants(int tileSize, int width)
+	{
+		if (tileSize <= 0)
+			return int4(0);
+		return int4(tileSize, (width + tileSize - 1) / tileSize, 0, 0);
+	}
+
+	int2 GetConeTileCount(const RenderConstants& constants)
+	{
+		if (constants.g_Cone.x <= 0)
+			return int2(0);
+		return int2(constants.g_Cone.y, (int(constants.g_Resolution.y) + constants.g_Cone.x - 1) / constants.g_Cone.x);
+	}
+
+	float ConeMarch(const SceneMap& map, const float3& ro, const float3& axis, float sinAngle, float cosAngle,
+		int maxSteps, int* steps, float tmin)
+	{
+		// Every ray of the cone is empty up to t. The sphere of radius d around the axis point at t
+		// covers each of them up to t * cos(angle) + sqrt(d^2 - r^2), least far on the cone's boundary.
+		float t = tmin;
+		int i = 0;
+		for (; i < maxSteps && t < SDF_RAY_END; i++)
+		{
+			float d = map(ro + axis * t).x;
+			float r = t * sinAngle;
+			if (d <= r)
+			{
+				i++;
+				break;
+			}
+
+			float next = t * cosAngle + std::sqrt(d * d - r * r);
+			if (next <= t)
+			{
+				i++;
+				break;
+			}
+			t = next;
+		}
+
+		if (steps)
+			*steps = i;
+
+		return std::min(t, SDF_RAY_END);
+	}
+
+	float ConeMarchPixels(const SceneMap& map, const Camera& camera, const float2& resolution, const float2& pixelMin,
+		const float2& pixelMax, int maxSteps, int* steps, float tmin)
+	{
+		float3 axis = camera.PixelRay(0.5f * (pixelMin + pixelMax), resolution);
+
+		// The rays through a rectangle of the image plane stay inside the cone through its corners.
+		float cosAngle = 1.0f;
+		cosAngle = std::min(cosAngle, dot(axis, camera.PixelRay(float2(pixelMin.x, pixelMin.y), resolution)));
+		cosAngle = std::min(cosAngle, dot(axis, camera.PixelRay(float2(pixelMax.x, pixelMin.y), resolution)));
+		cosAngle = std::min(cosAngle, dot(axis, camera.PixelRay(float2(pixelMin.x, pixelMax.y), resolution)));
+		cosAngle = std::min(cosAngle, dot(axis, camera.PixelRay(float2(pixelMax.x, pixelMax.y), resolution)));
+		float sinAngle = std::sqrt(saturate(1.0f - cosAngle * cosAngle));
+
+		return ConeMarch(map, camera.origin, axis, sinAngle, cosAngle, maxSteps, steps, tmin);
+	}
+
+	void RenderConePrepass(tf::Executor& executor, const RenderConstants& constants, const SceneMap& map,
+		std::vector<float>& depth, RenderStats* stats)
+	{
+		const int2 tileCount = GetConeTileCount(constants);
+		const int tileSize = constants.g_Cone.x;
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		depth.assign(size_t(tileCount.x) * size_t(tileCount.y), SDF_RAY_START);
+		if (depth.empty())
+			return;
+
+		const Camera camera = Camera::Current(constants);
+		const int maxSteps = int(constants.g_Factor.x);
+		std::vector<RenderStats> rowStats(tileCount.y);
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0, tileCount.y, 1, [&](int ty)
+		{
+			for (int tx = 0; tx < tileCount.x; tx++)
+			{
+				// Pixel edges rather than centers, so the cone holds the rays of the outermost pixels.
+				float2 pixelMin = float2(float(tx * tileSize), float(ty * tileSize));
+				float2 pixelMax = min(pixelMin + float(tileSize), resolution);
+
+				int steps = 0;
+				depth[size_t(ty) * tileCount.x + tx] = ConeMarchPixels(map, camera, resolution, pixelMin, pixelMax, maxSteps, &steps);
+
+				rowStats[ty].prepassRays++;
+				rowStats[ty].prepassSteps += uint64_t(steps);
+			}
+		}, 1);
+
+		executor.run(taskflow).wait();
+
+		if (stats)
+		{
+			for (const RenderStats& row : rowStats)
+				*stats += row;
+		}
+	}
+
+	float GetConeStart(const RenderConstants& constants, const std::vector<float>& depth, const float2& pixel)
+	{
+		if (constants.g_Cone.x <= 0 || depth.empty())
+			return SDF_RAY_START;
+
+		int tx = int(pixel.x) / constants.g_Cone.x;
+		int ty = int(pixel.y) / constants.g_Cone.x;
+		return depth[size_t(ty) * constants.g_Cone.y + tx];
+	}
+}
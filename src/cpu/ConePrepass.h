@@ -0,0 +1,44 @@
+#pragma once
+
+// CPU port of the cone prepass in sdf_cone_cs.hlsl.
+//
+// Most of a primary ray's steps are spent crossing the empty space in front of the camera, and the
+// neighbouring rays of a tile cross the same space. One cone per tile, wide enough to hold all of the
+// tile's rays, is sphere traced until the scene gets closer than the cone's radius; every ray of the
+// tile then starts there instead of at SDF_RAY_START (Amanatides, "Ray Tracing with Cones", 1984).
+// The layout of the per-tile distances is described next to RenderConstants::g_Cone in sdf_cb.h.
+
+#include "Renderer.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// g_Cone for tiles of tileSize pixels on an image of the given width; 0 disables the prepass.
+	int4 GetConeConstants(int tileSize, int width);
+
+	// Number of tiles of the prepass on the image, 0 when it is disabled.
+	int2 GetConeTileCount(const RenderConstants& constants);
+
+	// Marches the cone with apex ro around the unit vector axis and returns the ray distance up to
+	// which every ray within the half angle is known to be empty. steps receives the map() calls.
+	// The march starts at tmin, up to which the rays must already be known to be empty.
+	float ConeMarch(const SceneMap& map, const float3& ro, const float3& axis, float sinAngle, float cosAngle,
+		int maxSteps, int* steps = nullptr, float tmin = SDF_RAY_START);
+
+	// ConeMarch() of the narrowest cone around the rays through the pixels between the edges pixelMin and pixelMax.
+	float ConeMarchPixels(const SceneMap& map, const Camera& camera, const float2& resolution, const float2& pixelMin,
+		const float2& pixelMax, int maxSteps, int* steps = nullptr, float tmin = SDF_RAY_START);
+
+	// Start distances of all tiles, the contents of g_ConeDepth. The stats pointer may be null.
+	void RenderConePrepass(tf::Executor& executor, const RenderConstants& constants, const SceneMap& map,
+		std::vector<float>& depth, RenderStats* stats = nullptr);
+
+	// Start distance for a pixel, (0, 0) being the top-left corner of the image like in RenderPixel().
+	float GetConeStart(const RenderConstants& constants, const std::vector<float>& depth, const float2& pixel);
+}
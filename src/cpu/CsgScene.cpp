@@ -0,0 +1,449 @@
+#include "CsgScene.h"
+
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/KeyframeAnimation.h>
+#include <json/value.h>
+
+#include <cmath>
+#include <cstring>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		struct OpcodeInfo
+		{
+			const char* name;
+			uint32_t opcode;
+		};
+
+		const OpcodeInfo c_Opcodes[] = {
+			{ "plane", SDF_OP_PLANE },
+			{ "sphere", SDF_OP_SPHERE },
+			{ "box", SDF_OP_BOX },
+			{ "boxFrame", SDF_OP_BOX_FRAME },
+			{ "torus", SDF_OP_TORUS },
+			{ "cylinder", SDF_OP_CYLINDER },
+			{ "octahedron", SDF_OP_OCTAHEDRON },
+			{ "union", SDF_OP_UNION },
+			{ "subtraction", SDF_OP_SUBTRACTION },
+			{ "intersection", SDF_OP_INTERSECTION },
+			{ "smoothUnion", SDF_OP_SMOOTH_UNION },
+			{ "smoothSubtraction", SDF_OP_SMOOTH_SUBTRACTION },
+			{ "smoothIntersection", SDF_OP_SMOOTH_INTERSECTION },
+			{ "round", SDF_OP_ROUND },
+			{ "displace", SDF_OP_DISPLACE },
+			{ "noise", SDF_OP_DISPLACE_NOISE },
+			{ "repeat", SDF_OP_REPEAT },
+			{ "repeatLimited", SDF_OP_REPEAT_LIMITED },
+			{ "repeatPolar", SDF_OP_REPEAT_POLAR },
+		};
+
+		// Parameters that can be animated, by opcode.
+		struct ParameterInfo
+		{
+			uint32_t opcode;
+			const char* name;
+			uint32_t param;
+			uint32_t components;
+		};
+
+		const ParameterInfo c_Parameters[] = {
+			{ SDF_OP_PLANE, "offset", 3, 1 },
+			{ SDF_OP_SPHERE, "position", 0, 3 },
+			{ SDF_OP_SPHERE, "radius", 3, 1 },
+			{ SDF_OP_BOX, "position", 0, 3 },
+			{ SDF_OP_BOX, "size", 3, 3 },
+			{ SDF_OP_BOX_FRAME, "position", 0, 3 },
+			{ SDF_OP_BOX_FRAME, "size", 3, 3 },
+			{ SDF_OP_BOX_FRAME, "thickness", 6, 1 },
+			{ SDF_OP_TORUS, "position", 0, 3 },
+			{ SDF_OP_TORUS, "radii", 3, 2 },
+			{ SDF_OP_CYLINDER, "position", 0, 3 },
+			{ SDF_OP_CYLINDER, "radius", 3, 1 },
+			{ SDF_OP_CYLINDER, "height", 4, 1 },
+			{ SDF_OP_OCTAHEDRON, "position", 0, 3 },
+			{ SDF_OP_OCTAHEDRON, "size", 3, 1 },
+			{ SDF_OP_SMOOTH_UNION, "k", 0, 1 },
+			{ SDF_OP_SMOOTH_SUBTRACTION, "k", 0, 1 },
+			{ SDF_OP_SMOOTH_INTERSECTION, "k", 0, 1 },
+			{ SDF_OP_ROUND, "thickness", 0, 1 },
+			{ SDF_OP_DISPLACE, "amplitude", 0, 1 },
+			{ SDF_OP_DISPLACE_NOISE, "amplitude", 0, 1 },
+			{ SDF_OP_DISPLACE_NOISE, "frequency", 1, 1 },
+		};
+
+		// The camera's parameters, under a made-up opcode.
+		constexpr uint32_t c_CameraOpcode = ~0u;
+		const ParameterInfo c_CameraParameters[] = {
+			{ c_CameraOpcode, "position", 0, 3 },
+			{ c_CameraOpcode, "target", 3, 3 },
+		};
+
+		bool FindOpcode(const std::string& name, uint32_t& opcode)
+		{
+			for (const auto& info : c_Opcodes)
+			{
+				if (name == info.name)
+				{
+					opcode = info.opcode;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void SetFloat3(float* dest, const float3& value)
+		{
+			dest[0] = value.x;
+			dest[1] = value.y;
+			dest[2] = value.z;
+		}
+
+		// Reads the type-specific fields of a node into its parameter block, in the order the tape expects.
+		bool ReadParameters(const Json::Value& src, CsgNode& node)
+		{
+			float* p = node.params;
+			float3 position = json::Read<float3>(src["position"], float3(0.f));
+
+			switch (node.opcode)
+			{
+			case SDF_OP_PLANE:
+				SetFloat3(p, normalize(json::Read<float3>(src["normal"], float3(0.f, 1.f, 0.f))));
+				p[3] = json::Read<float>(src["offset"], 0.f);
+				break;
+			case SDF_OP_SPHERE:
+				SetFloat3(p, position);
+				p[3] = json::Read<float>(src["radius"], 0.5f);
+				break;
+			case SDF_OP_BOX:
+				SetFloat3(p, position);
+				SetFloat3(p + 3, json::Read<float3>(src["size"], float3(0.5f)));
+				break;
+			case SDF_OP_BOX_FRAME:
+				SetFloat3(p, position);
+				SetFloat3(p + 3, json::Read<float3>(src["size"], float3(0.5f)));
+				p[6] = json::Read<float>(src["thickness"], 0.05f);
+				break;
+			case SDF_OP_TORUS: {
+				float2 radii = json::Read<float2>(src["radii"], float2(0.5f, 0.1f));
+				SetFloat3(p, position);
+				p[3] = radii.x;
+				p[4] = radii.y;
+				break;
+			}
+			case SDF_OP_CYLINDER: {
+				std::string axis = json::Read<std::string>(src["axis"], "y");
+				if (axis == "z")
+					node.flags = 0;
+				else if (axis == "x")
+					node.flags = 1;
+				else if (axis == "y")
+					node.flags = 2;
+				else
+				{
+					log::error("Unknown cylinder axis '%s'", axis.c_str());
+					return false;
+				}
+				SetFloat3(p, position);
+				p[3] = json::Read<float>(src["radius"], 0.5f);
+				p[4] = json::Read<float>(src["height"], 0.5f);
+				break;
+			}
+			case SDF_OP_OCTAHEDRON:
+				SetFloat3(p, position);
+				p[3] = json::Read<float>(src["size"], 0.5f);
+				break;
+			case SDF_OP_SMOOTH_UNION:
+			case SDF_OP_SMOOTH_SUBTRACTION:
+			case SDF_OP_SMOOTH_INTERSECTION:
+				p[0] = json::Read<float>(src["k"], 0.25f);
+				if (p[0] <= 0.f)
+				{
+					log::error("Smooth operator needs a positive 'k'");
+					return false;
+				}
+				break;
+			case SDF_OP_ROUND:
+				p[0] = json::Read<float>(src["thickness"], 0.1f);
+				break;
+			case SDF_OP_DISPLACE:
+				p[0] = json::Read<float>(src["amplitude"], 0.2f);
+				p[1] = json::Read<float>(src["frequency"], 3.f);
+				break;
+			case SDF_OP_DISPLACE_NOISE: {
+				p[0] = json::Read<float>(src["amplitude"], 0.05f);
+				p[1] = json::Read<float>(src["frequency"], 4.f);
+				int octaves = json::Read<int>(src["octaves"], 3);
+				if (octaves < 1 || octaves > 8)
+				{
+					log::error("Noise needs between 1 and 8 'octaves'");
+					return false;
+				}
+				p[2] = float(octaves);
+				break;
+			}
+			case SDF_OP_REPEAT:
+			case SDF_OP_REPEAT_LIMITED: {
+				float3 period = json::Read<float3>(src["period"], float3(1.f));
+				int3 count = json::Read<int3>(src["count"], int3(1));
+				if (any(period < 0.f) || all(period == 0.f) || any(count < 0))
+				{
+					log::error("Repetition needs a non-negative 'period' that isn't all zero and a non-negative 'count'");
+					return false;
+				}
+				SetFloat3(p, period);
+				if (node.opcode == SDF_OP_REPEAT_LIMITED)
+					SetFloat3(p + 3, float3(count));
+				node.flags = json::Read<bool>(src["mirror"], false) ? SDF_REPEAT_MIRROR : 0;
+				break;
+			}
+			case SDF_OP_REPEAT_POLAR: {
+				int count = json::Read<int>(src["count"], 6);
+				node.flags = json::Read<bool>(src["mirror"], false) ? SDF_REPEAT_MIRROR : 0;
+				if (count < 1 || (node.flags && count % 2))
+				{
+					log::error("Polar repetition needs a positive 'count', an even one when mirrored");
+					return false;
+				}
+				SetFloat3(p, position);
+				p[3] = float(count);
+				break;
+			}
+			default:
+				break;
+			}
+
+			return true;
+		}
+
+		bool ReadTrack(const Json::Value& src, const ParameterInfo& info, CsgTrack& track)
+		{
+			const Json::Value& keys = src["keys"];
+			if (!keys.isArray() || keys.empty())
+			{
+				log::error("Track of '%s' needs an array of 'keys'", info.name);
+				return false;
+			}
+
+			using namespace donut::engine::animation;
+			std::string mode = json::Read<std::string>(src["mode"], "linear");
+			const bool smoothness = std::strcmp(info.name, "k") == 0;
+			auto sampler = std::make_shared<Sampler>();
+			if (mode == "step")
+				sampler->SetInterpolationMode(InterpolationMode::Step);
+			else if (mode == "linear")
+				sampler->SetInterpolationMode(InterpolationMode::Linear);
+			else if (mode == "spline" && !smoothness)
+				sampler->SetInterpolationMode(InterpolationMode::CatmullRomSpline);
+			else if (mode == "spline")
+			{
+				// The curve can overshoot below zero between positive keys.
+				log::error("Track of 'k' can't be a spline");
+				return false;
+			}
+			else
+			{
+				log::error("Unknown track mode '%s'", mode.c_str());
+				return false;
+			}
+
+			for (const auto& key : keys)
+			{
+				// The sampler finds the keys of a time by binary search.
+				if (!key.isArray() || key.size() != info.components + 1
+					|| (!sampler->GetKeyframes().empty() && key[0].asFloat() <= sampler->GetEndTime()))
+				{
+					log::error("Keys of '%s' must be [time, %u values] in increasing time", info.name, info.components);
+					return false;
+				}
+
+				Keyframe keyframe;
+				keyframe.time = key[0].asFloat();
+				for (uint32_t i = 0; i < info.components; i++)
+					keyframe.value[i] = key[i + 1].asFloat();
+				if (smoothness && keyframe.value.x <= 0.f)
+				{
+					log::error("Smooth operator needs a positive 'k'");
+					return false;
+				}
+				sampler->AddKeyframe(keyframe);
+			}
+
+			track.param = info.param;
+			track.components = info.components;
+			track.loop = json::Read<bool>(src["loop"], false);
+			track.sampler = std::move(sampler);
+			return true;
+		}
+
+		template<size_t N> bool ReadTracks(const Json::Value& src, uint32_t opcode, const ParameterInfo (&parameters)[N],
+			std::vector<CsgTrack>& tracks)
+		{
+			const Json::Value& animate = src["animate"];
+			if (animate.isNull())
+				return true;
+			if (!animate.isObject())
+			{
+				log::error("'animate' must be an object");
+				return false;
+			}
+
+			for (const std::string& name : animate.getMemberNames())
+			{
+				const ParameterInfo* info = nullptr;
+				for (const auto& parameter : parameters)
+				{
+					if (parameter.opcode == opcode && name == parameter.name)
+						info = &parameter;
+				}
+				if (!info)
+				{
+					log::error("Parameter '%s' can't be animated", name.c_str());
+					return false;
+				}
+
+				CsgTrack track;
+				if (!ReadTrack(animate[name], *info, track))
+					return false;
+				tracks.push_back(std::move(track));
+			}
+			return true;
+		}
+	}
+
+	float4 CsgTrack::Evaluate(float time) const
+	{
+		const float start = sampler->GetStartTime();
+		const float duration = sampler->GetEndTime() - start;
+		if (loop && duration > 0.f)
+		{
+			float offset = std::fmod(time - start, duration);
+			time = start + (offset < 0.f ? offset + duration : offset);
+		}
+		return sampler->Evaluate(time, true).value_or(float4(0.f));
+	}
+
+	void CsgCamera::Evaluate(float time, float3& position, float3& target) const
+	{
+		float values[6];
+		std::memcpy(values, params, sizeof(values));
+		for (const CsgTrack& track : tracks)
+		{
+			float4 value = track.Evaluate(time);
+			for (uint32_t i = 0; i < track.components; i++)
+				values[track.param + i] = value[i];
+		}
+		position = float3(values[0], values[1], values[2]);
+		target = float3(values[3], values[4], values[5]);
+	}
+
+	std::unique_ptr<CsgNode> ParseCsgNode(const Json::Value& src)
+	{
+		if (!src.isObject())
+		{
+			log::error("SDF scene node must be an object");
+			return nullptr;
+		}
+
+		std::string type = json::Read<std::string>(src["type"], "");
+
+		auto node = std::make_unique<CsgNode>();
+		if (!FindOpcode(type, node->opcode))
+		{
+			log::error("Unknown SDF scene node type '%s'", type.c_str());
+			return nullptr;
+		}
+
+		node->name = json::Read<std::string>(src["name"], "");
+		node->material = json::Read<int>(src["material"], -1);
+
+		if (!ReadParameters(src, *node) || !ReadTracks(src, node->opcode, c_Parameters, node->tracks))
+			return nullptr;
+
+		// An animated amplitude, the only track a displacement can have, replaces its motion.
+		if (node->opcode == SDF_OP_DISPLACE && !node->tracks.empty())
+			node->flags |= SDF_DISPLACE_KEYFRAMED;
+
+		const Json::Value& children = src["children"];
+		if (!children.isNull() && !children.isArray())
+		{
+			log::error("'children' of SDF scene node '%s' must be an array", type.c_str());
+			return nullptr;
+		}
+
+		for (const auto& child : children)
+		{
+			auto childNode = ParseCsgNode(child);
+			if (!childNode)
+				return nullptr;
+			node->children.push_back(std::move(childNode));
+		}
+
+		size_t childCount = node->children.size();
+		if ((node->IsPrimitive() && childCount != 0)
+			|| ((node->IsUnary() || node->IsDomain()) && childCount != 1)
+			|| (node->IsBinary() && childCount < 2))
+		{
+			log::error("SDF scene node '%s' has an invalid number of children (%d)", type.c_str(), int(childCount));
+			return nullptr;
+		}
+
+		return node;
+	}
+
+	bool ParseCsgCamera(const Json::Value& src, CsgCamera& camera)
+	{
+		if (!src.isObject())
+		{
+			log::error("SDF scene camera must be an object");
+			return false;
+		}
+
+		SetFloat3(camera.params, json::Read<float3>(src["position"], float3(4.f, 0.4f, 0.f)));
+		SetFloat3(camera.params + 3, json::Read<float3>(src["target"], float3(0.f)));
+		camera.tracks.clear();
+		return ReadTracks(src, c_CameraOpcode, c_CameraParameters, camera.tracks);
+	}
+
+	std::unique_ptr<CsgNode> LoadCsgScene(vfs::IFileSystem& fs, const std::filesystem::path& fileName,
+		std::unique_ptr<CsgCamera>* camera)
+	{
+		Json::Value documentRoot;
+		if (!json::LoadFromFile(fs, fileName, documentRoot))
+			return nullptr;
+
+		auto root = ParseCsgNode(documentRoot["root"]);
+		if (root && camera)
+		{
+			camera->reset();
+			const Json::Value& src = documentRoot["camera"];
+			if (!src.isNull())
+			{
+				auto parsed = std::make_unique<CsgCamera>();
+				if (ParseCsgCamera(src, *parsed))
+					*camera = std::move(parsed);
+				else
+					root.reset();
+			}
+		}
+		if (!root)
+			log::error("Couldn't load SDF scene %s", fileName.generic_string().c_str());
+
+		return root;
+	}
+
+	const char* GetOpcodeName(uint32_t opcode)
+	{
+		for (const auto& info : c_Opcodes)
+		{
+			if (info.opcode == opcode)
+				return info.name;
+		}
+		return "unknown";
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Data-driven replacement for the hardcoded map() in SDF.hlsli.
+//
+// A scene is a JSON document with a single "root" node. Every node has a "type":
+//   primitives: plane, sphere, box, boxFrame, torus, cylinder, octahedron
+//   operators:  union, subtraction, intersection, smoothUnion, smoothSubtraction,
+//               smoothIntersection (two or more children, folded left to right),
+//               round, displace, noise (exactly one child)
+//   domain:     repeat, repeatLimited, repeatPolar (exactly one child, repeated)
+// and an optional "material". Primitives without a material use the material of the
+// closest ancestor that has one, or 0. See Scene/default.json for the built-in scene.
+//
+// Parameters can be animated: an "animate" object maps parameter names of the node to tracks,
+//   "animate": { "radius": { "keys": [[0, 0.3], [2, 0.5]], "mode": "spline", "loop": true } }
+// where every key is the time followed by the value, one number per component (three for
+// "position"), and the mode is "step", "linear" (the default) or "spline" (Catmull-Rom). The
+// value is held before the first and after the last key unless the track loops. The "k" of a smooth
+// operator can't be a spline, which could overshoot to zero or below between its keys. Animating the
+// "amplitude" of a displace replaces its motion over g_Time. The document can also have a
+// "camera" with a "position" and a "target", animated the same way, which replaces the orbit.
+// See Scene/animated.json.
+
+#include "ShaderTypes.h"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Json
+{
+	class Value;
+}
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace donut::engine::animation
+{
+	class Sampler;
+}
+
+namespace sdf
+{
+	// Keyframes of components consecutive parameters, starting at params[param].
+	struct CsgTrack
+	{
+		uint32_t param = 0;
+		uint32_t components = 1;
+		bool loop = false;
+		std::shared_ptr<donut::engine::animation::Sampler> sampler;
+
+		// Value at the time, in the first components; looping tracks repeat between their first and last key.
+		float4 Evaluate(float time) const;
+	};
+
+	struct CsgNode
+	{
+		uint32_t opcode = SDF_OP_UNION;
+		uint32_t flags = 0;
+		int material = -1;
+		float params[7] = {};
+		std::string name;
+		std::vector<CsgTrack> tracks;
+		std::vector<std::unique_ptr<CsgNode>> children;
+
+		bool IsPrimitive() const { return opcode < SDF_OP_FIRST_BINARY; }
+		bool IsUnary() const { return opcode >= SDF_OP_FIRST_UNARY && opcode < SDF_OP_FIRST_DOMAIN; }
+		bool IsDomain() const { return opcode >= SDF_OP_FIRST_DOMAIN; }
+		bool IsBinary() const { return !IsPrimitive() && !IsUnary() && !IsDomain(); }
+	};
+
+	// Camera of a scene document, looking from params[0..2] at params[3..5].
+	struct CsgCamera
+	{
+		float params[6] = { 4.f, 0.4f, 0.f, 0.f, 0.f, 0.f };
+		std::vector<CsgTrack> tracks;
+
+		// Position and target at the time.
+		void Evaluate(float time, float3& position, float3& target) const;
+	};
+
+	std::unique_ptr<CsgNode> ParseCsgNode(const Json::Value& node);
+	bool ParseCsgCamera(const Json::Value& node, CsgCamera& camera);
+	// When camera isn't null, it receives the camera of the document, or null when there is none.
+	std::unique_ptr<CsgNode> LoadCsgScene(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName,
+		std::unique_ptr<CsgCamera>* camera = nullptr);
+
+	const char* GetOpcodeName(uint32_t opcode);
+}
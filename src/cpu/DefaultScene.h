@@ -0,0 +1,53 @@
+#pragma once
+
+// Hand-written C++ port of the built-in map() in SDF.hlsli.
+// Scene/default.json describes the same scene for the tape compiler; this version is kept
+// as the reference the tape is tested and benchmarked against.
+
+#include "Primitives.h"
+
+namespace sdf
+{
+	// The blobs are only displaced where they are nearer than the rest of the scene, so elsewhere
+	// mapDefault() may exceed the distance to their surface by up to the amplitude of the displacement.
+	constexpr float c_DefaultSceneOvershoot = 0.2f;
+
+	template<typename F> Vec2<F> mapDefault(const Vec3<F>& pos, float time)
+	{
+		Vec2<F> res(sdPlane(pos, Splat<F>(0.f, 1.f, 0.f)), F(0.0f));
+		F tmp[5];
+
+		tmp[0] = sdCylinder(pos - Splat<F>(0.f, 0.3f, 1.5f), Vec2<F>(0.3f, 0.3f), 0);
+		tmp[1] = sdCylinder(pos - Splat<F>(0.f, 0.3f, 1.5f), Vec2<F>(0.3f, 0.3f), 1);
+		res = opU(res, Vec2<F>(opIntersection(tmp[0], tmp[1]), F(8.0f)));
+
+		tmp[0] = sdBoxFrame(pos - Splat<F>(1.f, 0.3f, 0.5f), Splat<F>(0.3f, 0.3f, 0.3f), F(0.06f));
+		tmp[1] = sdOctahedron(pos - Splat<F>(1.f, 0.3f, 0.5f), F(0.3f));
+		res = opU(res, Vec2<F>(opUnion(tmp[0], tmp[1]), F(14.0f)));
+
+		// The shader only displaces blobs that are closer than the current result; per lane this becomes a select.
+		const float blobCenters[4][3] = { { -1.f, 0.3f, 0.f }, { -1.5f, 0.9f, 0.f }, { -0.5f, 0.9f, 0.f }, { -1.f, 1.5f, 0.f } };
+		for (int i = 0; i < 4; i++)
+		{
+			tmp[i] = sdSphere(pos - Splat<F>(blobCenters[i][0], blobCenters[i][1], blobCenters[i][2]), F(0.35f));
+			tmp[4] = opDisplace(tmp[i], time);
+			tmp[i] = select(tmp[i] < res.x, opUnion(tmp[4], tmp[i]), tmp[i]);
+		}
+		res = opU(res, Vec2<F>(opSmoothUnion(tmp[0], tmp[1], F(0.25f)), F(6.0f)));
+		res = opU(res, Vec2<F>(opSmoothUnion(tmp[0], tmp[2], F(0.25f)), F(6.0f)));
+		res = opU(res, Vec2<F>(opSmoothUnion(tmp[3], tmp[1], F(0.25f)), F(6.0f)));
+		res = opU(res, Vec2<F>(opSmoothUnion(tmp[3], tmp[2], F(0.25f)), F(6.0f)));
+
+		res = opU(res, Vec2<F>(sdTorus(pos - Splat<F>(1.0f, 0.3f, -0.5f), Vec2<F>(0.27f, 0.03f)), F(7.0f)));
+		res = opU(res, Vec2<F>(sdTorus(pos - Splat<F>(0.3f, 0.3f, -0.5f), Vec2<F>(0.27f, 0.03f)), F(7.0f)));
+		res = opU(res, Vec2<F>(sdTorus(pos - Splat<F>(0.0f, 0.6f, -0.5f), Vec2<F>(0.27f, 0.03f)), F(7.0f)));
+		res = opU(res, Vec2<F>(sdTorus(pos - Splat<F>(0.65f, 0.6f, -0.5f), Vec2<F>(0.27f, 0.03f)), F(7.0f)));
+		res = opU(res, Vec2<F>(sdTorus(pos - Splat<F>(1.3f, 0.6f, -0.5f), Vec2<F>(0.27f, 0.03f)), F(7.0f)));
+
+		tmp[0] = opRound(sdBox(pos - Splat<F>(-1.f, 0.3f, 1.f), Splat<F>(0.3f, 0.3f, 0.3f)), F(0.1f));
+		tmp[1] = sdBox(pos - Splat<F>(-1.f, 0.6f, 1.f), Splat<F>(0.3f, 0.15f, 0.15f));
+		res = opU(res, Vec2<F>(opSubtraction(tmp[0], tmp[1]), F(37.0f)));
+
+		return res;
+	}
+}
@@ -0,0 +1,489 @@
+#include "DistanceOctree.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		// The levels above are always split, so that the workers build 8^c_TaskDepth subtrees.
+		constexpr int c_TaskDepth = 3;
+		constexpr int c_MaxDepth = 16;
+		constexpr float c_QuantizationSteps = 32767.0f;
+
+		// A cell being built: its first child in the subtree's nodes, or -1 for a leaf, and its corners.
+		struct BuildNode
+		{
+			int32_t firstChild = -1;
+			float corners[8] = {};
+		};
+
+		template<typename F> F LoadRow(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StoreRow(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		// Corner i of a cell is at x = i & 1, y = i >> 1 & 1, z = i >> 2 of it.
+		float Trilinear(const float* corners, float tx, float ty, float tz)
+		{
+			float c00 = lerp(corners[0], corners[1], tx);
+			float c10 = lerp(corners[2], corners[3], tx);
+			float c01 = lerp(corners[4], corners[5], tx);
+			float c11 = lerp(corners[6], corners[7], tx);
+			return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+		}
+
+		struct Refinement
+		{
+			const BrickMapField& field;
+			float tolerance;
+			float band;
+			int maxDepth;
+
+			// Samples the 3^3 lattice of the cell and splits it while its corners miss the other points.
+			void Build(std::vector<BuildNode>& nodes, uint32_t index, const float3& cellMin, float cellSize, int depth) const
+			{
+				float lattice[27];
+				field(cellMin, 0.5f * cellSize, 3, lattice);
+
+				float corners[8];
+				for (int i = 0; i < 8; i++)
+					corners[i] = lattice[((i >> 2) * 3 + (i >> 1 & 1)) * 3 * 2 + (i & 1) * 2];
+				std::memcpy(nodes[index].corners, corners, sizeof(corners));
+				if (depth == maxDepth)
+					return;
+
+				float error = 0.f;
+				for (int z = 0; z < 3; z++)
+				{
+					for (int y = 0; y < 3; y++)
+					{
+						for (int x = 0; x < 3; x++)
+						{
+							float filtered = Trilinear(corners, 0.5f * float(x), 0.5f * float(y), 0.5f * float(z));
+							error = std::max(error, std::fabs(filtered - lattice[(z * 3 + y) * 3 + x]));
+						}
+					}
+				}
+				if (error <= tolerance)
+					return;
+
+				// No point of a cell is closer to the surface than |d(center)| - halfDiagonal. Beyond the band
+				// that bound is all a leaf needs.
+				const float center = lattice[13];
+				const float halfDiagonal = 0.5f * cellSize * std::sqrt(3.0f);
+				if (std::fabs(center) > halfDiagonal + band)
+				{
+					const float bound = center > 0.f ? center - halfDiagonal : center + halfDiagonal;
+					std::fill(std::begin(nodes[index].corners), std::end(nodes[index].corners), bound);
+					return;
+				}
+
+				const uint32_t first = uint32_t(nodes.size());
+				nodes[index].firstChild = int32_t(first);
+				nodes.resize(nodes.size() + 8);
+
+				const float childSize = 0.5f * cellSize;
+				for (int octant = 0; octant < 8; octant++)
+				{
+					const float3 offset(float(octant & 1), float(octant >> 1 & 1), float(octant >> 2));
+					Build(nodes, first + octant, cellMin + offset * childSize, childSize, depth + 1);
+				}
+			}
+		};
+	}
+
+	bool DistanceOctree::Build(tf::Executor& executor, const SceneMap& map, const DistanceOctreeDesc& desc)
+	{
+		// The lattice points go to the map as packets, whatever rows they are on.
+		return Build(executor, [&map](const float3& origin, float step, int count, float* distances)
+		{
+			constexpr int W = WidthOf<FloatN>;
+			const int total = count * count * count;
+			for (int first = 0; first < total; first += W)
+			{
+				alignas(32) float xs[W], ys[W], zs[W], out[W];
+				for (int lane = 0; lane < W; lane++)
+				{
+					const int i = std::min(first + lane, total - 1);
+					xs[lane] = origin.x + float(i % count) * step;
+					ys[lane] = origin.y + float(i / count % count) * step;
+					zs[lane] = origin.z + float(i / (count * count)) * step;
+				}
+
+				StoreRow(out, map.Evaluate(Vec3<FloatN>(LoadRow<FloatN>(xs), LoadRow<FloatN>(ys), LoadRow<FloatN>(zs))).x);
+				for (int lane = 0; lane < W && first + lane < total; lane++)
+					distances[first + lane] = out[lane];
+			}
+		}, desc);
+	}
+
+	bool DistanceOctree::Build(tf::Executor& executor, const BrickMapField& field, const DistanceOctreeDesc& desc)
+	{
+		if (desc.maxDepth < 1 || desc.maxDepth > c_MaxDepth || !(desc.tolerance > 0.f) || !(desc.band >= 0.f))
+		{
+			log::error("Can't build a distance octree of depth %d, tolerance %g and band %g", desc.maxDepth, desc.tolerance, desc.band);
+			return false;
+		}
+
+		const float3 extent = desc.bounds.diagonal();
+		if (!(extent.x > 0.f && extent.y > 0.f && extent.z > 0.f) || !IsFinite(desc.bounds))
+		{
+			log::error("Can't build a distance octree of an empty region");
+			return false;
+		}
+
+		const float size = std::max(extent.x, std::max(extent.y, extent.z));
+		const float3 origin = desc.bounds.center() - 0.5f * size;
+
+		const int taskDepth = std::min(c_TaskDepth, desc.maxDepth);
+		const uint32_t subtreeCount = 1u << (3 * taskDepth);
+		const float subtreeSize = size / float(1 << taskDepth);
+		const Refinement refinement = { field, desc.tolerance, desc.band, desc.maxDepth };
+
+		std::vector<std::vector<BuildNode>> subtrees(subtreeCount);
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0u, subtreeCount, 1u, [&](uint32_t subtree)
+		{
+			// The octants of the levels above, from the top, are the digits of the subtree's index in base 8.
+			int3 cell = int3(0);
+			for (int level = taskDepth - 1; level >= 0; level--)
+			{
+				const uint32_t octant = subtree >> (3 * level) & 7;
+				cell = cell * 2 + int3(int(octant & 1), int(octant >> 1 & 1), int(octant >> 2));
+			}
+
+			std::vector<BuildNode>& nodes = subtrees[subtree];
+			nodes.resize(1);
+			refinement.Build(nodes, 0, origin + float3(cell) * subtreeSize, subtreeSize, taskDepth);
+		}, 1u);
+		executor.run(taskflow).wait();
+
+		size_t nodeCount = (subtreeCount - 1) / 7;
+		for (const std::vector<BuildNode>& nodes : subtrees)
+			nodeCount += nodes.size();
+		if (nodeCount >= size_t(UINT32_MAX))
+		{
+			log::error("The distance octree would have too many nodes, raise its tolerance or lower its depth");
+			return false;
+		}
+
+		m_Origin = origin;
+		m_Size = size;
+		m_Band = desc.band;
+		m_MaxDepth = desc.maxDepth;
+		m_NodeCount = uint32_t(nodeCount);
+		m_Split.assign((nodeCount >> 6) + 1, 0);
+		m_Corners.clear();
+		UpdateLookups();
+
+		// Breadth first: the levels above the subtrees are all split, then the subtrees go down a level at a time.
+		uint32_t node = 0;
+		for (; node < (subtreeCount - 1) / 7; node++)
+			m_Split[node >> 6] |= uint64_t(1) << (node & 63);
+
+		struct Entry
+		{
+			uint32_t subtree;
+			uint32_t index;
+		};
+		std::vector<Entry> level, next;
+		for (uint32_t subtree = 0; subtree < subtreeCount; subtree++)
+			level.push_back({ subtree, 0 });
+
+		for (int depth = taskDepth; !level.empty(); depth++)
+		{
+			const float scale = m_Scales[depth];
+			next.clear();
+			for (const Entry& entry : level)
+			{
+				const BuildNode& buildNode = subtrees[entry.subtree][entry.index];
+				if (buildNode.firstChild >= 0)
+				{
+					m_Split[node >> 6] |= uint64_t(1) << (node & 63);
+					for (uint32_t child = 0; child < 8; child++)
+						next.push_back({ entry.subtree, uint32_t(buildNode.firstChild) + child });
+				}
+				else
+				{
+					// Clamping only shrinks the distances of the leaves beyond the band, which stays conservative.
+					for (float corner : buildNode.corners)
+						m_Corners.push_back(int16_t(std::lround(clamp(corner / scale, -c_QuantizationSteps, c_QuantizationSteps))));
+				}
+				node++;
+			}
+			std::swap(level, next);
+		}
+
+		UpdateLookups();
+		return true;
+	}
+
+	void DistanceOctree::UpdateLookups()
+	{
+		m_Ranks.resize(m_Split.size());
+		uint32_t rank = 0;
+		for (size_t word = 0; word < m_Split.size(); word++)
+		{
+			m_Ranks[word] = rank;
+			rank += uint32_t(std::bitset<64>(m_Split[word]).count());
+		}
+
+		// The corners of a leaf within the band are at most its diagonal further from the surface than the band.
+		m_Scales.resize(size_t(m_MaxDepth) + 1);
+		for (int depth = 0; depth <= m_MaxDepth; depth++)
+			m_Scales[depth] = (m_Band + std::sqrt(3.0f) * std::ldexp(m_Size, -depth)) / c_QuantizationSteps;
+	}
+
+	DistanceOctree::Leaf DistanceOctree::FindLeaf(const float3& pos) const
+	{
+		Leaf leaf;
+		leaf.cellMin = m_Origin;
+		leaf.cellSize = m_Size;
+
+		uint32_t node = 0;
+		while (IsSplit(node))
+		{
+			leaf.cellSize *= 0.5f;
+			const float3 center = leaf.cellMin + leaf.cellSize;
+			uint32_t octant = 0;
+			if (pos.x >= center.x) { octant |= 1; leaf.cellMin.x = center.x; }
+			if (pos.y >= center.y) { octant |= 2; leaf.cellMin.y = center.y; }
+			if (pos.z >= center.z) { octant |= 4; leaf.cellMin.z = center.z; }
+			node = 8 * Rank(node) + 1 + octant;
+			leaf.depth++;
+		}
+
+		leaf.index = node - Rank(node);
+		return leaf;
+	}
+
+	float DistanceOctree::Sample(const float3& pos) const
+	{
+		if (Empty())
+			return 1e10f;
+
+		const box3 bounds = GetBounds();
+		const float3 p = bounds.clamp(pos);
+		const float outside = length(pos - p);
+
+		const Leaf leaf = FindLeaf(p);
+		const float3 t = saturate((p - leaf.cellMin) / leaf.cellSize);
+		const int16_t* quantized = &m_Corners[size_t(leaf.index) * 8];
+		float corners[8];
+		for (int i = 0; i < 8; i++)
+			corners[i] = float(quantized[i]) * m_Scales[leaf.depth];
+
+		return Trilinear(corners, t.x, t.y, t.z) + outside;
+	}
+
+	template<typename F> F DistanceOctree::Sample(const Vec3<F>& pos) const
+	{
+		constexpr int W = WidthOf<F>;
+		if constexpr (W == 1)
+		{
+			return Sample(float3(pos.x, pos.y, pos.z));
+		}
+		else
+		{
+			if (Empty())
+				return F(1e10f);
+
+			const Vec3<F> p(clamp(pos.x, F(m_Origin.x), F(m_Origin.x + m_Size)),
+				clamp(pos.y, F(m_Origin.y), F(m_Origin.y + m_Size)),
+				clamp(pos.z, F(m_Origin.z), F(m_Origin.z + m_Size)));
+			const F outside = length(pos - p);
+
+			alignas(32) float px[W], py[W], pz[W];
+			p.x.Store(px);
+			p.y.Store(py);
+			p.z.Store(pz);
+
+			alignas(32) float corners[8][W];
+			alignas(32) float minX[W], minY[W], minZ[W], invSize[W];
+			for (int lane = 0; lane < W; lane++)
+			{
+				const Leaf leaf = FindLeaf(float3(px[lane], py[lane], pz[lane]));
+				const int16_t* quantized = &m_Corners[size_t(leaf.index) * 8];
+				const float scale = m_Scales[leaf.depth];
+				for (int i = 0; i < 8; i++)
+					corners[i][lane] = float(quantized[i]) * scale;
+				minX[lane] = leaf.cellMin.x;
+				minY[lane] = leaf.cellMin.y;
+				minZ[lane] = leaf.cellMin.z;
+				invSize[lane] = 1.0f / leaf.cellSize;
+			}
+
+			const F inv = F::Load(invSize);
+			const F tx = saturate((p.x - F::Load(minX)) * inv);
+			const F ty = saturate((p.y - F::Load(minY)) * inv);
+			const F tz = saturate((p.z - F::Load(minZ)) * inv);
+
+			const F c00 = lerp(F::Load(corners[0]), F::Load(corners[1]), tx);
+			const F c10 = lerp(F::Load(corners[2]), F::Load(corners[3]), tx);
+			const F c01 = lerp(F::Load(corners[4]), F::Load(corners[5]), tx);
+			const F c11 = lerp(F::Load(corners[6]), F::Load(corners[7]), tx);
+			return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz) + outside;
+		}
+	}
+
+	template float DistanceOctree::Sample(const Vec3<float>& pos) const;
+#if defined(SDF_SIMD_SSE)
+	template Float4 DistanceOctree::Sample(const Vec3<Float4>& pos) const;
+#endif
+#if defined(SDF_SIMD_AVX2)
+	template Float8 DistanceOctree::Sample(const Vec3<Float8>& pos) const;
+#endif
+
+	std::vector<uint32_t> DistanceOctree::GetLeafCounts() const
+	{
+		std::vector<uint32_t> counts(size_t(m_MaxDepth) + 1, 0);
+		if (Empty())
+			return counts;
+
+		// The split nodes of a level have their children next, so the levels are ranges of nodes.
+		uint32_t first = 0, count = 1;
+		for (int depth = 0; depth <= m_MaxDepth && count > 0; depth++)
+		{
+			const uint32_t split = Rank(first + count) - Rank(first);
+			counts[depth] = count - split;
+			first += count;
+			count = 8 * split;
+		}
+		return counts;
+	}
+
+	int DistanceOctree::GetLeafDepth(const float3& pos) const
+	{
+		return Empty() ? 0 : FindLeaf(GetBounds().clamp(pos)).depth;
+	}
+
+	size_t DistanceOctree::GetMemorySize() const
+	{
+		return m_Split.size() * sizeof(uint64_t) + m_Ranks.size() * sizeof(uint32_t) + m_Corners.size() * sizeof(int16_t);
+	}
+
+	bool DistanceOctree::Save(const std::filesystem::path& fileName) const
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		DistanceOctreeFileHeader header;
+		header.nodeCount = m_NodeCount;
+		header.leafCount = GetLeafCount();
+		header.origin[0] = m_Origin.x;
+		header.origin[1] = m_Origin.y;
+		header.origin[2] = m_Origin.z;
+		header.size = m_Size;
+		header.band = m_Band;
+		header.maxDepth = uint32_t(m_MaxDepth);
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(m_Split.data()), m_Split.size() * sizeof(uint64_t));
+		file.write(reinterpret_cast<const char*>(m_Corners.data()), m_Corners.size() * sizeof(int16_t));
+
+		return file.good();
+	}
+
+	bool DistanceOctree::Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+	{
+		std::shared_ptr<vfs::IBlob> data = fs.readFile(fileName);
+		if (!data)
+		{
+			log::error("Couldn't read file %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		DistanceOctreeFileHeader header;
+		if (data->size() < sizeof(header))
+		{
+			log::error("%s is not an SDF distance octree file", fileName.generic_string().c_str());
+			return false;
+		}
+
+		std::memcpy(&header, data->data(), sizeof(header));
+		if (header.magic != DistanceOctreeFileHeader::c_Magic || header.version != DistanceOctreeFileHeader::c_Version)
+		{
+			log::error("%s is not an SDF distance octree file of version %u", fileName.generic_string().c_str(), DistanceOctreeFileHeader::c_Version);
+			return false;
+		}
+
+		const bool validHeader = header.nodeCount > 0 && header.nodeCount < UINT32_MAX && header.leafCount <= header.nodeCount
+			&& header.maxDepth >= 1 && header.maxDepth <= uint32_t(c_MaxDepth) && header.size > 0.f && header.band >= 0.f;
+		const size_t words = validHeader ? (size_t(header.nodeCount) >> 6) + 1 : 0;
+		const size_t expectedSize = sizeof(header) + words * sizeof(uint64_t) + size_t(header.leafCount) * 8 * sizeof(int16_t);
+		if (!validHeader || data->size() < expectedSize)
+		{
+			log::error("SDF distance octree file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		DistanceOctree loaded;
+		loaded.m_Origin = float3(header.origin[0], header.origin[1], header.origin[2]);
+		loaded.m_Size = header.size;
+		loaded.m_Band = header.band;
+		loaded.m_MaxDepth = int(header.maxDepth);
+		loaded.m_NodeCount = header.nodeCount;
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(data->data()) + sizeof(header);
+		loaded.m_Split.resize(words);
+		std::memcpy(loaded.m_Split.data(), bytes, words * sizeof(uint64_t));
+		bytes += words * sizeof(uint64_t);
+		// Bits past the last node would count as split.
+		loaded.m_Split.back() &= (uint64_t(1) << (header.nodeCount & 63)) - 1;
+		loaded.UpdateLookups();
+
+		// Every split node has 8 children, the rest hold corners, and the tree must not be deeper than it says.
+		const uint32_t split = loaded.Rank(header.nodeCount);
+		bool valid = uint64_t(split) * 8 + 1 == header.nodeCount && header.nodeCount - split == header.leafCount;
+		uint32_t first = 0, count = 1;
+		for (int depth = 0; valid && count > 0; depth++)
+		{
+			if (uint64_t(first) + count > header.nodeCount)
+			{
+				valid = false;
+				break;
+			}
+			const uint32_t levelSplit = loaded.Rank(first + count) - loaded.Rank(first);
+			first += count;
+			count = 8 * levelSplit;
+			valid = depth < loaded.m_MaxDepth || levelSplit == 0;
+		}
+		if (!valid)
+		{
+			log::error("SDF distance octree file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		loaded.m_Corners.resize(size_t(header.leafCount) * 8);
+		std::memcpy(loaded.m_Corners.data(), bytes, loaded.m_Corners.size() * sizeof(int16_t));
+
+		*this = std::move(loaded);
+		return true;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// Adaptive distance field: an octree over a cube around the baked region whose leaves hold the distances
+// on their 8 corners and are filtered trilinearly. A cell is split while the filtered distance misses the
+// field by more than the tolerance at the centers of its faces, its edges and itself, so flat and gently
+// curved surfaces such as the ground plane stay in large cells while the fine parts of a scene get small
+// ones, where a brick map (see BrickMap.h) spends the same resolution everywhere along the surfaces.
+//
+// Only the cells within the band of the surface are refined. A leaf beyond it that misses the field holds
+// a conservative distance instead, enough to sphere trace across it.
+//
+// The tree is pointerless: one bit per node in breadth-first order says whether it is split, and the 8
+// children of the n-th split node are nodes 8n + 1 to 8n + 8. Counting the set bits before a node finds
+// its children, and the leaves' corners, in the order of the clear bits. The corners are quantized to
+// 16 bits over a range that shrinks with the size of the cell.
+
+#include "BrickMap.h"
+
+#include <bitset>
+
+namespace sdf
+{
+	struct DistanceOctreeDesc
+	{
+		box3 bounds = box3(float3(-2.5f, -0.5f, -2.5f), float3(2.5f, 2.0f, 2.5f));  // the root is the cube around it
+		float tolerance = 0.001f;   // largest trilinear error allowed at the test points
+		float band = 0.1f;          // distance from the surface within which cells are refined
+		int maxDepth = 10;          // levels below the root, [1, 16]
+	};
+
+	// Binary octree file: the header, the split bits (uint64 per 64 nodes) and the corners (8 int16 per
+	// leaf, x fastest), little endian.
+	struct DistanceOctreeFileHeader
+	{
+		static constexpr uint32_t c_Magic = 0x41464453; // "SDFA"
+		static constexpr uint32_t c_Version = 1;
+
+		uint32_t magic = c_Magic;
+		uint32_t version = c_Version;
+		uint32_t nodeCount = 0;
+		uint32_t leafCount = 0;
+		float origin[3] = {};
+		float size = 0.f;
+		float band = 0.f;
+		uint32_t maxDepth = 0;
+	};
+
+	class DistanceOctree
+	{
+	public:
+		// Samples map at time map.time on the executor's workers. Fails on an empty region, a tolerance
+		// that isn't positive or a depth outside [1, 16].
+		bool Build(tf::Executor& executor, const SceneMap& map, const DistanceOctreeDesc& desc);
+		// Same for any other field, called from the executor's workers with blocks of 3^3 points.
+		bool Build(tf::Executor& executor, const BrickMapField& field, const DistanceOctreeDesc& desc);
+
+		bool Save(const std::filesystem::path& fileName) const;
+		bool Load(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName);
+
+		// Trilinearly filtered distance of the leaf around pos. Points outside the root add their distance to it.
+		float Sample(const float3& pos) const;
+		// Same for a packet: the lanes find their leaves one by one and are filtered together.
+		template<typename F> F Sample(const Vec3<F>& pos) const;
+
+		bool Empty() const { return m_NodeCount == 0; }
+		uint32_t GetNodeCount() const { return m_NodeCount; }
+		uint32_t GetLeafCount() const { return uint32_t(m_Corners.size() / 8); }
+		int GetMaxDepth() const { return m_MaxDepth; }
+		// Leaves at each depth, GetMaxDepth() + 1 of them.
+		std::vector<uint32_t> GetLeafCounts() const;
+		// Depth of the leaf around a point of the root cube.
+		int GetLeafDepth(const float3& pos) const;
+		box3 GetBounds() const { return box3(m_Origin, m_Origin + m_Size); }
+		// Bytes of the split bits, their running counts and the corners.
+		size_t GetMemorySize() const;
+
+	private:
+		struct Leaf
+		{
+			uint32_t index = 0;     // in the order of the leaves
+			int depth = 0;
+			float3 cellMin;
+			float cellSize = 0.f;
+		};
+
+		bool IsSplit(uint32_t node) const { return (m_Split[node >> 6] >> (node & 63)) & 1; }
+		// Split nodes before node.
+		uint32_t Rank(uint32_t node) const
+		{
+			const uint64_t below = m_Split[node >> 6] & ((uint64_t(1) << (node & 63)) - 1);
+			return m_Ranks[node >> 6] + uint32_t(std::bitset<64>(below).count());
+		}
+
+		// pos must be inside the root cube.
+		Leaf FindLeaf(const float3& pos) const;
+		// Fills m_Ranks and m_Scales.
+		void UpdateLookups();
+
+		float3 m_Origin = float3(0.f);
+		float m_Size = 0.f;
+		float m_Band = 0.f;
+		int m_MaxDepth = 0;
+		uint32_t m_NodeCount = 0;
+		std::vector<uint64_t> m_Split;      // one word more than the nodes need, so that Rank(m_NodeCount) works
+		std::vector<uint32_t> m_Ranks;      // split nodes before each word of m_Split
+		std::vector<int16_t> m_Corners;
+		std::vector<float> m_Scales;        // distance of a quantization step at each depth
+	};
+}
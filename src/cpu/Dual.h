@@ -0,0 +1,81 @@
+#pragma once
+
+// Dual numbers for forward-mode automatic differentiation of the distance functions.
+//
+// Dual<F> carries a value and its gradient with respect to the sample position. It behaves like the
+// packet types of SimdMath.h, so the templates of Primitives.h, Tape.h and Bvh.h instantiate with
+// F = Dual<float> (or Dual<FloatN>) unchanged and return the distance and its gradient in one pass.
+// min, max, abs and select pass on the gradient of the operand they pick, which is the derivative
+// wherever the field is differentiable. SDFDual.hlsli is the shader version.
+
+#include "SimdMath.h"
+
+namespace sdf
+{
+	template<typename F> struct Dual
+	{
+		F v;
+		Vec3<F> d;  // gradient of v
+
+		Dual() = default;
+		// Constants have a zero gradient.
+		Dual(float x) : v(F(x)), d(F(0.0f), F(0.0f), F(0.0f)) { }
+		Dual(const F& _v, const Vec3<F>& _d) : v(_v), d(_d) { }
+	};
+
+	template<typename F> struct SimdTraits<Dual<F>>
+	{
+		static constexpr int Width = SimdTraits<F>::Width;
+		using Mask = MaskOf<F>;
+	};
+
+	template<typename F> inline Dual<F> operator+(const Dual<F>& a, const Dual<F>& b) { return Dual<F>(a.v + b.v, a.d + b.d); }
+	template<typename F> inline Dual<F> operator-(const Dual<F>& a, const Dual<F>& b) { return Dual<F>(a.v - b.v, a.d - b.d); }
+	template<typename F> inline Dual<F> operator*(const Dual<F>& a, const Dual<F>& b) { return Dual<F>(a.v * b.v, a.d * b.v + b.d * a.v); }
+	template<typename F> inline Dual<F> operator/(const Dual<F>& a, const Dual<F>& b)
+	{
+		F v = a.v / b.v;
+		return Dual<F>(v, (a.d - b.d * v) * (F(1.0f) / b.v));
+	}
+	template<typename F> inline Dual<F> operator-(const Dual<F>& a) { return Dual<F>(-a.v, -a.d); }
+	template<typename F> inline Dual<F>& operator+=(Dual<F>& a, const Dual<F>& b) { return a = a + b; }
+	template<typename F> inline Dual<F>& operator-=(Dual<F>& a, const Dual<F>& b) { return a = a - b; }
+	template<typename F> inline Dual<F>& operator*=(Dual<F>& a, const Dual<F>& b) { return a = a * b; }
+	template<typename F> inline Dual<F>& operator/=(Dual<F>& a, const Dual<F>& b) { return a = a / b; }
+
+	// Comparisons look at the values only.
+	template<typename F> inline MaskOf<F> operator<(const Dual<F>& a, const Dual<F>& b) { return a.v < b.v; }
+	template<typename F> inline MaskOf<F> operator<=(const Dual<F>& a, const Dual<F>& b) { return a.v <= b.v; }
+	template<typename F> inline MaskOf<F> operator>(const Dual<F>& a, const Dual<F>& b) { return a.v > b.v; }
+	template<typename F> inline MaskOf<F> operator>=(const Dual<F>& a, const Dual<F>& b) { return a.v >= b.v; }
+
+	template<typename F> inline Dual<F> select(const MaskOf<F>& mask, const Dual<F>& a, const Dual<F>& b)
+	{
+		return Dual<F>(select(mask, a.v, b.v), select(mask, a.d, b.d));
+	}
+
+	// Same operand order as the packet versions, so ties pick the same side.
+	template<typename F> inline Dual<F> min(const Dual<F>& a, const Dual<F>& b) { return select(a.v < b.v, a, b); }
+	template<typename F> inline Dual<F> max(const Dual<F>& a, const Dual<F>& b) { return select(a.v < b.v, b, a); }
+	template<typename F> inline Dual<F> abs(const Dual<F>& a) { return select(a.v < F(0.0f), -a, a); }
+	template<typename F> inline Dual<F> floor(const Dual<F>& a) { return Dual<F>(floor(a.v), Splat<F>(0.0f, 0.0f, 0.0f)); }
+	template<typename F> inline Dual<F> fmadd(const Dual<F>& a, const Dual<F>& b, const Dual<F>& c) { return a * b + c; }
+
+	// length() of a zero vector has no derivative; take 0 rather than inf * 0.
+	template<typename F> inline Dual<F> sqrt(const Dual<F>& a)
+	{
+		F s = sqrt(a.v);
+		F scale = select(s > F(0.0f), F(0.5f) / s, F(0.0f));
+		return Dual<F>(s, a.d * scale);
+	}
+
+	template<typename F> inline float lane(const Dual<F>& a, int i) { return lane(a.v, i); }
+
+	// Seeds a sample position: each coordinate is its own variable.
+	template<typename F> inline Vec3<Dual<F>> DualPosition(const Vec3<F>& p)
+	{
+		const F zero(0.0f), one(1.0f);
+		return Vec3<Dual<F>>(Dual<F>(p.x, Vec3<F>(one, zero, zero)), Dual<F>(p.y, Vec3<F>(zero, one, zero)),
+			Dual<F>(p.z, Vec3<F>(zero, zero, one)));
+	}
+}
@@ -0,0 +1,124 @@
+#include "Image.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		uint8_t ToUnorm8(float value)
+		{
+			return uint8_t(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+		}
+
+		// Decodes an 8-bit RGB file from the file system, returns the pixels row by row from the top.
+		bool LoadRgb8(vfs::IFileSystem& fs, const std::filesystem::path& fileName, int& width, int& height,
+			std::vector<float3>& pixels, bool srgb)
+		{
+			std::shared_ptr<vfs::IBlob> data = fs.readFile(fileName);
+			if (!data)
+			{
+				log::error("Couldn't read file %s", fileName.generic_string().c_str());
+				return false;
+			}
+
+			int channels = 0;
+			stbi_uc* rgb = stbi_load_from_memory(static_cast<const stbi_uc*>(data->data()), int(data->size()),
+				&width, &height, &channels, 3);
+			if (!rgb)
+			{
+				log::error("Couldn't decode image %s: %s", fileName.generic_string().c_str(), stbi_failure_reason());
+				return false;
+			}
+
+			pixels.resize(size_t(width) * size_t(height));
+			for (size_t i = 0; i < pixels.size(); i++)
+			{
+				float3 c = float3(rgb[i * 3 + 0], rgb[i * 3 + 1], rgb[i * 3 + 2]) / 255.f;
+				pixels[i] = srgb ? toLinear(c) : c;
+			}
+
+			stbi_image_free(rgb);
+			return true;
+		}
+	}
+
+	bool SavePng(const Image& image, const std::filesystem::path& fileName, bool encodeSrgb)
+	{
+		std::vector<uint8_t> rgb(image.pixels.size() * 3);
+		for (size_t i = 0; i < image.pixels.size(); i++)
+		{
+			float3 c = encodeSrgb ? toSRGB(saturate(image.pixels[i])) : image.pixels[i];
+			rgb[i * 3 + 0] = ToUnorm8(c.x);
+			rgb[i * 3 + 1] = ToUnorm8(c.y);
+			rgb[i * 3 + 2] = ToUnorm8(c.z);
+		}
+
+		if (!stbi_write_png(fileName.generic_string().c_str(), image.width, image.height, 3, rgb.data(), image.width * 3))
+		{
+			log::error("Couldn't write %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	bool LoadPng(vfs::IFileSystem& fs, const std::filesystem::path& fileName, Image& image, bool decodeSrgb)
+	{
+		return LoadRgb8(fs, fileName, image.width, image.height, image.pixels, decodeSrgb);
+	}
+
+	double ComputePsnr(const Image& a, const Image& b)
+	{
+		if (a.width != b.width || a.height != b.height || a.pixels.empty())
+			return 0.0;
+
+		double sum = 0.0;
+		for (size_t i = 0; i < a.pixels.size(); i++)
+		{
+			float3 d = saturate(a.pixels[i]) - saturate(b.pixels[i]);
+			sum += double(dot(d, d));
+		}
+
+		double mse = sum / double(a.pixels.size() * 3);
+		return mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : std::numeric_limits<double>::infinity();
+	}
+
+	float3 Texture::Sample(const float2& uv) const
+	{
+		if (texels.empty())
+			return float3(1.f);
+
+		float x = uv.x * float(width) - 0.5f;
+		float y = uv.y * float(height) - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float wx = x - fx;
+		float wy = y - fy;
+
+		auto wrap = [](int i, int n) { i %= n; return i < 0 ? i + n : i; };
+		int x0 = wrap(int(fx), width);
+		int y0 = wrap(int(fy), height);
+		int x1 = wrap(x0 + 1, width);
+		int y1 = wrap(y0 + 1, height);
+
+		float3 top = lerp(texels[size_t(y0) * width + x0], texels[size_t(y0) * width + x1], wx);
+		float3 bottom = lerp(texels[size_t(y1) * width + x0], texels[size_t(y1) * width + x1], wx);
+		return lerp(top, bottom, wy);
+	}
+
+	bool LoadTexture(vfs::IFileSystem& fs, const std::filesystem::path& fileName, Texture& texture, bool srgb)
+	{
+		return LoadRgb8(fs, fileName, texture.width, texture.height, texture.texels, srgb);
+	}
+}
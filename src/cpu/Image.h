@@ -0,0 +1,54 @@
+#pragma once
+
+// Float images for the CPU renderer and the texture it samples, read and written through stb.
+
+#include "ShaderTypes.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace sdf
+{
+	struct Image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<float3> pixels;  // rows from the top
+
+		void Resize(int _width, int _height)
+		{
+			width = _width;
+			height = _height;
+			pixels.assign(size_t(width) * size_t(height), float3(0.f));
+		}
+
+		float3& At(int x, int y) { return pixels[size_t(y) * width + x]; }
+		const float3& At(int x, int y) const { return pixels[size_t(y) * width + x]; }
+	};
+
+	// The application renders into an SRGBA8 swap chain, so the values written by PS() are
+	// sRGB-encoded once more on the way to the screen. encodeSrgb reproduces that.
+	bool SavePng(const Image& image, const std::filesystem::path& fileName, bool encodeSrgb = true);
+	bool LoadPng(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName, Image& image, bool decodeSrgb = true);
+
+	// Peak signal-to-noise ratio in dB between two images of the same size, values in [0, 1].
+	double ComputePsnr(const Image& a, const Image& b);
+
+	// Linear RGB texture sampled with wrapping and bilinear filtering, like g_SamLinear on mip 0.
+	struct Texture
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<float3> texels;
+
+		float3 Sample(const float2& uv) const;
+	};
+
+	// Loads an 8-bit image file; with srgb the texels are converted to linear like an SRGB texture format.
+	bool LoadTexture(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName, Texture& texture, bool srgb = true);
+}
@@ -0,0 +1,97 @@
+#include "Instrumentation.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace donut;
+
+namespace sdf
+{
+	uint32_t EvaluationDistribution::GetPercentile(double fraction) const
+	{
+		uint64_t rank = uint64_t(std::ceil(fraction * double(pixels)));
+		uint64_t seen = 0;
+		for (size_t count = 0; count < histogram.size(); count++)
+		{
+			seen += histogram[count];
+			if (seen >= rank && seen > 0)
+				return uint32_t(count);
+		}
+		return max;
+	}
+
+	EvaluationDistribution GetEvaluationDistribution(const EvaluationImage& evaluations, int mode)
+	{
+		EvaluationDistribution result;
+		for (const PixelEvaluations& pixel : evaluations.pixels)
+			result.max = std::max(result.max, pixel.Get(mode));
+
+		result.histogram.assign(size_t(result.max) + 1, 0);
+		for (const PixelEvaluations& pixel : evaluations.pixels)
+		{
+			uint32_t count = pixel.Get(mode);
+			result.histogram[count]++;
+			result.sum += count;
+		}
+
+		result.pixels = evaluations.pixels.size();
+		result.p50 = result.GetPercentile(0.50);
+		result.p95 = result.GetPercentile(0.95);
+		result.p99 = result.GetPercentile(0.99);
+		return result;
+	}
+
+	float3 HeatmapColor(uint32_t count, uint32_t scale)
+	{
+		const float4 red(0.13572138f, 4.61539260f, -42.66032258f, 132.13108234f);
+		const float4 green(0.09140261f, 2.19418839f, 4.84296658f, -14.18503333f);
+		const float4 blue(0.10667330f, 12.64194608f, -60.58204836f, 110.36276771f);
+		const float2 red2(-152.94239396f, 59.28637943f);
+		const float2 green2(4.27729857f, 2.82956604f);
+		const float2 blue2(-89.90310912f, 27.34824973f);
+
+		float x = saturate(float(count) / float(std::max(scale, 1u)));
+		float4 v4(1.0f, x, x * x, x * x * x);
+		float2 v2 = float2(v4.z, v4.w) * v4.z;
+		return saturate(float3(dot(v4, red) + dot(v2, red2), dot(v4, green) + dot(v2, green2), dot(v4, blue) + dot(v2, blue2)));
+	}
+
+	void MakeHeatmap(const EvaluationImage& evaluations, int mode, uint32_t scale, Image& heatmap)
+	{
+		heatmap.Resize(evaluations.width, evaluations.height);
+		for (size_t i = 0; i < evaluations.pixels.size(); i++)
+			heatmap.pixels[i] = HeatmapColor(evaluations.pixels[i].Get(mode), scale);
+	}
+
+	bool SaveEvaluationHistogram(const EvaluationImage& evaluations, const std::filesystem::path& fileName)
+	{
+		std::ofstream file(fileName);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		const int modes[] = { SDF_HEATMAP_TOTAL, SDF_HEATMAP_PRIMARY, SDF_HEATMAP_NORMAL, SDF_HEATMAP_AO, SDF_HEATMAP_SHADOW };
+		std::vector<EvaluationDistribution> distributions;
+		size_t rows = 0;
+		for (int mode : modes)
+		{
+			distributions.push_back(GetEvaluationDistribution(evaluations, mode));
+			rows = std::max(rows, distributions.back().histogram.size());
+		}
+
+		file << "evaluations,total,primary,normal,ao,shadow\n";
+		for (size_t count = 0; count < rows; count++)
+		{
+			file << count;
+			for (const EvaluationDistribution& distribution : distributions)
+				file << ',' << (count < distribution.histogram.size() ? distribution.histogram[count] : 0);
+			file << '\n';
+		}
+
+		return file.good();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Analysis of the per-pixel map() evaluation counts recorded by CpuRenderer::SetRecordEvaluations().
+//
+// Frame time is the number of map() calls times their cost. The distribution of the counts, split by
+// the shader function that made them, tells which of the two changed; the heatmap shows where.
+
+#include "Renderer.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace sdf
+{
+	struct EvaluationDistribution
+	{
+		uint64_t pixels = 0;
+		uint64_t sum = 0;
+		uint32_t p50 = 0;
+		uint32_t p95 = 0;
+		uint32_t p99 = 0;
+		uint32_t max = 0;
+		std::vector<uint64_t> histogram;  // histogram[n]: pixels with n evaluations
+
+		double GetMean() const { return pixels ? double(sum) / double(pixels) : 0.0; }
+		// Smallest count that at least the given fraction of the pixels does not exceed.
+		uint32_t GetPercentile(double fraction) const;
+	};
+
+	// Distribution of one of the SDF_HEATMAP_TOTAL ... SDF_HEATMAP_SHADOW counts over the image.
+	EvaluationDistribution GetEvaluationDistribution(const EvaluationImage& evaluations, int mode);
+
+	// Display color of a count on a color scale that saturates at scale. Same ramp as heatmapColor()
+	// in SDF.hlsli, a polynomial fit of the Turbo colormap (Mikhailov, 2019).
+	float3 HeatmapColor(uint32_t count, uint32_t scale);
+
+	// Heatmap of one count. The colors are display values, save it without sRGB encoding.
+	void MakeHeatmap(const EvaluationImage& evaluations, int mode, uint32_t scale, Image& heatmap);
+
+	// CSV with one row per evaluation count: the number of pixels with that many evaluations in total
+	// and in each shader function.
+	bool SaveEvaluationHistogram(const EvaluationImage& evaluations, const std::filesystem::path& fileName);
+}
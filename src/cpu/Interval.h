@@ -0,0 +1,95 @@
+#pragma once
+
+// Interval arithmetic over scene tapes: bounds the distance field inside an axis-aligned region.
+
+#include "Tape.h"
+
+#include <algorithm>
+
+namespace sdf
+{
+	struct Interval
+	{
+		float lo = 0.f;
+		float hi = 0.f;
+
+		Interval() = default;
+		Interval(float _lo, float _hi) : lo(_lo), hi(_hi) { }
+		explicit Interval(float x) : lo(x), hi(x) { }
+
+		bool Contains(float x) const { return lo <= x && x <= hi; }
+	};
+
+	inline Interval operator+(const Interval& a, float b) { return Interval(a.lo + b, a.hi + b); }
+	inline Interval operator-(const Interval& a, float b) { return Interval(a.lo - b, a.hi - b); }
+	inline Interval operator-(const Interval& a) { return Interval(-a.hi, -a.lo); }
+	inline Interval min(const Interval& a, const Interval& b) { return Interval(std::min(a.lo, b.lo), std::min(a.hi, b.hi)); }
+	inline Interval max(const Interval& a, const Interval& b) { return Interval(std::max(a.lo, b.lo), std::max(a.hi, b.hi)); }
+
+	// Range of a primitive over a box. Every primitive in the library is an exact (1-Lipschitz)
+	// distance, so its value anywhere in the box lies within the half diagonal of the value at the center.
+	// The plane is linear and gets the exact range. c_IntervalSlack covers float rounding in the point evaluator.
+	constexpr float c_IntervalSlack = 1e-5f;
+
+	inline Interval EvaluatePrimitive(const TapeInstruction& ins, const box3& region)
+	{
+		float3 center = region.center();
+		float3 extent = region.diagonal() * 0.5f;
+
+		if (GetOpcode(ins) == SDF_OP_PLANE)
+		{
+			float3 n(ins.params[0], ins.params[1], ins.params[2]);
+			float d = dot(center, n) - ins.params[3];
+			float r = dot(abs(n), extent) + c_IntervalSlack;
+			return Interval(d - r, d + r);
+		}
+
+		float d = EvaluatePrimitive(ins, Vec3<float>(center.x, center.y, center.z));
+		float r = length(extent) + c_IntervalSlack;
+		return Interval(d - r, d + r);
+	}
+
+	inline Interval EvaluateBinary(const TapeInstruction& ins, const Interval& a, const Interval& b)
+	{
+		const float k = ins.params[0];
+
+		switch (GetOpcode(ins))
+		{
+		case SDF_OP_UNION:
+			return min(a, b);
+		case SDF_OP_SUBTRACTION:
+			return max(a, -b);
+		case SDF_OP_INTERSECTION:
+			return max(a, b);
+		case SDF_OP_SMOOTH_UNION: {
+			// The polynomial smooth minimum undershoots min() by at most k/4.
+			Interval r = min(a, b);
+			return Interval(r.lo - 0.25f * k, r.hi);
+		}
+		case SDF_OP_SMOOTH_SUBTRACTION: {
+			Interval r = max(a, -b);
+			return Interval(r.lo, r.hi + 0.25f * k);
+		}
+		case SDF_OP_SMOOTH_INTERSECTION: {
+			Interval r = max(a, b);
+			return Interval(r.lo, r.hi + 0.25f * k);
+		}
+		default:
+			return a;
+		}
+	}
+
+	inline Interval EvaluateUnary(const TapeInstruction& ins, const Interval& d, float time)
+	{
+		// The noise stays within its amplitude either way, the other operators add a constant offset.
+		if (GetOpcode(ins) == SDF_OP_DISPLACE_NOISE)
+		{
+			float amplitude = std::abs(ins.params[0]);
+			return Interval(d.lo - amplitude, d.hi + amplitude);
+		}
+		float offset = EvaluateUnary(ins, 0.0f, Vec3<float>(0.0f, 0.0f, 0.0f), time);
+		return d + offset;
+	}
+
+	Interval EvaluateTape(const Tape& tape, const box3& region, float time);
+}
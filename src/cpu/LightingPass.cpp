@@ -0,0 +1,128 @@
+#include "LightingPass.h"
+#include "ConePrepass.h"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sdf
+{
+	int4 GetLightingConstants(int scale, int width)
+	{
+		if (scale <= 1)
+			return int4(0);
+		return int4(scale, (width + scale - 1) / scale, 0, 0);
+	}
+
+	int2 GetLightingSampleCount(const RenderConstants& constants)
+	{
+		if (constants.g_Lighting.x <= 1)
+			return int2(0);
+		return int2(constants.g_Lighting.y, (int(constants.g_Resolution.y) + constants.g_Lighting.x - 1) / constants.g_Lighting.x);
+	}
+
+	void RenderLightingPass(tf::Executor& executor, const RenderConstants& constants, const SceneMap& map,
+		const std::vector<float>& coneDepth, std::vector<LightingSample>& samples, RenderStats* stats)
+	{
+		const int2 sampleCount = GetLightingSampleCount(constants);
+		const int scale = constants.g_Lighting.x;
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		samples.resize(size_t(sampleCount.x) * size_t(sampleCount.y));
+		if (samples.empty())
+			return;
+
+		const Camera camera = Camera::Current(constants);
+		std::vector<RenderStats> rowStats(sampleCount.y);
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0, sampleCount.y, 1, [&](int sy)
+		{
+			RenderStats& stats = rowStats[sy];
+			for (int sx = 0; sx < sampleCount.x; sx++)
+			{
+				// The center of the block, also for the blocks cut by the edges of the image, so that the
+				// upsample can place every sample on the same grid.
+				const float2 pixel = (float2(float(sx), float(sy)) + 0.5f) * float(scale);
+				const float2 conePixel = min(pixel, resolution - 0.5f);
+				const float3 rd = camera.PixelRay(pixel, resolution);
+
+				LightingSample& sample = samples[size_t(sy) * sampleCount.x + sx];
+				sample.position = float3(0.f);
+				sample.t = -1.f;
+				sample.normal = float3(0.f);
+				sample.occlusion = 0.f;
+				sample.keyShadow = 0.f;
+				sample.skyShadow = 0.f;
+				sample.pad = float2(0.f);
+
+				float2 res = Raycast(map, camera.origin, rd, int(constants.g_Factor.x), GetConeStart(constants, coneDepth, conePixel),
+					constants.g_Relax.x, &stats);
+				stats.lightingSamples++;
+				if (res.y < 0.f)
+					continue;
+
+				const float3 pos = camera.origin + res.x * rd;
+				const float3 nor = (res.y < 1.5f) ? float3(0.f, 1.f, 0.f) : CalcNormal(map, pos, res.x, &stats);
+				const LightingTerms terms = CalcLightingTerms(constants, map, pos, nor, rd, &stats);
+				sample.position = pos;
+				sample.t = res.x;
+				sample.normal = nor;
+				sample.occlusion = terms.occlusion;
+				sample.keyShadow = terms.keyShadow;
+				sample.skyShadow = terms.skyShadow;
+			}
+		}, 1);
+
+		executor.run(taskflow).wait();
+
+		if (stats)
+		{
+			for (const RenderStats& row : rowStats)
+				*stats += row;
+		}
+	}
+
+	bool UpsampleLighting(const RenderConstants& constants, const std::vector<LightingSample>& samples,
+		const float2& pixel, const float3& pos, const float3& nor, float t, LightingTerms& terms)
+	{
+		const int2 sampleCount = GetLightingSampleCount(constants);
+		if (samples.empty() || sampleCount.x * sampleCount.y != int(samples.size()))
+			return false;
+
+		// The samples sit at the centers of the blocks, so the four around the pixel start half a block
+		// up and to the left of it.
+		const float2 u = pixel / float(constants.g_Lighting.x) - 0.5f;
+		const int2 base = int2(int(std::floor(u.x)), int(std::floor(u.y)));
+		const float2 f = u - float2(base);
+
+		float weightSum = 0.f;
+		float3 sum(0.f);
+		for (int j = 0; j < 2; j++)
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				const int sx = std::clamp(base.x + i, 0, sampleCount.x - 1);
+				const int sy = std::clamp(base.y + j, 0, sampleCount.y - 1);
+				const LightingSample& sample = samples[size_t(sy) * sampleCount.x + sx];
+				if (sample.t < 0.f)
+					continue;
+
+				float weight = (i ? f.x : 1.f - f.x) * (j ? f.y : 1.f - f.y);
+				weight *= saturate(1.f - std::abs(dot(sample.position - pos, nor)) / (SDF_LIGHTING_DEPTH_TOLERANCE * t));
+				weight *= std::pow(saturate(dot(sample.normal, nor)), SDF_LIGHTING_NORMAL_POWER);
+				weightSum += weight;
+				sum += weight * float3(sample.occlusion, sample.keyShadow, sample.skyShadow);
+			}
+		}
+
+		if (weightSum < SDF_LIGHTING_MIN_WEIGHT)
+			return false;
+
+		sum /= weightSum;
+		terms.occlusion = sum.x;
+		terms.keyShadow = sum.y;
+		terms.skyShadow = sum.z;
+		return true;
+	}
+}
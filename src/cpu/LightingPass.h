@@ -0,0 +1,37 @@
+#pragma once
+
+// CPU port of the reduced-resolution lighting of sdf_lighting_cs.hlsl and its upsample in sdf_ps.hlsl.
+//
+// The soft shadows and the ambient occlusion are evaluated for one ray per block of g_Lighting.x pixels
+// and reconstructed per pixel with a joint bilateral upsample guided by the pixel's own hit distance and
+// normal (Kopf et al., "Joint Bilateral Upsampling", 2007). The layout of the samples is described next
+// to RenderConstants::g_Lighting in sdf_cb.h.
+
+#include "Renderer.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// g_Lighting for samples of scale x scale pixels on an image of the given width; below 2 the terms are
+	// evaluated per pixel.
+	int4 GetLightingConstants(int scale, int width);
+
+	// Number of samples on the image, 0 when the terms are evaluated per pixel.
+	int2 GetLightingSampleCount(const RenderConstants& constants);
+
+	// The samples of all blocks, the contents of g_LightingSamples. coneDepth is the result of the cone
+	// prepass, empty when it is disabled. The stats pointer may be null.
+	void RenderLightingPass(tf::Executor& executor, const RenderConstants& constants, const SceneMap& map,
+		const std::vector<float>& coneDepth, std::vector<LightingSample>& samples, RenderStats* stats = nullptr);
+
+	// Terms at a pixel, (0, 0) being the top-left corner of the image, whose ray hit pos with the normal
+	// nor at distance t. False when none of the nearest samples resembles the pixel.
+	bool UpsampleLighting(const RenderConstants& constants, const std::vector<LightingSample>& samples,
+		const float2& pixel, const float3& pos, const float3& nor, float t, LightingTerms& terms);
+}
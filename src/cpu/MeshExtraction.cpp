@@ -0,0 +1,548 @@
+#include "MeshExtraction.h"
+
+#include <donut/core/log.h>
+#include <donut/engine/SceneTypes.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <memory>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		constexpr int c_LeafCorners = c_LeafCells + 1;
+		constexpr int c_MaxCells = 1 << 21;
+		constexpr uint64_t c_EmptyKey = ~0ull;
+		// Pulls the vertex towards the mean of the crossings where the tangent planes leave it free,
+		// along flat areas and straight edges.
+		constexpr float c_QefRegularization = 0.01f;
+		// A leaf of the octree mostly holds fewer vertices than this.
+		constexpr size_t c_VerticesPerLeaf = 128;
+
+		// The corners of a cell, bit 0 for +x, bit 1 for +y and bit 2 for +z, and its edges as pairs of them.
+		constexpr int c_CellEdges[12][2] = {
+			{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+			{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+			{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+		};
+
+		template<typename F> F LoadRow(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StoreRow(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		uint64_t CellKey(const int3& cell)
+		{
+			return uint64_t(cell.x) | uint64_t(cell.y) << 21 | uint64_t(cell.z) << 42;
+		}
+
+		int3 KeyCell(uint64_t key)
+		{
+			return int3(int(key & (c_MaxCells - 1)), int(key >> 21 & (c_MaxCells - 1)), int(key >> 42));
+		}
+
+		struct OctreeNode
+		{
+			int3 first;     // first cell
+			int size = 0;   // cells along each axis
+		};
+
+		// Open addressing with linear probing. A cell's vertex lives in the slot its key was claimed
+		// in, so the leaves never wait for each other, and the slots are numbered at the end.
+		class VertexTable
+		{
+		public:
+			explicit VertexTable(int log2Slots)
+				: m_Shift(64 - log2Slots)
+				, m_Mask((size_t(1) << log2Slots) - 1)
+				, m_Keys(new std::atomic<uint64_t>[size_t(1) << log2Slots])
+				, positions(size_t(1) << log2Slots)
+				, normals(size_t(1) << log2Slots)
+			{
+				for (size_t i = 0; i <= m_Mask; i++)
+					m_Keys[i].store(c_EmptyKey, std::memory_order_relaxed);
+			}
+
+			size_t GetSlotCount() const { return m_Mask + 1; }
+			uint64_t GetKey(size_t slot) const { return m_Keys[slot].load(std::memory_order_relaxed); }
+
+			// The slot of the key, and whether this call claimed it. Fails when the table is 3/4 full.
+			bool Insert(uint64_t key, size_t& slot, bool& claimed)
+			{
+				slot = size_t((key * 0x9E3779B97F4A7C15ull) >> m_Shift);
+				for (;;)
+				{
+					uint64_t current = m_Keys[slot].load(std::memory_order_acquire);
+					if (current == key)
+					{
+						claimed = false;
+						return true;
+					}
+
+					if (current == c_EmptyKey)
+					{
+						if (m_Keys[slot].compare_exchange_strong(current, key, std::memory_order_acq_rel))
+						{
+							claimed = true;
+							return m_Count.fetch_add(1, std::memory_order_relaxed) < GetSlotCount() / 4 * 3;
+						}
+						// Another leaf got here first, with this key or another one.
+						if (current == key)
+						{
+							claimed = false;
+							return true;
+						}
+					}
+					slot = (slot + 1) & m_Mask;
+				}
+			}
+
+		private:
+			int m_Shift;
+			size_t m_Mask;
+			std::unique_ptr<std::atomic<uint64_t>[]> m_Keys;
+			std::atomic<size_t> m_Count = 0;
+
+		public:
+			std::vector<float3> positions;
+			std::vector<float3> normals;
+		};
+
+		// Solves the symmetric a * x = b, or returns false when a is close to singular.
+		bool SolveSymmetric(const float a[6], const float3& b, float3& x)
+		{
+			// a = | a0 a1 a2 |
+			//     | a1 a3 a4 |
+			//     | a2 a4 a5 |
+			const float c0 = a[3] * a[5] - a[4] * a[4];
+			const float c1 = a[2] * a[4] - a[1] * a[5];
+			const float c2 = a[1] * a[4] - a[2] * a[3];
+			const float det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+			if (std::fabs(det) < 1e-12f)
+				return false;
+
+			const float c4 = a[0] * a[5] - a[2] * a[2];
+			const float c5 = a[1] * a[2] - a[0] * a[4];
+			const float c8 = a[0] * a[3] - a[1] * a[1];
+			x = float3(c0 * b.x + c1 * b.y + c2 * b.z, c1 * b.x + c4 * b.y + c5 * b.z, c2 * b.x + c5 * b.y + c8 * b.z) / det;
+			return true;
+		}
+
+		class Extractor
+		{
+		public:
+			Extractor(const SceneMap& map, const float3& origin, float cellSize, const int3& cells)
+				: m_Map(map), m_Origin(origin), m_CellSize(cellSize), m_Cells(cells)
+			{
+			}
+
+			float3 GetCorner(const int3& corner) const { return m_Origin + float3(corner) * m_CellSize; }
+
+			// Drops the children that lie outside the grid or are too far from the surface to hold any of it.
+			void Subdivide(const OctreeNode& node, OctreeNode* children, uint32_t& childCount)
+			{
+				childCount = 0;
+				const int half = node.size / 2;
+				for (int i = 0; i < 8; i++)
+				{
+					OctreeNode child = { node.first + int3(i & 1, i >> 1 & 1, i >> 2) * half, half };
+					if (any(child.first >= m_Cells))
+						continue;
+
+					const float size = float(half) * m_CellSize;
+					const float d = m_Map(GetCorner(child.first) + 0.5f * size).x;
+					m_Evaluations.fetch_add(1, std::memory_order_relaxed);
+					// A cell of margin for the fields that aren't quite exact distances.
+					if (std::fabs(d) <= 0.5f * size * std::sqrt(3.f) + m_CellSize)
+						children[childCount++] = child;
+				}
+			}
+
+			// Claims the vertices of the crossed edges' cells and appends a quad of them per edge.
+			// Returns false when the vertex table is full.
+			bool Polygonize(const OctreeNode& leaf, VertexTable& table, std::vector<uint32_t>& quads)
+			{
+				float corners[c_LeafCorners * c_LeafCorners * c_LeafCorners];
+				EvaluateCorners(c_LeafCorners * c_LeafCorners * c_LeafCorners, [&leaf](int i)
+				{
+					return leaf.first + int3(i % c_LeafCorners, i / c_LeafCorners % c_LeafCorners, i / (c_LeafCorners * c_LeafCorners));
+				}, corners);
+				auto cornerAt = [&corners](int x, int y, int z) { return corners[(z * c_LeafCorners + y) * c_LeafCorners + x]; };
+
+				for (int z = 0; z < c_LeafCells; z++)
+				{
+					for (int y = 0; y < c_LeafCells; y++)
+					{
+						for (int x = 0; x < c_LeafCells; x++)
+						{
+							const int3 cell = leaf.first + int3(x, y, z);
+							if (any(cell >= m_Cells))
+								continue;
+
+							// The cell owns the edges along +x, +y and +z from its first corner. The four
+							// cells around an edge go counterclockwise seen from the end of the edge.
+							const bool inside = cornerAt(x, y, z) < 0.f;
+							const bool crossed[3] = {
+								(cornerAt(x + 1, y, z) < 0.f) != inside,
+								(cornerAt(x, y + 1, z) < 0.f) != inside,
+								(cornerAt(x, y, z + 1) < 0.f) != inside,
+							};
+							for (int axis = 0; axis < 3; axis++)
+							{
+								if (!crossed[axis])
+									continue;
+
+								int3 u(0), v(0);
+								u[(axis + 1) % 3] = 1;
+								v[(axis + 2) % 3] = 1;
+								if (any(cell - u - v < int3(0)))
+									continue;
+
+								const int3 around[4] = { cell - u - v, cell - v, cell, cell - u };
+								uint32_t quad[4];
+								for (int i = 0; i < 4; i++)
+								{
+									size_t slot;
+									bool claimed;
+									if (!table.Insert(CellKey(around[i]), slot, claimed))
+										return false;
+									if (claimed)
+										PlaceVertex(around[i], table.positions[slot], table.normals[slot]);
+									quad[i] = uint32_t(slot);
+								}
+
+								// The quad faces along the edge when the edge leaves the inside.
+								if (inside)
+									quads.insert(quads.end(), { quad[0], quad[1], quad[2], quad[3] });
+								else
+									quads.insert(quads.end(), { quad[0], quad[3], quad[2], quad[1] });
+							}
+						}
+					}
+				}
+				return true;
+			}
+
+			uint64_t GetEvaluations() const { return m_Evaluations.load(); }
+
+		private:
+			// Distances at count grid corners, cornerOf(i) for i < count, in packets. A corner's position
+			// and distance come out the same whether it's evaluated for a leaf or for a cell, which keeps
+			// the signs that a leaf and a vertex see on surfaces right at the corners in agreement.
+			template<typename CornerOf> void EvaluateCorners(int count, const CornerOf& cornerOf, float* distances)
+			{
+				for (int i = 0; i < count; i += WidthOf<FloatN>)
+				{
+					alignas(32) float xs[WidthOf<FloatN>], ys[WidthOf<FloatN>], zs[WidthOf<FloatN>], ds[WidthOf<FloatN>];
+					for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+					{
+						const float3 p = GetCorner(cornerOf(std::min(i + lane, count - 1)));
+						xs[lane] = p.x;
+						ys[lane] = p.y;
+						zs[lane] = p.z;
+					}
+					StoreRow(ds, m_Map.Evaluate(Vec3<FloatN>(LoadRow<FloatN>(xs), LoadRow<FloatN>(ys), LoadRow<FloatN>(zs))).x);
+					std::copy(ds, ds + std::min(int(WidthOf<FloatN>), count - i), distances + i);
+				}
+				m_Evaluations.fetch_add(uint64_t(count), std::memory_order_relaxed);
+			}
+
+			// Minimizes the squared distances to the tangent planes at the edge crossings, regularized
+			// towards their mean and clamped to the cell. The corners are evaluated again rather than
+			// taken from whichever leaf gets here first, so the vertex doesn't depend on the threads.
+			void PlaceVertex(const int3& cell, float3& position, float3& normal)
+			{
+				const float3 cellMin = GetCorner(cell);
+				float corners[8];
+				EvaluateCorners(8, [&cell](int i) { return cell + int3(i & 1, i >> 1 & 1, i >> 2); }, corners);
+
+				float3 points[12], normals[12];
+				int count = 0;
+				float3 mean(0.f);
+				for (const auto& edge : c_CellEdges)
+				{
+					const float d0 = corners[edge[0]], d1 = corners[edge[1]];
+					if ((d0 < 0.f) == (d1 < 0.f))
+						continue;
+
+					const float3 p0 = cellMin + float3(float(edge[0] & 1), float(edge[0] >> 1 & 1), float(edge[0] >> 2)) * m_CellSize;
+					const float3 p1 = cellMin + float3(float(edge[1] & 1), float(edge[1] >> 1 & 1), float(edge[1] >> 2)) * m_CellSize;
+					const float t = saturate(d0 / (d0 - d1));
+					points[count] = p0 + (p1 - p0) * t;
+					normals[count] = Normal(points[count]);
+					mean += points[count];
+					count++;
+				}
+
+				// The leaf saw a crossing that these corners don't, right at the surface.
+				if (count == 0)
+				{
+					position = cellMin + 0.5f * m_CellSize;
+					normal = Normal(position);
+					return;
+				}
+
+				// In coordinates relative to the mean, sum(n n^T) + lambda I times x = sum(n (n . (p - mean))).
+				mean /= float(count);
+				float ata[6] = { c_QefRegularization, 0.f, 0.f, c_QefRegularization, 0.f, c_QefRegularization };
+				float3 atb(0.f);
+				float3 normalSum(0.f);
+				for (int i = 0; i < count; i++)
+				{
+					const float3& n = normals[i];
+					ata[0] += n.x * n.x; ata[1] += n.x * n.y; ata[2] += n.x * n.z;
+					ata[3] += n.y * n.y; ata[4] += n.y * n.z; ata[5] += n.z * n.z;
+					atb += n * dot(n, points[i] - mean);
+					normalSum += n;
+				}
+
+				float3 offset;
+				if (!SolveSymmetric(ata, atb, offset))
+					offset = float3(0.f);
+				position = clamp(mean + offset, cellMin, cellMin + m_CellSize);
+
+				normal = Normal(position);
+				if (all(normal == 0.f))
+					normal = length(normalSum) > 0.f ? normalize(normalSum) : float3(0.f, 1.f, 0.f);
+			}
+
+			// The normalized gradient. Surfaces that run right through the grid corners put crossings
+			// on the kinks of min() and max(), where the derivatives cancel out, and there the
+			// tetrahedron of CalcNormal() over a fraction of a cell takes over. Zero if both vanish.
+			float3 Normal(const float3& pos)
+			{
+				const Dual<float> dual = m_Map.EvaluateDual(pos);
+				float3 gradient(dual.d.x, dual.d.y, dual.d.z);
+				m_Evaluations.fetch_add(1, std::memory_order_relaxed);
+				if (dot(gradient, gradient) > 1e-12f)
+					return normalize(gradient);
+
+				const float h = 1e-3f * m_CellSize;
+				gradient = float3(0.f);
+				for (const float3& k : { float3(1.f, -1.f, -1.f), float3(-1.f, -1.f, 1.f), float3(-1.f, 1.f, -1.f), float3(1.f, 1.f, 1.f) })
+					gradient += k * m_Map(pos + k * h).x;
+				m_Evaluations.fetch_add(4, std::memory_order_relaxed);
+				return dot(gradient, gradient) > 0.f ? normalize(gradient) : float3(0.f);
+			}
+
+			const SceneMap& m_Map;
+			float3 m_Origin;
+			float m_CellSize;
+			int3 m_Cells;
+			std::atomic<uint64_t> m_Evaluations = 0;
+		};
+	}
+
+	bool ExtractMesh(tf::Executor& executor, const SceneMap& map, const MeshExtractionDesc& desc,
+		TriangleMesh& out, MeshExtractionStats* stats)
+	{
+		const float3 extent = desc.bounds.diagonal();
+		if (!(desc.cellSize > 0.f) || !(extent.x > 0.f && extent.y > 0.f && extent.z > 0.f) || !std::isfinite(extent.x + extent.y + extent.z))
+		{
+			log::error("Can't extract a mesh from an empty region");
+			return false;
+		}
+
+		const float3 cellCounts(std::ceil(extent.x / desc.cellSize), std::ceil(extent.y / desc.cellSize), std::ceil(extent.z / desc.cellSize));
+		if (cellCounts.x > float(c_MaxCells) || cellCounts.y > float(c_MaxCells) || cellCounts.z > float(c_MaxCells))
+		{
+			log::error("Can't extract a mesh over more than %d cells along an axis", c_MaxCells);
+			return false;
+		}
+
+		const int3 cells = max(int3(cellCounts), int3(1));
+		Extractor extractor(map, desc.bounds.m_mins, desc.cellSize, cells);
+
+		// The octree, a level at a time. The root is a power of two leaves wide and only its children
+		// that overlap the grid exist.
+		int rootSize = c_LeafCells;
+		while (rootSize < cells.x || rootSize < cells.y || rootSize < cells.z)
+			rootSize *= 2;
+
+		std::vector<OctreeNode> level = { { int3(0), rootSize } };
+		uint32_t nodeCount = 1;
+		while (level[0].size > c_LeafCells)
+		{
+			std::vector<OctreeNode> children(level.size() * 8);
+			std::vector<uint32_t> childCounts(level.size());
+			tf::Taskflow subdivide;
+			subdivide.for_each_index_dynamic(size_t(0), level.size(), size_t(1), [&](size_t i)
+			{
+				extractor.Subdivide(level[i], &children[i * 8], childCounts[i]);
+			}, 64);
+			executor.run(subdivide).wait();
+
+			std::vector<OctreeNode> next;
+			for (size_t i = 0; i < level.size(); i++)
+				next.insert(next.end(), children.begin() + i * 8, children.begin() + i * 8 + childCounts[i]);
+			nodeCount += uint32_t(next.size());
+
+			level = std::move(next);
+			if (level.empty())
+				break;
+		}
+		const std::vector<OctreeNode>& leaves = level;
+
+		// Polygonize the leaves, again with a larger table whenever it fills up.
+		int log2Slots = 12;
+		while ((size_t(1) << log2Slots) < 2 * c_VerticesPerLeaf * leaves.size())
+			log2Slots++;
+
+		std::unique_ptr<VertexTable> table;
+		std::vector<std::vector<uint32_t>> leafQuads(leaves.size());
+		for (;;)
+		{
+			table = std::make_unique<VertexTable>(log2Slots);
+			std::atomic<bool> full = false;
+			tf::Taskflow polygonize;
+			polygonize.for_each_index_dynamic(size_t(0), leaves.size(), size_t(1), [&](size_t i)
+			{
+				leafQuads[i].clear();
+				if (!full.load(std::memory_order_relaxed) && !extractor.Polygonize(leaves[i], *table, leafQuads[i]))
+					full.store(true, std::memory_order_relaxed);
+			});
+			executor.run(polygonize).wait();
+
+			if (!full.load())
+				break;
+			log2Slots++;
+		}
+
+		// Number the vertices in the order of their cells, z slowest, so the result doesn't depend on the threads.
+		std::vector<std::pair<uint64_t, uint32_t>> vertices;
+		for (size_t slot = 0; slot < table->GetSlotCount(); slot++)
+		{
+			const uint64_t key = table->GetKey(slot);
+			if (key != c_EmptyKey)
+			{
+				const int3 cell = KeyCell(key);
+				vertices.push_back({ (uint64_t(cell.z) * uint64_t(cells.y) + uint64_t(cell.y)) * uint64_t(cells.x) + uint64_t(cell.x), uint32_t(slot) });
+			}
+		}
+		std::sort(vertices.begin(), vertices.end());
+
+		std::vector<uint32_t> remap(table->GetSlotCount());
+		out.positions.resize(vertices.size());
+		out.normals.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			remap[vertices[i].second] = uint32_t(i);
+			out.positions[i] = table->positions[vertices[i].second];
+			out.normals[i] = table->normals[vertices[i].second];
+		}
+
+		// Split every quad along its shorter diagonal, the leaves' triangles in the order of the leaves.
+		std::vector<size_t> firstIndex(leaves.size() + 1, 0);
+		for (size_t i = 0; i < leaves.size(); i++)
+			firstIndex[i + 1] = firstIndex[i] + leafQuads[i].size() / 4 * 6;
+		out.indices.resize(firstIndex.back());
+
+		tf::Taskflow triangulate;
+		triangulate.for_each_index_dynamic(size_t(0), leaves.size(), size_t(1), [&](size_t i)
+		{
+			uint32_t* indices = out.indices.data() + firstIndex[i];
+			const std::vector<uint32_t>& quads = leafQuads[i];
+			for (size_t q = 0; q < quads.size(); q += 4)
+			{
+				const uint32_t a = remap[quads[q]], b = remap[quads[q + 1]], c = remap[quads[q + 2]], d = remap[quads[q + 3]];
+				const float3 ac = out.positions[c] - out.positions[a];
+				const float3 bd = out.positions[d] - out.positions[b];
+				if (dot(ac, ac) <= dot(bd, bd))
+				{
+					*indices++ = a; *indices++ = b; *indices++ = c;
+					*indices++ = a; *indices++ = c; *indices++ = d;
+				}
+				else
+				{
+					*indices++ = b; *indices++ = c; *indices++ = d;
+					*indices++ = b; *indices++ = d; *indices++ = a;
+				}
+			}
+		}, 16);
+		executor.run(triangulate).wait();
+
+		if (stats)
+		{
+			stats->nodes = nodeCount;
+			stats->leaves = uint32_t(leaves.size());
+			stats->evaluations = extractor.GetEvaluations();
+		}
+		return true;
+	}
+
+	void FillMeshInfo(const TriangleMesh& mesh, engine::MeshInfo& info)
+	{
+		auto buffers = std::make_shared<engine::BufferGroup>();
+		buffers->positionData = mesh.positions;
+		buffers->indexData = mesh.indices;
+		buffers->normalData.reserve(mesh.normals.size());
+		for (const float3& normal : mesh.normals)
+			buffers->normalData.push_back(vectorToSnorm8(normal));
+
+		auto geometry = std::make_shared<engine::MeshGeometry>();
+		geometry->objectSpaceBounds = mesh.GetBounds();
+		geometry->numIndices = uint32_t(mesh.indices.size());
+		geometry->numVertices = uint32_t(mesh.positions.size());
+
+		info.type = engine::MeshType::Triangles;
+		info.buffers = buffers;
+		info.geometries = { geometry };
+		info.objectSpaceBounds = geometry->objectSpaceBounds;
+		info.indexOffset = 0;
+		info.vertexOffset = 0;
+		info.totalIndices = geometry->numIndices;
+		info.totalVertices = geometry->numVertices;
+	}
+
+	bool SaveObj(const TriangleMesh& mesh, const std::filesystem::path& fileName)
+	{
+		std::ofstream file(fileName);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		const bool withNormals = mesh.normals.size() == mesh.positions.size();
+		for (const float3& p : mesh.positions)
+			file << "v " << p.x << ' ' << p.y << ' ' << p.z << '\n';
+		if (withNormals)
+		{
+			for (const float3& n : mesh.normals)
+				file << "vn " << n.x << ' ' << n.y << ' ' << n.z << '\n';
+		}
+
+		// OBJ counts from 1.
+		for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3)
+		{
+			file << 'f';
+			for (size_t j = i; j < i + 3; j++)
+			{
+				file << ' ' << mesh.indices[j] + 1;
+				if (withNormals)
+					file << "//" << mesh.indices[j] + 1;
+			}
+			file << '\n';
+		}
+
+		return file.good();
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Triangle meshes extracted from the SDF scene, as raster LODs of distant content and as cheap
+// proxies for collision and shadow maps.
+//
+// Dual contouring (Ju et al. 2002, "Dual contouring of Hermite data") over a uniform grid of cells.
+// An octree over the grid skips empty space: a node whose center is farther from the surface than its
+// half diagonal can't hold any of it, so only the leaves of c_LeafCells^3 cells that survive are
+// sampled. The leaves are polygonized in parallel. A cell that the surface crosses gets one vertex at
+// the point closest to the tangent planes of its edge crossings, which keeps sharp CSG edges and
+// corners, and every crossed edge becomes a quad between the four cells around it. Leaves share the
+// vertices of their border cells through a lock-free hash table keyed by cell, so the result is welded.
+
+#include "MeshSdf.h"
+#include "Renderer.h"
+
+#include <filesystem>
+
+namespace donut::engine
+{
+	struct MeshInfo;
+}
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	struct MeshExtractionDesc
+	{
+		box3 bounds = box3(float3(-2.5f, -0.5f, -2.5f), float3(2.5f, 2.0f, 2.5f));
+		float cellSize = 0.02f;
+	};
+
+	struct MeshExtractionStats
+	{
+		uint32_t nodes = 0;         // octree nodes visited
+		uint32_t leaves = 0;        // of them the leaves that were polygonized
+		uint64_t evaluations = 0;   // distance and gradient evaluations
+	};
+
+	constexpr int c_LeafCells = 8;
+
+	// Polygonizes map at time map.time on the executor's workers into out, with a normal per vertex.
+	// The triangles face outwards and the vertices come in the same order whatever the thread count.
+	// Fails on an empty region or more than 2^21 cells along an axis.
+	bool ExtractMesh(tf::Executor& executor, const SceneMap& map, const MeshExtractionDesc& desc,
+		TriangleMesh& out, MeshExtractionStats* stats = nullptr);
+
+	// Fills a mesh with a single triangle geometry and a BufferGroup holding the CPU copies of the
+	// positions, normals and indices, ready for Scene::CreateMeshBuffers.
+	void FillMeshInfo(const TriangleMesh& mesh, donut::engine::MeshInfo& info);
+
+	// Wavefront OBJ with positions, normals when there are any, and triangles.
+	bool SaveObj(const TriangleMesh& mesh, const std::filesystem::path& fileName);
+}
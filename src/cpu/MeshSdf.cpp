@@ -0,0 +1,522 @@
+#include "MeshSdf.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/GltfImporter.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/TextureCache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		constexpr uint32_t c_LeafTriangles = 4;
+		constexpr int c_MaxStackDepth = 64;
+		constexpr float c_InvFourPi = 0.0795774715f;
+		// A node's dipole replaces its triangles beyond this many radii from its center.
+		constexpr float c_DipoleDistance = 2.0f;
+
+		// Only the geometry matters here, so the materials don't read or decode their textures.
+		class GeometryOnlyTextureCache : public engine::TextureCache
+		{
+		public:
+			using TextureCache::TextureCache;
+
+			std::shared_ptr<engine::LoadedTexture> LoadTextureFromFileDeferred(const std::filesystem::path&, bool) override
+			{
+				return nullptr;
+			}
+
+			std::shared_ptr<engine::LoadedTexture> LoadTextureFromMemoryDeferred(const std::shared_ptr<vfs::IBlob>&,
+				const std::string&, const std::string&, bool) override
+			{
+				return nullptr;
+			}
+
+#ifdef DONUT_WITH_TASKFLOW
+			std::shared_ptr<engine::LoadedTexture> LoadTextureFromFileAsync(const std::filesystem::path&, bool, tf::Executor&) override
+			{
+				return nullptr;
+			}
+
+			std::shared_ptr<engine::LoadedTexture> LoadTextureFromMemoryAsync(const std::shared_ptr<vfs::IBlob>&,
+				const std::string&, const std::string&, bool, tf::Executor&) override
+			{
+				return nullptr;
+			}
+#endif
+		};
+
+		template<typename F> F LoadPacket(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StorePacket(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		template<typename F> Vec3<F> SplatVec(const float3& v)
+		{
+			return Splat<F>(v.x, v.y, v.z);
+		}
+
+		template<typename F> F BoxDistanceSquared(const Vec3<F>& p, const float3& boundsMin, const float3& boundsMax)
+		{
+			const F dx = max(max(F(boundsMin.x) - p.x, p.x - F(boundsMax.x)), F(0.f));
+			const F dy = max(max(F(boundsMin.y) - p.y, p.y - F(boundsMax.y)), F(0.f));
+			const F dz = max(max(F(boundsMin.z) - p.z, p.z - F(boundsMax.z)), F(0.f));
+			return dx * dx + dy * dy + dz * dz;
+		}
+
+		template<typename F> F dot2(const Vec3<F>& v)
+		{
+			return dot(v, v);
+		}
+
+		// Squared udTriangle(): the distance to the plane above the triangle, to the closest edge elsewhere.
+		// Branch free, so a packet of points goes through it at once.
+		template<typename F, typename Triangle> F TriangleDistanceSquared(const Vec3<F>& p, const Triangle& tri)
+		{
+			const Vec3<F> ba = SplatVec<F>(tri.ba);
+			const Vec3<F> cb = SplatVec<F>(tri.cb);
+			const Vec3<F> ac = SplatVec<F>(tri.ac);
+			const Vec3<F> pa = p - SplatVec<F>(tri.a);
+			const Vec3<F> pb = pa - ba;
+			const Vec3<F> pc = pa + ac;
+
+			const MaskOf<F> inside = (dot(SplatVec<F>(cross(tri.ba, tri.normal)), pa) >= F(0.f))
+				& (dot(SplatVec<F>(cross(tri.cb, tri.normal)), pb) >= F(0.f))
+				& (dot(SplatVec<F>(cross(tri.ac, tri.normal)), pc) >= F(0.f));
+
+			const F plane = dot(SplatVec<F>(tri.normal), pa);
+			const F edges = min(min(
+				dot2(ba * saturate(dot(ba, pa) * F(tri.invBa)) - pa),
+				dot2(cb * saturate(dot(cb, pb) * F(tri.invCb)) - pb)),
+				dot2(ac * saturate(dot(ac, pc) * F(tri.invAc)) - pc));
+
+			return select(inside, plane * plane * F(tri.invNormal), edges);
+		}
+
+		// Solid angle of triangle abc seen from p over 4 pi (Van Oosterom and Strackee 1983).
+		float TriangleWinding(const float3& p, const float3& a, const float3& b, const float3& c)
+		{
+			const float3 pa = a - p;
+			const float3 pb = b - p;
+			const float3 pc = c - p;
+			const float la = length(pa);
+			const float lb = length(pb);
+			const float lc = length(pc);
+			const float det = dot(pa, cross(pb, pc));
+			const float div = la * lb * lc + dot(pa, pb) * lc + dot(pb, pc) * la + dot(pc, pa) * lb;
+			return std::atan2(det, div) * (2.f * c_InvFourPi);
+		}
+	}
+
+	box3 TriangleMesh::GetBounds() const
+	{
+		box3 bounds = box3::empty();
+		for (const float3& p : positions)
+			bounds |= p;
+		return bounds;
+	}
+
+	bool AppendMesh(const engine::MeshInfo& mesh, const affine3& transform, TriangleMesh& out)
+	{
+		if (!mesh.buffers)
+		{
+			log::error("Mesh %s has no buffers", mesh.name.c_str());
+			return false;
+		}
+
+		const engine::BufferGroup& buffers = *mesh.buffers;
+		// A mirroring transform turns the triangles inside out, which would flip the winding number.
+		const bool mirrored = determinant(transform.m_linear) < 0.f;
+
+		for (const auto& geometry : mesh.geometries)
+		{
+			if (geometry->type != engine::MeshGeometryPrimitiveType::Triangles)
+				continue;
+
+			const size_t firstVertex = size_t(mesh.vertexOffset) + geometry->vertexOffsetInMesh;
+			const size_t firstIndex = size_t(mesh.indexOffset) + geometry->indexOffsetInMesh;
+			if (firstVertex + geometry->numVertices > buffers.positionData.size()
+				|| firstIndex + geometry->numIndices > buffers.indexData.size())
+			{
+				log::error("Mesh %s has no CPU copy of its positions and indices", mesh.name.c_str());
+				return false;
+			}
+
+			const uint32_t base = uint32_t(out.positions.size());
+			for (uint32_t i = 0; i < geometry->numVertices; i++)
+				out.positions.push_back(transform.transformPoint(buffers.positionData[firstVertex + i]));
+
+			for (uint32_t i = 0; i + 3 <= geometry->numIndices; i += 3)
+			{
+				uint32_t tri[3] = { buffers.indexData[firstIndex + i], buffers.indexData[firstIndex + i + 1], buffers.indexData[firstIndex + i + 2] };
+				if (tri[0] >= geometry->numVertices || tri[1] >= geometry->numVertices || tri[2] >= geometry->numVertices)
+				{
+					log::error("Mesh %s has an index out of range", mesh.name.c_str());
+					return false;
+				}
+
+				if (mirrored)
+					std::swap(tri[1], tri[2]);
+				out.indices.push_back(base + tri[0]);
+				out.indices.push_back(base + tri[1]);
+				out.indices.push_back(base + tri[2]);
+			}
+		}
+
+		return true;
+	}
+
+	bool LoadGltfMesh(const std::shared_ptr<vfs::IFileSystem>& fs, const std::filesystem::path& fileName,
+		TriangleMesh& out, tf::Executor* executor)
+	{
+		engine::GltfImporter importer(fs, std::make_shared<engine::SceneTypeFactory>());
+		GeometryOnlyTextureCache textureCache(nullptr, fs, nullptr);
+		engine::SceneLoadingStats stats;
+		engine::SceneImportResult result;
+		if (!importer.Load(fileName, textureCache, stats, executor, result) || !result.rootNode)
+		{
+			log::error("Couldn't load glTF file %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		// The scene graph resolves the instance transforms.
+		auto graph = std::make_shared<engine::SceneGraph>();
+		graph->SetRootNode(result.rootNode);
+		graph->Refresh(0);
+
+		for (const auto& instance : graph->GetMeshInstances())
+		{
+			const std::shared_ptr<engine::MeshInfo>& mesh = instance->GetMesh();
+			if (!mesh || mesh->IsCurve())
+				continue;
+
+			if (!AppendMesh(*mesh, instance->GetNode()->GetLocalToWorldTransformFloat(), out))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool MeshDistance::Build(const TriangleMesh& mesh)
+	{
+		const uint32_t triangleCount = mesh.GetTriangleCount();
+		if (triangleCount == 0)
+		{
+			log::error("Can't compute the distance to an empty mesh");
+			return false;
+		}
+
+		for (uint32_t index : mesh.indices)
+		{
+			if (index >= mesh.positions.size())
+			{
+				log::error("Mesh index %u is out of range", index);
+				return false;
+			}
+		}
+
+		m_Triangles.resize(triangleCount);
+		std::vector<float3> centroids(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			const float3 a = mesh.positions[mesh.indices[i * 3]];
+			const float3 b = mesh.positions[mesh.indices[i * 3 + 1]];
+			const float3 c = mesh.positions[mesh.indices[i * 3 + 2]];
+			centroids[i] = (a + b + c) * (1.f / 3.f);
+
+			Triangle& tri = m_Triangles[i];
+			tri.a = a;
+			tri.ba = b - a;
+			tri.cb = c - b;
+			tri.ac = a - c;
+			tri.normal = cross(tri.ba, tri.ac);
+			tri.invBa = dot(tri.ba, tri.ba) > 0.f ? 1.f / dot(tri.ba, tri.ba) : 0.f;
+			tri.invCb = dot(tri.cb, tri.cb) > 0.f ? 1.f / dot(tri.cb, tri.cb) : 0.f;
+			tri.invAc = dot(tri.ac, tri.ac) > 0.f ? 1.f / dot(tri.ac, tri.ac) : 0.f;
+			tri.invNormal = dot(tri.normal, tri.normal) > 0.f ? 1.f / dot(tri.normal, tri.normal) : 0.f;
+		}
+
+		std::vector<uint32_t> order(triangleCount);
+		std::iota(order.begin(), order.end(), 0u);
+
+		m_Nodes.clear();
+		m_Dipoles.clear();
+		m_Nodes.reserve(2 * (triangleCount / c_LeafTriangles + 1));
+		m_Dipoles.reserve(m_Nodes.capacity());
+		BuildNode(order.data(), 0, triangleCount, centroids.data());
+
+		// Leaves reference contiguous ranges of the reordered triangles.
+		std::vector<Triangle> sorted(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++)
+			sorted[i] = m_Triangles[order[i]];
+		m_Triangles = std::move(sorted);
+
+		return true;
+	}
+
+	uint32_t MeshDistance::BuildNode(uint32_t* order, uint32_t first, uint32_t count, const float3* centroids)
+	{
+		const uint32_t index = uint32_t(m_Nodes.size());
+		m_Nodes.emplace_back();
+		m_Dipoles.emplace_back();
+
+		if (count <= c_LeafTriangles)
+		{
+			box3 bounds = box3::empty();
+			float3 weightedCenter = 0.f;
+			float3 areaNormal = 0.f;
+			float area = 0.f;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const Triangle& tri = m_Triangles[order[first + i]];
+				bounds = bounds | tri.a | tri.GetB() | tri.GetC();
+				const float3 n = -0.5f * tri.normal;
+				const float a = length(n);
+				weightedCenter += centroids[order[first + i]] * a;
+				areaNormal += n;
+				area += a;
+			}
+
+			Dipole& dipole = m_Dipoles[index];
+			dipole.center = area > 0.f ? weightedCenter / area : bounds.center();
+			dipole.areaNormal = areaNormal;
+			dipole.area = area;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const Triangle& tri = m_Triangles[order[first + i]];
+				dipole.radius = std::max(dipole.radius, std::max(length(tri.a - dipole.center),
+					std::max(length(tri.GetB() - dipole.center), length(tri.GetC() - dipole.center))));
+			}
+
+			Node& node = m_Nodes[index];
+			node.boundsMin = bounds.m_mins;
+			node.boundsMax = bounds.m_maxs;
+			node.offset = first;
+			node.count = count;
+			return index;
+		}
+
+		// Median split of the centroids along the longest axis keeps the tree balanced, so its depth stays
+		// around log2(count) however the triangles are distributed.
+		box3 centroidBounds = box3::empty();
+		for (uint32_t i = 0; i < count; i++)
+			centroidBounds |= centroids[order[first + i]];
+
+		const float3 extent = centroidBounds.diagonal();
+		const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		const uint32_t half = count / 2;
+		std::nth_element(order + first, order + first + half, order + first + count, [centroids, axis](uint32_t a, uint32_t b) {
+			return centroids[a][axis] < centroids[b][axis];
+		});
+
+		const uint32_t left = BuildNode(order, first, half, centroids);
+		const uint32_t right = BuildNode(order, first + half, count - half, centroids);
+
+		// The children's dipoles merge into their parent's: the area-weighted centers average, the
+		// area normals add up and the radius grows to enclose both children's balls.
+		const Dipole& l = m_Dipoles[left];
+		const Dipole& r = m_Dipoles[right];
+		Dipole dipole;
+		dipole.area = l.area + r.area;
+		dipole.center = dipole.area > 0.f ? (l.center * l.area + r.center * r.area) / dipole.area : 0.5f * (l.center + r.center);
+		dipole.areaNormal = l.areaNormal + r.areaNormal;
+		dipole.radius = std::max(length(l.center - dipole.center) + l.radius, length(r.center - dipole.center) + r.radius);
+		m_Dipoles[index] = dipole;
+
+		Node& node = m_Nodes[index];
+		node.boundsMin = min(m_Nodes[left].boundsMin, m_Nodes[right].boundsMin);
+		node.boundsMax = max(m_Nodes[left].boundsMax, m_Nodes[right].boundsMax);
+		node.offset = right;
+		node.count = 0;
+		return index;
+	}
+
+	template<typename F> F MeshDistance::DistanceSquared(const Vec3<F>& pos, F maxDistanceSquared) const
+	{
+		F best = maxDistanceSquared;
+		uint32_t stack[c_MaxStackDepth];
+		int sp = 0;
+		uint32_t index = 0;
+
+		for (;;)
+		{
+			const Node& node = m_Nodes[index];
+			if (any(BoxDistanceSquared(pos, node.boundsMin, node.boundsMax) < best))
+			{
+				if (node.count > 0)
+				{
+					for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+						best = min(best, TriangleDistanceSquared(pos, m_Triangles[i]));
+				}
+				else
+				{
+					// Nearer child first, so the far one is more likely to be culled when it is popped.
+					const uint32_t left = index + 1;
+					const uint32_t right = node.offset;
+					const bool leftFirst = lane(BoxDistanceSquared(pos, m_Nodes[left].boundsMin, m_Nodes[left].boundsMax), 0)
+						<= lane(BoxDistanceSquared(pos, m_Nodes[right].boundsMin, m_Nodes[right].boundsMax), 0);
+					stack[sp++] = leftFirst ? right : left;
+					index = leftFirst ? left : right;
+					continue;
+				}
+			}
+
+			if (sp == 0)
+				break;
+			index = stack[--sp];
+		}
+
+		return best;
+	}
+
+	float MeshDistance::UnsignedDistance(const float3& pos, float maxDistance) const
+	{
+		if (m_Nodes.empty())
+			return maxDistance;
+
+		const float bound = maxDistance < 1e15f ? maxDistance * maxDistance : 1e30f;
+		return std::min(std::sqrt(DistanceSquared(Vec3<float>(pos.x, pos.y, pos.z), bound)), maxDistance);
+	}
+
+	float MeshDistance::WindingNumber(const float3& pos) const
+	{
+		if (m_Nodes.empty())
+			return 0.f;
+
+		float winding = 0.f;
+		uint32_t stack[c_MaxStackDepth];
+		int sp = 0;
+		uint32_t index = 0;
+
+		for (;;)
+		{
+			const Dipole& dipole = m_Dipoles[index];
+			const float3 r = dipole.center - pos;
+			const float distance = length(r);
+			const Node& node = m_Nodes[index];
+			if (distance > c_DipoleDistance * dipole.radius)
+			{
+				winding += dot(r, dipole.areaNormal) * c_InvFourPi / (distance * distance * distance);
+			}
+			else if (node.count > 0)
+			{
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+				{
+					const Triangle& tri = m_Triangles[i];
+					winding += TriangleWinding(pos, tri.a, tri.GetB(), tri.GetC());
+				}
+			}
+			else
+			{
+				stack[sp++] = node.offset;
+				index++;
+				continue;
+			}
+
+			if (sp == 0)
+				break;
+			index = stack[--sp];
+		}
+
+		return winding;
+	}
+
+	float MeshDistance::Distance(const float3& pos) const
+	{
+		const float d = UnsignedDistance(pos);
+		return WindingNumber(pos) > 0.5f ? -d : d;
+	}
+
+	void MeshDistance::DistanceBlock(const float3& origin, float step, int count, float* distances) const
+	{
+		const size_t dy = size_t(count);
+		const size_t dz = size_t(count) * size_t(count);
+		// Some slack so rounding can't make a bound undercut the distance.
+		const float boundStep = step * 1.001f + 1e-6f;
+
+		// Signs from the neighbour a step away. The surface can only cross the segment between the two
+		// if it comes within a step of both, and only then does the winding number decide.
+		auto setSign = [&](size_t i, size_t neighbour, const float3& pos)
+		{
+			bool inside = distances[neighbour] < 0.f;
+			if (std::max(std::fabs(distances[neighbour]), distances[i]) <= step)
+				inside = WindingNumber(pos) > 0.5f;
+			if (inside)
+				distances[i] = -distances[i];
+		};
+
+		// The first row walks along x from a full query.
+		distances[0] = UnsignedDistance(origin);
+		if (WindingNumber(origin) > 0.5f)
+			distances[0] = -distances[0];
+		for (int x = 1; x < count; x++)
+		{
+			const float3 pos = origin + float3(float(x) * step, 0.f, 0.f);
+			distances[x] = UnsignedDistance(pos, std::fabs(distances[x - 1]) + boundStep);
+			setSign(size_t(x), size_t(x - 1), pos);
+		}
+
+		// The other rows go as packets, each lane bounded by the row before it along y, or else along z.
+		for (int z = 0; z < count; z++)
+		{
+			for (int y = z == 0 ? 1 : 0; y < count; y++)
+			{
+				const size_t row = size_t(z) * dz + size_t(y) * dy;
+				const size_t neighbourRow = y > 0 ? row - dy : row - dz;
+				const float py = origin.y + float(y) * step;
+				const float pz = origin.z + float(z) * step;
+
+				int x = 0;
+				for (; x + WidthOf<FloatN> <= count; x += WidthOf<FloatN>)
+				{
+					alignas(32) float xs[WidthOf<FloatN>];
+					alignas(32) float bounds[WidthOf<FloatN>];
+					for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+					{
+						xs[lane] = origin.x + float(x + lane) * step;
+						bounds[lane] = std::fabs(distances[neighbourRow + x + lane]) + boundStep;
+					}
+
+					const FloatN bound = LoadPacket<FloatN>(bounds);
+					const FloatN d = sqrt(DistanceSquared(Vec3<FloatN>(LoadPacket<FloatN>(xs), FloatN(py), FloatN(pz)), bound * bound));
+					StorePacket(distances + row + x, min(d, bound));
+				}
+
+				for (; x < count; x++)
+				{
+					const float3 pos(origin.x + float(x) * step, py, pz);
+					distances[row + x] = UnsignedDistance(pos, std::fabs(distances[neighbourRow + x]) + boundStep);
+				}
+
+				for (x = 0; x < count; x++)
+					setSign(row + x, neighbourRow + x, float3(origin.x + float(x) * step, py, pz));
+			}
+		}
+	}
+
+	box3 MeshDistance::GetBounds() const
+	{
+		if (m_Nodes.empty())
+			return box3::empty();
+		return box3(m_Nodes[0].boundsMin, m_Nodes[0].boundsMax);
+	}
+}
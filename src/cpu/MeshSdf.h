@@ -0,0 +1,118 @@
+#pragma once
+
+// Signed distance to triangle meshes, for baking imported assets into brick maps (see BrickMap.h).
+//
+// The triangles are kept in a BVH that answers closest-triangle queries. The sign comes from the
+// generalized winding number rather than from the normal of the closest triangle, so meshes with
+// holes, overlapping parts or flipped pieces still get a sensible inside. Far from a node its
+// triangles are replaced by a dipole of their area-weighted normal (Barill et al. 2018, "Fast
+// winding numbers for soups and clouds"), which keeps the winding number about as cheap as the
+// distance query.
+
+#include "ShaderTypes.h"
+#include "SimdMath.h"
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace donut::engine
+{
+	struct MeshInfo;
+}
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// Triangle soup in world space, three indices per triangle.
+	struct TriangleMesh
+	{
+		std::vector<float3> positions;
+		std::vector<uint32_t> indices;
+		// Empty, or a unit normal per position.
+		std::vector<float3> normals;
+
+		uint32_t GetTriangleCount() const { return uint32_t(indices.size() / 3); }
+		box3 GetBounds() const;
+	};
+
+	// Appends the triangle geometries of an imported mesh, read from its BufferGroup's positionData
+	// and indexData, transformed to world space. Fails when the buffers don't hold the CPU copies.
+	bool AppendMesh(const donut::engine::MeshInfo& mesh, const affine3& transform, TriangleMesh& out);
+
+	// Loads a glTF file through GltfImporter and appends every mesh instance of its scene graph.
+	bool LoadGltfMesh(const std::shared_ptr<donut::vfs::IFileSystem>& fs, const std::filesystem::path& fileName,
+		TriangleMesh& out, tf::Executor* executor = nullptr);
+
+	class MeshDistance
+	{
+	public:
+		// Fails on an empty mesh or out of range indices.
+		bool Build(const TriangleMesh& mesh);
+
+		// Negative where the winding number is above 1/2.
+		float Distance(const float3& pos) const;
+		// Distance to the closest triangle. maxDistance is an upper bound on the result, such as a
+		// neighbouring point's distance plus the distance to it, that lets the query skip more nodes.
+		float UnsignedDistance(const float3& pos, float maxDistance = 1e30f) const;
+		// Approximately 1 inside a closed mesh with outward facing triangles and 0 outside.
+		float WindingNumber(const float3& pos) const;
+		// Signed distances of a block of count^3 points in the shape of a BrickMapField. Every point's
+		// distance is bounded by a neighbour's, and the sign carries over unless both are next to the surface.
+		void DistanceBlock(const float3& origin, float step, int count, float* distances) const;
+
+		uint32_t GetTriangleCount() const { return uint32_t(m_Triangles.size()); }
+		uint32_t GetNodeCount() const { return uint32_t(m_Nodes.size()); }
+		box3 GetBounds() const;
+
+	private:
+		// A corner, the edges b - a, c - b and a - c and the normal, with the inverse squared lengths
+		// that udTriangle() divides by (0 for degenerate edges and triangles).
+		struct Triangle
+		{
+			float3 a, ba, cb, ac, normal;
+			float invBa = 0.f, invCb = 0.f, invAc = 0.f, invNormal = 0.f;
+
+			float3 GetB() const { return a + ba; }
+			float3 GetC() const { return a - ac; }
+		};
+
+		// Depth-first layout like BvhNode: the left child follows its parent, offset is the right child
+		// of an inner node and the first triangle of a leaf.
+		struct Node
+		{
+			float3 boundsMin;
+			uint32_t offset = 0;
+			float3 boundsMax;
+			uint32_t count = 0;
+		};
+
+		// Triangles of a node as seen from far away: the sum of their area-weighted normals at their
+		// area-weighted center, and the radius of the ball around that center that holds them all.
+		struct Dipole
+		{
+			float3 center;
+			float radius = 0.f;
+			float3 areaNormal;
+			float area = 0.f;
+		};
+
+		uint32_t BuildNode(uint32_t* order, uint32_t first, uint32_t count, const float3* centroids);
+
+		// Squared distances of a packet of points, the packet descends into a node when any of its lanes can still improve.
+		template<typename F> F DistanceSquared(const Vec3<F>& pos, F maxDistanceSquared) const;
+
+		std::vector<Triangle> m_Triangles;
+		std::vector<Node> m_Nodes;
+		std::vector<Dipole> m_Dipoles;
+	};
+}
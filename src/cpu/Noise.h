@@ -0,0 +1,190 @@
+#pragma once
+
+// Procedural value and gradient noise in 2D and 3D, and fractal sums of them, written once against the
+// float-like types of SimdMath.h like Primitives.h, so that they run on packets and on Dual numbers.
+// SDFNoise.hlsli is the shader version; both compute the same operations in the same order.
+//
+// The lattice points are hashed with the permutation polynomial (34 x^2 + x) mod 289 of Gustavson's
+// webgl-noise ("Efficient computational noise in GLSL", McEwan et al., 2012). Its intermediate values
+// stay below 2^24, so it is exact in float arithmetic and needs no integer lanes or tables, and the CPU
+// and the GPU hash every lattice point the same. Without a period the noises repeat after 289 cells;
+// with a whole number of cells as the period they repeat after that, so that they tile.
+
+#include "ShaderTypes.h"
+#include "SimdMath.h"
+
+namespace sdf
+{
+	template<typename F> inline F NoiseFract(F x)
+	{
+		return x - floor(x);
+	}
+
+	// x mod period for whole numbers. The half keeps the quotient away from whole numbers, where the
+	// rounding of 1 / period could floor it either way.
+	template<typename F> inline F NoiseMod(F x, float period)
+	{
+		return x - floor((x + F(0.5f)) * F(1.0f / period)) * F(period);
+	}
+
+	template<typename F> inline F NoisePermute(F x)
+	{
+		return NoiseMod((x * F(34.0f) + F(1.0f)) * x, 289.0f);
+	}
+
+	// Lattice coordinate wrapped by the period, then into the domain of NoisePermute().
+	template<typename F> inline F NoiseCell(F cell, float period)
+	{
+		return NoiseMod(period > 0.f ? NoiseMod(cell, period) : cell, 289.0f);
+	}
+
+	// Quintic fade curve of improved Perlin noise, with a zero first and second derivative at 0 and 1.
+	template<typename F> inline F NoiseFade(F t)
+	{
+		return t * t * t * (t * (t * F(6.0f) - F(15.0f)) + F(10.0f));
+	}
+
+	template<typename F> inline F NoiseHash(F x, F y)
+	{
+		return NoisePermute(NoisePermute(x) + y);
+	}
+
+	template<typename F> inline F NoiseHash(F x, F y, F z)
+	{
+		return NoisePermute(NoisePermute(NoisePermute(x) + y) + z);
+	}
+
+	// Value in [-1, 1) of a hash.
+	template<typename F> inline F NoiseValue(F hash)
+	{
+		return hash * F(2.0f / 289.0f) - F(1.0f);
+	}
+
+	// Unit gradient of a hash: a point of the octahedron |x| + |y| + |z| = 1, folded like an octahedral
+	// normal map where z would be negative, then normalized. The 2D noise uses its xy part.
+	template<typename F> inline Vec3<F> NoiseGradient(F hash)
+	{
+		F h = hash * F(1.0f / 7.0f);
+		F x = NoiseFract(h) * F(2.0f) - F(1.0f);
+		F y = NoiseFract(floor(h) * F(1.0f / 7.0f)) * F(2.0f) - F(1.0f);
+		F z = F(1.0f) - abs(x) - abs(y);
+		MaskOf<F> fold = z < F(0.0f);
+		F fx = (F(1.0f) - abs(y)) * select(x < F(0.0f), F(-1.0f), F(1.0f));
+		F fy = (F(1.0f) - abs(x)) * select(y < F(0.0f), F(-1.0f), F(1.0f));
+		return normalize(Vec3<F>(select(fold, fx, x), select(fold, fy, y), z));
+	}
+
+	template<typename F> F ValueNoise(const Vec2<F>& p, float period = 0.f)
+	{
+		F ix = floor(p.x), iy = floor(p.y);
+		F fx = NoiseFade(p.x - ix), fy = NoiseFade(p.y - iy);
+		F x0 = NoiseCell(ix, period), x1 = NoiseCell(ix + F(1.0f), period);
+		F y0 = NoiseCell(iy, period), y1 = NoiseCell(iy + F(1.0f), period);
+
+		F a = lerp(NoiseValue(NoiseHash(x0, y0)), NoiseValue(NoiseHash(x1, y0)), fx);
+		F b = lerp(NoiseValue(NoiseHash(x0, y1)), NoiseValue(NoiseHash(x1, y1)), fx);
+		return lerp(a, b, fy);
+	}
+
+	template<typename F> F ValueNoise(const Vec3<F>& p, float period = 0.f)
+	{
+		F ix = floor(p.x), iy = floor(p.y), iz = floor(p.z);
+		F fx = NoiseFade(p.x - ix), fy = NoiseFade(p.y - iy), fz = NoiseFade(p.z - iz);
+		F x0 = NoiseCell(ix, period), x1 = NoiseCell(ix + F(1.0f), period);
+		F y0 = NoiseCell(iy, period), y1 = NoiseCell(iy + F(1.0f), period);
+		F z0 = NoiseCell(iz, period), z1 = NoiseCell(iz + F(1.0f), period);
+
+		F a = lerp(NoiseValue(NoiseHash(x0, y0, z0)), NoiseValue(NoiseHash(x1, y0, z0)), fx);
+		F b = lerp(NoiseValue(NoiseHash(x0, y1, z0)), NoiseValue(NoiseHash(x1, y1, z0)), fx);
+		F c = lerp(NoiseValue(NoiseHash(x0, y0, z1)), NoiseValue(NoiseHash(x1, y0, z1)), fx);
+		F d = lerp(NoiseValue(NoiseHash(x0, y1, z1)), NoiseValue(NoiseHash(x1, y1, z1)), fx);
+		return lerp(lerp(a, b, fy), lerp(c, d, fy), fz);
+	}
+
+	// Gradient (Perlin) noise, 0 on every lattice point, within about [-0.7, 0.7] in 2D and [-0.9, 0.9] in 3D.
+	template<typename F> F GradientNoise(const Vec2<F>& p, float period = 0.f)
+	{
+		F ix = floor(p.x), iy = floor(p.y);
+		F rx = p.x - ix, ry = p.y - iy;
+		F x0 = NoiseCell(ix, period), x1 = NoiseCell(ix + F(1.0f), period);
+		F y0 = NoiseCell(iy, period), y1 = NoiseCell(iy + F(1.0f), period);
+
+		auto corner = [&](F x, F y, F dx, F dy)
+		{
+			Vec3<F> g = NoiseGradient(NoiseHash(x, y));
+			return g.x * dx + g.y * dy;
+		};
+		F fx = NoiseFade(rx), fy = NoiseFade(ry);
+		F a = lerp(corner(x0, y0, rx, ry), corner(x1, y0, rx - F(1.0f), ry), fx);
+		F b = lerp(corner(x0, y1, rx, ry - F(1.0f)), corner(x1, y1, rx - F(1.0f), ry - F(1.0f)), fx);
+		return lerp(a, b, fy);
+	}
+
+	template<typename F> F GradientNoise(const Vec3<F>& p, float period = 0.f)
+	{
+		F ix = floor(p.x), iy = floor(p.y), iz = floor(p.z);
+		F rx = p.x - ix, ry = p.y - iy, rz = p.z - iz;
+		F x0 = NoiseCell(ix, period), x1 = NoiseCell(ix + F(1.0f), period);
+		F y0 = NoiseCell(iy, period), y1 = NoiseCell(iy + F(1.0f), period);
+		F z0 = NoiseCell(iz, period), z1 = NoiseCell(iz + F(1.0f), period);
+
+		auto corner = [&](F x, F y, F z, F dx, F dy, F dz)
+		{
+			Vec3<F> g = NoiseGradient(NoiseHash(x, y, z));
+			return g.x * dx + g.y * dy + g.z * dz;
+		};
+		F sx = rx - F(1.0f), sy = ry - F(1.0f), sz = rz - F(1.0f);
+		F fx = NoiseFade(rx), fy = NoiseFade(ry), fz = NoiseFade(rz);
+		F a = lerp(corner(x0, y0, z0, rx, ry, rz), corner(x1, y0, z0, sx, ry, rz), fx);
+		F b = lerp(corner(x0, y1, z0, rx, sy, rz), corner(x1, y1, z0, sx, sy, rz), fx);
+		F c = lerp(corner(x0, y0, z1, rx, ry, sz), corner(x1, y0, z1, sx, ry, sz), fx);
+		F d = lerp(corner(x0, y1, z1, rx, sy, sz), corner(x1, y1, z1, sx, sy, sz), fx);
+		return lerp(lerp(a, b, fy), lerp(c, d, fy), fz);
+	}
+
+	// Fractal sum of octaves of noise(p, period), each at twice the frequency and half the amplitude of the
+	// previous one, divided by the sum of the amplitudes so that it stays in the range of one octave.
+	// The period doubles with the frequency, so a periodic sum repeats after the period of the first octave.
+	template<typename F, typename P, typename Noise> F Fbm(const P& p, int octaves, float period, Noise noise)
+	{
+		F sum = F(0.0f);
+		float amplitude = 1.0f;
+		float total = 0.0f;
+		float frequency = 1.0f;
+		for (int octave = 0; octave < octaves; octave++)
+		{
+			sum += noise(p * F(frequency), period * frequency) * F(amplitude);
+			total += amplitude;
+			amplitude *= 0.5f;
+			frequency *= 2.0f;
+		}
+		return total > 0.f ? sum * F(1.0f / total) : sum;
+	}
+
+	template<typename F, template<typename> class V> F ValueFbm(const V<F>& p, int octaves, float period = 0.f)
+	{
+		return Fbm<F>(p, octaves, period, [](const V<F>& q, float qp) { return ValueNoise(q, qp); });
+	}
+
+	template<typename F, template<typename> class V> F GradientFbm(const V<F>& p, int octaves, float period = 0.f)
+	{
+		return Fbm<F>(p, octaves, period, [](const V<F>& q, float qp) { return GradientNoise(q, qp); });
+	}
+
+	// Displacement of SDF_OP_DISPLACE_NOISE: amplitude times a value noise fBm of the position, at most the
+	// amplitude either way. It steepens the field with amplitude * frequency and the octaves; the product
+	// should stay well below 1 for the sphere tracing to keep finding the surface.
+	template<typename F> F NoiseDisplacement(const Vec3<F>& p, float amplitude, float frequency, int octaves)
+	{
+		return ValueFbm(p * F(frequency), octaves) * F(amplitude);
+	}
+
+	// Pattern of the floor material in render(), replacing the old noise0.jpg lookup: dark speckles of
+	// mostly black with a few bright spots, about as bright on average as the texture was.
+	template<typename F> F FloorPattern(const Vec2<F>& xz)
+	{
+		F v = saturate(GradientFbm(xz * F(SDF_FLOOR_NOISE_FREQUENCY), SDF_FLOOR_NOISE_OCTAVES) * F(1.2f) + F(0.5f));
+		F v2 = v * v;
+		return F(0.02f) + F(0.6f) * v2 * v2;
+	}
+}
@@ -0,0 +1,169 @@
+#include "NoiseVolume.h"
+#include "Noise.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		bool IsValid(const NoiseVolumeDesc& desc)
+		{
+			return desc.size >= 1 && desc.size <= 1024 && desc.period >= 1 && desc.octaves >= 1 && desc.octaves <= 8;
+		}
+
+		bool IsSame(const NoiseVolumeDesc& a, const NoiseVolumeDesc& b)
+		{
+			return a.size == b.size && a.period == b.period && a.octaves == b.octaves && a.gradient == b.gradient;
+		}
+
+		template<typename F> F Evaluate(const NoiseVolumeDesc& desc, const Vec3<F>& p)
+		{
+			const float period = float(desc.period);
+			return desc.gradient ? GradientFbm(p, desc.octaves, period) : ValueFbm(p, desc.octaves, period);
+		}
+	}
+
+	bool NoiseVolume::Build(tf::Executor& executor, const NoiseVolumeDesc& desc)
+	{
+		if (!IsValid(desc))
+		{
+			log::error("Can't build a noise volume of size %d, period %d and %d octaves", desc.size, desc.period, desc.octaves);
+			return false;
+		}
+
+		m_Desc = desc;
+		const int size = desc.size;
+		m_Samples.resize(size_t(size) * size * size);
+		const float step = float(desc.period) / float(size);
+
+		// Rows of samples are evaluated as packets.
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0, size * size, 1, [&](int row)
+		{
+			const float y = float(row % size) * step;
+			const float z = float(row / size) * step;
+			float* samples = m_Samples.data() + size_t(row) * size;
+			int x = 0;
+			for (; x + WidthOf<FloatN> <= size; x += WidthOf<FloatN>)
+			{
+				alignas(32) float xs[WidthOf<FloatN>];
+				for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+					xs[lane] = float(x + lane) * step;
+				Evaluate(desc, Vec3<FloatN>(FloatN::Load(xs), FloatN(y), FloatN(z))).Store(samples + x);
+			}
+			for (; x < size; x++)
+				samples[x] = Evaluate(desc, Vec3<float>(float(x) * step, y, z));
+		}, 4);
+
+		executor.run(taskflow).wait();
+		return true;
+	}
+
+	float NoiseVolume::Sample(const float3& pos) const
+	{
+		const int size = m_Desc.size;
+		const float3 u = pos * float(size);
+		const float3 base = float3(std::floor(u.x), std::floor(u.y), std::floor(u.z));
+		const float3 t = u - base;
+		auto wrap = [size](float v)
+		{
+			int i = int(std::fmod(v, float(size)));
+			return i < 0 ? i + size : i;
+		};
+		const int x0 = wrap(base.x), y0 = wrap(base.y), z0 = wrap(base.z);
+		const int x1 = (x0 + 1) % size, y1 = (y0 + 1) % size, z1 = (z0 + 1) % size;
+
+		float c00 = lerp(At(x0, y0, z0), At(x1, y0, z0), t.x);
+		float c10 = lerp(At(x0, y1, z0), At(x1, y1, z0), t.x);
+		float c01 = lerp(At(x0, y0, z1), At(x1, y0, z1), t.x);
+		float c11 = lerp(At(x0, y1, z1), At(x1, y1, z1), t.x);
+		return lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z);
+	}
+
+	bool NoiseVolume::Save(const std::filesystem::path& fileName) const
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		NoiseVolumeFileHeader header;
+		header.size = m_Desc.size;
+		header.period = m_Desc.period;
+		header.octaves = m_Desc.octaves;
+		header.gradient = m_Desc.gradient ? 1 : 0;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(m_Samples.data()), m_Samples.size() * sizeof(float));
+
+		return file.good();
+	}
+
+	bool NoiseVolume::Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+	{
+		std::shared_ptr<vfs::IBlob> data = fs.readFile(fileName);
+		if (!data)
+		{
+			log::error("Couldn't read file %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		NoiseVolumeFileHeader header;
+		if (data->size() < sizeof(header))
+		{
+			log::error("%s is not an SDF noise volume file", fileName.generic_string().c_str());
+			return false;
+		}
+
+		std::memcpy(&header, data->data(), sizeof(header));
+		if (header.magic != NoiseVolumeFileHeader::c_Magic || header.version != NoiseVolumeFileHeader::c_Version)
+		{
+			log::error("%s is not an SDF noise volume file of version %u", fileName.generic_string().c_str(), NoiseVolumeFileHeader::c_Version);
+			return false;
+		}
+
+		NoiseVolumeDesc desc;
+		desc.size = header.size;
+		desc.period = header.period;
+		desc.octaves = header.octaves;
+		desc.gradient = header.gradient != 0;
+		const size_t sampleCount = IsValid(desc) ? size_t(desc.size) * desc.size * desc.size : 0;
+		if (sampleCount == 0 || header.gradient > 1 || data->size() < sizeof(header) + sampleCount * sizeof(float))
+		{
+			log::error("SDF noise volume file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		m_Desc = desc;
+		m_Samples.resize(sampleCount);
+		std::memcpy(m_Samples.data(), static_cast<const uint8_t*>(data->data()) + sizeof(header), sampleCount * sizeof(float));
+
+		return true;
+	}
+
+	bool NoiseVolume::LoadOrBuild(tf::Executor& executor, vfs::IFileSystem& fs, const std::filesystem::path& fileName,
+		const NoiseVolumeDesc& desc)
+	{
+		if (fs.fileExists(fileName) && Load(fs, fileName) && IsSame(m_Desc, desc))
+			return true;
+
+		if (!Build(executor, desc))
+			return false;
+
+		if (!Save(fileName))
+			log::warning("Couldn't cache the noise volume in %s", fileName.generic_string().c_str());
+		return true;
+	}
+}
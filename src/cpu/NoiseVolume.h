@@ -0,0 +1,73 @@
+#pragma once
+
+// Precomputed tileable noise: a cube of fBm samples (see Noise.h) whose lattice period divides the cube,
+// so that it wraps seamlessly and a trilinear lookup can stand in for evaluating the octaves. It is
+// built on the executor's workers in packets and can be cached in a binary file, so that a volume of
+// many octaves is computed once.
+
+#include "ShaderTypes.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	struct NoiseVolumeDesc
+	{
+		int size = 64;          // samples per side
+		int period = 4;         // lattice cells per side of the first octave
+		int octaves = 4;
+		bool gradient = true;   // gradient noise, value noise otherwise
+	};
+
+	// Binary noise volume file: the header and size^3 floats, x fastest, little endian.
+	struct NoiseVolumeFileHeader
+	{
+		static constexpr uint32_t c_Magic = 0x4e464453; // "SDFN"
+		static constexpr uint32_t c_Version = 1;
+
+		uint32_t magic = c_Magic;
+		uint32_t version = c_Version;
+		int32_t size = 0;
+		int32_t period = 0;
+		int32_t octaves = 0;
+		uint32_t gradient = 0;
+	};
+
+	class NoiseVolume
+	{
+	public:
+		// Fails on a size outside [1, 1024], a period below 1 or octaves outside [1, 8].
+		bool Build(tf::Executor& executor, const NoiseVolumeDesc& desc);
+
+		bool Save(const std::filesystem::path& fileName) const;
+		bool Load(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName);
+		// Loads the file when it holds a volume of desc, otherwise builds the volume and writes it there.
+		// Only a failed build fails; the cache is best effort.
+		bool LoadOrBuild(tf::Executor& executor, donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName,
+			const NoiseVolumeDesc& desc);
+
+		// Trilinearly filtered and wrapped; pos in [0, 1)^3 covers the volume once.
+		float Sample(const float3& pos) const;
+		// Sample of a voxel in [0, size)^3, which holds the noise at voxel / size * period.
+		float At(int x, int y, int z) const { return m_Samples[(size_t(z) * m_Desc.size + size_t(y)) * m_Desc.size + size_t(x)]; }
+
+		bool Empty() const { return m_Samples.empty(); }
+		const NoiseVolumeDesc& GetDesc() const { return m_Desc; }
+		size_t GetMemorySize() const { return m_Samples.size() * sizeof(float); }
+
+	private:
+		NoiseVolumeDesc m_Desc;
+		std::vector<float> m_Samples;
+	};
+}
@@ -0,0 +1,316 @@
+#include "OccupancyGrid.h"
+#include "Interval.h"
+#include "Renderer.h"
+
+#include <donut/core/log.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <limits>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		// Cells classified by one task.
+		constexpr uint32_t c_TaskCells = 512;
+
+		const float c_Infinity = std::numeric_limits<float>::infinity();
+
+		bool HasTimeDisplacement(const TapeInstruction* code, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (GetOpcode(code[i]) == SDF_OP_DISPLACE && !(GetFlags(code[i]) & SDF_DISPLACE_KEYFRAMED))
+					return true;
+			}
+			return false;
+		}
+	}
+
+	bool OccupancyGrid::Build(tf::Executor& executor, const SceneMap& map, const OccupancyGridDesc& desc)
+	{
+		if (desc.size < 1 || desc.size > SDF_OCCUPANCY_MAX_SIZE || (desc.size & (desc.size - 1)) != 0)
+		{
+			log::error("Can't build an occupancy grid of %d cells per side", desc.size);
+			return false;
+		}
+
+		const float3 extent = desc.bounds.diagonal();
+		if (!(extent.x > 0.f && extent.y > 0.f && extent.z > 0.f) || !IsFinite(desc.bounds))
+		{
+			log::error("Can't build an occupancy grid of an empty region");
+			return false;
+		}
+
+		const float size = std::max(extent.x, std::max(extent.y, extent.z));
+		m_Origin = desc.bounds.center() - 0.5f * size;
+		m_CellSize = size / float(desc.size);
+		m_Margin = std::max(desc.margin, 0.f);
+		m_Size = desc.size;
+		m_LevelCount = 1;
+		while ((1 << (m_LevelCount - 1)) < m_Size)
+			m_LevelCount++;
+
+		m_Offsets.resize(m_LevelCount);
+		uint32_t wordCount = 0;
+		for (int level = 0; level < m_LevelCount; level++)
+		{
+			const uint32_t n = uint32_t(GetLevelSize(level));
+			m_Offsets[level] = wordCount;
+			wordCount += (n * n * n + 31) / 32;
+		}
+		m_Words.assign(wordCount, 0u);
+
+		Update(executor, map, { GetBounds() });
+		return true;
+	}
+
+	uint32_t OccupancyGrid::Update(tf::Executor& executor, const SceneMap& map, const std::vector<box3>& regions)
+	{
+		if (Empty())
+			return 0;
+
+		// A region around the whole grid starts over from clear bits, so that only the cells inside set
+		// cells need to be visited.
+		const box3 bounds = GetBounds();
+		std::vector<box3> clipped;
+		bool fresh = false;
+		for (const box3& region : regions)
+		{
+			if (region.contains(bounds))
+			{
+				std::fill(m_Words.begin(), m_Words.end(), 0u);
+				clipped = { bounds };
+				fresh = true;
+				break;
+			}
+
+			const box3 inside = region & bounds;
+			if (!inside.isempty())
+				clipped.push_back(inside);
+		}
+		if (clipped.empty())
+			return 0;
+
+		auto overlaps = [&](int level, const int3& cell)
+		{
+			const float side = GetCellSize(level);
+			const box3 box(m_Origin + float3(cell) * side, m_Origin + float3(cell + 1) * side);
+			for (const box3& region : clipped)
+			{
+				if (region.intersects(box))
+					return true;
+			}
+			return false;
+		};
+
+		// Cells of the previous level within the regions and those of this level to classify.
+		std::vector<uint32_t> parents;
+		std::vector<uint32_t> cells;
+		std::vector<uint32_t> classify = { 0 };
+		uint32_t evaluations = 0;
+		for (int level = 0; level < m_LevelCount; level++)
+		{
+			if (level > 0)
+			{
+				const uint32_t parentSize = uint32_t(GetLevelSize(level - 1));
+				const uint32_t n = parentSize * 2;
+				cells.clear();
+				classify.clear();
+				for (uint32_t parent : parents)
+				{
+					const int3 parentCell(int(parent % parentSize), int(parent / parentSize % parentSize), int(parent / (parentSize * parentSize)));
+					const bool occupied = IsOccupied(level - 1, parentCell);
+
+					// The cells inside a clear cell are clear; after a build they already are.
+					if (!occupied && fresh)
+						continue;
+
+					for (int child = 0; child < 8; child++)
+					{
+						const int3 cell = parentCell * 2 + int3(child & 1, child >> 1 & 1, child >> 2);
+						if (!overlaps(level, cell))
+							continue;
+
+						const uint32_t index = (uint32_t(cell.z) * n + uint32_t(cell.y)) * n + uint32_t(cell.x);
+						cells.push_back(index);
+						if (occupied)
+							classify.push_back(index);
+						else
+							m_Words[m_Offsets[level] + (index >> 5)] &= ~(1u << (index & 31));
+					}
+				}
+			}
+			else
+			{
+				cells = { 0 };
+			}
+
+			Classify(executor, map, level, classify);
+			evaluations += uint32_t(classify.size());
+			std::swap(parents, cells);
+		}
+
+		return evaluations;
+	}
+
+	void OccupancyGrid::Classify(tf::Executor& executor, const SceneMap& map, int level, const std::vector<uint32_t>& cells)
+	{
+		const uint32_t count = uint32_t(cells.size());
+		if (count == 0)
+			return;
+
+		const uint32_t n = uint32_t(GetLevelSize(level));
+		const float side = GetCellSize(level);
+		// map() exceeds the distance to the surface by at most the margin and the slack of the float
+		// evaluation, so a cell whose center is farther than that beyond its half diagonal can't hold any.
+		const float radius = length(float3(0.5f * side)) + c_IntervalSlack + m_Margin;
+
+		std::vector<uint8_t> occupied(count);
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0u, (count + c_TaskCells - 1) / c_TaskCells, 1u, [&](uint32_t task)
+		{
+			constexpr uint32_t W = uint32_t(WidthOf<FloatN>);
+			const uint32_t last = std::min((task + 1) * c_TaskCells, count);
+			for (uint32_t first = task * c_TaskCells; first < last; first += W)
+			{
+				alignas(32) float xs[W], ys[W], zs[W], out[W];
+				for (uint32_t lane = 0; lane < W; lane++)
+				{
+					const uint32_t index = cells[std::min(first + lane, last - 1)];
+					const float3 center = m_Origin + (float3(float(index % n), float(index / n % n), float(index / (n * n))) + 0.5f) * side;
+					xs[lane] = center.x;
+					ys[lane] = center.y;
+					zs[lane] = center.z;
+				}
+
+				const Vec2<FloatN> h = map.Evaluate(Vec3<FloatN>(FloatN::Load(xs), FloatN::Load(ys), FloatN::Load(zs)));
+				h.x.Store(out);
+				for (uint32_t lane = 0; lane < W && first + lane < last; lane++)
+					occupied[first + lane] = !(out[lane] > radius);
+			}
+		}, 1u);
+		executor.run(taskflow).wait();
+
+		uint32_t* words = m_Words.data() + m_Offsets[level];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t index = cells[i];
+			if (occupied[i])
+				words[index >> 5] |= 1u << (index & 31);
+			else
+				words[index >> 5] &= ~(1u << (index & 31));
+		}
+	}
+
+	float2 OccupancyGrid::FindEmptySpan(const float3& ro, const float3& rd, float t, float tmax) const
+	{
+		float2 span;
+		if (Empty() || !FindEmptyCell(ro, rd, t, span))
+			return float2(1.f, 0.f);
+
+		// The DDA goes on through the clear cells that follow.
+		float2 next;
+		for (int cells = 1; cells < SDF_OCCUPANCY_MAX_CELLS && span.y < tmax && FindEmptyCell(ro, rd, span.y, next); cells++)
+			span.y = next.y;
+		return span;
+	}
+
+	bool OccupancyGrid::FindEmptyCell(const float3& ro, const float3& rd, float t, float2& span) const
+	{
+		// Position in cells of the finest level.
+		const float3 p = (ro + rd * t - m_Origin) / m_CellSize;
+		const float size = float(m_Size);
+		if (!(p.x >= 0.f && p.y >= 0.f && p.z >= 0.f && p.x < size && p.y < size && p.z < size))
+			return false;
+		const int3 finest = min(int3(p), int3(m_Size - 1));
+
+		for (int level = 0; level < m_LevelCount; level++)
+		{
+			const int shift = m_LevelCount - 1 - level;
+			const int3 cell = int3(finest.x >> shift, finest.y >> shift, finest.z >> shift);
+			if (IsOccupied(level, cell))
+				continue;
+
+			// Where the ray enters and leaves the slabs of the cell.
+			const float side = GetCellSize(level);
+			const float3 cellMin = m_Origin + float3(cell) * side;
+			float entry = -c_Infinity;
+			float exit = c_Infinity;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (rd[axis] == 0.f)
+					continue;
+				const float t0 = (cellMin[axis] - ro[axis]) / rd[axis];
+				const float t1 = (cellMin[axis] + side - ro[axis]) / rd[axis];
+				entry = std::max(entry, std::min(t0, t1));
+				exit = std::min(exit, std::max(t0, t1));
+			}
+			span = float2(entry, std::max(exit, t) + SDF_OCCUPANCY_SKIP_MARGIN * m_CellSize);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool OccupancyGrid::IsOccupied(int level, const int3& cell) const
+	{
+		const uint32_t n = uint32_t(GetLevelSize(level));
+		const uint32_t index = (uint32_t(cell.z) * n + uint32_t(cell.y)) * n + uint32_t(cell.x);
+		return (m_Words[m_Offsets[level] + (index >> 5)] >> (index & 31)) & 1;
+	}
+
+	uint32_t OccupancyGrid::GetOccupiedCount(int level) const
+	{
+		const uint32_t n = uint32_t(GetLevelSize(level));
+		const uint32_t last = level + 1 < m_LevelCount ? m_Offsets[level + 1] : uint32_t(m_Words.size());
+		uint32_t count = 0;
+		for (uint32_t word = m_Offsets[level]; word < last; word++)
+			count += uint32_t(std::bitset<32>(m_Words[word]).count());
+		// Levels of fewer than 32 cells leave the rest of their word clear.
+		return std::min(count, n * n * n);
+	}
+
+	void OccupancyGrid::GetConstants(int4& occupancy, float4& grid) const
+	{
+		if (Empty())
+		{
+			occupancy = int4(0);
+			grid = float4(0.f);
+			return;
+		}
+
+		occupancy = int4(m_Size, m_LevelCount, 0, 0);
+		grid = float4(m_Origin, m_CellSize);
+	}
+
+	void GetTimeDependentRegions(const SceneMap& map, std::vector<box3>& regions)
+	{
+		const box3 everything(float3(-c_Infinity), float3(c_Infinity));
+		if (!map.bvh || map.bvh->GetInstructions().empty())
+		{
+			regions.push_back(everything);
+			return;
+		}
+
+		const TapeInstruction* code = map.bvh->GetInstructions().data();
+		if (HasTimeDisplacement(code, map.bvh->GetGlobalInstructionCount()))
+		{
+			regions.push_back(everything);
+			return;
+		}
+
+		// Every leaf holds one object, whose bounds cover all of its displacements.
+		for (const BvhNode& node : map.bvh->GetNodes())
+		{
+			if (node.count > 0 && HasTimeDisplacement(code + node.offset, node.count))
+				regions.push_back(box3(node.boundsMin, node.boundsMax));
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Occupancy grid for empty-space skipping.
+//
+// A cube around the scene is covered by a pyramid of grids, from a single cell down to size^3 cells, with
+// one bit per cell that is clear where the surface cannot pass through the cell: map() at its center is
+// larger than its half diagonal, and every field of the library changes no faster than the distance moved
+// (see Interval.h), plus a margin for fields that don't bound the distance. Only the cells inside set
+// cells are classified, so the cost of a build follows the area of the surfaces rather than the volume of
+// the cube. A ray whose point is in a clear cell can jump across the run of clear cells ahead of it in
+// one step, where sphere tracing takes many short ones along a surface that it passes close to without
+// reaching, such as the floor plane at grazing angles.
+//
+// The grid holds the surfaces at one time of the scene. When some of them move, Update() classifies the
+// cells that overlap the regions they moved within again and keeps the other bits, so an animation
+// only pays for what changed. The kept bits stay true, though a build may decide a few cells next to the
+// regions otherwise, where the fields of the moved surfaces changed beyond them.
+//
+// The layout of the bits is shared with raycast() in SDF.hlsli and described next to
+// RenderConstants::g_Occupancy in sdf_cb.h.
+
+#include "ShaderTypes.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	struct SceneMap;
+
+	struct OccupancyGridDesc
+	{
+		box3 bounds = box3(float3(-2.5f, -0.5f, -2.5f), float3(2.5f, 2.0f, 2.5f));  // the grid is the cube around it
+		int size = 128;     // cells per side of the finest level, a power of 2 up to SDF_OCCUPANCY_MAX_SIZE
+		float margin = 0.f; // how much map() may exceed the distance to the surface, e.g. c_DefaultSceneOvershoot
+	};
+
+	class OccupancyGrid
+	{
+	public:
+		// Classifies the cells with map at time map.time on the executor's workers. Fails on an empty region
+		// or a size that isn't a power of 2 up to SDF_OCCUPANCY_MAX_SIZE.
+		bool Build(tf::Executor& executor, const SceneMap& map, const OccupancyGridDesc& desc);
+		// Classifies the cells that overlap any of the regions again with map, after its surfaces moved
+		// within them, e.g. the regions of SceneBvh::Refit() and GetTimeDependentRegions(). Returns the
+		// number of map() calls.
+		uint32_t Update(tf::Executor& executor, const SceneMap& map, const std::vector<box3>& regions);
+
+		// Ray distances (entry, exit) of the run of clear cells from ro + rd * t: the coarsest clear cell
+		// around the point and those the ray goes on through, up to SDF_OCCUPANCY_MAX_CELLS of them or tmax.
+		// The exit is a margin past the last one. x > y when the point is in a set cell of the finest level
+		// or outside the grid.
+		float2 FindEmptySpan(const float3& ro, const float3& rd, float t, float tmax) const;
+
+		bool Empty() const { return m_Words.empty(); }
+		int GetSize() const { return m_Size; }
+		int GetLevelCount() const { return m_LevelCount; }
+		box3 GetBounds() const { return box3(m_Origin, m_Origin + m_CellSize * float(m_Size)); }
+		// Whether a cell of a level, 0 being the single coarsest cell, may hold the surface.
+		bool IsOccupied(int level, const int3& cell) const;
+		// Set cells of a level.
+		uint32_t GetOccupiedCount(int level) const;
+
+		// g_Occupancy and g_OccupancyGrid of the grid, disabled while it is empty.
+		void GetConstants(int4& occupancy, float4& grid) const;
+		// The contents of g_OccupancyBits.
+		const std::vector<uint32_t>& GetWords() const { return m_Words; }
+		size_t GetMemorySize() const { return m_Words.size() * sizeof(uint32_t); }
+
+	private:
+		int GetLevelSize(int level) const { return m_Size >> (m_LevelCount - 1 - level); }
+		float GetCellSize(int level) const { return m_CellSize * float(1 << (m_LevelCount - 1 - level)); }
+
+		// (entry, exit) of the coarsest clear cell around ro + rd * t, false when there is none.
+		bool FindEmptyCell(const float3& ro, const float3& rd, float t, float2& span) const;
+
+		// Classifies the cells of a level with map, given as (z * n + y) * n + x, and sets or clears their bits.
+		void Classify(tf::Executor& executor, const SceneMap& map, int level, const std::vector<uint32_t>& cells);
+
+		float3 m_Origin = float3(0.f);
+		float m_CellSize = 0.f;
+		float m_Margin = 0.f;
+		int m_Size = 0;
+		int m_LevelCount = 0;
+		std::vector<uint32_t> m_Offsets;    // first word of each level
+		std::vector<uint32_t> m_Words;
+	};
+
+	// Regions of map whose surfaces move with map.time by themselves: the objects of its BVH with
+	// SDF_OP_DISPLACE nodes that follow g_Time, or everything, for the built-in scene and when the global
+	// prefix has one.
+	void GetTimeDependentRegions(const SceneMap& map, std::vector<box3>& regions);
+}
@@ -0,0 +1,187 @@
+#include "PacketMarching.h"
+#include "ConePrepass.h"
+#include "TemporalReuse.h"
+
+#include <algorithm>
+
+namespace sdf
+{
+	namespace
+	{
+		template<typename F> F LoadPacket(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StorePacket(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		template<typename F> void MarchPackets(const SceneMap& map, const float3& ro, const float3* rd, const float* tmin,
+			int count, int maxSteps, float omega, float2* res, RenderStats* stats)
+		{
+			constexpr int W = WidthOf<F>;
+			RayMarch rays[W];
+			int index[W];
+			int next = 0;
+
+			auto finish = [&](int i, const RayMarch& ray)
+			{
+				if (stats)
+				{
+					stats[i].primaryRays++;
+					stats[i].primarySteps += uint64_t(ray.steps);
+					stats[i].primaryFallbacks += ray.fallback;
+					stats[i].primarySkips += uint64_t(ray.skips);
+				}
+			};
+
+			// Jumps across the empty cells ahead of the ray on its own, as they take no map() call. Returns
+			// whether the ray still has steps to take.
+			auto skip = [&](int i, RayMarch& ray)
+			{
+				if (map.occupancy)
+				{
+					while (ray.IsMarching(maxSteps) && ray.Skip(*map.occupancy, ro, rd[i]))
+					{
+					}
+				}
+				return ray.IsMarching(maxSteps);
+			};
+
+			// Gives the lane the next ray that has steps to take, false when there are none left.
+			auto start = [&](int lane)
+			{
+				while (next < count)
+				{
+					const int i = next++;
+					res[i] = float2(-1.0f, -1.0f);
+					RayMarch ray(tmin[i], omega);
+					if (skip(i, ray))
+					{
+						rays[lane] = ray;
+						index[lane] = i;
+						return true;
+					}
+					finish(i, ray);
+				}
+				index[lane] = -1;
+				return false;
+			};
+
+			int active = 0;
+			for (int lane = 0; lane < W; lane++)
+				active += start(lane) ? 1 : 0;
+
+			alignas(32) float x[W], y[W], z[W], distance[W], material[W];
+			while (active > 0)
+			{
+				// The idle lanes evaluate the origin and are ignored.
+				for (int lane = 0; lane < W; lane++)
+				{
+					const float3 p = index[lane] >= 0 ? ro + rd[index[lane]] * rays[lane].t : ro;
+					x[lane] = p.x;
+					y[lane] = p.y;
+					z[lane] = p.z;
+				}
+
+				const Vec2<F> h = map.Evaluate(Vec3<F>(LoadPacket<F>(x), LoadPacket<F>(y), LoadPacket<F>(z)));
+				StorePacket(distance, h.x);
+				StorePacket(material, h.y);
+
+				for (int lane = 0; lane < W; lane++)
+				{
+					const int i = index[lane];
+					if (i < 0)
+						continue;
+
+					RayMarch& ray = rays[lane];
+					if (!ray.Advance(float2(distance[lane], material[lane]), res[i]) || !skip(i, ray))
+					{
+						finish(i, ray);
+						if (!start(lane))
+							active--;
+					}
+				}
+			}
+		}
+	}
+
+	void PacketBundle::Resize(const int2& _pixelMin, const int2& _pixelMax)
+	{
+		pixelMin = _pixelMin;
+		pixelMax = _pixelMax;
+		const int2 size = max(pixelMax - pixelMin, int2(0));
+		const size_t count = size_t(size.x) * size_t(size.y);
+		pixels.resize(count);
+		directions.resize(count);
+		tmin.resize(count);
+		hits.resize(count);
+		startStats.assign(count, RenderStats());
+		rayStats.assign(count, RenderStats());
+	}
+
+	void RaycastPackets(const SceneMap& map, const float3& ro, const float3* rd, const float* tmin, int count,
+		int maxSteps, float omega, float2* res, RenderStats* stats)
+	{
+		// A few rays, such as those of a 2x2 bundle, don't fill the lanes of a wider packet.
+#if defined(SDF_SIMD_SSE)
+		if (count <= WidthOf<Float4>)
+		{
+			MarchPackets<Float4>(map, ro, rd, tmin, count, maxSteps, omega, res, stats);
+			return;
+		}
+#endif
+		MarchPackets<FloatN>(map, ro, rd, tmin, count, maxSteps, omega, res, stats);
+	}
+
+	void MarchBundle(const RenderConstants& constants, const SceneMap& map, const std::vector<float>& coneDepth,
+		const HitHistory& history, const float2& jitter, PacketBundle& bundle, RenderStats* stats)
+	{
+		const int count = bundle.GetCount();
+		if (count == 0)
+			return;
+
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		const Camera camera = Camera::Current(constants);
+		const int maxSteps = int(constants.g_Factor.x);
+
+		// Every ray of the bundle is empty up to the nearest of their prepass starts, where the cone takes over.
+		float coneStart = SDF_RAY_END;
+		for (int i = 0; i < count; i++)
+		{
+			const int2 pixel = bundle.GetPixel(i);
+			bundle.pixels[i] = float2(float(pixel.x) + 0.5f, float(pixel.y) + 0.5f) + jitter;
+			bundle.directions[i] = camera.PixelRay(bundle.pixels[i], resolution);
+			bundle.tmin[i] = GetConeStart(constants, coneDepth, bundle.pixels[i]);
+			coneStart = std::min(coneStart, bundle.tmin[i]);
+		}
+
+		int coneSteps = 0;
+		coneStart = ConeMarchPixels(map, camera, resolution, float2(bundle.pixelMin), float2(bundle.pixelMax), maxSteps,
+			&coneSteps, coneStart);
+		if (stats)
+		{
+			stats->prepassRays++;
+			stats->prepassSteps += uint64_t(coneSteps);
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			bundle.startStats[i] = RenderStats();
+			bundle.rayStats[i] = RenderStats();
+			bundle.tmin[i] = GetTemporalStart(constants, map, history, bundle.pixels[i], std::max(bundle.tmin[i], coneStart),
+				&bundle.startStats[i]);
+		}
+
+		RaycastPackets(map, camera.origin, bundle.directions.data(), bundle.tmin.data(), count, maxSteps, constants.g_Relax.x,
+			bundle.hits.data(), bundle.rayStats.data());
+	}
+}
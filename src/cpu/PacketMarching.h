@@ -0,0 +1,48 @@
+#pragma once
+
+// Packet marching of primary rays. The rays of a bundle of neighbouring pixels first march together as
+// the cone around them (see ConePrepass.h), one map() call per step for the whole bundle, until the
+// scene gets closer than the cone is wide. From there every ray takes the steps of raycast() on its
+// own, but the rays are still evaluated together: a packet of FloatN lanes holds as many rays as it
+// can, and a lane whose ray stopped takes the next ray of the bundle that hasn't, so that the lanes stay
+// busy until the bundle runs out of rays. The results are those of Raycast() up to the rounding of
+// the packet evaluation.
+
+#include "Renderer.h"
+
+#include <vector>
+
+namespace sdf
+{
+	// Primary rays of the pixels in [pixelMin, pixelMax) of the image, in rows from the top.
+	struct PacketBundle
+	{
+		int2 pixelMin = int2(0);
+		int2 pixelMax = int2(0);
+		std::vector<float2> pixels;             // sample positions, like the pixel of RenderPixel()
+		std::vector<float3> directions;
+		std::vector<float> tmin;
+		std::vector<float2> hits;               // raycast() results
+		std::vector<RenderStats> startStats;    // map() calls of GetTemporalStart()
+		std::vector<RenderStats> rayStats;      // steps of the rays
+
+		void Resize(const int2& _pixelMin, const int2& _pixelMax);
+
+		int GetCount() const { return int(pixels.size()); }
+		int2 GetPixel(int i) const
+		{
+			const int width = pixelMax.x - pixelMin.x;
+			return pixelMin + int2(i % width, i / width);
+		}
+	};
+
+	// Raycast() of count rays from ro along rd, each from its own tmin, evaluated in packets. res receives
+	// the (t, material) of each ray and stats, when not null, the steps of each.
+	void RaycastPackets(const SceneMap& map, const float3& ro, const float3* rd, const float* tmin, int count,
+		int maxSteps, float omega, float2* res, RenderStats* stats = nullptr);
+
+	// Marches the primary rays of a bundle from the cone prepass start of coneDepth, through the cone of
+	// the bundle and the temporal start of each pixel in history. The steps of the cone go to stats.
+	void MarchBundle(const RenderConstants& constants, const SceneMap& map, const std::vector<float>& coneDepth,
+		const HitHistory& history, const float2& jitter, PacketBundle& bundle, RenderStats* stats = nullptr);
+}
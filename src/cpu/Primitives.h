@@ -0,0 +1,136 @@
+#pragma once
+
+// C++ port of the primitives and operators in SDF.hlsli.
+// Each function keeps the name and argument order of its HLSL counterpart and is templated on the
+// packet type from SimdMath.h, so the same code runs on float, Float4 and Float8.
+
+#include "SimdMath.h"
+
+namespace sdf
+{
+	template<typename F> inline F dot2(const Vec2<F>& v) { return dot(v, v); }
+	template<typename F> inline F dot2(const Vec3<F>& v) { return dot(v, v); }
+	template<typename F> inline F ndot(const Vec2<F>& a, const Vec2<F>& b) { return a.x * b.x - a.y * b.y; }
+
+	template<typename F> inline F sdPlane(const Vec3<F>& p, const Vec3<F>& n)
+	{
+		return dot(p, n);
+	}
+
+	template<typename F> inline F sdSphere(const Vec3<F>& p, NoDeduceT<F> r)
+	{
+		return length(p) - r;
+	}
+
+	template<typename F> inline F sdTorus(const Vec3<F>& p, const Vec2<F>& t)
+	{
+		return length(Vec2<F>(length(Vec2<F>(p.x, p.z)) - t.x, p.y)) - t.y;
+	}
+
+	// mode selects the axis as in the shader: 0 = Z, 1 = X, anything else = Y.
+	template<typename F> inline F sdCylinder(const Vec3<F>& p, const Vec2<F>& h, int mode)
+	{
+		Vec2<F> d;
+		switch (mode)
+		{
+		case 0:
+			d = abs(Vec2<F>(length(Vec2<F>(p.x, p.y)), p.z)) - h;
+			break;
+		case 1:
+			d = abs(Vec2<F>(length(Vec2<F>(p.y, p.z)), p.x)) - h;
+			break;
+		default:
+			d = abs(Vec2<F>(length(Vec2<F>(p.x, p.z)), p.y)) - h;
+			break;
+		}
+		return min(max(d.x, d.y), F(0.0f)) + length(max(d, F(0.0f)));
+	}
+
+	template<typename F> inline F sdBox(const Vec3<F>& p, const Vec3<F>& b)
+	{
+		Vec3<F> d = abs(p) - b;
+		return min(max(d.x, max(d.y, d.z)), F(0.0f)) + length(max(d, F(0.0f)));
+	}
+
+	template<typename F> inline F sdBoxFrame(const Vec3<F>& p0, const Vec3<F>& b, NoDeduceT<F> e)
+	{
+		Vec3<F> p = abs(p0) - b;
+		e = e * F(0.5f);
+		Vec3<F> q = abs(p + e) - e;
+
+		return min(min(
+			length(max(Vec3<F>(p.x, q.y, q.z), F(0.0f))) + min(max(p.x, max(q.y, q.z)), F(0.0f)),
+			length(max(Vec3<F>(q.x, p.y, q.z), F(0.0f))) + min(max(q.x, max(p.y, q.z)), F(0.0f))),
+			length(max(Vec3<F>(q.x, q.y, p.z), F(0.0f))) + min(max(q.x, max(q.y, p.z)), F(0.0f)));
+	}
+
+	// The shader picks one of three swizzles with an if/else chain; here every lane takes the
+	// same path and the branches become selects.
+	template<typename F> inline F sdOctahedron(const Vec3<F>& p0, NoDeduceT<F> s)
+	{
+		Vec3<F> p = abs(p0);
+		F m = p.x + p.y + p.z - s;
+
+		auto cx = F(3.0f) * p.x < m;
+		auto cy = F(3.0f) * p.y < m;
+		auto cz = F(3.0f) * p.z < m;
+		Vec3<F> q = select(cx, p, select(cy, p.yzx(), p.zxy()));
+
+		F k = clamp(F(0.5f) * (q.z - q.y + s), F(0.0f), s);
+		F d = length(Vec3<F>(q.x, q.y - s + k, q.z - k));
+		return select(cx | cy | cz, d, m * F(0.57735027f));
+	}
+
+	// Union of two (distance, material) pairs.
+	template<typename F> inline Vec2<F> opU(const Vec2<F>& d1, const Vec2<F>& d2)
+	{
+		return select(d1.x < d2.x, d1, d2);
+	}
+
+	template<typename F> inline F opUnion(F d1, NoDeduceT<F> d2)
+	{
+		return min(d1, d2);
+	}
+
+	template<typename F> inline F opSubtraction(F d1, NoDeduceT<F> d2)
+	{
+		return max(d1, -d2);
+	}
+
+	template<typename F> inline F opIntersection(F d1, NoDeduceT<F> d2)
+	{
+		return max(d1, d2);
+	}
+
+	template<typename F> inline F opSmoothUnion(F d1, NoDeduceT<F> d2, NoDeduceT<F> k)
+	{
+		F h = clamp(F(0.5f) + F(0.5f) * (d2 - d1) / k, F(0.0f), F(1.0f));
+		return lerp(d2, d1, h) - k * h * (F(1.0f) - h);
+	}
+
+	template<typename F> inline F opSmoothSubtraction(F d1, NoDeduceT<F> d2, NoDeduceT<F> k)
+	{
+		F h = clamp(F(0.5f) - F(0.5f) * (d2 + d1) / k, F(0.0f), F(1.0f));
+		return lerp(d2, -d1, h) + k * h * (F(1.0f) - h);
+	}
+
+	template<typename F> inline F opSmoothIntersection(F d1, NoDeduceT<F> d2, NoDeduceT<F> k)
+	{
+		F h = clamp(F(0.5f) - F(0.5f) * (d2 - d1) / k, F(0.0f), F(1.0f));
+		return lerp(d2, d1, h) + k * h * (F(1.0f) - h);
+	}
+
+	// The shader reads g_Time.x directly; on the CPU the time is passed in.
+	// The offset is uniform across the packet, so it is computed once in scalar code.
+	template<typename F> inline F opDisplace(F d1, float time)
+	{
+		float an = std::fmod(time, 6.28f);
+		float d2 = 0.2f * std::sin(3.0f * an);
+		return d1 + F(d2);
+	}
+
+	template<typename F> inline F opRound(F sdf, NoDeduceT<F> thickness)
+	{
+		return sdf - thickness;
+	}
+}
@@ -0,0 +1,388 @@
+#include "ProbeGrid.h"
+#include "Renderer.h"
+
+#include <donut/core/log.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		constexpr int c_IrradianceTexels = SDF_PROBE_IRRADIANCE_SIZE + 2;
+		constexpr int c_DistanceTexels = SDF_PROBE_DISTANCE_SIZE + 2;
+
+		// How far the shaded point is pushed off the surface, relative to the smallest probe spacing.
+		constexpr float c_SurfaceBias = 0.2f;
+
+		const float c_Pi = 3.14159265f;
+		const float3 c_KeyLightColor(1.3f, 1.f, 0.7f);
+		const float3 c_SkyColor(0.4f, 0.6f, 1.15f);
+
+		float SignNotZero(float x)
+		{
+			return x >= 0.f ? 1.f : -1.f;
+		}
+
+		float Square(float x)
+		{
+			return x * x;
+		}
+
+		// The fixed diffuse sky term of render().
+		float3 SkyIrradiance(const float3& nor)
+		{
+			return 0.60f * std::sqrt(saturate(0.5f + 0.5f * nor.y)) * c_SkyColor;
+		}
+
+		// Radiance of the sky along dir, brighter overhead, whose irradiance on an open upward surface is
+		// that of SkyIrradiance().
+		float3 SkyRadiance(const float3& dir)
+		{
+			return 0.72f * (0.5f + 0.5f * dir.y) * c_SkyColor;
+		}
+
+		// Ray i of n spread evenly over the sphere.
+		float3 SphericalFibonacci(int i, int n)
+		{
+			const float phi = 2.f * c_Pi * (float(i) * 0.618034f - std::floor(float(i) * 0.618034f));
+			const float cosTheta = 1.f - (2.f * float(i) + 1.f) / float(n);
+			const float sinTheta = std::sqrt(std::max(1.f - cosTheta * cosTheta, 0.f));
+			return float3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+		}
+
+		// Direction of the center of interior texel (x, y) of a map of size x size interior texels.
+		float3 TexelDirection(int x, int y, int size)
+		{
+			return DecodeOctahedral((float2(float(x), float(y)) + 0.5f) / float(size) * 2.f - 1.f);
+		}
+
+		// Copies the texels across the edges of the octahedron into the border of a map of n x n texels.
+		template<typename T> void FillBorder(T* texels, int n)
+		{
+			for (int i = 1; i < n - 1; i++)
+			{
+				texels[i] = texels[n + n - 1 - i];
+				texels[(n - 1) * n + i] = texels[(n - 2) * n + n - 1 - i];
+				texels[i * n] = texels[(n - 1 - i) * n + 1];
+				texels[i * n + n - 1] = texels[(n - 1 - i) * n + n - 2];
+			}
+			texels[0] = texels[(n - 2) * n + n - 2];
+			texels[n - 1] = texels[(n - 2) * n + 1];
+			texels[(n - 1) * n] = texels[n + n - 2];
+			texels[(n - 1) * n + n - 1] = texels[n + 1];
+		}
+
+		// Bilinear lookup of dir in a map of n x n texels, bordered as by FillBorder().
+		template<typename T> T SampleOctahedral(const T* texels, int n, const float3& dir)
+		{
+			const float2 uv = (EncodeOctahedral(dir) * 0.5f + 0.5f) * float(n - 2) + 0.5f;
+			const int x = std::clamp(int(std::floor(uv.x)), 0, n - 2);
+			const int y = std::clamp(int(std::floor(uv.y)), 0, n - 2);
+			const float fx = saturate(uv.x - float(x));
+			const float fy = saturate(uv.y - float(y));
+			const T* row = texels + y * n + x;
+			return lerp(lerp(row[0], row[1], fx), lerp(row[n], row[n + 1], fx), fy);
+		}
+	}
+
+	float2 EncodeOctahedral(const float3& dir)
+	{
+		float2 p = float2(dir.x, dir.y) / (std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z));
+		if (dir.z < 0.f)
+			p = float2((1.f - std::abs(p.y)) * SignNotZero(p.x), (1.f - std::abs(p.x)) * SignNotZero(p.y));
+		return p;
+	}
+
+	float3 DecodeOctahedral(const float2& p)
+	{
+		float3 v(p.x, p.y, 1.f - std::abs(p.x) - std::abs(p.y));
+		if (v.z < 0.f)
+			v = float3((1.f - std::abs(p.y)) * SignNotZero(p.x), (1.f - std::abs(p.x)) * SignNotZero(p.y), v.z);
+		return normalize(v);
+	}
+
+	bool ProbeGrid::Init(const ProbeGridDesc& desc)
+	{
+		if (desc.counts.x < 2 || desc.counts.y < 2 || desc.counts.z < 2 || desc.raysPerProbe < 1)
+		{
+			log::error("Can't place %dx%dx%d probes of %d rays", desc.counts.x, desc.counts.y, desc.counts.z, desc.raysPerProbe);
+			return false;
+		}
+
+		const float3 extent = desc.bounds.diagonal();
+		if (!(extent.x > 0.f && extent.y > 0.f && extent.z > 0.f) || !IsFinite(desc.bounds))
+		{
+			log::error("Can't place probes over an empty region");
+			return false;
+		}
+
+		m_Origin = desc.bounds.m_mins;
+		m_Spacing = extent / float3(desc.counts - 1);
+		m_Counts = desc.counts;
+		m_RaysPerProbe = desc.raysPerProbe;
+		m_Hysteresis = saturate(desc.hysteresis);
+		m_MaxDistance = 1.5f * length(m_Spacing);
+		m_Bias = c_SurfaceBias * std::min(m_Spacing.x, std::min(m_Spacing.y, m_Spacing.z));
+		m_Irradiance.resize(size_t(GetProbeCount()) * c_IrradianceTexels * c_IrradianceTexels);
+		m_Distance.resize(size_t(GetProbeCount()) * c_DistanceTexels * c_DistanceTexels);
+		Reset();
+		return true;
+	}
+
+	void ProbeGrid::Reset()
+	{
+		std::fill(m_Irradiance.begin(), m_Irradiance.end(), float4(0.f));
+		std::fill(m_Distance.begin(), m_Distance.end(), float2(0.f));
+		m_Next = 0;
+		m_UpdateCount = 0;
+	}
+
+	uint32_t ProbeGrid::Update(tf::Executor& executor, const SceneMap& map, const RenderConstants& constants, uint32_t budget,
+		RenderStats* stats)
+	{
+		if (Empty() || budget == 0)
+			return 0;
+
+		const uint32_t probeCount = GetProbeCount();
+		const uint32_t count = std::min(budget, probeCount);
+		RenderConstants lighting = constants;
+		lighting.g_Accumulate = int4(0);
+
+		// The rays of every update are rotated at random, so that the blended values converge to the
+		// integral over all directions rather than to the same few rays.
+		std::mt19937 rng(m_UpdateCount++);
+		std::uniform_real_distribution<float> dist(0.f, 1.f);
+		const float u1 = dist(rng);
+		const float u2 = dist(rng) * 2.f * c_Pi;
+		const float u3 = dist(rng) * 2.f * c_Pi;
+		const quat rotation(std::sqrt(u1) * std::cos(u3), std::sqrt(1.f - u1) * std::sin(u2),
+			std::sqrt(1.f - u1) * std::cos(u2), std::sqrt(u1) * std::sin(u3));
+
+		// The new values go to separate texels, so that the rays of every probe see the grid as it was.
+		const size_t irradianceTexels = size_t(c_IrradianceTexels) * c_IrradianceTexels;
+		const size_t distanceTexels = size_t(c_DistanceTexels) * c_DistanceTexels;
+		std::vector<float4> irradiance(count * irradianceTexels);
+		std::vector<float2> distance(count * distanceTexels);
+		std::vector<RenderStats> probeStats(count);
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0u, count, 1u, [&](uint32_t i)
+		{
+			UpdateProbe((m_Next + i) % probeCount, map, lighting, rotation, &irradiance[i * irradianceTexels],
+				&distance[i * distanceTexels], probeStats[i]);
+		}, 1u);
+		executor.run(taskflow).wait();
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t probe = (m_Next + i) % probeCount;
+			std::copy_n(&irradiance[i * irradianceTexels], irradianceTexels, &m_Irradiance[probe * irradianceTexels]);
+			std::copy_n(&distance[i * distanceTexels], distanceTexels, &m_Distance[probe * distanceTexels]);
+			if (stats)
+				*stats += probeStats[i];
+		}
+		m_Next = (m_Next + count) % probeCount;
+		return count;
+	}
+
+	void ProbeGrid::UpdateProbe(uint32_t probe, const SceneMap& map, const RenderConstants& constants, const quat& rotation,
+		float4* irradiance, float2* distance, RenderStats& stats) const
+	{
+		const size_t irradianceTexels = size_t(c_IrradianceTexels) * c_IrradianceTexels;
+		const size_t distanceTexels = size_t(c_DistanceTexels) * c_DistanceTexels;
+		const float4* oldIrradiance = &m_Irradiance[probe * irradianceTexels];
+		const float2* oldDistance = &m_Distance[probe * distanceTexels];
+
+		// A probe inside a surface only sees the inside of it.
+		const float3 origin = GetProbePosition(probe);
+		if (!(map(origin).x > 0.f))
+		{
+			std::fill_n(irradiance, irradianceTexels, float4(0.f));
+			std::fill_n(distance, distanceTexels, float2(0.f));
+			return;
+		}
+
+		const int rayCount = m_RaysPerProbe;
+		std::vector<float3> directions(rayCount);
+		std::vector<float3> radiance(rayCount);
+		std::vector<float> hitDistance(rayCount);
+		const float3 lig = GetKeyLightDirection(constants);
+		for (int r = 0; r < rayCount; r++)
+		{
+			const float3 rd = applyQuat(rotation, SphericalFibonacci(r, rayCount));
+			directions[r] = rd;
+
+			const float2 res = Raycast(map, origin, rd, int(constants.g_Factor.x), SDF_RAY_START, constants.g_Relax.x, &stats);
+			if (res.y < 0.f)
+			{
+				radiance[r] = constants.g_Switch.z == 1 ? SkyRadiance(rd) : float3(0.f);
+				hitDistance[r] = m_MaxDistance;
+				continue;
+			}
+
+			// The light the surface reflects back: the key light and what the grid holds there.
+			const float3 pos = origin + rd * res.x;
+			const float3 nor = res.y < 1.5f ? float3(0.f, 1.f, 0.f) : CalcNormal(map, pos, res.x, &stats);
+			float3 light(0.f);
+			if (constants.g_Switch.y == 1)
+			{
+				float dif = saturate(dot(nor, lig));
+				if (dif > 0.f)
+					dif *= CalcSoftshadow(map, pos, lig, 0.02f, 2.5f, constants.g_Factor.y, &stats);
+				light += 2.20f * dif * c_KeyLightColor;
+			}
+			if (constants.g_Switch.z == 1)
+				light += Sample(pos, nor, rd);
+			radiance[r] = GetBaseColor(constants, nullptr, pos, res.y) * light;
+			hitDistance[r] = std::min(res.x, m_MaxDistance);
+		}
+
+		// The irradiance of a texel is the mean radiance of the rays weighted by the cosine to its direction,
+		// its distances the moments of the ray lengths weighted by a sharp power of it.
+		const bool blend = oldIrradiance[0].w > 0.f;
+		for (int y = 0; y < SDF_PROBE_IRRADIANCE_SIZE; y++)
+		{
+			for (int x = 0; x < SDF_PROBE_IRRADIANCE_SIZE; x++)
+			{
+				const float3 dir = TexelDirection(x, y, SDF_PROBE_IRRADIANCE_SIZE);
+				float3 sum(0.f);
+				float weightSum = 0.f;
+				for (int r = 0; r < rayCount; r++)
+				{
+					const float weight = std::max(dot(dir, directions[r]), 0.f);
+					sum += weight * radiance[r];
+					weightSum += weight;
+				}
+
+				const size_t texel = size_t(y + 1) * c_IrradianceTexels + x + 1;
+				float3 value = weightSum > 0.f ? sum / weightSum : float3(0.f);
+				if (blend)
+					value = lerp(value, oldIrradiance[texel].xyz(), m_Hysteresis);
+				irradiance[texel] = float4(value, 1.f);
+			}
+		}
+
+		for (int y = 0; y < SDF_PROBE_DISTANCE_SIZE; y++)
+		{
+			for (int x = 0; x < SDF_PROBE_DISTANCE_SIZE; x++)
+			{
+				const float3 dir = TexelDirection(x, y, SDF_PROBE_DISTANCE_SIZE);
+				float2 sum(0.f);
+				float weightSum = 0.f;
+				for (int r = 0; r < rayCount; r++)
+				{
+					const float weight = std::pow(std::max(dot(dir, directions[r]), 0.f), SDF_PROBE_DISTANCE_SHARPNESS);
+					sum += weight * float2(hitDistance[r], hitDistance[r] * hitDistance[r]);
+					weightSum += weight;
+				}
+
+				const size_t texel = size_t(y + 1) * c_DistanceTexels + x + 1;
+				float2 value = weightSum > 0.f ? sum / weightSum : float2(m_MaxDistance, m_MaxDistance * m_MaxDistance);
+				if (blend)
+					value = lerp(value, oldDistance[texel], m_Hysteresis);
+				distance[texel] = value;
+			}
+		}
+
+		FillBorder(irradiance, c_IrradianceTexels);
+		FillBorder(distance, c_DistanceTexels);
+	}
+
+	float3 ProbeGrid::Sample(const float3& pos, const float3& nor, const float3& rd) const
+	{
+		if (Empty())
+			return SkyIrradiance(nor);
+
+		// The point is pushed off the surface, mostly towards the viewer, so that the distances of the
+		// probes behind the surface don't shadow it.
+		const float3 biased = pos + (nor * 0.2f - rd * 0.8f) * m_Bias;
+		const float3 cell = (biased - m_Origin) / m_Spacing;
+		int3 base;
+		float3 alpha;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			base[axis] = std::clamp(int(std::floor(cell[axis])), 0, m_Counts[axis] - 2);
+			alpha[axis] = saturate(cell[axis] - float(base[axis]));
+		}
+
+		float3 sum(0.f);
+		float weightSum = 0.f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			const int3 offset(corner & 1, corner >> 1 & 1, corner >> 2);
+			const int3 index = base + offset;
+			const uint32_t probe = uint32_t((index.z * m_Counts.y + index.y) * m_Counts.x + index.x);
+			if (!HoldsLight(probe))
+				continue;
+
+			// Probes on the side of the surface the normal points to.
+			const float3 probePos = GetProbePosition(probe);
+			float weight = Square((dot(normalize(probePos - pos), nor) + 1.f) * 0.5f) + 0.2f;
+
+			// Chebyshev's bound on the probability that the probe sees the point past the surfaces around it.
+			const float3 fromProbe = biased - probePos;
+			const float d = length(fromProbe);
+			const float2 moments = SampleDistance(probe, d > 1e-6f ? fromProbe / d : nor);
+			if (d > moments.x)
+			{
+				const float variance = std::abs(moments.x * moments.x - moments.y);
+				const float visibility = variance / (variance + Square(d - moments.x));
+				weight *= std::max(visibility * visibility * visibility, 0.05f);
+			}
+
+			weight = std::max(weight, 1e-6f);
+			if (weight < SDF_PROBE_MIN_WEIGHT)
+				weight *= weight * weight / (SDF_PROBE_MIN_WEIGHT * SDF_PROBE_MIN_WEIGHT);
+			weight *= (offset.x ? alpha.x : 1.f - alpha.x) * (offset.y ? alpha.y : 1.f - alpha.y) * (offset.z ? alpha.z : 1.f - alpha.z);
+
+			sum += weight * SampleIrradiance(probe, nor).xyz();
+			weightSum += weight;
+		}
+
+		return weightSum > 0.f ? sum / weightSum : SkyIrradiance(nor);
+	}
+
+	float3 ProbeGrid::GetProbePosition(uint32_t probe) const
+	{
+		const uint32_t x = probe % uint32_t(m_Counts.x);
+		const uint32_t y = probe / uint32_t(m_Counts.x) % uint32_t(m_Counts.y);
+		const uint32_t z = probe / uint32_t(m_Counts.x * m_Counts.y);
+		return m_Origin + float3(float(x), float(y), float(z)) * m_Spacing;
+	}
+
+	bool ProbeGrid::HoldsLight(uint32_t probe) const
+	{
+		return m_Irradiance[size_t(probe) * c_IrradianceTexels * c_IrradianceTexels].w > 0.f;
+	}
+
+	float4 ProbeGrid::SampleIrradiance(uint32_t probe, const float3& dir) const
+	{
+		return SampleOctahedral(&m_Irradiance[size_t(probe) * c_IrradianceTexels * c_IrradianceTexels], c_IrradianceTexels, dir);
+	}
+
+	float2 ProbeGrid::SampleDistance(uint32_t probe, const float3& dir) const
+	{
+		return SampleOctahedral(&m_Distance[size_t(probe) * c_DistanceTexels * c_DistanceTexels], c_DistanceTexels, dir);
+	}
+
+	void ProbeGrid::GetConstants(int4& probes, float4& origin, float4& spacing) const
+	{
+		if (Empty())
+		{
+			probes = int4(0);
+			origin = spacing = float4(0.f);
+			return;
+		}
+
+		probes = int4(m_Counts, 0);
+		origin = float4(m_Origin, m_MaxDistance);
+		spacing = float4(m_Spacing, m_Bias);
+	}
+}
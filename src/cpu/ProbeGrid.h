@@ -0,0 +1,96 @@
+#pragma once
+
+// Irradiance probes for diffuse global illumination, after Majercik et al., "Dynamic Diffuse Global
+// Illumination with Ray-Traced Irradiance Fields", 2019.
+//
+// A regular grid of probes over the scene, each holding the irradiance arriving from every direction and
+// the distance to the surfaces around it in two small octahedral maps. Update() traces the rays of a few
+// probes per call against the SDF on the executor's workers: a ray that hits a surface returns the key
+// light reaching it, with its shadow, and the irradiance the grid already holds there times its base
+// color, so that every update adds a bounce; a ray that misses returns the sky. The new values are blended
+// with the old ones, so that noise and changes fade in over a few updates, and a fixed budget of probes
+// per frame refreshes the whole grid in turn at a fixed cost.
+//
+// render() takes the diffuse sky term from the grid instead of the fixed sky, see Sample(). The layout of
+// the maps is shared with SDFProbes.hlsli and described next to RenderConstants::g_Probes in sdf_cb.h.
+
+#include "ShaderTypes.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	struct SceneMap;
+	struct RenderStats;
+
+	struct ProbeGridDesc
+	{
+		box3 bounds = box3(float3(-2.5f, 0.1f, -2.5f), float3(2.5f, 2.1f, 2.5f));  // probes on its corners and across it
+		int3 counts = int3(8, 4, 8);    // probes per axis, at least 2
+		int raysPerProbe = 64;
+		float hysteresis = 0.9f;        // weight of the old values of a probe against those of its new rays
+	};
+
+	// Octahedral mapping of a unit direction to [-1, 1]^2 and back.
+	float2 EncodeOctahedral(const float3& dir);
+	float3 DecodeOctahedral(const float2& p);
+
+	class ProbeGrid
+	{
+	public:
+		// Places the probes, none of which holds light yet. Fails on an empty region, fewer than 2 probes
+		// along an axis or no rays.
+		bool Init(const ProbeGridDesc& desc);
+		// Traces the rays of the next budget probes, wrapping around the grid, with the lighting of
+		// constants: its time, g_Switch and march settings, without the jitter of the accumulation. Probes
+		// inside a surface are switched off. Returns the number of probes updated; stats, when not null,
+		// receives the rays and their map() calls.
+		uint32_t Update(tf::Executor& executor, const SceneMap& map, const RenderConstants& constants, uint32_t budget,
+			RenderStats* stats = nullptr);
+		// Forgets the light of every probe, e.g. after the scene changed.
+		void Reset();
+
+		// Irradiance at pos with the normal nor, seen along rd, from the 8 probes around it: the diffuse sky
+		// term of render(). The fixed sky irradiance where none of them holds light.
+		float3 Sample(const float3& pos, const float3& nor, const float3& rd) const;
+
+		bool Empty() const { return m_Irradiance.empty(); }
+		int3 GetCounts() const { return m_Counts; }
+		uint32_t GetProbeCount() const { return uint32_t(m_Counts.x * m_Counts.y * m_Counts.z); }
+		float3 GetProbePosition(uint32_t probe) const;
+		// Whether a probe was traced and isn't inside a surface.
+		bool HoldsLight(uint32_t probe) const;
+
+		// g_Probes, g_ProbeOrigin and g_ProbeSpacing of the grid, disabled while it is empty.
+		void GetConstants(int4& probes, float4& origin, float4& spacing) const;
+		// The contents of g_ProbeIrradiance and g_ProbeDistance.
+		const std::vector<float4>& GetIrradiance() const { return m_Irradiance; }
+		const std::vector<float2>& GetDistance() const { return m_Distance; }
+		size_t GetMemorySize() const { return m_Irradiance.size() * sizeof(float4) + m_Distance.size() * sizeof(float2); }
+
+	private:
+		float4 SampleIrradiance(uint32_t probe, const float3& dir) const;
+		float2 SampleDistance(uint32_t probe, const float3& dir) const;
+
+		// Traces the rays of a probe and blends them into the texels of its maps in irradiance and distance.
+		void UpdateProbe(uint32_t probe, const SceneMap& map, const RenderConstants& constants, const quat& rotation,
+			float4* irradiance, float2* distance, RenderStats& stats) const;
+
+		float3 m_Origin = float3(0.f);
+		float3 m_Spacing = float3(0.f);
+		int3 m_Counts = int3(0);
+		int m_RaysPerProbe = 0;
+		float m_Hysteresis = 0.f;
+		float m_MaxDistance = 0.f;
+		float m_Bias = 0.f;
+		uint32_t m_Next = 0;            // first probe of the next update
+		uint32_t m_UpdateCount = 0;     // seeds the rotation of the rays
+		std::vector<float4> m_Irradiance;
+		std::vector<float2> m_Distance;
+	};
+}
@@ -0,0 +1,111 @@
+#include "RandomScene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace sdf
+{
+	namespace
+	{
+		std::unique_ptr<CsgNode> MakeNode(uint32_t opcode, int material = -1)
+		{
+			auto node = std::make_unique<CsgNode>();
+			node->opcode = opcode;
+			node->material = material;
+			return node;
+		}
+
+		std::unique_ptr<CsgNode> MakePrimitive(std::mt19937& rng, const float3& center, float size)
+		{
+			std::uniform_real_distribution<float> unit(0.f, 1.f);
+			const uint32_t types[] = { SDF_OP_SPHERE, SDF_OP_BOX, SDF_OP_TORUS, SDF_OP_CYLINDER, SDF_OP_OCTAHEDRON };
+
+			auto node = MakeNode(types[rng() % 5]);
+			float* p = node->params;
+			p[0] = center.x + (unit(rng) - 0.5f) * size;
+			p[1] = center.y + (unit(rng) - 0.5f) * size;
+			p[2] = center.z + (unit(rng) - 0.5f) * size;
+
+			float s = size * (0.3f + 0.4f * unit(rng));
+			switch (node->opcode)
+			{
+			case SDF_OP_BOX:
+				p[3] = s;
+				p[4] = s * (0.5f + unit(rng));
+				p[5] = s;
+				break;
+			case SDF_OP_TORUS:
+				p[3] = s;
+				p[4] = s * 0.25f;
+				break;
+			case SDF_OP_CYLINDER:
+				node->flags = rng() % 3;
+				p[3] = s * 0.5f;
+				p[4] = s;
+				break;
+			default:
+				p[3] = s;
+				break;
+			}
+			return node;
+		}
+	}
+
+	std::unique_ptr<CsgNode> MakeRandomScene(uint32_t primitiveCount, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+		auto root = MakeNode(SDF_OP_UNION);
+		auto floor = MakeNode(SDF_OP_PLANE, 0);
+		floor->params[1] = 1.f;
+		root->children.push_back(std::move(floor));
+
+		// Keep the density constant: about one cluster of four primitives per square unit.
+		const uint32_t clusterSize = 4;
+		const float extent = std::sqrt(float(std::max(primitiveCount, 1u)) / float(clusterSize)) * 0.5f;
+		const float size = 0.35f;
+
+		uint32_t remaining = primitiveCount;
+		while (remaining > 0)
+		{
+			float3 center((unit(rng) * 2.f - 1.f) * extent, 0.2f + unit(rng) * 0.8f, (unit(rng) * 2.f - 1.f) * extent);
+			uint32_t count = std::min(remaining, clusterSize);
+			remaining -= count;
+
+			std::unique_ptr<CsgNode> cluster;
+			if (count >= 2 && (rng() % 4) == 0)
+			{
+				// A box with the other primitives carved out of it.
+				cluster = MakeNode(SDF_OP_SUBTRACTION);
+				auto box = MakeNode(SDF_OP_BOX);
+				box->params[0] = center.x;
+				box->params[1] = center.y;
+				box->params[2] = center.z;
+				box->params[3] = box->params[4] = box->params[5] = size;
+				cluster->children.push_back(std::move(box));
+				count--;
+			}
+			else
+			{
+				cluster = MakeNode(SDF_OP_SMOOTH_UNION);
+				cluster->params[0] = 0.1f;
+			}
+			cluster->material = int(rng() % 40);
+
+			for (uint32_t i = 0; i < count; i++)
+				cluster->children.push_back(MakePrimitive(rng, center, size));
+
+			if (cluster->children.size() == 1)
+			{
+				cluster->children[0]->material = cluster->material;
+				root->children.push_back(std::move(cluster->children[0]));
+			}
+			else
+				root->children.push_back(std::move(cluster));
+		}
+
+		return root;
+	}
+}
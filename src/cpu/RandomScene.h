@@ -0,0 +1,12 @@
+#pragma once
+
+// Synthetic scenes with many nodes for benchmarks and tests.
+// Clusters of smooth-blended primitives and carved boxes scattered over a floor plane,
+// roughly the shape of a production scene.
+
+#include "CsgScene.h"
+
+namespace sdf
+{
+	std::unique_ptr<CsgNode> MakeRandomScene(uint32_t primitiveCount, uint32_t seed = 1);
+}
@@ -0,0 +1,538 @@
+#include "Renderer.h"
+#include "Accumulation.h"
+#include "ConePrepass.h"
+#include "Instrumentation.h"
+#include "LightingPass.h"
+#include "Noise.h"
+#include "PacketMarching.h"
+#include "TemporalReuse.h"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace sdf
+{
+	namespace
+	{
+		float3 Reflect(const float3& i, const float3& n)
+		{
+			return i - 2.0f * dot(n, i) * n;
+		}
+
+		float Smoothstep(float edge0, float edge1, float x)
+		{
+			float t = saturate((x - edge0) / (edge1 - edge0));
+			return t * t * (3.0f - 2.0f * t);
+		}
+
+		float3 Sin(const float3& v)
+		{
+			return float3(std::sin(v.x), std::sin(v.y), std::sin(v.z));
+		}
+
+		// Gamma-encoded color of a pixel, or the heatmap color of the map() calls of pixelStats.
+		float3 EncodePixel(const RenderConstants& constants, const RenderStats& pixelStats, const float3& col)
+		{
+			if (constants.g_Heatmap.x != SDF_HEATMAP_OFF)
+			{
+				uint32_t count = PixelEvaluations(pixelStats).Get(constants.g_Heatmap.x);
+				return pow(HeatmapColor(count, uint32_t(std::max(constants.g_Heatmap.y, 1))), 2.2f);
+			}
+
+			return pow(col, 0.4545f);
+		}
+	}
+
+	RenderStats& RenderStats::operator+=(const RenderStats& other)
+	{
+		primaryRays += other.primaryRays;
+		primarySteps += other.primarySteps;
+		primaryFallbacks += other.primaryFallbacks;
+		primarySkips += other.primarySkips;
+		shadowRays += other.shadowRays;
+		shadowSteps += other.shadowSteps;
+		prepassRays += other.prepassRays;
+		prepassSteps += other.prepassSteps;
+		temporalSeeds += other.temporalSeeds;
+		lightingSamples += other.lightingSamples;
+		lightingFallbacks += other.lightingFallbacks;
+		normalEvaluations += other.normalEvaluations;
+		aoEvaluations += other.aoEvaluations;
+		seconds += other.seconds;
+		return *this;
+	}
+
+	uint32_t PixelEvaluations::Get(int mode) const
+	{
+		switch (mode)
+		{
+		case SDF_HEATMAP_PRIMARY: return primary;
+		case SDF_HEATMAP_NORMAL: return normal;
+		case SDF_HEATMAP_AO: return ao;
+		case SDF_HEATMAP_SHADOW: return shadow;
+		default: return GetTotal();
+		}
+	}
+
+	float2 Raycast(const SceneMap& map, const float3& ro, const float3& rd, int maxSteps, float tmin, float omega,
+		RenderStats* stats)
+	{
+		float2 res(-1.0f, -1.0f);
+
+		RayMarch ray(tmin, omega);
+		while (ray.IsMarching(maxSteps))
+		{
+			if (map.occupancy && ray.Skip(*map.occupancy, ro, rd))
+				continue;
+			if (!ray.Advance(map(ro + rd * ray.t), res))
+				break;
+		}
+
+		if (stats)
+		{
+			stats->primaryRays++;
+			stats->primarySteps += uint64_t(ray.steps);
+			stats->primaryFallbacks += ray.fallback;
+			stats->primarySkips += uint64_t(ray.skips);
+		}
+
+		return res;
+	}
+
+	float CalcSoftshadow(const SceneMap& map, const float3& ro, const float3& rd, float mint, float maxt, float k, RenderStats* stats)
+	{
+		float res = 1.0f;
+		float ph = 1e20f;
+		uint64_t steps = 0;
+
+		for (float t = mint; t < maxt;)
+		{
+			float h = map(ro + rd * t).x;
+			steps++;
+			if (h < 0.001f)
+			{
+				res = 0.0f;
+				break;
+			}
+			float y = h * h / (2.0f * ph);
+			float d = std::sqrt(h * h - y * y);
+			res = std::min(res, k * d / std::max(0.0f, t - y));
+			ph = h;
+			t += h;
+		}
+
+		if (stats)
+		{
+			stats->shadowRays++;
+			stats->shadowSteps += steps;
+		}
+
+		return res;
+	}
+
+	float3 CalcNormal(const SceneMap& map, const float3& p, float t, RenderStats* stats)
+	{
+		if (map.normals == SDF_NORMALS_DUAL)
+		{
+			if (stats)
+				stats->normalEvaluations += 1;
+
+			Dual<float> d = map.EvaluateDual(p);
+			return normalize(float3(d.d.x, d.d.y, d.d.z));
+		}
+
+		float eps = 0.0001f;
+		eps += eps / 10.0f * t;
+
+		if (map.normals == SDF_NORMALS_TETRAHEDRON)
+		{
+			if (stats)
+				stats->normalEvaluations += 4;
+
+			// The corners cancel in pairs, so the sum is the gradient up to a constant factor.
+			const float3 a(1.f, -1.f, -1.f);
+			const float3 b(-1.f, -1.f, 1.f);
+			const float3 c(-1.f, 1.f, -1.f);
+			const float3 d(1.f, 1.f, 1.f);
+			return normalize(a * map(p + a * eps).x + b * map(p + b * eps).x +
+				c * map(p + c * eps).x + d * map(p + d * eps).x);
+		}
+
+		if (stats)
+			stats->normalEvaluations += 6;
+
+		const float3 x(eps, 0.f, 0.f);
+		const float3 y(0.f, eps, 0.f);
+		const float3 z(0.f, 0.f, eps);
+
+		return normalize(float3(map(p + x).x - map(p - x).x,
+			map(p + y).x - map(p - y).x,
+			map(p + z).x - map(p - z).x));
+	}
+
+	float CalcAO(const SceneMap& map, const float3& pos, const float3& nor, RenderStats* stats)
+	{
+		float occ = 0.0f;
+		float decay = 1.0f;
+		int i = 0;
+		while (i < 5)
+		{
+			float h = 0.01f + 0.12f * float(i) / 4.0f;
+			float d = map(pos + h * nor).x;
+			i++;
+			occ += (h - d) * decay;
+			decay *= 0.95f;
+			if (occ > 0.35f)
+				break;
+		}
+
+		if (stats)
+			stats->aoEvaluations += uint64_t(i);
+
+		return saturate(1.0f - 3.0f * occ) * (0.5f + 0.5f * nor.y);
+	}
+
+	float3 GetKeyLightDirection(const RenderConstants& constants)
+	{
+		float an = std::fmod(constants.g_Time.x, 6.28f);
+		float3 lig = normalize(float3(2.0f * std::sin(an), 1.5f + std::cos(an), 2.0f * std::cos(an)));
+
+		// The accumulated samples spread the light over a disc facing the scene.
+		const float2 jitter = GetLightJitter(constants);
+		if (jitter.x != 0.f || jitter.y != 0.f)
+		{
+			float3 tangent = normalize(cross(lig, float3(0.f, 1.f, 0.f)));
+			float3 bitangent = cross(tangent, lig);
+			lig = normalize(lig + SDF_ACCUMULATE_LIGHT_RADIUS * (jitter.x * tangent + jitter.y * bitangent));
+		}
+		return lig;
+	}
+
+	float3 GetBaseColor(const RenderConstants& constants, const Texture* texture, const float3& pos, float m)
+	{
+		float3 col(0.f);
+		if (constants.g_Switch.x == 1)
+		{
+			col = 0.2f + 0.2f * Sin(m * 2.0f + float3(0.f, 1.f, 2.f));
+
+			if (m == 0.f)
+			{
+				col = float3(0.3f, 0.f, 0.f);
+				col = col * (texture ? texture->Sample(float2(pos.x, pos.z)) : float3(FloorPattern(Vec2<float>(pos.x, pos.z))));
+			}
+		}
+		return col;
+	}
+
+	LightingTerms CalcLightingTerms(const RenderConstants& constants, const SceneMap& map, const float3& pos,
+		const float3& nor, const float3& rd, RenderStats* stats)
+	{
+		LightingTerms terms;
+		if (constants.g_Switch.w == 1)
+			terms.occlusion = CalcAO(map, pos, nor, stats);
+		if (constants.g_Switch.y == 1)
+			terms.keyShadow = CalcSoftshadow(map, pos, GetKeyLightDirection(constants), 0.02f, 2.5f, constants.g_Factor.y, stats);
+		if (constants.g_Switch.z == 1)
+			terms.skyShadow = CalcSoftshadow(map, pos, Reflect(rd, nor), 0.02f, 2.5f, constants.g_Factor.y, stats);
+		return terms;
+	}
+
+	float3 RenderRay(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float3& ro, const float3& rd, float tmin, RenderStats* stats, float2* hit,
+		const std::vector<LightingSample>* lighting, const float2& pixel)
+	{
+		float2 res = Raycast(map, ro, rd, int(constants.g_Factor.x), tmin, constants.g_Relax.x, stats);
+		if (hit)
+			*hit = res;
+		return ShadeRay(constants, map, texture, ro, rd, res, stats, lighting, pixel);
+	}
+
+	float3 ShadeRay(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float3& ro, const float3& rd, const float2& res, RenderStats* stats,
+		const std::vector<LightingSample>* lighting, const float2& pixel)
+	{
+		float3 col(0.f);
+
+		float t = res.x;
+		float m = res.y;
+		if (m >= 0.f)
+		{
+			float3 pos = ro + t * rd;
+			float3 nor = (m < 1.5f) ? float3(0.f, 1.f, 0.f) : CalcNormal(map, pos, t, stats);
+			float3 ref = Reflect(rd, nor);
+
+			col = GetBaseColor(constants, texture, pos, m);
+
+			float3 lin(0.f);
+
+			LightingTerms terms;
+			if (!lighting || !UpsampleLighting(constants, *lighting, pixel, pos, nor, t, terms))
+			{
+				terms = CalcLightingTerms(constants, map, pos, nor, rd, stats);
+				if (lighting && stats)
+					stats->lightingFallbacks++;
+			}
+			float occ = terms.occlusion;
+
+			if (constants.g_Switch.y == 1)
+			{
+				float3 lig = GetKeyLightDirection(constants);
+				float3 hal = normalize(lig - rd);
+				float dif = saturate(dot(nor, lig));
+				dif *= occ;
+				dif *= terms.keyShadow;
+				float spe = std::pow(saturate(dot(nor, hal)), 16.0f);
+				lin += col * 2.20f * dif * float3(1.3f, 1.f, 0.7f);
+				lin += 0.2f * spe * float3(1.3f, 1.f, 0.7f);
+			}
+
+			if (constants.g_Switch.z == 1)
+			{
+				float dif = std::sqrt(saturate(0.5f + 0.5f * nor.y));
+				dif *= occ;
+				float spe = Smoothstep(-0.2f, 0.2f, ref.y);
+				spe *= terms.skyShadow;
+				spe *= 5.0f * std::pow(saturate(1.0f + dot(nor, rd)), 5.0f);
+				if (map.probes)
+					lin += col * map.probes->Sample(pos, nor, rd) * occ;
+				else
+					lin += col * 0.60f * dif * float3(0.4f, 0.6f, 1.15f);
+				lin += spe;
+			}
+
+			col = lin;
+			col = lerp(col, float3(0.9f), 1.0f - std::exp(-0.0001f * t * t * t));
+		}
+
+		return saturate(col);
+	}
+
+	float3 RenderPixel(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float2& pixel, float tmin, RenderStats* stats, float2* hit, const std::vector<LightingSample>* lighting)
+	{
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		Camera camera = Camera::Current(constants);
+		float3 rd = camera.PixelRay(pixel, resolution);
+
+		RenderStats pixelStats;
+		float3 col = RenderRay(constants, map, texture, camera.origin, rd, tmin, &pixelStats, hit, lighting, pixel);
+		if (stats)
+			*stats += pixelStats;
+
+		return EncodePixel(constants, pixelStats, col);
+	}
+
+	float3 ShadePixel(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float2& pixel, const float2& res, const RenderStats& rayStats, RenderStats* stats,
+		const std::vector<LightingSample>* lighting)
+	{
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		Camera camera = Camera::Current(constants);
+		float3 rd = camera.PixelRay(pixel, resolution);
+
+		RenderStats pixelStats = rayStats;
+		float3 col = ShadeRay(constants, map, texture, camera.origin, rd, res, &pixelStats, lighting, pixel);
+		if (stats)
+			*stats += pixelStats;
+
+		return EncodePixel(constants, pixelStats, col);
+	}
+
+	RenderStats CpuRenderer::Render(const RenderConstants& constants, Image& image)
+	{
+		const int width = int(constants.g_Resolution.x);
+		const int height = int(constants.g_Resolution.y);
+		image.Resize(width, height);
+
+		const bool sameSize = m_Accumulation.width == width && m_Accumulation.height == height;
+		if (constants.g_Accumulate.x != 0 && constants.g_Accumulate.z != 0 && sameSize)
+		{
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+					image.At(x, y) = pow(m_Accumulation.At(x, y), 0.4545f);
+			return RenderStats();
+		}
+
+		if (m_RecordEvaluations)
+			m_Evaluations.Resize(width, height);
+		else
+			m_Evaluations = EvaluationImage();
+
+		const int tilesX = (width + m_TileSize - 1) / m_TileSize;
+		const int tilesY = (height + m_TileSize - 1) / m_TileSize;
+		std::vector<RenderStats> tileStats(size_t(tilesX) * size_t(tilesY));
+
+		SceneMap map;
+		map.bvh = m_Scene;
+		map.time = constants.g_Time.x;
+		map.normals = m_Normals;
+		if (m_UseJit && m_Scene)
+		{
+			m_Jit.Update(*m_Scene, m_JitCache);
+			m_JitCache.Trim();
+			map.jit = &m_Jit;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// The hits of the previous render are only reused when they cover the same pixels.
+		RenderConstants frame = constants;
+		const bool temporal = m_History.width == width && m_History.height == height;
+		frame.g_Temporal = GetTemporalConstants(temporal && constants.g_Temporal.x != 0.f, m_History.time);
+		frame.g_PrevCamera = m_History.camera;
+		frame.g_PrevCameraTarget = m_History.cameraTarget;
+		if (m_Occupancy && !m_Occupancy->Empty())
+		{
+			map.occupancy = m_Occupancy;
+			m_Occupancy->GetConstants(frame.g_Occupancy, frame.g_OccupancyGrid);
+		}
+		if (m_Probes && !m_Probes->Empty())
+		{
+			map.probes = m_Probes;
+			m_Probes->GetConstants(frame.g_Probes, frame.g_ProbeOrigin, frame.g_ProbeSpacing);
+		}
+		m_NextHistory.Resize(width, height);
+		m_NextHistory.time = constants.g_Time.x;
+		m_NextHistory.camera = constants.g_Camera;
+		m_NextHistory.cameraTarget = constants.g_CameraTarget;
+
+		// Sample 0 starts the accumulation over, as does a change of size.
+		const bool accumulate = constants.g_Accumulate.x != 0;
+		if (accumulate && (constants.g_Accumulate.y <= 0 || !sameSize))
+		{
+			m_Accumulation.Resize(width, height);
+			m_Accumulation.constants = constants;
+			frame.g_Accumulate.y = 0;
+		}
+		const float2 jitter = GetSampleJitter(frame);
+		const float weight = 1.0f / float(frame.g_Accumulate.y + 1);
+
+		RenderStats prepassStats;
+		RenderConePrepass(m_Executor, frame, map, m_ConeDepth, &prepassStats);
+		RenderLightingPass(m_Executor, frame, map, m_ConeDepth, m_LightingSamples, &prepassStats);
+		const std::vector<LightingSample>* lighting = m_LightingSamples.empty() ? nullptr : &m_LightingSamples;
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(0, tilesX * tilesY, 1, [&](int tile)
+		{
+			int x0 = (tile % tilesX) * m_TileSize;
+			int y0 = (tile / tilesX) * m_TileSize;
+			int x1 = std::min(x0 + m_TileSize, width);
+			int y1 = std::min(y0 + m_TileSize, height);
+
+			RenderStats& stats = tileStats[tile];
+			auto storePixel = [&](int x, int y, float3 color, const RenderStats& pixelStats)
+			{
+				if (accumulate)
+				{
+					// The mean is kept in linear space, like the shading before the gamma encoding.
+					float3& mean = m_Accumulation.At(x, y);
+					mean += (pow(color, 2.2f) - mean) * weight;
+					color = pow(mean, 0.4545f);
+				}
+				image.At(x, y) = color;
+				stats += pixelStats;
+				if (m_RecordEvaluations)
+					m_Evaluations.At(x, y) = PixelEvaluations(pixelStats);
+			};
+
+			if (m_PacketSize > 0)
+			{
+				PacketBundle bundle;
+				for (int y = y0; y < y1; y += m_PacketSize)
+				{
+					for (int x = x0; x < x1; x += m_PacketSize)
+					{
+						bundle.Resize(int2(x, y), int2(std::min(x + m_PacketSize, x1), std::min(y + m_PacketSize, y1)));
+						MarchBundle(frame, map, m_ConeDepth, m_History, jitter, bundle, &stats);
+						for (int i = 0; i < bundle.GetCount(); i++)
+						{
+							const int2 p = bundle.GetPixel(i);
+							RenderStats& pixelStats = bundle.startStats[i];
+							m_NextHistory.At(p.x, p.y) = bundle.hits[i];
+							float3 color = ShadePixel(frame, map, m_Texture, bundle.pixels[i], bundle.hits[i], bundle.rayStats[i], &pixelStats, lighting);
+							storePixel(p.x, p.y, color, pixelStats);
+						}
+					}
+				}
+				return;
+			}
+
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					float2 pixel = float2(float(x) + 0.5f, float(y) + 0.5f) + jitter;
+					RenderStats pixelStats;
+					float tmin = GetConeStart(frame, m_ConeDepth, pixel);
+					tmin = GetTemporalStart(frame, map, m_History, pixel, tmin, &pixelStats);
+					float3 color = RenderPixel(frame, map, m_Texture, pixel, tmin, &pixelStats, &m_NextHistory.At(x, y), lighting);
+					storePixel(x, y, color, pixelStats);
+				}
+			}
+		}, 1);
+
+		m_Executor.run(taskflow).wait();
+		std::swap(m_History, m_NextHistory);
+		if (accumulate)
+			m_Accumulation.samples = frame.g_Accumulate.y + 1;
+
+		RenderStats total = prepassStats;
+		for (const RenderStats& stats : tileStats)
+			total += stats;
+		total.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		return total;
+	}
+
+	RenderStats CpuRenderer::Accumulate(const RenderConstants& constants, int samples, Image& image)
+	{
+		RenderConstants frame = constants;
+		const bool sameSize = m_Accumulation.width == int(constants.g_Resolution.x) && m_Accumulation.height == int(constants.g_Resolution.y);
+		if (!sameSize || m_Accumulation.samples == 0 || !IsSameImage(constants, m_Accumulation.constants))
+			ResetAccumulation();
+
+		RenderStats total;
+		const int count = std::min(samples, SDF_ACCUMULATE_MAX_SAMPLES - m_Accumulation.samples);
+		for (int i = 0; i < count; i++)
+		{
+			frame.g_Accumulate = GetAccumulateConstants(true, m_Accumulation.samples);
+			total += Render(frame, image);
+		}
+
+		// A converged image, or no budget at all, only shows what was accumulated.
+		if (count <= 0 && m_Accumulation.samples > 0)
+		{
+			frame.g_Accumulate = GetAccumulateConstants(true, m_Accumulation.samples, true);
+			total += Render(frame, image);
+		}
+		return total;
+	}
+
+	RenderConstants GetDefaultRenderConstants(float time, int width, int height)
+	{
+		RenderConstants constants = {};
+		constants.g_Time = float4(time, 0.f, 0.f, 0.f);
+		constants.g_Resolution = float4(float(width), float(height), 0.f, 0.f);
+		constants.g_Switch = int4(1, 1, 1, 1);
+		constants.g_Factor = float2(256.0f, 20.0f);
+		constants.g_FactorPad = float2(0.0f);
+		constants.g_Scene = int4(0);
+		constants.g_Cone = GetConeConstants(SDF_CONE_TILE_SIZE, width);
+		constants.g_Relax = float4(SDF_RAY_RELAXATION, 0.f, 0.f, 0.f);
+		constants.g_Heatmap = int4(SDF_HEATMAP_OFF, 256, 0, 0);
+		constants.g_Temporal = GetTemporalConstants(false, 0.f);
+		constants.g_Lighting = GetLightingConstants(0, width);
+		constants.g_Accumulate = GetAccumulateConstants(false, 0);
+		constants.g_Camera = constants.g_CameraTarget = float4(0.f);
+		constants.g_PrevCamera = constants.g_PrevCameraTarget = float4(0.f);
+		constants.g_Occupancy = int4(0);
+		constants.g_OccupancyGrid = float4(0.f);
+		constants.g_Probes = int4(0);
+		constants.g_ProbeOrigin = constants.g_ProbeSpacing = float4(0.f);
+		return constants;
+	}
+}
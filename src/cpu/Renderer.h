@@ -0,0 +1,351 @@
+#pragma once
+
+// Headless CPU port of sdf_ps.hlsl: raycast(), render(), calcNormal(), calcAO() and calcSoftshadow()
+// driven by the same RenderConstants as the shader. The image is split into tiles that the workers
+// of a taskflow executor take one at a time, so the load stays balanced however uneven the tiles are.
+
+#include "Camera.h"
+#include "DefaultScene.h"
+#include "Dual.h"
+#include "Image.h"
+#include "OccupancyGrid.h"
+#include "ProbeGrid.h"
+#include "TapeJit.h"
+
+#include <algorithm>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// CPU version of map() in SDF.hlsli: the uploaded scene when there is one, the built-in scene otherwise.
+	struct SceneMap
+	{
+		const SceneBvh* bvh = nullptr;
+		const BvhJit* jit = nullptr;        // compiled tapes of bvh, interpreted when null
+		const OccupancyGrid* occupancy = nullptr;   // empty space Raycast() may jump across, like g_OccupancyBits; not used by map()
+		const ProbeGrid* probes = nullptr;  // diffuse sky term of ShadeRay(), like g_ProbeIrradiance; not used by map()
+		float time = 0.f;
+		int normals = SDF_NORMALS_DEFAULT;  // SDF_NORMALS_* of CalcNormal(), the SDF_NORMALS permutation of the shader
+
+		template<typename F> Vec2<F> Evaluate(const Vec3<F>& pos) const
+		{
+			if (bvh && !bvh->GetInstructions().empty())
+				return jit ? EvaluateBvh(*bvh, *jit, pos, time) : EvaluateBvh(*bvh, pos, time);
+			return mapDefault(pos, time);
+		}
+
+		float2 operator()(const float3& pos) const
+		{
+			Vec2<float> res = Evaluate(Vec3<float>(pos.x, pos.y, pos.z));
+			return float2(res.x, res.y);
+		}
+
+		// Distance and its gradient in one pass, see Dual.h.
+		Dual<float> EvaluateDual(const float3& pos) const
+		{
+			return Evaluate(DualPosition(Vec3<float>(pos.x, pos.y, pos.z))).x;
+		}
+	};
+
+	struct RenderStats
+	{
+		uint64_t primaryRays = 0;
+		uint64_t primarySteps = 0;
+		uint64_t primaryFallbacks = 0;  // primary rays whose over-relaxed march fell back to plain steps
+		uint64_t primarySkips = 0;      // empty cells of the occupancy grid the primary rays jumped across, see OccupancyGrid.h
+		uint64_t shadowRays = 0;
+		uint64_t shadowSteps = 0;
+		uint64_t prepassRays = 0;   // cones of the prepass, see ConePrepass.h
+		uint64_t prepassSteps = 0;
+		uint64_t temporalSeeds = 0;     // primary rays started at the reprojected hit of the previous frame, see TemporalReuse.h
+		uint64_t lightingSamples = 0;   // reduced-resolution shadow and AO samples, their rays count as primary rays, see LightingPass.h
+		uint64_t lightingFallbacks = 0; // pixels that evaluated their own shadows and AO as no sample resembled them
+		uint64_t normalEvaluations = 0;
+		uint64_t aoEvaluations = 0;
+		double seconds = 0.0;
+
+		uint64_t GetRays() const { return primaryRays + shadowRays; }
+		uint64_t GetSteps() const { return primarySteps + shadowSteps + prepassSteps; }
+		// All map() calls: march steps plus the samples of the normals and the ambient occlusion.
+		uint64_t GetEvaluations() const { return GetSteps() + normalEvaluations + aoEvaluations; }
+		double GetRaysPerSecond() const { return seconds > 0.0 ? double(GetRays()) / seconds : 0.0; }
+		double GetStepsPerSecond() const { return seconds > 0.0 ? double(GetSteps()) / seconds : 0.0; }
+
+		RenderStats& operator+=(const RenderStats& other);
+	};
+
+	// map() evaluations of one pixel, split like the SDF_HEATMAP_* modes.
+	struct PixelEvaluations
+	{
+		uint32_t primary = 0;
+		uint32_t normal = 0;
+		uint32_t ao = 0;
+		uint32_t shadow = 0;
+
+		PixelEvaluations() = default;
+		explicit PixelEvaluations(const RenderStats& stats)
+			: primary(uint32_t(stats.primarySteps)), normal(uint32_t(stats.normalEvaluations))
+			, ao(uint32_t(stats.aoEvaluations)), shadow(uint32_t(stats.shadowSteps)) { }
+
+		uint32_t GetTotal() const { return primary + normal + ao + shadow; }
+		// Count for one of SDF_HEATMAP_TOTAL ... SDF_HEATMAP_SHADOW.
+		uint32_t Get(int mode) const;
+	};
+
+	struct EvaluationImage
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<PixelEvaluations> pixels;  // rows from the top
+
+		void Resize(int _width, int _height)
+		{
+			width = _width;
+			height = _height;
+			pixels.assign(size_t(width) * size_t(height), PixelEvaluations());
+		}
+
+		PixelEvaluations& At(int x, int y) { return pixels[size_t(y) * width + x]; }
+		const PixelEvaluations& At(int x, int y) const { return pixels[size_t(y) * width + x]; }
+	};
+
+	// Primary hits of a frame, the contents of g_Hits, see TemporalReuse.h.
+	struct HitHistory
+	{
+		int width = 0;
+		int height = 0;
+		float time = 0.f;               // g_Time.x of the frame
+		float4 camera = float4(0.f);    // g_Camera of the frame
+		float4 cameraTarget = float4(0.f);
+		std::vector<float2> hits;       // (t, material) rows from the top, -1 for misses
+
+		void Resize(int _width, int _height)
+		{
+			width = _width;
+			height = _height;
+			hits.assign(size_t(width) * size_t(height), float2(-1.f));
+		}
+
+		bool IsEmpty() const { return hits.empty(); }
+		float2& At(int x, int y) { return hits[size_t(y) * width + x]; }
+		const float2& At(int x, int y) const { return hits[size_t(y) * width + x]; }
+	};
+
+	// Mean of the samples accumulated so far, the contents of g_Accumulation, see Accumulation.h.
+	struct AccumulationImage
+	{
+		int width = 0;
+		int height = 0;
+		int samples = 0;
+		RenderConstants constants;      // of the first sample, when there is one
+		std::vector<float3> mean;       // linear colors, rows from the top
+
+		void Resize(int _width, int _height)
+		{
+			width = _width;
+			height = _height;
+			samples = 0;
+			mean.assign(size_t(width) * size_t(height), float3(0.f));
+		}
+
+		float3& At(int x, int y) { return mean[size_t(y) * width + x]; }
+		const float3& At(int x, int y) const { return mean[size_t(y) * width + x]; }
+	};
+
+	// A ray of raycast() between its steps, so that rays can also be marched together (see PacketMarching.h).
+	struct RayMarch
+	{
+		float t = SDF_RAY_START;
+		float prevT = SDF_RAY_START;
+		float prevH = 0.f;
+		float omega = 1.f;
+		int steps = 0;
+		int skips = 0;
+		bool fallback = false;
+
+		RayMarch() = default;
+		RayMarch(float tmin, float _omega) : t(tmin), prevT(tmin), omega(_omega) { }
+
+		// The steps and the jumps share the budget, like the iterations of raycast().
+		bool IsMarching(int maxSteps) const { return steps + skips < maxSteps && t < SDF_RAY_END; }
+
+		// Jumps past the empty cells of the grid from the ray's point on, as long as the ray is known to be
+		// empty up to where it entered the first: up to the point after a plain step, only up to the sphere
+		// of the previous point after an over-relaxed one. A ray that stepped back out of a surface stays, so
+		// that it doesn't jump over it again. Returns false when the ray stays where it is.
+		bool Skip(const OccupancyGrid& grid, const float3& ro, const float3& rd)
+		{
+			if (prevH < 0.f)
+				return false;
+
+			const float2 cell = grid.FindEmptySpan(ro, rd, t, SDF_RAY_END);
+			const float known = omega > 1.0f ? prevT + std::abs(prevH) : t;
+			if (!(cell.y > t) || cell.x > known)
+				return false;
+
+			skips++;
+			t = cell.y;
+			prevT = t;
+			prevH = 0.f;
+			return true;
+		}
+
+		// Takes the step for h = map(ro + rd * t). Returns false at a hit, whose (t, material) goes to res.
+		bool Advance(const float2& h, float2& res)
+		{
+			steps++;
+
+			// Over-relaxed steps (Keinert et al., "Enhanced Sphere Tracing", 2014) are safe as long as the
+			// distance spheres of consecutive points overlap. When they do not, a surface may have been
+			// skipped: go back to the previous point, take the plain step from there and stop relaxing.
+			if (omega > 1.0f && std::abs(h.x) + std::abs(prevH) < std::abs(t - prevT))
+			{
+				t = prevT + prevH;
+				omega = 1.0f;
+				fallback = true;
+				return true;
+			}
+			if (std::abs(h.x) < 0.0001f * t)
+			{
+				res = float2(t, h.y);
+				return false;
+			}
+			prevT = t;
+			prevH = h.x;
+			t += h.x * omega;
+			return true;
+		}
+	};
+
+	// Shader functions. The stats pointers may be null.
+	// omega is g_Relax.x, the step factor of the over-relaxed sphere tracing; 1 marches plain steps.
+	float2 Raycast(const SceneMap& map, const float3& ro, const float3& rd, int maxSteps, float tmin, float omega,
+		RenderStats* stats = nullptr);
+	float CalcSoftshadow(const SceneMap& map, const float3& ro, const float3& rd, float mint, float maxt, float k, RenderStats* stats = nullptr);
+	// Gradient by map.normals: central differences (6 map() calls), differences along the four corners of
+	// a tetrahedron (4 calls) or one pass with dual numbers (counted as 1 call, each costs more).
+	float3 CalcNormal(const SceneMap& map, const float3& p, float t, RenderStats* stats = nullptr);
+	float CalcAO(const SceneMap& map, const float3& pos, const float3& nor, RenderStats* stats = nullptr);
+
+	// The soft shadows and the ambient occlusion of render(), for the terms g_Switch enables.
+	struct LightingTerms
+	{
+		float occlusion = 1.f;
+		float keyShadow = 1.f;
+		float skyShadow = 1.f;
+	};
+
+	float3 GetKeyLightDirection(const RenderConstants& constants);
+	// Albedo of material m at pos, the floor pattern or texture for material 0; black unless g_Switch.x is set.
+	float3 GetBaseColor(const RenderConstants& constants, const Texture* texture, const float3& pos, float m);
+	LightingTerms CalcLightingTerms(const RenderConstants& constants, const SceneMap& map, const float3& pos,
+		const float3& nor, const float3& rd, RenderStats* stats = nullptr);
+
+	// hit receives raycast()'s (t, material) when it isn't null. With lighting, the samples of the
+	// reduced-resolution pass when g_Lighting enables it, the shadows and AO are upsampled at pixel
+	// instead of evaluated for the ray.
+	float3 RenderRay(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float3& ro, const float3& rd, float tmin, RenderStats* stats = nullptr, float2* hit = nullptr,
+		const std::vector<LightingSample>* lighting = nullptr, const float2& pixel = float2(0.f));
+	// RenderRay() after the raycast(), whose (t, material) is res.
+	float3 ShadeRay(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float3& ro, const float3& rd, const float2& res, RenderStats* stats = nullptr,
+		const std::vector<LightingSample>* lighting = nullptr, const float2& pixel = float2(0.f));
+
+	// PS() for one pixel, (0, 0) is the top-left corner of the image. Returns the gamma-encoded color,
+	// or the heatmap color of the pixel's map() evaluations when g_Heatmap.x selects one.
+	// tmin is the distance the ray starts marching from: SDF_RAY_START, the cone prepass result or the
+	// temporal start. hit and lighting are as in RenderRay().
+	float3 RenderPixel(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float2& pixel, float tmin, RenderStats* stats = nullptr, float2* hit = nullptr,
+		const std::vector<LightingSample>* lighting = nullptr);
+	// RenderPixel() of a primary ray that was marched elsewhere, such as in a packet: res is its raycast()
+	// result and rayStats counts the steps it took, which are added to stats and show in the heatmap.
+	float3 ShadePixel(const RenderConstants& constants, const SceneMap& map, const Texture* texture,
+		const float2& pixel, const float2& res, const RenderStats& rayStats, RenderStats* stats = nullptr,
+		const std::vector<LightingSample>* lighting = nullptr);
+
+	class CpuRenderer
+	{
+	public:
+		explicit CpuRenderer(tf::Executor& executor) : m_Executor(executor) { }
+
+		// nullptr selects the built-in scene, like an empty tape on the GPU.
+		void SetScene(const SceneBvh* bvh) { m_Scene = bvh; ResetAccumulation(); }
+		// Floor texture sampled instead of FloorPattern(), the pattern of the shader, e.g. to compare with
+		// images of the old noise0.jpg floor. nullptr selects the pattern.
+		void SetTexture(const Texture* texture) { m_Texture = texture; ResetAccumulation(); }
+		void SetTileSize(int tileSize) { m_TileSize = tileSize; }
+		// Keeps the map() evaluation counts of every pixel of the next renders, see Instrumentation.h.
+		void SetRecordEvaluations(bool record) { m_RecordEvaluations = record; }
+		// SDF_NORMALS_* used for the normals, like the SDF_NORMALS permutation of the pixel shader.
+		void SetNormals(int normals) { m_Normals = normals; ResetAccumulation(); }
+		// Evaluates the scene with the tapes compiled by TapeJit.h. The tapes of every render are looked up
+		// in a cache, so that only the objects an animation changed are compiled again.
+		void SetJit(bool jit) { m_UseJit = jit; }
+		// Marches the primary rays of bundles of size x size pixels together, see PacketMarching.h; 0 marches
+		// every ray on its own.
+		void SetPacketSize(int size) { m_PacketSize = std::max(size, 0); }
+		// Lets the primary rays jump across the empty cells of the grid, which the caller keeps up to date with
+		// the scene, like the GPU renderer does with g_OccupancyBits. nullptr or an empty grid marches every step.
+		void SetOccupancy(const OccupancyGrid* grid) { m_Occupancy = grid; ResetAccumulation(); }
+		// Takes the diffuse sky term from the irradiance of the grid, which the caller updates, like the GPU
+		// renderer does with g_ProbeIrradiance. nullptr or an empty grid keeps the fixed sky light.
+		void SetProbes(const ProbeGrid* probes) { m_Probes = probes; ResetAccumulation(); }
+
+		// Renders an image of g_Resolution.xy pixels, after the cone prepass when g_Cone enables it and the
+		// reduced-resolution shadows and AO when g_Lighting does. When g_Temporal.x enables the reuse, the
+		// primary rays start at the hits of the previous Render() of the same size; g_Temporal.y and
+		// g_PrevCamera* are taken from them. When g_Accumulate.x is set, the jittered sample g_Accumulate.y
+		// is averaged into the accumulation, which starts over at sample 0, and the image shows the mean.
+		RenderStats Render(const RenderConstants& constants, Image& image);
+		// Forgets the hits of the previous render, e.g. after the scene changed.
+		void ResetHistory() { m_History = HitHistory(); }
+
+		// Progressive rendering of a still image: adds up to samples jittered samples per pixel to those of
+		// the previous calls and writes their mean to the image. The accumulation starts over when the
+		// constants render a different image or the size changes, and stops growing at
+		// SDF_ACCUMULATE_MAX_SAMPLES; g_Accumulate is ignored. The stats cover the samples of this call.
+		RenderStats Accumulate(const RenderConstants& constants, int samples, Image& image);
+		// Starts the accumulation over, e.g. after the contents of the scene changed.
+		void ResetAccumulation() { m_Accumulation.Resize(0, 0); }
+
+		// Start distances of the last prepass, one per tile as in g_ConeDepth.
+		const std::vector<float>& GetConeDepth() const { return m_ConeDepth; }
+		// Shadow and AO samples of the last render, as in g_LightingSamples.
+		const std::vector<LightingSample>& GetLightingSamples() const { return m_LightingSamples; }
+		// Primary hits of the last render, as in g_Hits.
+		const HitHistory& GetHistory() const { return m_History; }
+		// Samples averaged so far, as in g_Accumulation.
+		const AccumulationImage& GetAccumulation() const { return m_Accumulation; }
+		// Counts of the last render with SetRecordEvaluations(true), empty otherwise.
+		const EvaluationImage& GetEvaluations() const { return m_Evaluations; }
+
+	private:
+		tf::Executor& m_Executor;
+		const SceneBvh* m_Scene = nullptr;
+		const Texture* m_Texture = nullptr;
+		int m_TileSize = 16;
+		int m_Normals = SDF_NORMALS_DEFAULT;
+		bool m_UseJit = false;
+		int m_PacketSize = 0;
+		const OccupancyGrid* m_Occupancy = nullptr;
+		const ProbeGrid* m_Probes = nullptr;
+		JitCache m_JitCache;
+		BvhJit m_Jit;
+		std::vector<float> m_ConeDepth;
+		std::vector<LightingSample> m_LightingSamples;
+		HitHistory m_History;
+		HitHistory m_NextHistory;
+		AccumulationImage m_Accumulation;
+		bool m_RecordEvaluations = false;
+		EvaluationImage m_Evaluations;
+	};
+
+	// Constants for the default settings of the application at the given time and size.
+	RenderConstants GetDefaultRenderConstants(float time, int width, int height);
+}
@@ -0,0 +1,78 @@
+#include "SceneAnimation.h"
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sdf
+{
+	void SceneAnimation::Bind(const Tape& tape, const CsgCamera* camera)
+	{
+		m_Instructions.clear();
+		m_BaseParameters.clear();
+		m_Tracks.clear();
+		m_TrackInstructions.clear();
+
+		// The tracks are ordered by instruction, so those of one instruction are neighbours.
+		for (const TapeTrack& track : tape.tracks)
+		{
+			if (m_Instructions.empty() || m_Instructions.back() != track.instruction)
+			{
+				m_Instructions.push_back(track.instruction);
+				const float* params = tape.instructions[track.instruction].params;
+				m_BaseParameters.insert(m_BaseParameters.end(), params, params + c_Stride);
+			}
+			m_Tracks.push_back(track.track);
+			m_TrackInstructions.push_back(uint32_t(m_Instructions.size() - 1));
+		}
+
+		m_Parameters = m_BaseParameters;
+		m_NextParameters.resize(m_BaseParameters.size());
+		m_Evaluated = false;
+
+		m_HasCamera = camera != nullptr;
+		m_Camera = camera ? *camera : CsgCamera();
+	}
+
+	uint32_t SceneAnimation::Evaluate(float time, SceneBvh& bvh)
+	{
+		std::copy(m_BaseParameters.begin(), m_BaseParameters.end(), m_NextParameters.begin());
+		for (size_t i = 0; i < m_Tracks.size(); i++)
+		{
+			const CsgTrack& track = m_Tracks[i];
+			const float4 value = track.Evaluate(time);
+			float* params = m_NextParameters.data() + m_TrackInstructions[i] * c_Stride + track.param;
+			for (uint32_t c = 0; c < track.components; c++)
+				params[c] = value[c];
+		}
+
+		// A paused or finished animation writes nothing, so the BVH stays clean and the image still.
+		uint32_t written = 0;
+		for (size_t i = 0; i < m_Instructions.size(); i++)
+		{
+			const float* params = m_NextParameters.data() + i * c_Stride;
+			if (m_Evaluated && std::memcmp(params, m_Parameters.data() + i * c_Stride, c_Stride * sizeof(float)) == 0)
+				continue;
+			bvh.SetParameters(m_Instructions[i], params);
+			written++;
+		}
+
+		std::swap(m_Parameters, m_NextParameters);
+		m_Evaluated = true;
+		return written;
+	}
+
+	void SceneAnimation::GetCameraConstants(float time, float4& camera, float4& target) const
+	{
+		if (!m_HasCamera)
+		{
+			camera = target = float4(0.f);
+			return;
+		}
+
+		float3 position, lookAt;
+		m_Camera.Evaluate(time, position, lookAt);
+		camera = float4(position, 1.f);
+		target = float4(lookAt, 0.f);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Keyframe animation of a scene, the tracks of CsgScene.h.
+//
+// All tracks of a frame are evaluated in one pass into a parameter buffer of seven floats per animated
+// instruction, laid out like TapeInstruction::params and starting from the compiled values of the
+// parameters that aren't animated. Only the instructions whose parameters changed since the previous
+// frame are written into the BVH, which refits their objects, and the renderers upload its tape once per
+// frame. Animating more primitives adds no constants and no shader work.
+
+#include "CsgScene.h"
+#include "Tape.h"
+
+#include <vector>
+
+namespace sdf
+{
+	class SceneBvh;
+
+	class SceneAnimation
+	{
+	public:
+		// Binds the tracks of a compiled tape and the camera of its scene document, which may be null.
+		void Bind(const Tape& tape, const CsgCamera* camera);
+		void Clear() { Bind(Tape(), nullptr); }
+
+		bool IsAnimated() const { return !m_Instructions.empty(); }
+		bool HasCamera() const { return m_HasCamera; }
+		size_t GetInstructionCount() const { return m_Instructions.size(); }
+		size_t GetTrackCount() const { return m_Tracks.size(); }
+
+		// Evaluates every track at the time and writes the instructions whose parameters changed into the
+		// BVH, built from the bound tape. Returns the number of instructions written; the first call after
+		// Bind() writes them all.
+		uint32_t Evaluate(float time, SceneBvh& bvh);
+
+		// Source tape index and parameters of an animated instruction at the time of the last Evaluate().
+		uint32_t GetInstruction(size_t index) const { return m_Instructions[index]; }
+		const float* GetParameters(size_t index) const { return m_Parameters.data() + index * c_Stride; }
+
+		// g_Camera and g_CameraTarget at the time; without a camera both are 0, which keeps the orbit.
+		void GetCameraConstants(float time, float4& camera, float4& target) const;
+
+	private:
+		static constexpr size_t c_Stride = 7;
+
+		std::vector<uint32_t> m_Instructions;       // source tape index of every animated instruction
+		std::vector<float> m_BaseParameters;        // their compiled parameters
+		std::vector<float> m_Parameters;            // the parameter buffer of the last Evaluate()
+		std::vector<float> m_NextParameters;
+		std::vector<CsgTrack> m_Tracks;
+		std::vector<uint32_t> m_TrackInstructions;  // animated instruction of every track
+		bool m_Evaluated = false;
+		bool m_HasCamera = false;
+		CsgCamera m_Camera;
+	};
+}
@@ -0,0 +1,220 @@
+#include "SceneQuery.h"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+
+namespace sdf
+{
+	namespace
+	{
+		constexpr int c_Width = WidthOf<FloatN>;
+		constexpr size_t c_PacketsPerTask = 32;
+		// Raycast()'s 0.0001 * t, kept from shrinking below 0.0001 for the rays that start at the surfaces.
+		constexpr float c_HitEpsilon = 0.0001f;
+
+		template<typename F> F LoadRow(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		template<typename F> void StoreRow(float* p, F v)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		// The queries of a packet, by their index in the batch. The lanes past the end of the batch
+		// repeat its last query.
+		struct Lanes
+		{
+			uint32_t index[c_Width];
+			int count = 0;
+		};
+
+		FloatN Load(const std::vector<float>& values, const Lanes& lanes)
+		{
+			alignas(32) float row[c_Width];
+			for (int lane = 0; lane < c_Width; lane++)
+				row[lane] = values[lanes.index[std::min(lane, lanes.count - 1)]];
+			return LoadRow<FloatN>(row);
+		}
+
+		Vec3<FloatN> Load(const Float3Array& values, const Lanes& lanes)
+		{
+			return Vec3<FloatN>(Load(values.x, lanes), Load(values.y, lanes), Load(values.z, lanes));
+		}
+
+		void Store(std::vector<float>& values, const Lanes& lanes, FloatN v)
+		{
+			alignas(32) float row[c_Width];
+			StoreRow(row, v);
+			for (int lane = 0; lane < lanes.count; lane++)
+				values[lanes.index[lane]] = row[lane];
+		}
+
+		void Store(Float3Array& values, const Lanes& lanes, const Vec3<FloatN>& v)
+		{
+			Store(values.x, lanes, v.x);
+			Store(values.y, lanes, v.y);
+			Store(values.z, lanes, v.z);
+		}
+
+		// Spreads the bits of a 10 bit integer to every third bit.
+		uint32_t SpreadBits(uint32_t v)
+		{
+			v = (v | v << 16) & 0x030000ff;
+			v = (v | v << 8) & 0x0300f00f;
+			v = (v | v << 4) & 0x030c30c3;
+			v = (v | v << 2) & 0x09249249;
+			return v;
+		}
+
+		// The batch in Morton order of the positions over their bounds. Neighbouring queries then
+		// share packets and take the same paths through the BVH, in far fewer nodes than a packet of
+		// queries from all over the scene.
+		std::vector<uint32_t> GetCoherentOrder(const Float3Array& positions)
+		{
+			box3 bounds = box3::empty();
+			for (size_t i = 0; i < positions.Size(); i++)
+				bounds |= positions.Get(i);
+			const float3 scale = 1023.f / max(bounds.diagonal(), float3(1e-20f));
+
+			std::vector<std::pair<uint32_t, uint32_t>> keys(positions.Size());
+			for (size_t i = 0; i < positions.Size(); i++)
+			{
+				const float3 cell = (positions.Get(i) - bounds.m_mins) * scale;
+				keys[i] = { SpreadBits(uint32_t(cell.x)) | SpreadBits(uint32_t(cell.y)) << 1 | SpreadBits(uint32_t(cell.z)) << 2, uint32_t(i) };
+			}
+			std::sort(keys.begin(), keys.end());
+
+			std::vector<uint32_t> order(keys.size());
+			for (size_t i = 0; i < keys.size(); i++)
+				order[i] = keys[i].second;
+			return order;
+		}
+
+		// Sphere traces a packet of rays against the field shrunk by radius, the lanes that are done
+		// keep their t while the others step on. Returns t and the material, -1 for misses.
+		template<typename F> Vec2<F> March(const SceneMap& map, const Vec3<F>& ro, const Vec3<F>& rd, F radius, F tmax, int maxSteps)
+		{
+			F t(0.0f);
+			Vec2<F> res(F(-1.0f), F(-1.0f));
+			MaskOf<F> active = t < tmax;
+			for (int i = 0; i < maxSteps && any(active); i++)
+			{
+				Vec2<F> h = map.Evaluate(ro + rd * t);
+				h.x = h.x - radius;
+
+				MaskOf<F> hit = active & (h.x < F(c_HitEpsilon) * max(t, F(1.0f)));
+				res = select(hit, Vec2<F>(t, h.y), res);
+				active = active & !hit;
+				t = select(active, t + h.x, t);
+				active = active & (t < tmax);
+			}
+			return res;
+		}
+	}
+
+	template<typename Kernel> void SceneQuery::ForEachPacket(const Float3Array& positions, const Kernel& kernel) const
+	{
+		const std::vector<uint32_t> order = GetCoherentOrder(positions);
+		const size_t count = order.size();
+		const size_t taskSize = c_PacketsPerTask * c_Width;
+		tf::Taskflow taskflow;
+		taskflow.for_each_index_dynamic(size_t(0), count, taskSize, [&](size_t first)
+		{
+			const size_t last = std::min(first + taskSize, count);
+			for (size_t i = first; i < last; i += c_Width)
+			{
+				Lanes lanes;
+				lanes.count = int(std::min(last - i, size_t(c_Width)));
+				std::copy(order.begin() + i, order.begin() + i + lanes.count, lanes.index);
+				kernel(lanes);
+			}
+		});
+		m_Executor.run(taskflow).wait();
+	}
+
+	void SceneQuery::Distance(const Float3Array& positions, std::vector<float>& distances, std::vector<float>* materials) const
+	{
+		distances.resize(positions.Size());
+		if (materials)
+			materials->resize(positions.Size());
+
+		ForEachPacket(positions, [&](const Lanes& lanes)
+		{
+			Vec2<FloatN> res = m_Map.Evaluate(Load(positions, lanes));
+			Store(distances, lanes, res.x);
+			if (materials)
+				Store(*materials, lanes, res.y);
+		});
+	}
+
+	void SceneQuery::Gradient(const Float3Array& positions, Float3Array& gradients) const
+	{
+		gradients.Resize(positions.Size());
+		ForEachPacket(positions, [&](const Lanes& lanes)
+		{
+			Dual<FloatN> res = m_Map.Evaluate(DualPosition(Load(positions, lanes))).x;
+			Store(gradients, lanes, res.d);
+		});
+	}
+
+	void SceneQuery::Raycast(const RayQueries& rays, RayHits& hits) const
+	{
+		const size_t count = rays.origins.Size();
+		hits.t.resize(count);
+		hits.materials.resize(count);
+
+		ForEachPacket(rays.origins, [&](const Lanes& lanes)
+		{
+			Vec2<FloatN> res = March(m_Map, Load(rays.origins, lanes), Load(rays.directions, lanes),
+				FloatN(0.0f), Load(rays.maxDistances, lanes), m_MaxSteps);
+			Store(hits.t, lanes, res.x);
+			Store(hits.materials, lanes, res.y);
+		});
+	}
+
+	void SceneQuery::SphereOverlap(const Float3Array& centers, const std::vector<float>& radii, std::vector<float>& depths) const
+	{
+		depths.resize(centers.Size());
+		ForEachPacket(centers, [&](const Lanes& lanes)
+		{
+			Vec2<FloatN> res = m_Map.Evaluate(Load(centers, lanes));
+			Store(depths, lanes, Load(radii, lanes) - res.x);
+		});
+	}
+
+	void SceneQuery::SphereSweep(const SweepQueries& sweeps, SweepHits& hits) const
+	{
+		const size_t count = sweeps.origins.Size();
+		hits.t.resize(count);
+		hits.normals.Resize(count);
+		hits.materials.resize(count);
+
+		ForEachPacket(sweeps.origins, [&](const Lanes& lanes)
+		{
+			const Vec3<FloatN> ro = Load(sweeps.origins, lanes);
+			const Vec3<FloatN> rd = Load(sweeps.directions, lanes);
+			Vec2<FloatN> res = March(m_Map, ro, rd, Load(sweeps.radii, lanes), Load(sweeps.maxDistances, lanes), m_MaxSteps);
+
+			// The gradient at the sphere's center, or against the sweep where it vanishes. Zero for misses.
+			const Vec3<FloatN> gradient = m_Map.Evaluate(DualPosition(ro + rd * max(res.x, FloatN(0.0f)))).x.d;
+			const FloatN gradientLength = length(gradient);
+			const MaskOf<FloatN> hit = res.x >= FloatN(0.0f);
+			const MaskOf<FloatN> valid = hit & (gradientLength > FloatN(0.0f));
+			Vec3<FloatN> normal = select(valid, gradient * (FloatN(1.0f) / max(gradientLength, FloatN(1e-20f))), -rd);
+			normal = select(hit, normal, Vec3<FloatN>(FloatN(0.0f), FloatN(0.0f), FloatN(0.0f)));
+
+			Store(hits.t, lanes, res.x);
+			Store(hits.normals, lanes, normal);
+			Store(hits.materials, lanes, res.y);
+		});
+	}
+}
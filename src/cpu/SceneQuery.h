@@ -0,0 +1,93 @@
+#pragma once
+
+// Batched spatial queries against the scene the renderer draws, for gameplay and physics.
+//
+// A batch holds many queries of one kind in structure of arrays form. The queries are loaded
+// WidthOf<FloatN> at a time into packets that go through the same SceneMap::Evaluate() as the
+// renderer's map(), and the packets are split across the executor's workers. Marching queries keep
+// stepping until every lane of their packet is done, so batches of nearby, similar queries, such as
+// the agents of one area, waste the fewest evaluations.
+
+#include "Renderer.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// Structure of arrays of 3D vectors.
+	struct Float3Array
+	{
+		std::vector<float> x, y, z;
+
+		size_t Size() const { return x.size(); }
+		void Resize(size_t count) { x.resize(count); y.resize(count); z.resize(count); }
+		void Set(size_t i, const float3& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+		float3 Get(size_t i) const { return float3(x[i], y[i], z[i]); }
+	};
+
+	// Rays from origins along unit directions, up to maxDistances.
+	struct RayQueries
+	{
+		Float3Array origins;
+		Float3Array directions;
+		std::vector<float> maxDistances;
+	};
+
+	// Spheres moved from origins along unit directions, up to maxDistances.
+	struct SweepQueries
+	{
+		Float3Array origins;
+		Float3Array directions;
+		std::vector<float> radii;
+		std::vector<float> maxDistances;
+	};
+
+	// First hits, t = -1 and material = -1 for the queries that hit nothing.
+	struct RayHits
+	{
+		std::vector<float> t;
+		std::vector<float> materials;   // map().y at the hit
+	};
+
+	// First contacts of swept spheres. The sphere touches the surface at origin + t * direction - radius * normal.
+	struct SweepHits
+	{
+		std::vector<float> t;
+		Float3Array normals;            // unit surface normals at the contacts
+		std::vector<float> materials;
+	};
+
+	class SceneQuery
+	{
+	public:
+		// Both must outlive the queries.
+		SceneQuery(tf::Executor& executor, const SceneMap& map) : m_Executor(executor), m_Map(map) { }
+
+		// Largest number of map() evaluations of a marching query, 256 by default.
+		void SetMaxSteps(int maxSteps) { m_MaxSteps = maxSteps; }
+
+		// map() at the positions: the closest distance and, when materials isn't null, the material.
+		void Distance(const Float3Array& positions, std::vector<float>& distances, std::vector<float>* materials = nullptr) const;
+		// Gradients of the distance in one pass with dual numbers, unit length wherever the field is an
+		// exact distance. Zero on the creases where min() and max() pick neither side.
+		void Gradient(const Float3Array& positions, Float3Array& gradients) const;
+		// Sphere traces the rays. A ray starting inside a surface hits it at t = 0.
+		void Raycast(const RayQueries& rays, RayHits& hits) const;
+		// How far the spheres reach into the surfaces, radius - distance, positive when they overlap.
+		void SphereOverlap(const Float3Array& centers, const std::vector<float>& radii, std::vector<float>& depths) const;
+		// Sphere traces the distance field shrunk by the radii to the first contact of every sphere.
+		void SphereSweep(const SweepQueries& sweeps, SweepHits& hits) const;
+
+	private:
+		template<typename Kernel> void ForEachPacket(const Float3Array& positions, const Kernel& kernel) const;
+
+		tf::Executor& m_Executor;
+		const SceneMap& m_Map;
+		int m_MaxSteps = 256;
+	};
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// C++ view of the structures shared with the shaders, and small helpers on the donut math types they use.
+
+#include <donut/core/math/math.h>
+
+#include <cmath>
+
+// sdf_cb.h names the donut vector types without their namespace, so it is read inside sdf where they are
+// visible; the structures become sdf::RenderConstants and so on, and nothing leaks into the includers.
+namespace sdf
+{
+	using namespace donut::math;
+
+#include "../sdf_cb.h"
+
+	// False for the infinite boxes of unbounded objects and for bounds computed from bad parameters.
+	inline bool IsFinite(const box3& box)
+	{
+		return std::isfinite(box.m_mins.x) && std::isfinite(box.m_mins.y) && std::isfinite(box.m_mins.z)
+			&& std::isfinite(box.m_maxs.x) && std::isfinite(box.m_maxs.y) && std::isfinite(box.m_maxs.z);
+	}
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+// Packet math used by the CPU SDF evaluator.
+//
+// Every routine in Primitives.h is written once against a "float-like" type F and
+// instantiated with one of:
+//   float   - scalar fallback, always available
+//   Float4  - 4-wide SSE packet
+//   Float8  - 8-wide AVX2 packet
+// Comparisons return a mask type (bool, Mask4, Mask8) which is consumed by select().
+// FloatN is the widest packet the current build supports.
+
+#include <cmath>
+#include <cstdint>
+
+#if !defined(SDF_SIMD_SCALAR_ONLY)
+#if defined(__AVX2__)
+#define SDF_SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SDF_SIMD_SSE 1
+#endif
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define SDF_SIMD_SSE41 1
+#endif
+#endif
+
+#if defined(SDF_SIMD_SSE) || defined(SDF_SIMD_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace sdf
+{
+	// Prevents template argument deduction on a parameter, so that Vec3<Float8> * 0.5f works.
+	template<typename T> struct NoDeduce { using Type = T; };
+	template<typename T> using NoDeduceT = typename NoDeduce<T>::Type;
+
+	template<typename F> struct SimdTraits;
+
+	// ---------------------------------------------------------------- scalar
+
+	template<> struct SimdTraits<float>
+	{
+		static constexpr int Width = 1;
+		using Mask = bool;
+	};
+
+	inline float min(float a, float b) { return a < b ? a : b; }
+	inline float max(float a, float b) { return a < b ? b : a; }
+	inline float abs(float a) { return std::fabs(a); }
+	inline float sqrt(float a) { return std::sqrt(a); }
+	inline float floor(float a) { return std::floor(a); }
+	inline float fmadd(float a, float b, float c) { return a * b + c; }
+	inline float select(bool mask, float a, float b) { return mask ? a : b; }
+	inline bool any(bool mask) { return mask; }
+	inline bool all(bool mask) { return mask; }
+	inline int movemask(bool mask) { return mask ? 1 : 0; }
+	inline float lane(float a, int) { return a; }
+
+	// ---------------------------------------------------------------- SSE
+
+#if defined(SDF_SIMD_SSE)
+	struct Mask4
+	{
+		__m128 v;
+	};
+
+	struct Float4
+	{
+		__m128 v;
+
+		Float4() = default;
+		Float4(__m128 x) : v(x) { }
+		Float4(float x) : v(_mm_set1_ps(x)) { }
+
+		static Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+		void Store(float* p) const { _mm_storeu_ps(p, v); }
+	};
+
+	template<> struct SimdTraits<Float4>
+	{
+		static constexpr int Width = 4;
+		using Mask = Mask4;
+	};
+
+	inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+	inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+	inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+	inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+	inline Float4 operator-(Float4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+	inline Float4& operator+=(Float4& a, Float4 b) { return a = a + b; }
+	inline Float4& operator-=(Float4& a, Float4 b) { return a = a - b; }
+	inline Float4& operator*=(Float4& a, Float4 b) { return a = a * b; }
+	inline Float4& operator/=(Float4& a, Float4 b) { return a = a / b; }
+
+	inline Mask4 operator<(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+	inline Mask4 operator<=(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+	inline Mask4 operator>(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+	inline Mask4 operator>=(Float4 a, Float4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline Mask4 operator==(Float4 a, Float4 b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+	inline Mask4 operator&(Mask4 a, Mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+	inline Mask4 operator|(Mask4 a, Mask4 b) { return { _mm_or_ps(a.v, b.v) }; }
+	inline Mask4 operator!(Mask4 a) { return { _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+
+	inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+	inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+	inline Float4 abs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+	inline Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+	inline Float4 fmadd(Float4 a, Float4 b, Float4 c)
+	{
+#if defined(SDF_SIMD_AVX2)
+		return _mm_fmadd_ps(a.v, b.v, c.v);
+#else
+		return a * b + c;
+#endif
+	}
+
+	inline Float4 select(Mask4 mask, Float4 a, Float4 b)
+	{
+#if defined(SDF_SIMD_SSE41)
+		return _mm_blendv_ps(b.v, a.v, mask.v);
+#else
+		return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+#endif
+	}
+
+	inline Float4 floor(Float4 a)
+	{
+#if defined(SDF_SIMD_SSE41)
+		return _mm_floor_ps(a.v);
+#else
+		// Truncate, then step down where truncation rounded towards zero from below.
+		Float4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+		return t - select(t > a, Float4(1.0f), Float4(0.0f));
+#endif
+	}
+
+	inline int movemask(Mask4 mask) { return _mm_movemask_ps(mask.v); }
+	inline bool any(Mask4 mask) { return movemask(mask) != 0; }
+	inline bool all(Mask4 mask) { return movemask(mask) == 0xf; }
+
+	inline float lane(Float4 a, int i)
+	{
+		alignas(16) float tmp[4];
+		_mm_store_ps(tmp, a.v);
+		return tmp[i];
+	}
+#endif // SDF_SIMD_SSE
+
+	// ---------------------------------------------------------------- AVX2
+
+#if defined(SDF_SIMD_AVX2)
+	struct Mask8
+	{
+		__m256 v;
+	};
+
+	struct Float8
+	{
+		__m256 v;
+
+		Float8() = default;
+		Float8(__m256 x) : v(x) { }
+		Float8(float x) : v(_mm256_set1_ps(x)) { }
+
+		static Float8 Load(const float* p) { return _mm256_loadu_ps(p); }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+	};
+
+	template<> struct SimdTraits<Float8>
+	{
+		static constexpr int Width = 8;
+		using Mask = Mask8;
+	};
+
+	inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+	inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.v, b.v); }
+	inline Float8 operator-(Float8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+	inline Float8& operator+=(Float8& a, Float8 b) { return a = a + b; }
+	inline Float8& operator-=(Float8& a, Float8 b) { return a = a - b; }
+	inline Float8& operator*=(Float8& a, Float8 b) { return a = a * b; }
+	inline Float8& operator/=(Float8& a, Float8 b) { return a = a / b; }
+
+	inline Mask8 operator<(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	inline Mask8 operator<=(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+	inline Mask8 operator>(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	inline Mask8 operator>=(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	inline Mask8 operator==(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+	inline Mask8 operator&(Mask8 a, Mask8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+	inline Mask8 operator|(Mask8 a, Mask8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+	inline Mask8 operator!(Mask8 a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+
+	inline Float8 min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+	inline Float8 max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+	inline Float8 abs(Float8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+	inline Float8 sqrt(Float8 a) { return _mm256_sqrt_ps(a.v); }
+	inline Float8 floor(Float8 a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+	inline Float8 fmadd(Float8 a, Float8 b, Float8 c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+	inline Float8 select(Mask8 mask, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+	inline int movemask(Mask8 mask) { return _mm256_movemask_ps(mask.v); }
+	inline bool any(Mask8 mask) { return movemask(mask) != 0; }
+	inline bool all(Mask8 mask) { return movemask(mask) == 0xff; }
+
+	inline float lane(Float8 a, int i)
+	{
+		alignas(32) float tmp[8];
+		_mm256_store_ps(tmp, a.v);
+		return tmp[i];
+	}
+#endif // SDF_SIMD_AVX2
+
+#if defined(SDF_SIMD_AVX2)
+	using FloatN = Float8;
+#elif defined(SDF_SIMD_SSE)
+	using FloatN = Float4;
+#else
+	using FloatN = float;
+#endif
+
+	template<typename F> using MaskOf = typename SimdTraits<F>::Mask;
+	template<typename F> constexpr int WidthOf = SimdTraits<F>::Width;
+
+	// ---------------------------------------------------------------- generic helpers
+
+	template<typename F> inline F clamp(F x, NoDeduceT<F> lo, NoDeduceT<F> hi) { return min(max(x, lo), hi); }
+	template<typename F> inline F saturate(F x) { return clamp(x, F(0.0f), F(1.0f)); }
+
+	// Matches HLSL lerp(a, b, t) = a + (b - a) * t.
+	template<typename F> inline F lerp(F a, NoDeduceT<F> b, NoDeduceT<F> t) { return a + (b - a) * t; }
+
+	// Matches HLSL fmod: the result has the sign of x.
+	template<typename F> inline F fmod(F x, NoDeduceT<F> y)
+	{
+		F q = x / y;
+		F t = select(q < F(0.0f), -floor(-q), floor(q));
+		return x - t * y;
+	}
+
+	// Polynomial atan2 for packets, within 1e-5 radians of std::atan2.
+	template<typename F> inline F Atan2(F y, NoDeduceT<F> x)
+	{
+		F ax = abs(x), ay = abs(y);
+		F a = min(ax, ay) / max(max(ax, ay), F(1e-30f));
+		F s = a * a;
+		F r = ((((F(-0.01172120f) * s + F(0.05265332f)) * s - F(0.11643287f)) * s + F(0.19354346f)) * s - F(0.33262347f)) * s + F(0.99997726f);
+		r = r * a;
+		r = select(ay > ax, F(1.57079633f) - r, r);
+		r = select(x < F(0.0f), F(3.14159265f) - r, r);
+		return select(y < F(0.0f), -r, r);
+	}
+
+	// Sine and cosine of x in [-pi, pi] for packets, within 3e-7 of std::sin and std::cos.
+	template<typename F> inline void SinCos(F x, F& s, F& c)
+	{
+		// Both reduce to the odd Taylor series of sin on [-pi/2, pi/2].
+		auto sinHalfPi = [](F u)
+		{
+			F u2 = u * u;
+			F p = ((((F(-2.5052108e-8f) * u2 + F(2.7557319e-6f)) * u2 - F(1.9841270e-4f)) * u2 + F(8.3333333e-3f)) * u2 - F(0.16666667f)) * u2 + F(1.0f);
+			return p * u;
+		};
+		const F halfPi(1.57079633f), pi(3.14159265f);
+		s = sinHalfPi(select(x > halfPi, pi - x, select(x < -halfPi, -pi - x, x)));
+		c = sinHalfPi(halfPi - abs(x));
+	}
+
+	// ---------------------------------------------------------------- vectors of packets
+
+	template<typename F> struct Vec2
+	{
+		F x, y;
+
+		Vec2() = default;
+		Vec2(F _x, F _y) : x(_x), y(_y) { }
+	};
+
+	template<typename F> struct Vec3
+	{
+		F x, y, z;
+
+		Vec3() = default;
+		Vec3(F _x, F _y, F _z) : x(_x), y(_y), z(_z) { }
+
+		Vec3<F> yzx() const { return Vec3<F>(y, z, x); }
+		Vec3<F> zxy() const { return Vec3<F>(z, x, y); }
+	};
+
+	template<typename F> inline Vec2<F> operator+(const Vec2<F>& a, const Vec2<F>& b) { return Vec2<F>(a.x + b.x, a.y + b.y); }
+	template<typename F> inline Vec2<F> operator-(const Vec2<F>& a, const Vec2<F>& b) { return Vec2<F>(a.x - b.x, a.y - b.y); }
+	template<typename F> inline Vec2<F> operator-(const Vec2<F>& a, const NoDeduceT<F>& b) { return Vec2<F>(a.x - b, a.y - b); }
+	template<typename F> inline Vec2<F> operator*(const Vec2<F>& a, const NoDeduceT<F>& b) { return Vec2<F>(a.x * b, a.y * b); }
+	template<typename F> inline Vec2<F> abs(const Vec2<F>& a) { return Vec2<F>(abs(a.x), abs(a.y)); }
+	template<typename F> inline Vec2<F> max(const Vec2<F>& a, const NoDeduceT<F>& b) { return Vec2<F>(max(a.x, b), max(a.y, b)); }
+	template<typename F> inline Vec2<F> select(const MaskOf<F>& m, const Vec2<F>& a, const Vec2<F>& b) { return Vec2<F>(select(m, a.x, b.x), select(m, a.y, b.y)); }
+	template<typename F> inline F dot(const Vec2<F>& a, const Vec2<F>& b) { return a.x * b.x + a.y * b.y; }
+	template<typename F> inline F length(const Vec2<F>& a) { return sqrt(dot(a, a)); }
+
+	template<typename F> inline Vec3<F> operator+(const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(a.x + b.x, a.y + b.y, a.z + b.z); }
+	template<typename F> inline Vec3<F> operator-(const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(a.x - b.x, a.y - b.y, a.z - b.z); }
+	template<typename F> inline Vec3<F> operator*(const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(a.x * b.x, a.y * b.y, a.z * b.z); }
+	template<typename F> inline Vec3<F> operator+(const Vec3<F>& a, const NoDeduceT<F>& b) { return Vec3<F>(a.x + b, a.y + b, a.z + b); }
+	template<typename F> inline Vec3<F> operator-(const Vec3<F>& a, const NoDeduceT<F>& b) { return Vec3<F>(a.x - b, a.y - b, a.z - b); }
+	template<typename F> inline Vec3<F> operator*(const Vec3<F>& a, const NoDeduceT<F>& b) { return Vec3<F>(a.x * b, a.y * b, a.z * b); }
+	template<typename F> inline Vec3<F> operator*(const NoDeduceT<F>& a, const Vec3<F>& b) { return Vec3<F>(a * b.x, a * b.y, a * b.z); }
+	template<typename F> inline Vec3<F> operator-(const Vec3<F>& a) { return Vec3<F>(-a.x, -a.y, -a.z); }
+	template<typename F> inline Vec3<F> abs(const Vec3<F>& a) { return Vec3<F>(abs(a.x), abs(a.y), abs(a.z)); }
+	template<typename F> inline Vec3<F> max(const Vec3<F>& a, const NoDeduceT<F>& b) { return Vec3<F>(max(a.x, b), max(a.y, b), max(a.z, b)); }
+	template<typename F> inline Vec3<F> min(const Vec3<F>& a, const NoDeduceT<F>& b) { return Vec3<F>(min(a.x, b), min(a.y, b), min(a.z, b)); }
+	template<typename F> inline Vec3<F> select(const MaskOf<F>& m, const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)); }
+	template<typename F> inline F dot(const Vec3<F>& a, const Vec3<F>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	template<typename F> inline F length(const Vec3<F>& a) { return sqrt(dot(a, a)); }
+	template<typename F> inline Vec3<F> normalize(const Vec3<F>& a) { return a * (F(1.0f) / length(a)); }
+
+	template<typename F> inline Vec3<F> Splat(float x, float y, float z) { return Vec3<F>(F(x), F(y), F(z)); }
+}
@@ -0,0 +1,306 @@
+#include "Tape.h"
+
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+namespace sdf
+{
+	namespace
+	{
+		bool IsCommutative(uint32_t opcode)
+		{
+			switch (opcode)
+			{
+			case SDF_OP_UNION:
+			case SDF_OP_INTERSECTION:
+			case SDF_OP_SMOOTH_UNION:
+			case SDF_OP_SMOOTH_INTERSECTION:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Number of stack slots needed to evaluate a subtree when its children are emitted in the given order.
+		uint32_t StackNeed(const CsgNode& node);
+
+		std::vector<const CsgNode*> OrderChildren(const CsgNode& node)
+		{
+			std::vector<const CsgNode*> children;
+			for (const auto& child : node.children)
+				children.push_back(child.get());
+
+			if (IsCommutative(node.opcode))
+			{
+				std::stable_sort(children.begin(), children.end(), [](const CsgNode* a, const CsgNode* b) {
+					return StackNeed(*a) > StackNeed(*b);
+				});
+			}
+
+			return children;
+		}
+
+		uint32_t StackNeed(const CsgNode& node)
+		{
+			if (node.IsPrimitive())
+				return 1;
+
+			if (node.IsUnary() || node.IsDomain())
+				return StackNeed(*node.children[0]);
+
+			std::vector<const CsgNode*> children = OrderChildren(node);
+			uint32_t need = StackNeed(*children[0]);
+			for (size_t i = 1; i < children.size(); i++)
+				need = std::max(need, 1 + StackNeed(*children[i]));
+
+			return need;
+		}
+
+		// Deepest nesting of domain operators in a subtree.
+		uint32_t DomainDepth(const CsgNode& node)
+		{
+			uint32_t depth = 0;
+			for (const auto& child : node.children)
+				depth = std::max(depth, DomainDepth(*child));
+			return depth + (node.IsDomain() ? 1 : 0);
+		}
+
+		// Appends an instruction of the node with the node's tracks.
+		void Push(const CsgNode& node, const TapeInstruction& ins, Tape& tape)
+		{
+			for (const CsgTrack& track : node.tracks)
+				tape.tracks.push_back(TapeTrack{ uint32_t(tape.instructions.size()), track });
+			tape.instructions.push_back(ins);
+		}
+
+		bool Emit(const CsgNode& node, int inheritedMaterial, Tape& tape)
+		{
+			int material = node.material >= 0 ? node.material : inheritedMaterial;
+
+			TapeInstruction ins;
+			std::memcpy(ins.params, node.params, sizeof(ins.params));
+
+			if (node.IsPrimitive())
+			{
+				uint32_t id = uint32_t(std::max(material, 0));
+				if (id >= (1u << (32 - c_MaterialBits)))
+				{
+					log::error("SDF material id %d is out of range", material);
+					return false;
+				}
+
+				ins.code = MakeInstructionCode(node.opcode, node.flags, id);
+				Push(node, ins, tape);
+				return true;
+			}
+
+			ins.code = MakeInstructionCode(node.opcode, node.flags, 0);
+
+			// Domain operators enclose their child: the operator, the child, SDF_OP_DOMAIN_END.
+			if (node.IsDomain())
+			{
+				Push(node, ins, tape);
+				if (!Emit(*node.children[0], material, tape))
+					return false;
+
+				TapeInstruction end = {};
+				end.code = MakeInstructionCode(SDF_OP_DOMAIN_END, 0, 0);
+				tape.instructions.push_back(end);
+				return true;
+			}
+
+			std::vector<const CsgNode*> children = OrderChildren(node);
+			for (size_t i = 0; i < children.size(); i++)
+			{
+				if (!Emit(*children[i], material, tape))
+					return false;
+
+				// Binary operators are folded left to right: a b op c op ...
+				if (node.IsUnary() || i > 0)
+					Push(node, ins, tape);
+			}
+
+			return true;
+		}
+
+		bool IsCount(float value)
+		{
+			return value >= 0.f && value == std::floor(value);
+		}
+
+		// The ranges LoadCsgScene() accepts for the repetition operators, which GetDomainPosition() and
+		// GetDomainBound() divide by. Other instructions don't divide by their parameters.
+		bool HasValidParameters(const TapeInstruction& ins)
+		{
+			const float* a = ins.params;
+			const bool mirror = (GetFlags(ins) & SDF_REPEAT_MIRROR) != 0;
+			switch (GetOpcode(ins))
+			{
+			case SDF_OP_REPEAT_LIMITED:
+				if (!IsCount(a[3]) || !IsCount(a[4]) || !IsCount(a[5]))
+					return false;
+				[[fallthrough]];
+			case SDF_OP_REPEAT:
+				return a[0] >= 0.f && a[1] >= 0.f && a[2] >= 0.f && a[0] + a[1] + a[2] > 0.f && std::isfinite(a[0] + a[1] + a[2]);
+			case SDF_OP_REPEAT_POLAR:
+				return IsCount(a[3]) && a[3] >= 1.f && !(mirror && std::fmod(a[3], 2.f) != 0.f)
+					&& std::isfinite(a[0] + a[1] + a[2]);
+			default:
+				return true;
+			}
+		}
+	}
+
+	size_t FindDomainEnd(const TapeInstruction* code, size_t count, size_t begin)
+	{
+		int depth = 0;
+		for (size_t i = begin; i < count; i++)
+		{
+			uint32_t opcode = GetOpcode(code[i]);
+			if (opcode == SDF_OP_DOMAIN_END)
+			{
+				if (--depth == 0)
+					return i;
+			}
+			else if (opcode >= SDF_OP_FIRST_DOMAIN)
+				depth++;
+		}
+		return count;
+	}
+
+	bool ComputeStackDepth(const std::vector<TapeInstruction>& instructions, uint32_t& maxDepth)
+	{
+		// Stack depth at every open domain operator, below which its subtree may not take entries.
+		uint32_t domainDepths[SDF_TAPE_MAX_DOMAIN];
+		int dp = 0;
+		uint32_t depth = 0;
+		maxDepth = 0;
+		for (const TapeInstruction& ins : instructions)
+		{
+			const uint32_t opcode = GetOpcode(ins);
+			const uint32_t floor = dp > 0 ? domainDepths[dp - 1] : 0;
+			if (opcode < SDF_OP_FIRST_BINARY)
+				maxDepth = std::max(maxDepth, ++depth);
+			else if (opcode < SDF_OP_FIRST_UNARY)
+			{
+				if (depth < floor + 2)
+					return false;
+				depth--;
+			}
+			else if (opcode < SDF_OP_FIRST_DOMAIN)
+			{
+				if (depth < floor + 1)
+					return false;
+			}
+			else if (opcode != SDF_OP_DOMAIN_END)
+			{
+				if (dp == SDF_TAPE_MAX_DOMAIN)
+					return false;
+				domainDepths[dp++] = depth;
+			}
+			else if (dp == 0 || depth != domainDepths[--dp] + 1)
+				return false;
+		}
+		return dp == 0 && depth == (instructions.empty() ? 0u : 1u);
+	}
+
+	bool CompileTape(const CsgNode& root, Tape& tape)
+	{
+		tape.instructions.clear();
+		tape.tracks.clear();
+		tape.maxStackDepth = StackNeed(root);
+
+		if (tape.maxStackDepth > SDF_TAPE_MAX_STACK)
+		{
+			log::error("SDF scene needs %u stack entries, the limit is %d", tape.maxStackDepth, SDF_TAPE_MAX_STACK);
+			return false;
+		}
+
+		if (DomainDepth(root) > SDF_TAPE_MAX_DOMAIN)
+		{
+			log::error("SDF scene nests more than %d repetition operators", SDF_TAPE_MAX_DOMAIN);
+			return false;
+		}
+
+		return Emit(root, -1, tape);
+	}
+
+	bool SaveTape(const Tape& tape, const std::filesystem::path& fileName)
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+		{
+			log::error("Couldn't open %s for writing", fileName.generic_string().c_str());
+			return false;
+		}
+
+		TapeFileHeader header;
+		header.instructionCount = uint32_t(tape.instructions.size());
+		header.maxStackDepth = tape.maxStackDepth;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(tape.instructions.data()), tape.instructions.size() * sizeof(TapeInstruction));
+
+		return file.good();
+	}
+
+	bool LoadTape(vfs::IFileSystem& fs, const std::filesystem::path& fileName, Tape& tape)
+	{
+		std::shared_ptr<vfs::IBlob> data = fs.readFile(fileName);
+		if (!data)
+		{
+			log::error("Couldn't read file %s", fileName.generic_string().c_str());
+			return false;
+		}
+
+		TapeFileHeader header;
+		if (data->size() < sizeof(header))
+		{
+			log::error("%s is not an SDF tape file", fileName.generic_string().c_str());
+			return false;
+		}
+
+		std::memcpy(&header, data->data(), sizeof(header));
+		if (header.magic != TapeFileHeader::c_Magic || header.version != TapeFileHeader::c_Version)
+		{
+			log::error("%s is not an SDF tape file of version %u", fileName.generic_string().c_str(), TapeFileHeader::c_Version);
+			return false;
+		}
+
+		size_t expectedSize = sizeof(header) + size_t(header.instructionCount) * sizeof(TapeInstruction);
+		if (data->size() < expectedSize || header.maxStackDepth > SDF_TAPE_MAX_STACK)
+		{
+			log::error("SDF tape file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		std::vector<TapeInstruction> instructions(header.instructionCount);
+		std::memcpy(instructions.data(), static_cast<const uint8_t*>(data->data()) + sizeof(header),
+			instructions.size() * sizeof(TapeInstruction));
+
+		// The interpreters index their stacks without checks, so the instructions must form a tape that
+		// fits the depth of the header, and the repetitions need the parameters a scene file could give them.
+		uint32_t maxDepth = 0;
+		bool valid = ComputeStackDepth(instructions, maxDepth) && maxDepth <= header.maxStackDepth;
+		for (size_t i = 0; valid && i < instructions.size(); i++)
+			valid = HasValidParameters(instructions[i]);
+		if (!valid)
+		{
+			log::error("SDF tape file %s is corrupt", fileName.generic_string().c_str());
+			return false;
+		}
+
+		tape.maxStackDepth = header.maxStackDepth;
+		tape.tracks.clear();
+		tape.instructions = std::move(instructions);
+
+		return true;
+	}
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+// Compiled form of a CsgNode tree: a flat post-order instruction list (see sdf_cb.h).
+// The same instructions are interpreted here on the CPU and by mapTape() in SDFTape.hlsli.
+
+#include "CsgScene.h"
+#include "Noise.h"
+#include "Primitives.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace donut::vfs
+{
+	class IFileSystem;
+}
+
+namespace sdf
+{
+	constexpr uint32_t c_MaterialBits = 16;
+
+	inline uint32_t GetOpcode(const TapeInstruction& ins) { return ins.code & 0xff; }
+	inline uint32_t GetFlags(const TapeInstruction& ins) { return (ins.code >> 8) & 0xff; }
+	inline uint32_t GetMaterial(const TapeInstruction& ins) { return ins.code >> c_MaterialBits; }
+
+	inline uint32_t MakeInstructionCode(uint32_t opcode, uint32_t flags, uint32_t material)
+	{
+		return (opcode & 0xff) | ((flags & 0xff) << 8) | (material << c_MaterialBits);
+	}
+
+	// Track of the parameters of a tape instruction, see SceneAnimation.h.
+	struct TapeTrack
+	{
+		uint32_t instruction = 0;
+		CsgTrack track;
+	};
+
+	struct Tape
+	{
+		std::vector<TapeInstruction> instructions;
+		uint32_t maxStackDepth = 0;
+		// Ordered by instruction. Tape files don't store them, a loaded tape is still.
+		std::vector<TapeTrack> tracks;
+
+		bool Empty() const { return instructions.empty(); }
+		size_t Size() const { return instructions.size(); }
+	};
+
+	// Flattens the tree. Children of commutative operators are reordered so the deeper subtree
+	// is emitted first, which keeps the stack within SDF_TAPE_MAX_STACK for typical scenes.
+	bool CompileTape(const CsgNode& root, Tape& tape);
+
+	// Binary tape file: TapeFileHeader followed by the instructions, little endian.
+	bool SaveTape(const Tape& tape, const std::filesystem::path& fileName);
+	bool LoadTape(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName, Tape& tape);
+
+	// Index of the SDF_OP_DOMAIN_END that closes the domain operator at begin, count when there is none.
+	size_t FindDomainEnd(const TapeInstruction* code, size_t count, size_t begin);
+
+	// Walks the stack and the open domain operators of the instructions like EvaluateTape() and returns the
+	// deepest stack in maxDepth. False when an operator finds fewer entries than it takes from its own
+	// subtree, a SDF_OP_DOMAIN_END closes no operator or its subtree doesn't leave exactly one entry,
+	// domain operators nest deeper than SDF_TAPE_MAX_DOMAIN or the tape doesn't end with one entry. An
+	// empty tape is valid.
+	bool ComputeStackDepth(const std::vector<TapeInstruction>& instructions, uint32_t& maxDepth);
+
+	struct TapeFileHeader
+	{
+		static constexpr uint32_t c_Magic = 0x54464453; // "SDFT"
+		static constexpr uint32_t c_Version = 2;   // 2: domain operators, noise displacement and keyframed flags
+
+		uint32_t magic = c_Magic;
+		uint32_t version = c_Version;
+		uint32_t instructionCount = 0;
+		uint32_t maxStackDepth = 0;
+	};
+
+	// Applies one primitive instruction, returns the distance.
+	template<typename F> F EvaluatePrimitive(const TapeInstruction& ins, const Vec3<F>& pos)
+	{
+		const float* a = ins.params;
+		Vec3<F> p = pos - Splat<F>(a[0], a[1], a[2]);
+
+		switch (GetOpcode(ins))
+		{
+		case SDF_OP_PLANE:
+			return sdPlane(pos, Splat<F>(a[0], a[1], a[2])) - F(a[3]);
+		case SDF_OP_SPHERE:
+			return sdSphere(p, F(a[3]));
+		case SDF_OP_BOX:
+			return sdBox(p, Splat<F>(a[3], a[4], a[5]));
+		case SDF_OP_BOX_FRAME:
+			return sdBoxFrame(p, Splat<F>(a[3], a[4], a[5]), F(a[6]));
+		case SDF_OP_TORUS:
+			return sdTorus(p, Vec2<F>(F(a[3]), F(a[4])));
+		case SDF_OP_CYLINDER:
+			return sdCylinder(p, Vec2<F>(F(a[3]), F(a[4])), int(GetFlags(ins)));
+		case SDF_OP_OCTAHEDRON:
+			return sdOctahedron(p, F(a[3]));
+		default:
+			return F(1e10f);
+		}
+	}
+
+	// Applies a binary operator to (distance, material) pairs.
+	// Union-like operators keep the material of the closer operand, intersections the farther one,
+	// subtractions keep the material of the first operand.
+	template<typename F> Vec2<F> EvaluateBinary(const TapeInstruction& ins, const Vec2<F>& a, const Vec2<F>& b)
+	{
+		const float k = ins.params[0];
+
+		switch (GetOpcode(ins))
+		{
+		case SDF_OP_UNION:
+			return Vec2<F>(opUnion(a.x, b.x), select(a.x < b.x, a.y, b.y));
+		case SDF_OP_SUBTRACTION:
+			return Vec2<F>(opSubtraction(a.x, b.x), a.y);
+		case SDF_OP_INTERSECTION:
+			return Vec2<F>(opIntersection(a.x, b.x), select(a.x > b.x, a.y, b.y));
+		case SDF_OP_SMOOTH_UNION:
+			return Vec2<F>(opSmoothUnion(a.x, b.x, F(k)), select(a.x < b.x, a.y, b.y));
+		case SDF_OP_SMOOTH_SUBTRACTION:
+			// opSmoothSubtraction(d1, d2) removes d1 from d2, the opposite order of opSubtraction.
+			return Vec2<F>(opSmoothSubtraction(b.x, a.x, F(k)), a.y);
+		case SDF_OP_SMOOTH_INTERSECTION:
+			return Vec2<F>(opSmoothIntersection(a.x, b.x, F(k)), select(a.x > b.x, a.y, b.y));
+		default:
+			return a;
+		}
+	}
+
+	// p is the position the operand was evaluated at, in the frame of the innermost domain operator.
+	template<typename F> F EvaluateUnary(const TapeInstruction& ins, F d, const Vec3<F>& p, float time)
+	{
+		switch (GetOpcode(ins))
+		{
+		case SDF_OP_ROUND:
+			return opRound(d, F(ins.params[0]));
+		case SDF_OP_DISPLACE: {
+			if (GetFlags(ins) & SDF_DISPLACE_KEYFRAMED)
+				return d + F(ins.params[0]);
+			float an = std::fmod(time, 6.28f);
+			return d + F(ins.params[0] * std::sin(ins.params[1] * an));
+		}
+		case SDF_OP_DISPLACE_NOISE:
+			return d + NoiseDisplacement(p, ins.params[0], ins.params[1], int(ins.params[2]));
+		default:
+			return d;
+		}
+	}
+
+	// Domain operators. The candidates are the instances the repeated subtree is evaluated for: candidate 0
+	// is the nearest one, bit i of the others steps to the neighbour on the i-th repeated axis.
+	constexpr float c_TwoPi = 6.28318531f;
+	// Covers the error of Atan2() in the sector bounds.
+	constexpr float c_PolarAngleSlack = 1e-4f;
+
+	inline int GetDomainCandidateCount(const TapeInstruction& ins)
+	{
+		if (GetOpcode(ins) == SDF_OP_REPEAT_POLAR)
+			return 2;
+
+		int count = 1;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (ins.params[axis] > 0.f)
+				count *= 2;
+		}
+		return count;
+	}
+
+	// Nearest cell of a coordinate along a repeated axis, clamped to the limit, and the offset from its center.
+	template<typename F> void GetRepeatCell(const TapeInstruction& ins, int axis, F p, F& cell, F& offset)
+	{
+		const float period = ins.params[axis];
+		cell = floor(p * F(1.0f / period) + F(0.5f));
+		if (GetOpcode(ins) == SDF_OP_REPEAT_LIMITED)
+			cell = clamp(cell, F(-ins.params[3 + axis]), F(ins.params[3 + axis]));
+		offset = p - cell * F(period);
+	}
+
+	// Nearest sector around the polar axis and the angle from its center.
+	template<typename F> void GetPolarSector(const TapeInstruction& ins, const Vec3<F>& pos, F& sector, F& offset)
+	{
+		const float width = c_TwoPi / ins.params[3];
+		F angle = Atan2(pos.z - F(ins.params[2]), pos.x - F(ins.params[0]));
+		sector = floor(angle * F(1.0f / width) + F(0.5f));
+		offset = angle - sector * F(width);
+	}
+
+	template<typename F> MaskOf<F> IsOdd(F cell)
+	{
+		return cell - F(2.0f) * floor(cell * F(0.5f)) > F(0.5f);
+	}
+
+	// Position in the local frame of a candidate instance.
+	template<typename F> Vec3<F> GetDomainPosition(const TapeInstruction& ins, const Vec3<F>& pos, int candidate)
+	{
+		const float* a = ins.params;
+		const bool mirror = (GetFlags(ins) & SDF_REPEAT_MIRROR) != 0;
+
+		if (GetOpcode(ins) == SDF_OP_REPEAT_POLAR)
+		{
+			F sector, offset;
+			GetPolarSector(ins, pos, sector, offset);
+			if (candidate)
+				sector = sector + select(offset < F(0.0f), F(-1.0f), F(1.0f));
+
+			// Rotates by minus the sector's angle, wrapped to [-pi, pi].
+			const float width = c_TwoPi / a[3];
+			F angle = sector * F(width);
+			angle = angle - F(c_TwoPi) * floor(angle * F(1.0f / c_TwoPi) + F(0.5f));
+			F s, c;
+			SinCos(angle, s, c);
+
+			Vec3<F> d = pos - Splat<F>(a[0], a[1], a[2]);
+			Vec3<F> local(d.x * c + d.z * s, d.y, d.z * c - d.x * s);
+			if (mirror)
+				local.z = select(IsOdd(sector - F(a[3]) * floor(sector * F(1.0f / a[3]))), -local.z, local.z);
+			return local;
+		}
+
+		F p[3] = { pos.x, pos.y, pos.z };
+		int bit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float period = a[axis];
+			if (!(period > 0.f))
+				continue;
+
+			F cell, offset;
+			GetRepeatCell(ins, axis, p[axis], cell, offset);
+			if ((candidate >> bit++) & 1)
+			{
+				// The neighbour on the side of the sample, or the cell itself at the limit.
+				cell = cell + select(offset < F(0.0f), F(-1.0f), F(1.0f));
+				if (GetOpcode(ins) == SDF_OP_REPEAT_LIMITED)
+					cell = clamp(cell, F(-a[3 + axis]), F(a[3 + axis]));
+			}
+
+			F local = p[axis] - cell * F(period);
+			p[axis] = mirror ? select(IsOdd(cell), -local, local) : local;
+		}
+		return Vec3<F>(p[0], p[1], p[2]);
+	}
+
+	// Lower bound of the distance to the instances that none of the candidates covers.
+	template<typename F> F GetDomainBound(const TapeInstruction& ins, const Vec3<F>& pos)
+	{
+		const float* a = ins.params;
+		const F none(1e10f);
+
+		if (GetOpcode(ins) == SDF_OP_REPEAT_POLAR)
+		{
+			// One or two sectors are both candidates.
+			if (a[3] < 3.0f)
+				return none;
+
+			// The skipped sectors begin half a sector past the angle from the nearest sector's center.
+			F sector, offset;
+			GetPolarSector(ins, pos, sector, offset);
+			F angle = min(abs(offset) + F(0.5f * c_TwoPi / a[3] - c_PolarAngleSlack), F(0.25f * c_TwoPi));
+			F s, c;
+			SinCos(angle, s, c);
+			return length(Vec2<F>(pos.x - F(a[0]), pos.z - F(a[2]))) * s;
+		}
+
+		// A skipped cell differs from the candidates along at least one axis, and along the others it lies
+		// within the grid, at least the gap from the sample to the grid's extent away.
+		const bool limited = GetOpcode(ins) == SDF_OP_REPEAT_LIMITED;
+		const F p[3] = { pos.x, pos.y, pos.z };
+		F axisDistance[3] = { none, none, none };
+		F gap[3] = { F(0.0f), F(0.0f), F(0.0f) };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float period = a[axis];
+			if (!(period > 0.f))
+				continue;
+
+			F cell, offset;
+			GetRepeatCell(ins, axis, p[axis], cell, offset);
+			F d = abs(offset);
+
+			// The closest skipped cells along the axis: the one behind the sample and the one past its neighbour.
+			F behind = d + F(0.5f * period);
+			F beyond = F(1.5f * period) - d;
+			if (limited)
+			{
+				const float limit = a[3 + axis];
+				F side = select(offset < F(0.0f), F(-1.0f), F(1.0f));
+				behind = select(abs(cell - side) <= F(limit), behind, none);
+				beyond = select(abs(cell + side * F(2.0f)) <= F(limit), beyond, none);
+				gap[axis] = max(d - F(0.5f * period), F(0.0f));
+			}
+			axisDistance[axis] = min(behind, beyond);
+		}
+
+		F gaps = gap[0] * gap[0] + gap[1] * gap[1] + gap[2] * gap[2];
+		F bound = none * none;
+		for (int axis = 0; axis < 3; axis++)
+			bound = min(bound, axisDistance[axis] * axisDistance[axis] + gaps - gap[axis] * gap[axis]);
+		return sqrt(bound);
+	}
+
+	// Evaluation state of an open domain operator.
+	template<typename F> struct DomainFrame
+	{
+		Vec3<F> pos;            // sample position outside the operator
+		size_t begin = 0;       // index of the operator
+		int candidate = 0;
+		Vec2<F> result;         // union of the candidates so far
+	};
+
+	// CPU interpreter, returns (distance, material) like map().
+	template<typename F> Vec2<F> EvaluateTape(const TapeInstruction* code, size_t count, const Vec3<F>& pos, float time)
+	{
+		Vec2<F> stack[SDF_TAPE_MAX_STACK];
+		int sp = 0;
+		DomainFrame<F> domains[SDF_TAPE_MAX_DOMAIN];
+		int dp = 0;
+		Vec3<F> p = pos;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const TapeInstruction& ins = code[i];
+			uint32_t opcode = GetOpcode(ins);
+
+			if (opcode < SDF_OP_FIRST_BINARY)
+			{
+				stack[sp++] = Vec2<F>(EvaluatePrimitive(ins, p), F(float(GetMaterial(ins))));
+			}
+			else if (opcode < SDF_OP_FIRST_UNARY)
+			{
+				sp--;
+				stack[sp - 1] = EvaluateBinary(ins, stack[sp - 1], stack[sp]);
+			}
+			else if (opcode < SDF_OP_FIRST_DOMAIN)
+			{
+				stack[sp - 1].x = EvaluateUnary(ins, stack[sp - 1].x, p, time);
+			}
+			else if (opcode != SDF_OP_DOMAIN_END)
+			{
+				DomainFrame<F>& frame = domains[dp++];
+				frame.pos = p;
+				frame.begin = i;
+				frame.candidate = 0;
+				frame.result = Vec2<F>(F(1e10f), F(-1.0f));
+				p = GetDomainPosition(ins, p, 0);
+			}
+			else
+			{
+				DomainFrame<F>& frame = domains[dp - 1];
+				const TapeInstruction& domain = code[frame.begin];
+				const Vec2<F> d = stack[--sp];
+				frame.result = Vec2<F>(min(frame.result.x, d.x), select(frame.result.x < d.x, frame.result.y, d.y));
+
+				// Evaluates the subtree again for the next candidate.
+				if (++frame.candidate < GetDomainCandidateCount(domain))
+				{
+					p = GetDomainPosition(domain, frame.pos, frame.candidate);
+					i = frame.begin;
+					continue;
+				}
+
+				p = frame.pos;
+				stack[sp++] = Vec2<F>(min(frame.result.x, GetDomainBound(domain, frame.pos)), frame.result.y);
+				dp--;
+			}
+		}
+
+		return sp > 0 ? stack[0] : Vec2<F>(F(1e10f), F(-1.0f));
+	}
+
+	template<typename F> Vec2<F> EvaluateTape(const Tape& tape, const Vec3<F>& pos, float time)
+	{
+		return EvaluateTape(tape.instructions.data(), tape.instructions.size(), pos, time);
+	}
+}
@@ -0,0 +1,1138 @@
+#include "TapeJit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SDF_JIT_X64 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace sdf
+{
+	namespace
+	{
+		// Machine code of one width, at most this large; larger tapes are interpreted.
+		constexpr size_t c_MaxCodeSize = 1 << 20;
+
+		constexpr float c_None = 1e10f;
+		constexpr uint32_t c_AbsMask = 0x7fffffff;
+		constexpr uint32_t c_SignMask = 0x80000000;
+
+		// vcmpps predicates, the ordered and quiet ones of the _CMP_*_OQ comparisons of SimdMath.h.
+		constexpr uint8_t c_LT = 0x11;
+		constexpr uint8_t c_LE = 0x12;
+		constexpr uint8_t c_GT = 0x1e;
+
+		// General purpose registers. The arguments are moved to the same registers for both calling conventions.
+		constexpr int c_Rax = 0;
+		constexpr int c_Rcx = 1;
+		constexpr int c_Rdx = 2;
+		constexpr int c_Rsi = 6;
+		constexpr int c_Rdi = 7;
+		constexpr int c_R8 = 8;
+		constexpr int c_R9 = 9;
+		constexpr int c_R10 = 10;
+		constexpr int c_R11 = 11;
+		constexpr int c_Rip = -1;
+
+		constexpr int c_PosArg = c_Rax;
+		constexpr int c_ResultArg = c_R10;
+		constexpr int c_UniformArg = c_R11;
+		constexpr int c_ScratchArg = c_R9;
+
+		// Vector registers 0 to 12 are temporaries, the position in the frame of the innermost domain stays in 13 to 15.
+		constexpr int c_Pos[3] = { 15, 14, 13 };
+
+		// Layout of the scratch memory in bytes, every value takes a 32-byte slot whatever the width.
+		constexpr int32_t c_ValueSize = 32;
+		constexpr int32_t c_StackOffset = 0;
+		constexpr int32_t c_DomainOffset = c_StackOffset + SDF_TAPE_MAX_STACK * 2 * c_ValueSize;
+		constexpr int32_t c_DomainSize = 5 * c_ValueSize;
+		constexpr int32_t c_SaveOffset = c_DomainOffset + SDF_TAPE_MAX_DOMAIN * c_DomainSize;
+		static_assert(c_SaveOffset + 10 * 16 <= c_JitScratchSize * 4, "c_JitScratchSize is too small");
+
+		struct Memory
+		{
+			int base;
+			int32_t disp;   // index of the constant for c_Rip
+		};
+
+		uint32_t FloatBits(float v)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &v, sizeof(bits));
+			return bits;
+		}
+
+		// Encoder of the few instructions the compiler needs. Vector instructions are VEX encoded with
+		// packed single operands of the assembler's width; constants go into a pool after the code and are
+		// addressed relative to the instruction pointer.
+		class Assembler
+		{
+		public:
+			explicit Assembler(bool wide, size_t reserve) : m_Wide(wide) { m_Code.reserve(reserve); }
+
+			size_t Size() const { return m_Code.size(); }
+
+			void Add(int dst, int a, int b) { Op(0x58, dst, a, b); }
+			void Mul(int dst, int a, int b) { Op(0x59, dst, a, b); }
+			void Sub(int dst, int a, int b) { Op(0x5c, dst, a, b); }
+			void Min(int dst, int a, int b) { Op(0x5d, dst, a, b); }
+			void Div(int dst, int a, int b) { Op(0x5e, dst, a, b); }
+			void Max(int dst, int a, int b) { Op(0x5f, dst, a, b); }
+			void And(int dst, int a, int b) { Op(0x54, dst, a, b); }
+			void Or(int dst, int a, int b) { Op(0x56, dst, a, b); }
+			void Xor(int dst, int a, int b) { Op(0x57, dst, a, b); }
+			void Zero(int dst) { Xor(dst, dst, dst); }
+			void Sqrt(int dst, int a) { Op(0x51, dst, 0, a); }
+			void Move(int dst, int a) { Op(0x28, dst, 0, a); }
+			// dst = a < b and so on, all bits set where true.
+			void Compare(int dst, int a, int b, uint8_t predicate) { Vex(1, 0, m_Wide, dst, a, b, nullptr, 0xc2, predicate); }
+			// dst = mask ? b : a, per lane by the sign bit of mask.
+			void Blend(int dst, int a, int b, int mask) { Vex(3, 1, m_Wide, dst, a, b, nullptr, 0x4a, mask << 4); }
+			void Floor(int dst, int a) { Vex(3, 1, m_Wide, dst, 0, a, nullptr, 0x08, 0x09); }
+
+			void Load(int dst, const Memory& m) { Vex(1, 0, m_Wide, dst, 0, 0, &m, 0x10); }
+			void Store(const Memory& m, int src) { Vex(1, 0, m_Wide, src, 0, 0, &m, 0x11); }
+			void Broadcast(int dst, const Memory& m) { Vex(2, 1, m_Wide, dst, 0, 0, &m, 0x18); }
+			// vmovss, the first lane only.
+			void StoreScalar(const Memory& m, int src) { Vex(1, 2, false, src, 0, 0, &m, 0x11); }
+			// vmovups of the low 128 bits, the part of xmm6 to xmm15 the Windows x64 convention preserves.
+			void Load128(int dst, const Memory& m) { Vex(1, 0, false, dst, 0, 0, &m, 0x10); }
+			void Store128(const Memory& m, int src) { Vex(1, 0, false, src, 0, 0, &m, 0x11); }
+
+			void Splat(int dst, float v) { SplatBits(dst, FloatBits(v)); }
+			void SplatBits(int dst, uint32_t bits)
+			{
+				auto it = m_ConstantIndex.find(bits);
+				if (it == m_ConstantIndex.end())
+				{
+					it = m_ConstantIndex.emplace(bits, int32_t(m_Constants.size())).first;
+					m_Constants.push_back(bits);
+				}
+				Broadcast(dst, Memory{ c_Rip, it->second });
+			}
+
+			// mov dst, src of 64-bit registers.
+			void MoveGpr(int dst, int src)
+			{
+				Byte(uint8_t(0x48 | (src >= 8 ? 4 : 0) | (dst >= 8 ? 1 : 0)));
+				Byte(0x89);
+				Byte(uint8_t(0xc0 | (src & 7) << 3 | (dst & 7)));
+			}
+
+			void VZeroUpper() { Byte(0xc5); Byte(0xf8); Byte(0x77); }
+			void Ret() { Byte(0xc3); }
+
+			// Code followed by the constants, with the constant addresses resolved.
+			std::vector<uint8_t> Finish()
+			{
+				std::vector<uint8_t> result = m_Code;
+				result.resize((result.size() + 15) & ~size_t(15), 0xcc);
+				const size_t pool = result.size();
+				for (const Fixup& fixup : m_Fixups)
+				{
+					const int32_t disp = int32_t(pool + size_t(fixup.constant) * 4 - fixup.end);
+					std::memcpy(result.data() + fixup.position, &disp, sizeof(disp));
+				}
+				result.resize(pool + m_Constants.size() * 4);
+				if (!m_Constants.empty())
+					std::memcpy(result.data() + pool, m_Constants.data(), m_Constants.size() * 4);
+				return result;
+			}
+
+		private:
+			struct Fixup
+			{
+				size_t position;    // of the displacement
+				size_t end;         // of the instruction, which the displacement is relative to
+				int32_t constant;
+			};
+
+			void Op(uint8_t opcode, int dst, int a, int b) { Vex(1, 0, m_Wide, dst, a, b, nullptr, opcode); }
+
+			// VEX prefix, the two-byte form when the instruction allows it; map 1 = 0F, 2 = 0F38, 3 = 0F3A;
+			// pp 0 = none, 1 = 66, 2 = F3. The ModRM.rm operand is the register rm, or m when it isn't null.
+			// imm < 0 has no immediate.
+			void Vex(int map, int pp, bool wide, int reg, int vvvv, int rm, const Memory* m, uint8_t opcode, int imm = -1)
+			{
+				const bool extendedRm = m ? m->base >= 8 : rm >= 8;
+				const uint8_t lastByte = uint8_t((~vvvv & 15) << 3 | (wide ? 4 : 0) | pp);
+				if (map == 1 && !extendedRm)
+				{
+					Byte(0xc5);
+					Byte(uint8_t((reg >= 8 ? 0 : 0x80) | lastByte));
+				}
+				else
+				{
+					Byte(0xc4);
+					Byte(uint8_t((reg >= 8 ? 0 : 0x80) | 0x40 | (extendedRm ? 0 : 0x20) | map));
+					Byte(lastByte);
+				}
+				Byte(opcode);
+
+				if (!m)
+				{
+					Byte(uint8_t(0xc0 | (reg & 7) << 3 | (rm & 7)));
+				}
+				else if (m->base == c_Rip)
+				{
+					Byte(uint8_t(0x05 | (reg & 7) << 3));
+					m_Fixups.push_back(Fixup{ m_Code.size(), m_Code.size() + 4 + (imm >= 0 ? 1 : 0), m->disp });
+					Dword(0);
+				}
+				else
+				{
+					// disp32 always; rsp and r12 need a SIB byte.
+					Byte(uint8_t(0x80 | (reg & 7) << 3 | (m->base & 7)));
+					if ((m->base & 7) == 4)
+						Byte(0x24);
+					Dword(uint32_t(m->disp));
+				}
+
+				if (imm >= 0)
+					Byte(uint8_t(imm));
+			}
+
+			void Byte(uint8_t b) { m_Code.push_back(b); }
+			void Dword(uint32_t d)
+			{
+				for (int i = 0; i < 4; i++)
+					Byte(uint8_t(d >> (8 * i)));
+			}
+
+			bool m_Wide;
+			std::vector<uint8_t> m_Code;
+			std::vector<uint32_t> m_Constants;
+			std::unordered_map<uint32_t, int32_t> m_ConstantIndex;
+			std::vector<Fixup> m_Fixups;
+		};
+
+		// Emits the function of one width. The stack of (distance, material) pairs and the domain frames
+		// live in the scratch memory; the stack depth and the domain nesting are known at every instruction,
+		// so they are resolved at compile time.
+		class Compiler
+		{
+		public:
+			Compiler(const TapeInstruction* code, size_t count, const std::vector<uint32_t>& uniforms, int width)
+				: m_Code(code), m_Count(count), m_Uniforms(uniforms), m_Width(width), m_Asm(width == 8, count * 256)
+			{
+			}
+
+			bool Run(std::vector<uint8_t>& result)
+			{
+#ifdef _WIN32
+				m_Asm.MoveGpr(c_PosArg, c_Rcx);
+				m_Asm.MoveGpr(c_ResultArg, c_Rdx);
+				m_Asm.MoveGpr(c_UniformArg, c_R8);
+				for (int i = 0; i < 10; i++)
+					m_Asm.Store128(Memory{ c_ScratchArg, c_SaveOffset + 16 * i }, 6 + i);
+#else
+				m_Asm.MoveGpr(c_PosArg, c_Rdi);
+				m_Asm.MoveGpr(c_ResultArg, c_Rsi);
+				m_Asm.MoveGpr(c_UniformArg, c_Rdx);
+				m_Asm.MoveGpr(c_ScratchArg, c_Rcx);
+#endif
+
+				const int32_t stride = m_Width * 4;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (m_Width == 1)
+						m_Asm.Broadcast(c_Pos[axis], Memory{ c_PosArg, 4 * axis });
+					else
+						m_Asm.Load(c_Pos[axis], Memory{ c_PosArg, stride * axis });
+				}
+
+				int sp = 0;
+				if (!EmitRange(0, m_Count, sp, 0))
+					return false;
+
+				if (sp > 0)
+				{
+					m_Asm.Load(0, Distance(0));
+					m_Asm.Load(1, Material(0));
+				}
+				else
+				{
+					m_Asm.Splat(0, c_None);
+					m_Asm.Splat(1, -1.0f);
+				}
+				if (m_Width == 1)
+				{
+					m_Asm.StoreScalar(Memory{ c_ResultArg, 0 }, 0);
+					m_Asm.StoreScalar(Memory{ c_ResultArg, 4 }, 1);
+				}
+				else
+				{
+					m_Asm.Store(Memory{ c_ResultArg, 0 }, 0);
+					m_Asm.Store(Memory{ c_ResultArg, stride }, 1);
+				}
+
+#ifdef _WIN32
+				for (int i = 0; i < 10; i++)
+					m_Asm.Load128(6 + i, Memory{ c_ScratchArg, c_SaveOffset + 16 * i });
+#endif
+				m_Asm.VZeroUpper();
+				m_Asm.Ret();
+
+				result = m_Asm.Finish();
+				return true;
+			}
+
+		private:
+			static Memory Distance(int index) { return Memory{ c_ScratchArg, c_StackOffset + index * 2 * c_ValueSize }; }
+			static Memory Material(int index) { return Memory{ c_ScratchArg, c_StackOffset + (index * 2 + 1) * c_ValueSize }; }
+			static Memory FramePos(int depth, int axis) { return Memory{ c_ScratchArg, c_DomainOffset + depth * c_DomainSize + axis * c_ValueSize }; }
+			static Memory FrameDistance(int depth) { return Memory{ c_ScratchArg, c_DomainOffset + depth * c_DomainSize + 3 * c_ValueSize }; }
+			static Memory FrameMaterial(int depth) { return Memory{ c_ScratchArg, c_DomainOffset + depth * c_DomainSize + 4 * c_ValueSize }; }
+
+			// dst = sqrt(x * x + y * y [+ z * z]), tmp is overwritten.
+			void Length(int dst, int x, int y, int z, int tmp)
+			{
+				m_Asm.Mul(dst, x, x);
+				m_Asm.Mul(tmp, y, y);
+				m_Asm.Add(dst, dst, tmp);
+				if (z >= 0)
+				{
+					m_Asm.Mul(tmp, z, z);
+					m_Asm.Add(dst, dst, tmp);
+				}
+				m_Asm.Sqrt(dst, dst);
+			}
+
+			void Abs(int dst, int a, int mask)
+			{
+				m_Asm.SplatBits(mask, c_AbsMask);
+				m_Asm.And(dst, a, mask);
+			}
+
+			void Negate(int dst, int a, int mask)
+			{
+				m_Asm.SplatBits(mask, c_SignMask);
+				m_Asm.Xor(dst, a, mask);
+			}
+
+			// dst = clamp(a, lo, hi) of constants.
+			void Clamp(int dst, int a, float lo, float hi, int tmp)
+			{
+				m_Asm.Splat(tmp, lo);
+				m_Asm.Max(dst, a, tmp);
+				m_Asm.Splat(tmp, hi);
+				m_Asm.Min(dst, dst, tmp);
+			}
+
+			// dst = mask ? -1 : 1
+			void Side(int dst, int mask, int tmp)
+			{
+				m_Asm.Splat(dst, -1.0f);
+				m_Asm.Splat(tmp, 1.0f);
+				m_Asm.Blend(dst, tmp, dst, mask);
+			}
+
+			bool EmitRange(size_t begin, size_t end, int& sp, int depth)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					if (m_Asm.Size() > c_MaxCodeSize)
+						return false;
+
+					const TapeInstruction& ins = m_Code[i];
+					const uint32_t opcode = GetOpcode(ins);
+
+					if (opcode < SDF_OP_FIRST_BINARY)
+					{
+						if (sp >= SDF_TAPE_MAX_STACK || !EmitPrimitive(ins))
+							return false;
+						m_Asm.Store(Distance(sp), 0);
+						m_Asm.Splat(1, float(GetMaterial(ins)));
+						m_Asm.Store(Material(sp), 1);
+						sp++;
+					}
+					else if (opcode < SDF_OP_FIRST_UNARY)
+					{
+						if (sp < 2 || !EmitBinary(ins, sp - 2))
+							return false;
+						sp--;
+					}
+					else if (opcode < SDF_OP_FIRST_DOMAIN)
+					{
+						if (sp < 1 || !EmitUnary(ins, uint32_t(i), sp - 1))
+							return false;
+					}
+					else
+					{
+						const size_t domainEnd = FindDomainEnd(m_Code, m_Count, i);
+						if (opcode == SDF_OP_DOMAIN_END || domainEnd >= end || depth >= SDF_TAPE_MAX_DOMAIN ||
+							!EmitDomain(ins, i + 1, domainEnd, sp, depth))
+							return false;
+						i = domainEnd;
+					}
+				}
+				return true;
+			}
+
+			// Distance into register 0, from the position in c_Pos.
+			bool EmitPrimitive(const TapeInstruction& ins)
+			{
+				const float* a = ins.params;
+				const int px = c_Pos[0], py = c_Pos[1], pz = c_Pos[2];
+
+				if (GetOpcode(ins) == SDF_OP_PLANE)
+				{
+					m_Asm.Splat(1, a[0]);
+					m_Asm.Mul(0, px, 1);
+					m_Asm.Splat(1, a[1]);
+					m_Asm.Mul(1, py, 1);
+					m_Asm.Add(0, 0, 1);
+					m_Asm.Splat(1, a[2]);
+					m_Asm.Mul(1, pz, 1);
+					m_Asm.Add(0, 0, 1);
+					m_Asm.Splat(1, a[3]);
+					m_Asm.Sub(0, 0, 1);
+					return true;
+				}
+
+				// Position relative to the center in 1, 2 and 3.
+				for (int axis = 0; axis < 3; axis++)
+				{
+					m_Asm.Splat(0, a[axis]);
+					m_Asm.Sub(1 + axis, c_Pos[axis], 0);
+				}
+
+				switch (GetOpcode(ins))
+				{
+				case SDF_OP_SPHERE:
+					Length(0, 1, 2, 3, 4);
+					m_Asm.Splat(4, a[3]);
+					m_Asm.Sub(0, 0, 4);
+					return true;
+
+				case SDF_OP_BOX:
+				case SDF_OP_BOX_FRAME:
+					// abs(p) - b
+					for (int axis = 0; axis < 3; axis++)
+					{
+						Abs(1 + axis, 1 + axis, 12);
+						m_Asm.Splat(4, a[3 + axis]);
+						m_Asm.Sub(1 + axis, 1 + axis, 4);
+					}
+					if (GetOpcode(ins) == SDF_OP_BOX)
+					{
+						m_Asm.Max(4, 2, 3);
+						m_Asm.Max(4, 1, 4);
+						m_Asm.Zero(5);
+						m_Asm.Min(4, 4, 5);
+						for (int axis = 0; axis < 3; axis++)
+							m_Asm.Max(1 + axis, 1 + axis, 5);
+						Length(0, 1, 2, 3, 6);
+						m_Asm.Add(0, 4, 0);
+					}
+					else
+					{
+						// q = abs(p + e) - e in 5, 6 and 7.
+						m_Asm.Splat(4, a[6] * 0.5f);
+						for (int axis = 0; axis < 3; axis++)
+						{
+							m_Asm.Add(5 + axis, 1 + axis, 4);
+							Abs(5 + axis, 5 + axis, 12);
+							m_Asm.Sub(5 + axis, 5 + axis, 4);
+						}
+						m_Asm.Zero(8);
+						EmitFrameEdge(0, 1, 6, 7);
+						EmitFrameEdge(4, 5, 2, 7);
+						m_Asm.Min(0, 0, 4);
+						EmitFrameEdge(4, 5, 6, 3);
+						m_Asm.Min(0, 0, 4);
+					}
+					return true;
+
+				case SDF_OP_TORUS:
+					Length(4, 1, 3, -1, 5);
+					m_Asm.Splat(5, a[3]);
+					m_Asm.Sub(4, 4, 5);
+					Length(0, 4, 2, -1, 5);
+					m_Asm.Splat(5, a[4]);
+					m_Asm.Sub(0, 0, 5);
+					return true;
+
+				case SDF_OP_CYLINDER: {
+					// The two coordinates across the axis and the one along it.
+					const int mode = int(GetFlags(ins));
+					const int u = mode == 1 ? 2 : 1;
+					const int v = mode == 0 ? 2 : 3;
+					const int w = mode == 0 ? 3 : mode == 1 ? 1 : 2;
+					Length(4, u, v, -1, 5);
+					Abs(4, 4, 5);
+					Abs(6, w, 5);
+					m_Asm.Splat(5, a[3]);
+					m_Asm.Sub(4, 4, 5);
+					m_Asm.Splat(5, a[4]);
+					m_Asm.Sub(6, 6, 5);
+					m_Asm.Max(7, 4, 6);
+					m_Asm.Zero(8);
+					m_Asm.Min(7, 7, 8);
+					m_Asm.Max(4, 4, 8);
+					m_Asm.Max(6, 6, 8);
+					Length(0, 4, 6, -1, 5);
+					m_Asm.Add(0, 7, 0);
+					return true;
+				}
+
+				case SDF_OP_OCTAHEDRON:
+					for (int axis = 0; axis < 3; axis++)
+						Abs(1 + axis, 1 + axis, 12);
+					// m in 4, s in 5, the masks of sdOctahedron() in 7, 8 and 9.
+					m_Asm.Add(4, 1, 2);
+					m_Asm.Add(4, 4, 3);
+					m_Asm.Splat(5, a[3]);
+					m_Asm.Sub(4, 4, 5);
+					m_Asm.Splat(6, 3.0f);
+					for (int axis = 0; axis < 3; axis++)
+					{
+						m_Asm.Mul(7 + axis, 6, 1 + axis);
+						m_Asm.Compare(7 + axis, 7 + axis, 4, c_LT);
+					}
+					// q = select(cx, p, select(cy, p.yzx, p.zxy)) in 10, 11 and 6.
+					m_Asm.Blend(10, 3, 2, 8);
+					m_Asm.Blend(10, 10, 1, 7);
+					m_Asm.Blend(11, 1, 3, 8);
+					m_Asm.Blend(11, 11, 2, 7);
+					m_Asm.Blend(6, 2, 1, 8);
+					m_Asm.Blend(6, 6, 3, 7);
+					m_Asm.Or(7, 7, 8);
+					m_Asm.Or(7, 7, 9);
+					// k in 1
+					m_Asm.Sub(1, 6, 11);
+					m_Asm.Add(1, 1, 5);
+					m_Asm.Splat(2, 0.5f);
+					m_Asm.Mul(1, 2, 1);
+					m_Asm.Zero(3);
+					m_Asm.Max(1, 1, 3);
+					m_Asm.Min(1, 1, 5);
+					m_Asm.Sub(2, 11, 5);
+					m_Asm.Add(2, 2, 1);
+					m_Asm.Sub(3, 6, 1);
+					Length(0, 10, 2, 3, 8);
+					m_Asm.Splat(9, 0.57735027f);
+					m_Asm.Mul(9, 4, 9);
+					m_Asm.Blend(0, 9, 0, 7);
+					return true;
+
+				default:
+					return false;
+				}
+			}
+
+			// One of the three terms of sdBoxFrame(), length(max(v, 0)) + min(max(x, max(y, z)), 0), into dst.
+			// Register 8 holds zero, 9 to 12 are overwritten.
+			void EmitFrameEdge(int dst, int x, int y, int z)
+			{
+				m_Asm.Max(9, x, 8);
+				m_Asm.Max(10, y, 8);
+				m_Asm.Max(11, z, 8);
+				Length(dst, 9, 10, 11, 12);
+				m_Asm.Max(9, y, z);
+				m_Asm.Max(9, x, 9);
+				m_Asm.Min(9, 9, 8);
+				m_Asm.Add(dst, dst, 9);
+			}
+
+			// Combines the pair at index with the one above it, see EvaluateBinary().
+			bool EmitBinary(const TapeInstruction& ins, int index)
+			{
+				const uint32_t opcode = GetOpcode(ins);
+				const float k = ins.params[0];
+				// a in 0 and 1, b in 2 and 3
+				m_Asm.Load(0, Distance(index));
+				m_Asm.Load(2, Distance(index + 1));
+				if (opcode != SDF_OP_SUBTRACTION && opcode != SDF_OP_SMOOTH_SUBTRACTION)
+				{
+					m_Asm.Load(1, Material(index));
+					m_Asm.Load(3, Material(index + 1));
+				}
+
+				switch (opcode)
+				{
+				case SDF_OP_UNION:
+					m_Asm.Min(4, 0, 2);
+					break;
+				case SDF_OP_SUBTRACTION:
+					Negate(2, 2, 5);
+					m_Asm.Max(4, 0, 2);
+					break;
+				case SDF_OP_INTERSECTION:
+					m_Asm.Max(4, 0, 2);
+					break;
+				case SDF_OP_SMOOTH_UNION:
+				case SDF_OP_SMOOTH_INTERSECTION:
+					// h = clamp(0.5 +- 0.5 * (d2 - d1) / k, 0, 1) in 4, with d1 = a and d2 = b.
+					m_Asm.Sub(4, 2, 0);
+					EmitSmoothWeight(opcode == SDF_OP_SMOOTH_UNION, k);
+					// lerp(d2, d1, h) -+ k * h * (1 - h)
+					m_Asm.Sub(9, 0, 2);
+					m_Asm.Mul(9, 9, 4);
+					m_Asm.Add(9, 2, 9);
+					EmitSmoothCorner();
+					if (opcode == SDF_OP_SMOOTH_UNION)
+						m_Asm.Sub(4, 9, 10);
+					else
+						m_Asm.Add(4, 9, 10);
+					break;
+				case SDF_OP_SMOOTH_SUBTRACTION:
+					// opSmoothSubtraction(b, a): h = clamp(0.5 - 0.5 * (a + b) / k, 0, 1),
+					// lerp(a, -b, h) + k * h * (1 - h)
+					m_Asm.Add(4, 0, 2);
+					EmitSmoothWeight(false, k);
+					Negate(9, 2, 10);
+					m_Asm.Sub(9, 9, 0);
+					m_Asm.Mul(9, 9, 4);
+					m_Asm.Add(9, 0, 9);
+					EmitSmoothCorner();
+					m_Asm.Add(4, 9, 10);
+					break;
+				default:
+					return false;
+				}
+				m_Asm.Store(Distance(index), 4);
+
+				// Union-like operators keep the material of the closer operand, intersections the farther one.
+				if (opcode == SDF_OP_UNION || opcode == SDF_OP_SMOOTH_UNION || opcode == SDF_OP_INTERSECTION ||
+					opcode == SDF_OP_SMOOTH_INTERSECTION)
+				{
+					const bool closer = opcode == SDF_OP_UNION || opcode == SDF_OP_SMOOTH_UNION;
+					m_Asm.Compare(5, 0, 2, closer ? c_LT : c_GT);
+					m_Asm.Blend(1, 3, 1, 5);
+					m_Asm.Store(Material(index), 1);
+				}
+				return true;
+			}
+
+			// Register 4 holds the difference or sum of the distances; makes it the clamped weight h of the
+			// smooth operators, leaves k in 6 and 1 in 8.
+			void EmitSmoothWeight(bool add, float k)
+			{
+				m_Asm.Splat(5, 0.5f);
+				m_Asm.Mul(4, 5, 4);
+				m_Asm.Splat(6, k);
+				m_Asm.Div(4, 4, 6);
+				if (add)
+					m_Asm.Add(4, 5, 4);
+				else
+					m_Asm.Sub(4, 5, 4);
+				m_Asm.Zero(7);
+				m_Asm.Max(4, 4, 7);
+				m_Asm.Splat(8, 1.0f);
+				m_Asm.Min(4, 4, 8);
+			}
+
+			// k * h * (1 - h) into 10.
+			void EmitSmoothCorner()
+			{
+				m_Asm.Mul(10, 6, 4);
+				m_Asm.Sub(11, 8, 4);
+				m_Asm.Mul(10, 10, 11);
+			}
+
+			bool EmitUnary(const TapeInstruction& ins, uint32_t instruction, int index)
+			{
+				m_Asm.Load(0, Distance(index));
+				switch (GetOpcode(ins))
+				{
+				case SDF_OP_ROUND:
+					m_Asm.Splat(1, ins.params[0]);
+					m_Asm.Sub(0, 0, 1);
+					break;
+				case SDF_OP_DISPLACE:
+					if (GetFlags(ins) & SDF_DISPLACE_KEYFRAMED)
+					{
+						m_Asm.Splat(1, ins.params[0]);
+					}
+					else
+					{
+						auto it = std::lower_bound(m_Uniforms.begin(), m_Uniforms.end(), instruction);
+						m_Asm.Broadcast(1, Memory{ c_UniformArg, int32_t(it - m_Uniforms.begin()) * 4 });
+					}
+					m_Asm.Add(0, 0, 1);
+					break;
+				default:
+					return false;
+				}
+				m_Asm.Store(Distance(index), 0);
+				return true;
+			}
+
+			// Unrolls the subtree [begin, end) over the candidates, see EvaluateTape().
+			bool EmitDomain(const TapeInstruction& ins, size_t begin, size_t end, int& sp, int depth)
+			{
+				const uint32_t opcode = GetOpcode(ins);
+				if (opcode != SDF_OP_REPEAT && opcode != SDF_OP_REPEAT_LIMITED)
+					return false;
+
+				for (int axis = 0; axis < 3; axis++)
+					m_Asm.Store(FramePos(depth, axis), c_Pos[axis]);
+				m_Asm.Splat(0, c_None);
+				m_Asm.Store(FrameDistance(depth), 0);
+				m_Asm.Splat(0, -1.0f);
+				m_Asm.Store(FrameMaterial(depth), 0);
+
+				const int candidates = GetDomainCandidateCount(ins);
+				for (int candidate = 0; candidate < candidates; candidate++)
+				{
+					EmitDomainPosition(ins, depth, candidate);
+					const int base = sp;
+					if (!EmitRange(begin, end, sp, depth + 1) || sp != base + 1)
+						return false;
+
+					sp--;
+					m_Asm.Load(0, Distance(sp));
+					m_Asm.Load(1, Material(sp));
+					m_Asm.Load(2, FrameDistance(depth));
+					m_Asm.Load(3, FrameMaterial(depth));
+					m_Asm.Min(4, 2, 0);
+					m_Asm.Compare(5, 2, 0, c_LT);
+					m_Asm.Blend(3, 1, 3, 5);
+					m_Asm.Store(FrameDistance(depth), 4);
+					m_Asm.Store(FrameMaterial(depth), 3);
+				}
+
+				for (int axis = 0; axis < 3; axis++)
+					m_Asm.Load(c_Pos[axis], FramePos(depth, axis));
+				EmitDomainBound(ins);
+				m_Asm.Load(0, FrameDistance(depth));
+				m_Asm.Min(0, 0, 1);
+				m_Asm.Store(Distance(sp), 0);
+				m_Asm.Load(0, FrameMaterial(depth));
+				m_Asm.Store(Material(sp), 0);
+				sp++;
+				return true;
+			}
+
+			// cell = floor(p / period + 0.5), clamped to the limit, into dst; tmp is overwritten.
+			void EmitRepeatCell(const TapeInstruction& ins, int axis, int p, int dst, int tmp)
+			{
+				m_Asm.Splat(tmp, 1.0f / ins.params[axis]);
+				m_Asm.Mul(dst, p, tmp);
+				m_Asm.Splat(tmp, 0.5f);
+				m_Asm.Add(dst, dst, tmp);
+				m_Asm.Floor(dst, dst);
+				if (GetOpcode(ins) == SDF_OP_REPEAT_LIMITED)
+					Clamp(dst, dst, -ins.params[3 + axis], ins.params[3 + axis], tmp);
+			}
+
+			// dst = p - cell * period
+			void EmitCellOffset(const TapeInstruction& ins, int axis, int p, int cell, int dst, int tmp)
+			{
+				m_Asm.Splat(tmp, ins.params[axis]);
+				m_Asm.Mul(dst, cell, tmp);
+				m_Asm.Sub(dst, p, dst);
+			}
+
+			// c_Pos = GetDomainPosition() of the frame's position.
+			void EmitDomainPosition(const TapeInstruction& ins, int depth, int candidate)
+			{
+				const bool mirror = (GetFlags(ins) & SDF_REPEAT_MIRROR) != 0;
+				int bit = 0;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					const float period = ins.params[axis];
+					if (!(period > 0.f))
+					{
+						m_Asm.Load(c_Pos[axis], FramePos(depth, axis));
+						continue;
+					}
+
+					m_Asm.Load(0, FramePos(depth, axis));
+					EmitRepeatCell(ins, axis, 0, 2, 1);
+					if ((candidate >> bit++) & 1)
+					{
+						EmitCellOffset(ins, axis, 0, 2, 3, 1);
+						m_Asm.Zero(4);
+						m_Asm.Compare(4, 3, 4, c_LT);
+						Side(5, 4, 6);
+						m_Asm.Add(2, 2, 5);
+						if (GetOpcode(ins) == SDF_OP_REPEAT_LIMITED)
+							Clamp(2, 2, -ins.params[3 + axis], ins.params[3 + axis], 1);
+					}
+
+					EmitCellOffset(ins, axis, 0, 2, 3, 1);
+					if (mirror)
+					{
+						// IsOdd(cell) = cell - 2 * floor(cell * 0.5) > 0.5
+						m_Asm.Splat(1, 0.5f);
+						m_Asm.Mul(4, 2, 1);
+						m_Asm.Floor(4, 4);
+						m_Asm.Splat(5, 2.0f);
+						m_Asm.Mul(4, 5, 4);
+						m_Asm.Sub(4, 2, 4);
+						m_Asm.Compare(4, 4, 1, c_GT);
+						Negate(5, 3, 6);
+						m_Asm.Blend(3, 3, 5, 4);
+					}
+					m_Asm.Move(c_Pos[axis], 3);
+				}
+			}
+
+			// GetDomainBound() of c_Pos into register 1. The axes that aren't repeated only add terms
+			// beyond none * none to the minimum, so they are left out.
+			void EmitDomainBound(const TapeInstruction& ins)
+			{
+				const bool limited = GetOpcode(ins) == SDF_OP_REPEAT_LIMITED;
+				// Distance along each axis in 7 + axis, gap in 10 + axis.
+				bool repeated[3] = {};
+				for (int axis = 0; axis < 3; axis++)
+				{
+					const float period = ins.params[axis];
+					if (!(period > 0.f))
+						continue;
+					repeated[axis] = true;
+
+					const int distance = 7 + axis;
+					const int gap = 10 + axis;
+					// cell in 0, offset in 1, d in 2, behind in 3, beyond in 4
+					EmitRepeatCell(ins, axis, c_Pos[axis], 0, 6);
+					EmitCellOffset(ins, axis, c_Pos[axis], 0, 1, 6);
+					Abs(2, 1, 6);
+					m_Asm.Splat(6, 0.5f * period);
+					m_Asm.Add(3, 2, 6);
+					m_Asm.Splat(6, 1.5f * period);
+					m_Asm.Sub(4, 6, 2);
+					if (limited)
+					{
+						const float limit = ins.params[3 + axis];
+						m_Asm.Zero(6);
+						m_Asm.Compare(6, 1, 6, c_LT);
+						Side(5, 6, distance);
+						// behind unless abs(cell - side) <= limit
+						m_Asm.Sub(6, 0, 5);
+						Abs(6, 6, distance);
+						m_Asm.Splat(distance, limit);
+						m_Asm.Compare(6, 6, distance, c_LE);
+						m_Asm.Splat(distance, c_None);
+						m_Asm.Blend(3, distance, 3, 6);
+						// beyond unless abs(cell + side * 2) <= limit
+						m_Asm.Splat(6, 2.0f);
+						m_Asm.Mul(6, 5, 6);
+						m_Asm.Add(6, 0, 6);
+						Abs(6, 6, distance);
+						m_Asm.Splat(distance, limit);
+						m_Asm.Compare(6, 6, distance, c_LE);
+						m_Asm.Splat(distance, c_None);
+						m_Asm.Blend(4, distance, 4, 6);
+						// gap = max(d - period / 2, 0)
+						m_Asm.Splat(6, 0.5f * period);
+						m_Asm.Sub(gap, 2, 6);
+						m_Asm.Zero(6);
+						m_Asm.Max(gap, gap, 6);
+					}
+					m_Asm.Min(distance, 3, 4);
+				}
+
+				// gaps in 0
+				bool first = true;
+				for (int axis = 0; axis < 3 && limited; axis++)
+				{
+					if (!repeated[axis])
+						continue;
+					m_Asm.Mul(first ? 0 : 2, 10 + axis, 10 + axis);
+					if (!first)
+						m_Asm.Add(0, 0, 2);
+					first = false;
+				}
+
+				m_Asm.Splat(1, c_None * c_None);
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (!repeated[axis])
+						continue;
+					m_Asm.Mul(2, 7 + axis, 7 + axis);
+					if (limited)
+					{
+						m_Asm.Add(2, 2, 0);
+						m_Asm.Mul(3, 10 + axis, 10 + axis);
+						m_Asm.Sub(2, 2, 3);
+					}
+					m_Asm.Min(1, 1, 2);
+				}
+				m_Asm.Sqrt(1, 1);
+			}
+
+			const TapeInstruction* m_Code;
+			size_t m_Count;
+			const std::vector<uint32_t>& m_Uniforms;
+			int m_Width;
+			Assembler m_Asm;
+		};
+
+		// Executable copy of code; writable while it is filled, executable afterwards.
+		void* MapCode(const std::vector<uint8_t>& code, size_t& size)
+		{
+#ifdef _WIN32
+			void* memory = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (!memory)
+				return nullptr;
+			std::memcpy(memory, code.data(), code.size());
+			DWORD oldProtect;
+			if (!VirtualProtect(memory, code.size(), PAGE_EXECUTE_READ, &oldProtect))
+			{
+				VirtualFree(memory, 0, MEM_RELEASE);
+				return nullptr;
+			}
+			FlushInstructionCache(GetCurrentProcess(), memory, code.size());
+#else
+			void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+				return nullptr;
+			std::memcpy(memory, code.data(), code.size());
+			if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0)
+			{
+				munmap(memory, code.size());
+				return nullptr;
+			}
+#endif
+			size = code.size();
+			return memory;
+		}
+
+		void UnmapCode(void* memory, size_t size)
+		{
+#ifdef _WIN32
+			(void)size;
+			VirtualFree(memory, 0, MEM_RELEASE);
+#else
+			munmap(memory, size);
+#endif
+		}
+
+		uint64_t HashInstructions(const TapeInstruction* code, size_t count)
+		{
+			// FNV-1a
+			uint64_t hash = 14695981039346656037ull;
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(code);
+			for (size_t i = 0; i < count * sizeof(TapeInstruction); i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			return hash;
+		}
+
+		bool IsSame(const JitTape& tape, const TapeInstruction* code, size_t count)
+		{
+			const std::vector<TapeInstruction>& instructions = tape.GetInstructions();
+			return instructions.size() == count && (count == 0 || std::memcmp(instructions.data(), code, count * sizeof(TapeInstruction)) == 0);
+		}
+	}
+
+	JitTape::~JitTape()
+	{
+		Release();
+	}
+
+	bool JitTape::IsSupported()
+	{
+#if defined(SDF_JIT_X64)
+		static const bool supported = []
+		{
+			// AVX, and the OS saving the YMM registers.
+			int info[4] = {};
+#if defined(_MSC_VER)
+			__cpuid(info, 1);
+#else
+			__cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!avx || !osxsave)
+				return false;
+#if defined(_MSC_VER)
+			const unsigned long long xcr0 = _xgetbv(0);
+#else
+			uint32_t eax, edx;
+			__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			const unsigned long long xcr0 = (uint64_t(edx) << 32) | eax;
+#endif
+			return (xcr0 & 6) == 6;
+		}();
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+	bool JitTape::Compile(const TapeInstruction* code, size_t count)
+	{
+		Release();
+		m_Instructions.assign(code, code + count);
+		m_Uniforms.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			if (GetOpcode(code[i]) == SDF_OP_DISPLACE && !(GetFlags(code[i]) & SDF_DISPLACE_KEYFRAMED))
+				m_Uniforms.push_back(uint32_t(i));
+		}
+
+		if (!IsSupported() || m_Uniforms.size() > size_t(c_JitMaxUniforms))
+			return false;
+
+		// The functions one after the other, each followed by its constants.
+		// Only the widths this build has packets of.
+		std::vector<uint8_t> image;
+		size_t offsets[3] = {};
+		bool compiled[3] = {};
+		for (int width : { 1, 4, 8 })
+		{
+			if (width > c_JitWidth<FloatN>)
+				continue;
+
+			std::vector<uint8_t> function;
+			if (!Compiler(code, count, m_Uniforms, width).Run(function))
+				return false;
+			image.resize((image.size() + 63) & ~size_t(63), 0xcc);
+			offsets[FunctionIndex(width)] = image.size();
+			compiled[FunctionIndex(width)] = true;
+			image.insert(image.end(), function.begin(), function.end());
+		}
+
+		m_Memory = MapCode(image, m_MemorySize);
+		if (!m_Memory)
+			return false;
+		m_CodeSize = image.size();
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (compiled[i])
+				m_Functions[i] = reinterpret_cast<Function>(static_cast<uint8_t*>(m_Memory) + offsets[i]);
+		}
+		return true;
+	}
+
+	void JitTape::SetUniforms(float time, float* uniforms) const
+	{
+		if (m_Uniforms.empty())
+			return;
+
+		// The offsets of EvaluateUnary().
+		const float an = std::fmod(time, 6.28f);
+		for (size_t i = 0; i < m_Uniforms.size(); i++)
+		{
+			const TapeInstruction& ins = m_Instructions[m_Uniforms[i]];
+			uniforms[i] = ins.params[0] * std::sin(ins.params[1] * an);
+		}
+	}
+
+	void JitTape::Release()
+	{
+		if (m_Memory)
+			UnmapCode(m_Memory, m_MemorySize);
+		m_Memory = nullptr;
+		m_MemorySize = 0;
+		m_CodeSize = 0;
+		for (Function& function : m_Functions)
+			function = nullptr;
+	}
+
+	std::shared_ptr<const JitTape> JitCache::Get(const TapeInstruction* code, size_t count)
+	{
+		const uint64_t hash = HashInstructions(code, count);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto range = m_Tapes.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (IsSame(*it->second, code, count))
+				{
+					m_Hits++;
+					return it->second;
+				}
+			}
+		}
+
+		// Compiled outside the lock; when another thread got there first, its tape is kept.
+		auto tape = std::make_shared<JitTape>();
+		tape->Compile(code, count);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto range = m_Tapes.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (IsSame(*it->second, code, count))
+			{
+				m_Hits++;
+				return it->second;
+			}
+		}
+		m_Misses++;
+		m_Tapes.emplace(hash, tape);
+		return tape;
+	}
+
+	size_t JitCache::Trim()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		size_t removed = 0;
+		for (auto it = m_Tapes.begin(); it != m_Tapes.end();)
+		{
+			if (it->second.use_count() == 1)
+			{
+				it = m_Tapes.erase(it);
+				removed++;
+			}
+			else
+			{
+				++it;
+			}
+		}
+		return removed;
+	}
+
+	size_t JitCache::GetSize() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Tapes.size();
+	}
+
+	uint64_t JitCache::GetHits() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Hits;
+	}
+
+	uint64_t JitCache::GetMisses() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Misses;
+	}
+
+	void BvhJit::Update(const SceneBvh& bvh, JitCache& cache)
+	{
+		const std::vector<TapeInstruction>& code = bvh.GetInstructions();
+		m_Global = cache.Get(code.data(), bvh.GetGlobalInstructionCount());
+		m_Leaves.clear();
+		m_LeafIndex.assign(code.size(), 0);
+		for (const BvhNode& node : bvh.GetNodes())
+		{
+			if (node.count == 0)
+				continue;
+			m_LeafIndex[node.offset] = uint32_t(m_Leaves.size());
+			m_Leaves.push_back(cache.Get(code.data() + node.offset, node.count));
+		}
+	}
+
+	uint32_t BvhJit::GetCompiledCount() const
+	{
+		uint32_t count = m_Global && m_Global->IsCompiled() ? 1 : 0;
+		for (const auto& leaf : m_Leaves)
+			count += leaf->IsCompiled() ? 1 : 0;
+		return count;
+	}
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+// Native code for tapes. A tape is compiled to an x86-64 function per packet width that does what
+// EvaluateTape() does, in AVX instructions of that width: the dispatch, the stack and the parameter
+// loads of the interpreter become straight-line code with the parameters folded into constants, and
+// domain operators are unrolled over their candidates. The code is written to a buffer that is only
+// made executable once it is complete.
+//
+// Tapes with SDF_OP_DISPLACE_NOISE or SDF_OP_REPEAT_POLAR, or whose code would get too large, are not
+// compiled, nor is anything outside x86-64 or on CPUs without AVX; JitTape::Evaluate() interprets
+// those, as it does dual numbers and intervals. Results match the interpreter up to the rounding of
+// the multiply-adds the C++ compiler fuses.
+
+#include "Bvh.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sdf
+{
+	// Packet widths that have a compiled function, 0 for the types that are always interpreted.
+	template<typename F> constexpr int c_JitWidth = 0;
+	template<> inline constexpr int c_JitWidth<float> = 1;
+#if defined(SDF_SIMD_SSE)
+	template<> inline constexpr int c_JitWidth<Float4> = 4;
+#endif
+#if defined(SDF_SIMD_AVX2)
+	template<> inline constexpr int c_JitWidth<Float8> = 8;
+#endif
+
+	// Time-dependent displacement offsets a compiled tape reads, one per SDF_OP_DISPLACE without SDF_DISPLACE_KEYFRAMED.
+	constexpr int c_JitMaxUniforms = 64;
+	// Stack, domain frames and saved registers of a compiled function, in floats.
+	constexpr int c_JitScratchSize = 456;
+
+	class JitTape
+	{
+	public:
+		JitTape() = default;
+		~JitTape();
+		JitTape(const JitTape&) = delete;
+		JitTape& operator=(const JitTape&) = delete;
+
+		// Whether this build and CPU run compiled tapes.
+		static bool IsSupported();
+
+		// Keeps a copy of the instructions and compiles them when it can, returns whether it did.
+		bool Compile(const TapeInstruction* code, size_t count);
+		bool Compile(const Tape& tape) { return Compile(tape.instructions.data(), tape.instructions.size()); }
+
+		bool IsCompiled() const { return m_Memory != nullptr; }
+		// Bytes of machine code and constants of all the widths.
+		size_t GetCodeSize() const { return m_CodeSize; }
+		const std::vector<TapeInstruction>& GetInstructions() const { return m_Instructions; }
+
+		// (distance, material) like EvaluateTape().
+		template<typename F> Vec2<F> Evaluate(const Vec3<F>& pos, float time) const
+		{
+			constexpr int W = c_JitWidth<F>;
+			if constexpr (W > 0)
+			{
+				if (Function function = m_Functions[FunctionIndex(W)])
+				{
+					alignas(32) float in[3 * W];
+					alignas(32) float out[2 * W];
+					alignas(32) float scratch[c_JitScratchSize];
+					float uniforms[c_JitMaxUniforms];
+					StoreLanes(pos.x, in);
+					StoreLanes(pos.y, in + W);
+					StoreLanes(pos.z, in + 2 * W);
+					SetUniforms(time, uniforms);
+					function(in, out, uniforms, scratch);
+					return Vec2<F>(LoadLanes<F>(out), LoadLanes<F>(out + W));
+				}
+			}
+			return EvaluateTape(m_Instructions.data(), m_Instructions.size(), pos, time);
+		}
+
+	private:
+		// Positions and results are W x values, W y values and so on.
+		using Function = void (*)(const float* pos, float* result, const float* uniforms, float* scratch);
+
+		static constexpr int FunctionIndex(int width) { return width == 1 ? 0 : width == 4 ? 1 : 2; }
+
+		template<typename F> static void StoreLanes(F v, float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				*p = v;
+			else
+				v.Store(p);
+		}
+
+		template<typename F> static F LoadLanes(const float* p)
+		{
+			if constexpr (WidthOf<F> == 1)
+				return *p;
+			else
+				return F::Load(p);
+		}
+
+		void SetUniforms(float time, float* uniforms) const;
+		void Release();
+
+		std::vector<TapeInstruction> m_Instructions;
+		std::vector<uint32_t> m_Uniforms;   // instructions whose offset is a uniform, in the order of the uniforms
+		void* m_Memory = nullptr;
+		size_t m_MemorySize = 0;
+		size_t m_CodeSize = 0;
+		Function m_Functions[3] = {};       // 1, 4 and 8 lanes
+	};
+
+	// Compiled tapes by their instructions. The tiles whose pruned tapes came out the same and the frames
+	// of an animation that come back to earlier parameters share one compilation. Thread safe.
+	class JitCache
+	{
+	public:
+		std::shared_ptr<const JitTape> Get(const TapeInstruction* code, size_t count);
+		std::shared_ptr<const JitTape> Get(const Tape& tape) { return Get(tape.instructions.data(), tape.instructions.size()); }
+
+		// Forgets the tapes nothing else holds on to, returns how many.
+		size_t Trim();
+
+		size_t GetSize() const;
+		uint64_t GetHits() const;
+		uint64_t GetMisses() const;
+
+	private:
+		mutable std::mutex m_Mutex;
+		std::unordered_multimap<uint64_t, std::shared_ptr<const JitTape>> m_Tapes;
+		uint64_t m_Hits = 0;
+		uint64_t m_Misses = 0;
+	};
+
+	// Compiled global prefix and leaves of a SceneBvh.
+	class BvhJit
+	{
+	public:
+		// Takes the tapes of the BVH from the cache, which compiles the new ones. Call it again after
+		// SetParameters(); the leaves that didn't change are found in the cache.
+		void Update(const SceneBvh& bvh, JitCache& cache);
+
+		const JitTape& GetGlobal() const { return *m_Global; }
+		// Leaf whose instructions start at first in SceneBvh::GetInstructions().
+		const JitTape& GetLeaf(uint32_t first) const { return *m_Leaves[m_LeafIndex[first]]; }
+
+		uint32_t GetTapeCount() const { return m_Global ? uint32_t(m_Leaves.size()) + 1 : 0; }
+		uint32_t GetCompiledCount() const;
+
+	private:
+		std::shared_ptr<const JitTape> m_Global;
+		std::vector<std::shared_ptr<const JitTape>> m_Leaves;
+		std::vector<uint32_t> m_LeafIndex;
+	};
+
+	// EvaluateBvh() with the compiled tapes of jit, which was updated for bvh.
+	template<typename F> Vec2<F> EvaluateBvh(const SceneBvh& bvh, const BvhJit& jit, const Vec3<F>& pos, float time)
+	{
+		return TraverseBvh(bvh, pos, jit.GetGlobal().Evaluate(pos, time),
+			[&](const BvhNode& leaf) { return jit.GetLeaf(leaf.offset).Evaluate(pos, time); });
+	}
+}
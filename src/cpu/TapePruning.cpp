@@ -0,0 +1,459 @@
+#include "TapePruning.h"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sdf
+{
+	namespace
+	{
+		enum class Choice
+		{
+			Both,
+			First,
+			Second
+		};
+
+		// Decides whether one operand always produces the operator's result inside the region.
+		// The smooth operators blend only within k of the crossover, beyond that they return one operand
+		// unchanged. For the subtractions only the first operand can be kept: keeping -b needs a negation.
+		Choice Choose(const TapeInstruction& ins, const Interval& a, const Interval& b)
+		{
+			const float k = ins.params[0];
+
+			switch (GetOpcode(ins))
+			{
+			case SDF_OP_UNION:
+				return a.hi < b.lo ? Choice::First : b.hi < a.lo ? Choice::Second : Choice::Both;
+			case SDF_OP_INTERSECTION:
+				return a.lo > b.hi ? Choice::First : b.lo > a.hi ? Choice::Second : Choice::Both;
+			case SDF_OP_SUBTRACTION:
+				return a.lo > -b.lo ? Choice::First : Choice::Both;
+			case SDF_OP_SMOOTH_UNION:
+				return a.hi + k < b.lo ? Choice::First : b.hi + k < a.lo ? Choice::Second : Choice::Both;
+			case SDF_OP_SMOOTH_INTERSECTION:
+				return a.lo - k > b.hi ? Choice::First : b.lo - k > a.hi ? Choice::Second : Choice::Both;
+			case SDF_OP_SMOOTH_SUBTRACTION:
+				return a.lo + b.lo > k ? Choice::First : Choice::Both;
+			default:
+				return Choice::Both;
+			}
+		}
+
+		const float c_Infinity = std::numeric_limits<float>::infinity();
+
+		// Domain operators over larger regions fall back to a single box that holds every local position.
+		constexpr double c_MaxDomainInstances = 64.0;
+
+		Interval EvaluateRange(const TapeInstruction* code, size_t count, const box3& region, float time);
+
+		// Range of a domain operator from the ranges of its child over the region in the frames of the
+		// instances. The interpreter takes the nearest instance of a point and its neighbours, so the result
+		// is at most the largest value of the nearest instances and at least the smallest value of them and
+		// their neighbours, or the bound of the skipped instances.
+		struct DomainRange
+		{
+			float lo = c_Infinity;
+			float hi = -c_Infinity;
+
+			void Add(const Interval& child, bool nearest)
+			{
+				lo = std::min(lo, child.lo);
+				if (nearest)
+					hi = std::max(hi, child.hi);
+			}
+
+			Interval Get(float skippedLo) const { return Interval(std::min(lo, skippedLo), hi); }
+		};
+
+		Interval EvaluateRepeat(const TapeInstruction* code, size_t begin, size_t end, const box3& region, float time)
+		{
+			const TapeInstruction& ins = code[begin];
+			const float* a = ins.params;
+			const bool limited = GetOpcode(ins) == SDF_OP_REPEAT_LIMITED;
+			const bool mirror = (GetFlags(ins) & SDF_REPEAT_MIRROR) != 0;
+			const TapeInstruction* child = code + begin + 1;
+			const size_t childCount = end - begin - 1;
+
+			// Per axis the cells nearest to some point of the region, and with their neighbours.
+			float3 nearestFirst(0.f), nearestLast(0.f), first(0.f), last(0.f);
+			box3 grid(float3(-c_Infinity), float3(c_Infinity));
+			box3 local = region;
+			float minPeriod = c_Infinity;
+			double instances = 1.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const float period = a[axis];
+				if (!(period > 0.f))
+					continue;
+
+				const float limit = limited ? a[3 + axis] : c_Infinity;
+				nearestFirst[axis] = std::clamp(std::floor(region.m_mins[axis] / period + 0.5f), -limit, limit);
+				nearestLast[axis] = std::clamp(std::floor(region.m_maxs[axis] / period + 0.5f), -limit, limit);
+				first[axis] = std::max(nearestFirst[axis] - 1.f, -limit);
+				last[axis] = std::min(nearestLast[axis] + 1.f, limit);
+				instances *= double(last[axis]) - double(first[axis]) + 1.0;
+				minPeriod = std::min(minPeriod, period);
+
+				// Every local position of the candidates, for the fallback.
+				if (limited)
+				{
+					grid.m_mins[axis] = -(limit + 0.5f) * period;
+					grid.m_maxs[axis] = (limit + 0.5f) * period;
+					local.m_mins[axis] = region.m_mins[axis] - limit * period;
+					local.m_maxs[axis] = region.m_maxs[axis] + limit * period;
+				}
+				else
+				{
+					local.m_mins[axis] = -1.5f * period;
+					local.m_maxs[axis] = 1.5f * period;
+				}
+				if (mirror)
+				{
+					float reach = std::max(std::abs(local.m_mins[axis]), std::abs(local.m_maxs[axis]));
+					local.m_mins[axis] = -reach;
+					local.m_maxs[axis] = reach;
+				}
+			}
+
+			// Skipped cells are at least half a period away, and within the grid.
+			float3 gap = max(max(grid.m_mins - region.m_maxs, region.m_mins - grid.m_maxs), float3(0.f));
+			const float skippedLo = std::max(0.5f * minPeriod, length(gap));
+
+			if (instances > c_MaxDomainInstances)
+			{
+				Interval range = EvaluateRange(child, childCount, local, time);
+				return Interval(std::min(range.lo, skippedLo), range.hi);
+			}
+
+			DomainRange result;
+			for (float z = first.z; z <= last.z; z++)
+			{
+				for (float y = first.y; y <= last.y; y++)
+				{
+					for (float x = first.x; x <= last.x; x++)
+					{
+						const float3 cell(x, y, z);
+						bool nearest = true;
+						for (int axis = 0; axis < 3; axis++)
+						{
+							if (!(a[axis] > 0.f))
+								continue;
+
+							nearest = nearest && nearestFirst[axis] <= cell[axis] && cell[axis] <= nearestLast[axis];
+							local.m_mins[axis] = region.m_mins[axis] - cell[axis] * a[axis];
+							local.m_maxs[axis] = region.m_maxs[axis] - cell[axis] * a[axis];
+							if (mirror && std::fmod(std::abs(cell[axis]), 2.f) == 1.f)
+							{
+								std::swap(local.m_mins[axis], local.m_maxs[axis]);
+								local.m_mins[axis] = -local.m_mins[axis];
+								local.m_maxs[axis] = -local.m_maxs[axis];
+							}
+						}
+						result.Add(EvaluateRange(child, childCount, local, time), nearest);
+					}
+				}
+			}
+			return result.Get(skippedLo);
+		}
+
+		Interval EvaluatePolar(const TapeInstruction* code, size_t begin, size_t end, const box3& region, float time)
+		{
+			const TapeInstruction& ins = code[begin];
+			const float* a = ins.params;
+			const bool mirror = (GetFlags(ins) & SDF_REPEAT_MIRROR) != 0;
+			const TapeInstruction* child = code + begin + 1;
+			const size_t childCount = end - begin - 1;
+
+			const float count = a[3];
+			const float width = c_TwoPi / count;
+			const float3 center(a[0], a[1], a[2]);
+			const float2 lo(region.m_mins.x - center.x, region.m_mins.z - center.z);
+			const float2 hi(region.m_maxs.x - center.x, region.m_maxs.z - center.z);
+
+			float minRadius = length(clamp(float2(0.f), lo, hi));
+			float maxRadius = 0.f;
+			for (int corner = 0; corner < 4; corner++)
+				maxRadius = std::max(maxRadius, length(float2((corner & 1) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y)));
+
+			const float skippedLo = count >= 3.f
+				? minRadius * std::sin(std::min(0.5f * width - c_PolarAngleSlack, 0.25f * c_TwoPi)) : c_Infinity;
+			// Covers the difference between the rotations here and SinCos() in the point evaluator.
+			const float slack = c_IntervalSlack * (1.f + maxRadius);
+
+			// Sectors nearest to some point of the region: all of them around the axis, otherwise those
+			// within the angles of the corners.
+			float nearestFirst = 0.f, nearestLast = count - 1.f;
+			bool all = minRadius == 0.f;
+			if (!all)
+			{
+				const float2 mid = (lo + hi) * 0.5f;
+				const float midAngle = std::atan2(mid.y, mid.x);
+				float minOffset = 0.f, maxOffset = 0.f;
+				for (int corner = 0; corner < 4; corner++)
+				{
+					float offset = std::atan2((corner & 2) ? hi.y : lo.y, (corner & 1) ? hi.x : lo.x) - midAngle;
+					offset -= c_TwoPi * std::floor(offset / c_TwoPi + 0.5f);
+					minOffset = std::min(minOffset, offset);
+					maxOffset = std::max(maxOffset, offset);
+				}
+				nearestFirst = std::floor((midAngle + minOffset) / width + 0.5f);
+				nearestLast = std::floor((midAngle + maxOffset) / width + 0.5f);
+				all = nearestLast - nearestFirst + 3.f >= count;
+			}
+			if (all)
+			{
+				nearestFirst = 0.f;
+				nearestLast = count - 1.f;
+			}
+			const float first = all ? nearestFirst : nearestFirst - 1.f;
+			const float last = all ? nearestLast : nearestLast + 1.f;
+
+			if (double(last - first) + 1.0 > c_MaxDomainInstances)
+			{
+				box3 local(float3(-maxRadius, region.m_mins.y - center.y, -maxRadius), float3(maxRadius, region.m_maxs.y - center.y, maxRadius));
+				Interval range = EvaluateRange(child, childCount, local.grow(slack), time);
+				return Interval(std::min(range.lo, skippedLo), range.hi);
+			}
+
+			DomainRange result;
+			for (float sector = first; sector <= last; sector++)
+			{
+				const float c = std::cos(sector * width), s = std::sin(sector * width);
+				box3 local = box3::empty();
+				for (int corner = 0; corner < 4; corner++)
+				{
+					const float2 d((corner & 1) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y);
+					float2 xz(d.x * c + d.y * s, d.y * c - d.x * s);
+					if (mirror && std::fmod(sector - count * std::floor(sector / count), 2.f) == 1.f)
+						xz.y = -xz.y;
+					local |= float3(xz.x, region.m_mins.y - center.y, xz.y);
+					local |= float3(xz.x, region.m_maxs.y - center.y, xz.y);
+				}
+				result.Add(EvaluateRange(child, childCount, local.grow(slack), time), nearestFirst <= sector && sector <= nearestLast);
+			}
+			return result.Get(skippedLo);
+		}
+
+		Interval EvaluateDomain(const TapeInstruction* code, size_t begin, size_t end, const box3& region, float time)
+		{
+			if (GetOpcode(code[begin]) == SDF_OP_REPEAT_POLAR)
+				return EvaluatePolar(code, begin, end, region, time);
+			return EvaluateRepeat(code, begin, end, region, time);
+		}
+
+		Interval EvaluateRange(const TapeInstruction* code, size_t count, const box3& region, float time)
+		{
+			Interval stack[SDF_TAPE_MAX_STACK];
+			int sp = 0;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const TapeInstruction& ins = code[i];
+				uint32_t opcode = GetOpcode(ins);
+
+				if (opcode < SDF_OP_FIRST_BINARY)
+				{
+					stack[sp++] = EvaluatePrimitive(ins, region);
+				}
+				else if (opcode < SDF_OP_FIRST_UNARY)
+				{
+					sp--;
+					stack[sp - 1] = EvaluateBinary(ins, stack[sp - 1], stack[sp]);
+				}
+				else if (opcode < SDF_OP_FIRST_DOMAIN)
+				{
+					stack[sp - 1] = EvaluateUnary(ins, stack[sp - 1], time);
+				}
+				else
+				{
+					// The whole repeated subtree at once.
+					size_t end = FindDomainEnd(code, count, i);
+					stack[sp++] = EvaluateDomain(code, i, end, region, time);
+					i = end;
+				}
+			}
+
+			return sp > 0 ? stack[0] : Interval(1e10f);
+		}
+	}
+
+	Interval EvaluateTape(const Tape& tape, const box3& region, float time)
+	{
+		return EvaluateRange(tape.instructions.data(), tape.Size(), region, time);
+	}
+
+	Interval PruneTape(const Tape& tape, const box3& region, float time, Tape& pruned)
+	{
+		// Same walk as EvaluateTape(), but every stack entry also remembers where its subtree starts
+		// so that a losing operand can be cut out of the tape as one contiguous range.
+		struct Entry
+		{
+			Interval range;
+			size_t start;
+		};
+
+		Entry stack[SDF_TAPE_MAX_STACK];
+		int sp = 0;
+
+		const size_t count = tape.Size();
+		std::vector<uint8_t> keep(count, 1);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const TapeInstruction& ins = tape.instructions[i];
+			uint32_t opcode = GetOpcode(ins);
+
+			if (opcode < SDF_OP_FIRST_BINARY)
+			{
+				stack[sp++] = Entry{ EvaluatePrimitive(ins, region), i };
+			}
+			else if (opcode < SDF_OP_FIRST_UNARY)
+			{
+				const Entry b = stack[--sp];
+				Entry& a = stack[sp - 1];
+
+				switch (Choose(ins, a.range, b.range))
+				{
+				case Choice::First:
+					std::fill(keep.begin() + b.start, keep.begin() + i + 1, uint8_t(0));
+					break;
+				case Choice::Second:
+					std::fill(keep.begin() + a.start, keep.begin() + b.start, uint8_t(0));
+					keep[i] = 0;
+					a.range = b.range;
+					break;
+				default:
+					a.range = EvaluateBinary(ins, a.range, b.range);
+					break;
+				}
+			}
+			else if (opcode < SDF_OP_FIRST_DOMAIN)
+			{
+				stack[sp - 1].range = EvaluateUnary(ins, stack[sp - 1].range, time);
+			}
+			else
+			{
+				// Repeated subtrees are kept or dropped as a whole: their operators serve every instance.
+				size_t end = FindDomainEnd(tape.instructions.data(), count, i);
+				stack[sp++] = Entry{ EvaluateDomain(tape.instructions.data(), i, end, region, time), i };
+				i = end;
+			}
+		}
+
+		// The tracks follow their instructions to where they moved, those of dropped ones go with them.
+		std::vector<uint32_t> index(count);
+		pruned.instructions.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			index[i] = uint32_t(pruned.instructions.size());
+			if (keep[i])
+				pruned.instructions.push_back(tape.instructions[i]);
+		}
+		pruned.tracks.clear();
+		for (const TapeTrack& track : tape.tracks)
+		{
+			if (keep[track.instruction])
+				pruned.tracks.push_back(TapeTrack{ index[track.instruction], track.track });
+		}
+		ComputeStackDepth(pruned.instructions, pruned.maxStackDepth);
+
+		return sp > 0 ? stack[0].range : Interval(1e10f);
+	}
+
+	box3 GetFrustumSlabBounds(const Camera& camera, const float2& pixelMin, const float2& pixelMax,
+		const float2& resolution, float tNear, float tFar)
+	{
+		float3 center = camera.PixelRay((pixelMin + pixelMax) * 0.5f, resolution);
+
+		box3 bounds = box3::empty();
+		float minCos = 1.0f;
+		for (int corner = 0; corner < 4; corner++)
+		{
+			float2 pixel((corner & 1) ? pixelMax.x : pixelMin.x, (corner & 2) ? pixelMax.y : pixelMin.y);
+			float3 rd = camera.PixelRay(pixel, resolution);
+
+			bounds |= camera.origin + rd * tNear;
+			bounds |= camera.origin + rd * tFar;
+			minCos = std::min(minCos, dot(rd, center));
+		}
+		bounds |= camera.origin + center * tFar;
+
+		// The far end of the slab is a spherical cap that bulges past the corner points.
+		return bounds.grow(tFar * (1.0f - minCos));
+	}
+
+	int TileTapes::FindSlab(float t) const
+	{
+		// The tapes are only valid inside their slabs, not in front of the first one.
+		auto it = std::upper_bound(slabDepths.begin(), slabDepths.end(), t);
+		if (it == slabDepths.begin() || it == slabDepths.end())
+			return -1;
+
+		return int(it - slabDepths.begin()) - 1;
+	}
+
+	double TileTapes::GetAverageSize() const
+	{
+		if (tapes.empty())
+			return 0.0;
+
+		size_t total = 0;
+		for (const Tape& tape : tapes)
+			total += tape.Size();
+
+		return double(total) / double(tapes.size());
+	}
+
+	void PruneTiles(tf::Executor& executor, const Tape& tape, const Camera& camera, const int2& resolution,
+		int tileSize, const std::vector<float>& slabDepths, float time, TileTapes& result)
+	{
+		result.tileSize = tileSize;
+		result.tileCount = (resolution + tileSize - 1) / tileSize;
+		result.slabDepths = slabDepths;
+
+		const int slabCount = result.GetSlabCount();
+		const int taskCount = result.tileCount.x * result.tileCount.y * std::max(slabCount, 0);
+		result.tapes.resize(taskCount);
+		result.ranges.resize(taskCount);
+
+		const float2 fres = float2(resolution);
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index(0, taskCount, 1, [&](int index)
+		{
+			int slab = index % slabCount;
+			int tile = index / slabCount;
+			int2 tileMin = int2(tile % result.tileCount.x, tile / result.tileCount.x) * tileSize;
+			int2 tileMax = min(tileMin + tileSize, resolution);
+
+			box3 bounds = GetFrustumSlabBounds(camera, float2(tileMin), float2(tileMax), fres,
+				slabDepths[slab], slabDepths[slab + 1]);
+
+			result.ranges[index] = PruneTape(tape, bounds, time, result.tapes[index]);
+		});
+
+		executor.run(taskflow).wait();
+	}
+
+	void PruneCells(tf::Executor& executor, const Tape& tape, const std::vector<box3>& cells, float time,
+		std::vector<Tape>& tapes, std::vector<Interval>* ranges)
+	{
+		tapes.resize(cells.size());
+		if (ranges)
+			ranges->resize(cells.size());
+
+		tf::Taskflow taskflow;
+		taskflow.for_each_index(size_t(0), cells.size(), size_t(1), [&](size_t index)
+		{
+			Interval range = PruneTape(tape, cells[index], time, tapes[index]);
+			if (ranges)
+				(*ranges)[index] = range;
+		});
+
+		executor.run(taskflow).wait();
+	}
+}
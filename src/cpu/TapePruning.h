@@ -0,0 +1,61 @@
+#pragma once
+
+// Region-specialized tapes.
+//
+// The interval evaluator in Interval.h bounds every subtree of a tape over a box. Wherever one side
+// of a min/max-like operator can never win inside the box, that side and the operator are dropped,
+// so the pruned tape gives the same (distance, material) as the full tape at every point of the box
+// while touching only the few primitives nearby (Keeter, "Massively Parallel Rendering of Complex
+// Closed-Form Implicit Surfaces", 2020).
+//
+// Pruned tapes are only valid inside their region and, with displace nodes, only at the time they
+// were pruned for.
+
+#include "Camera.h"
+#include "Interval.h"
+
+#include <vector>
+
+namespace tf
+{
+	class Executor;
+}
+
+namespace sdf
+{
+	// Writes the pruned tape and returns the range of the field over the region. The tracks of the kept
+	// instructions are kept, though the choices hold for the parameters the instructions have now.
+	Interval PruneTape(const Tape& tape, const box3& region, float time, Tape& pruned);
+
+	// Conservative bounds of the part of a pixel rectangle's frustum between the ray distances tNear and tFar.
+	box3 GetFrustumSlabBounds(const Camera& camera, const float2& pixelMin, const float2& pixelMax,
+		const float2& resolution, float tNear, float tFar);
+
+	// Pruned tapes for every screen tile, split along the view rays into slabs.
+	// slabDepths holds the slab boundaries in ray distance, at least two increasing values.
+	struct TileTapes
+	{
+		int tileSize = 0;
+		int2 tileCount = 0;
+		std::vector<float> slabDepths;
+		std::vector<Tape> tapes;
+		std::vector<Interval> ranges;
+
+		int GetSlabCount() const { return int(slabDepths.size()) - 1; }
+		int GetIndex(int tileX, int tileY, int slab) const { return (tileY * tileCount.x + tileX) * GetSlabCount() + slab; }
+		const Tape& GetTape(int tileX, int tileY, int slab) const { return tapes[GetIndex(tileX, tileY, slab)]; }
+
+		// Slab that contains the ray distance t, or -1 in front of the first one and beyond the last one,
+		// where only the full tape is valid.
+		int FindSlab(float t) const;
+
+		double GetAverageSize() const;
+	};
+
+	void PruneTiles(tf::Executor& executor, const Tape& tape, const Camera& camera, const int2& resolution,
+		int tileSize, const std::vector<float>& slabDepths, float time, TileTapes& result);
+
+	// Pruned tapes for a list of cells, e.g. the leaves of an octree.
+	void PruneCells(tf::Executor& executor, const Tape& tape, const std::vector<box3>& cells, float time,
+		std::vector<Tape>& tapes, std::vector<Interval>* ranges = nullptr);
+}
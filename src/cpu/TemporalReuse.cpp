@@ -0,0 +1,75 @@
+#include "TemporalReuse.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sdf
+{
+	float4 GetTemporalConstants(bool enable, float previousTime)
+	{
+		return float4(enable ? 1.f : 0.f, previousTime, 0.f, 0.f);
+	}
+
+	float GetTemporalStart(const RenderConstants& constants, const SceneMap& map, const HitHistory& history,
+		const float2& pixel, float tmin, RenderStats* stats)
+	{
+		const float2 resolution(constants.g_Resolution.x, constants.g_Resolution.y);
+		if (constants.g_Temporal.x == 0.f || history.width != int(resolution.x) || history.height != int(resolution.y))
+			return tmin;
+
+		// The pixel's own hit of the previous frame guesses where the ray meets the surface now.
+		const float2 guess = history.At(int(pixel.x), int(pixel.y));
+		if (guess.y < 0.f)
+			return tmin;
+
+		const Camera camera = Camera::Current(constants);
+		const Camera previous = Camera::Previous(constants);
+		const float3 rd = camera.PixelRay(pixel, resolution);
+
+		float2 previousPixel;
+		if (!previous.Project(camera.origin + rd * guess.x, resolution, previousPixel))
+			return tmin;
+		const int px = int(std::floor(previousPixel.x));
+		const int py = int(std::floor(previousPixel.y));
+		if (px < 0 || py < 0 || px >= history.width || py >= history.height)
+			return tmin;
+
+		// A surface can only come out in front of the hit next to where it was seen in front of it before.
+		// A nearer neighbour is fine where the opposite one continues the slope, as across a tilted surface,
+		// and farther ones are harmless: the march goes on to them.
+		const float2 hit = history.At(px, py);
+		if (hit.y < 0.f)
+			return tmin;
+		auto depth = [&](int x, int y)
+		{
+			const float2 neighbour = history.At(std::clamp(x, 0, history.width - 1), std::clamp(y, 0, history.height - 1));
+			return neighbour.y >= 0.f ? neighbour.x : hit.x;
+		};
+		const int2 directions[] = { int2(1, 0), int2(0, 1), int2(1, 1), int2(1, -1) };
+		for (const int2& d : directions)
+		{
+			const float a = depth(px + d.x, py + d.y);
+			const float b = depth(px - d.x, py - d.y);
+			if (std::min(a, b) < (1.0f - SDF_TEMPORAL_DEPTH_TOLERANCE) * hit.x && a + b < (2.0f - SDF_TEMPORAL_DEPTH_TOLERANCE) * hit.x)
+				return tmin;
+		}
+
+		// The surface point seen by the previous camera, brought onto the current ray.
+		const float3 surface = previous.origin + previous.PixelRay(float2(float(px) + 0.5f, float(py) + 0.5f), resolution) * hit.x;
+		const float seed = dot(surface - camera.origin, rd);
+		const float start = seed * (1.0f - SDF_TEMPORAL_BACKOFF);
+		if (start <= tmin || start >= SDF_RAY_END)
+			return tmin;
+
+		// The surface must still be there: just ahead of the start and of the same material.
+		const float2 h = map(camera.origin + rd * start);
+		if (stats)
+			stats->primarySteps++;
+		if (h.y != hit.y || h.x <= 0.f || h.x > 2.0f * SDF_TEMPORAL_BACKOFF * seed)
+			return tmin;
+
+		if (stats)
+			stats->temporalSeeds++;
+		return start;
+	}
+}
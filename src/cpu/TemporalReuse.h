@@ -0,0 +1,26 @@
+#pragma once
+
+// CPU port of the temporal reuse of primary hits in sdf_ps.hlsl.
+//
+// The orbit camera moves little from one frame to the next, so most surfaces a pixel sees were already
+// found by the previous frame, only from a slightly different place. Every frame keeps the distance and
+// material of its primary hits; the next frame projects its ray's guess of the surface into the previous
+// camera, takes the hit seen there and starts marching just in front of it instead of crossing the empty
+// space again. The checks that keep disoccluded and moving surfaces on the usual start are described
+// next to SDF_TEMPORAL_BACKOFF in sdf_cb.h, HitHistory in Renderer.h holds the hits.
+
+#include "Renderer.h"
+
+namespace sdf
+{
+	// g_Temporal for reusing the hits of a frame at time previousTime; enable = false turns the reuse off.
+	// A keyframed camera also needs the g_Camera* of that frame in g_PrevCamera*.
+	float4 GetTemporalConstants(bool enable, float previousTime);
+
+	// Start distance for a pixel, (0, 0) being the top-left corner of the image like in RenderPixel():
+	// in front of the reprojected hit of the previous frame when g_Temporal.x enables the reuse and the hit
+	// passes the checks, tmin otherwise. The history has to be as large as the image. The map() call of
+	// the check counts as a primary step of the stats, which may be null.
+	float GetTemporalStart(const RenderConstants& constants, const SceneMap& map, const HitHistory& history,
+		const float2& pixel, float tmin, RenderStats* stats = nullptr);
+}
@@ -0,0 +1,210 @@
+#ifndef SDF_CB_H
+#define SDF_CB_H
+
+// Structures shared between the shaders and the C++ code.
+// C++ files include this after "using namespace donut::math;", like the donut *_cb.h headers.
+
+// Mirrors cbuffer ConstantBuffer in SDF.hlsli; keep the two in the same order.
+struct RenderConstants
+{
+    float4 g_Time;
+    float4 g_Resolution;
+    int4 g_Switch;
+    float2 g_Factor;
+    float2 g_FactorPad;
+    int4 g_Scene;       // x: instructions in g_Tape evaluated for every point, y: nodes in g_Bvh; both 0 select the built-in map()
+    int4 g_Cone;        // x: tile size of the cone prepass in pixels, 0 disables it, y: tiles per row of g_ConeDepth
+    float4 g_Relax;     // x: step factor of the over-relaxed sphere tracing in raycast(), 1 is plain sphere tracing
+    int4 g_Heatmap;     // x: SDF_HEATMAP_* shown instead of the shaded image, y: evaluation count at the top of the color scale
+    float4 g_Temporal;  // x: 1 starts the primary rays at the reprojected hits of the previous frame in g_PrevHits, y: g_Time.x of that frame
+    int4 g_Lighting;    // x: pixels per side of a sample of g_LightingSamples, 0 evaluates the soft shadows and AO per pixel, y: samples per row
+    int4 g_Accumulate;  // x: 1 averages jittered samples in g_Accumulation, y: samples averaged before this frame's, z: 1 only shows g_Accumulation
+    float4 g_Camera;            // xyz: position of the keyframed camera, w: 1 looks from it at g_CameraTarget, 0 orbits with g_Time.x
+    float4 g_CameraTarget;      // xyz: point the keyframed camera looks at
+    float4 g_PrevCamera;        // g_Camera of the frame of g_Temporal.y
+    float4 g_PrevCameraTarget;  // g_CameraTarget of the frame of g_Temporal.y
+    int4 g_Occupancy;           // x: cells per side of the finest level of g_OccupancyBits, 0 disables the empty-space skipping, y: levels
+    float4 g_OccupancyGrid;     // xyz: lowest corner of the cube of g_OccupancyBits, w: side of a cell of its finest level
+    int4 g_Probes;              // xyz: probes per axis of g_ProbeIrradiance and g_ProbeDistance, 0 keeps the fixed sky light
+    float4 g_ProbeOrigin;       // xyz: position of probe (0, 0, 0), w: largest distance stored in g_ProbeDistance
+    float4 g_ProbeSpacing;      // xyz: distance between neighbouring probes, w: how far the shaded point is pushed off the surface
+};
+
+// Instrumentation: PS() counts its map() evaluations per shader function and can show one of the
+// counts as a heatmap. The cone prepass runs per tile and is not included.
+
+#define SDF_HEATMAP_OFF             0
+#define SDF_HEATMAP_TOTAL           1
+#define SDF_HEATMAP_PRIMARY         2   // raycast()
+#define SDF_HEATMAP_NORMAL          3   // calcNormal()
+#define SDF_HEATMAP_AO              4   // calcAO()
+#define SDF_HEATMAP_SHADOW          5   // calcSoftshadow()
+
+// Gradient used by calcNormal(), selected by the SDF_NORMALS permutation of sdf_ps.hlsl.
+
+#define SDF_NORMALS_CENTRAL         0   // central differences, 6 map() calls
+#define SDF_NORMALS_TETRAHEDRON     1   // differences along the corners of a tetrahedron, 4 map() calls
+#define SDF_NORMALS_DUAL            2   // forward-mode automatic differentiation, 1 call of mapDual()
+#define SDF_NORMALS_DEFAULT         SDF_NORMALS_TETRAHEDRON
+
+// Cone prepass: one cone per screen tile, enclosing the view rays of all its pixels, is marched
+// through empty space before the pixels are shaded. g_ConeDepth holds one float per tile, row by
+// row from the top-left tile: the ray distance every pixel ray of the tile can start marching from.
+// It is never below the fixed start distance of raycast() and at most its far distance.
+
+#define SDF_CONE_TILE_SIZE          8
+#define SDF_CONE_GROUP_SIZE         8   // tiles per thread group side in sdf_cone_cs.hlsl
+#define SDF_RAY_START               1.0f    // first ray distance of raycast()
+#define SDF_RAY_END                 20.0f   // ray distance where raycast() gives up
+#define SDF_RAY_RELAXATION          1.6f    // default g_Relax.x
+
+// Temporal reuse: PS() writes the primary hit of every pixel to g_Hits, float2(t, material) row by row
+// from the top-left pixel, -1 for misses, and the next frame reads them back as g_PrevHits. A ray whose
+// surface was seen by the previous camera starts marching a little in front of it. The hit is reused only
+// where none of the 3x3 pixels around it saw a nearer surface and map() still finds its material just ahead
+// of the start, so rays towards surfaces that were hidden before or have moved march from the usual start.
+
+#define SDF_TEMPORAL_BACKOFF        0.02f   // the march starts this fraction of the reprojected distance in front of it
+#define SDF_TEMPORAL_DEPTH_TOLERANCE 0.05f  // how much nearer than the hit, relatively, the 3x3 pixels around it may be
+
+// Reduced-resolution lighting: the two calcSoftshadow() and the calcAO() of a pixel are most of its map()
+// calls, and they vary slowly across a surface. With g_Lighting.x = n they are evaluated once per n x n pixels
+// by sdf_lighting_cs.hlsl, for the ray through the center of the block, into g_LightingSamples row by row from
+// the top-left block. PS() reconstructs them with a joint bilateral upsample: the 2x2 nearest samples are
+// weighted bilinearly and by how close their hit point is to the tangent plane of the pixel's and their
+// normal to its normal. A pixel that none of them resembles, on a silhouette or a crease, evaluates its
+// own terms.
+
+#define SDF_LIGHTING_GROUP_SIZE     8       // samples per thread group side in sdf_lighting_cs.hlsl
+#define SDF_LIGHTING_DEPTH_TOLERANCE 0.02f  // distance to the pixel's tangent plane, relative to its hit distance, where a sample's weight reaches 0
+#define SDF_LIGHTING_NORMAL_POWER   16.0f   // exponent of the cosine between the normals in a sample's weight
+#define SDF_LIGHTING_MIN_WEIGHT     0.05f   // below this total weight the pixel evaluates its own terms
+
+struct LightingSample
+{
+    float3 position;    // hit point
+    float t;            // hit distance, -1 for misses
+    float3 normal;
+    float occlusion;    // calcAO(), 1 when g_Switch.w disables it
+    float keyShadow;    // calcSoftshadow() towards the key light, 1 when g_Switch.y disables it
+    float skyShadow;    // calcSoftshadow() along the reflection for the sky specular, 1 when g_Switch.z disables it
+    float2 pad;
+};
+
+// Progressive accumulation: while the camera and g_Time stay the same, every frame renders one more
+// sample of each pixel, with the ray jittered inside the pixel and the key light direction jittered over
+// a small disc, and g_Accumulation keeps the linear mean of the samples so far. Sample 0 is the unjittered
+// image, so the first frame looks like a frame without accumulation, and the result converges to an
+// antialiased image with the shadows of an area light. Any change of the constants starts over; after
+// SDF_ACCUMULATE_MAX_SAMPLES samples the frames only show the result.
+
+#define SDF_ACCUMULATE_MAX_SAMPLES  256
+#define SDF_ACCUMULATE_LIGHT_RADIUS 0.04f   // radius of the key light disc, relative to its distance
+
+// Floor material of render(): its red is scaled by floorPattern() of SDFNoise.hlsli (sdf::FloorPattern() in
+// src/cpu/Noise.h), an fBm of gradient noise over the floor plane, so that the CPU and GPU renderers need no
+// texture and agree.
+
+#define SDF_FLOOR_NOISE_FREQUENCY   8.0f    // lattice cells per world unit of the first octave
+#define SDF_FLOOR_NOISE_OCTAVES     4
+
+// Keyframe animation: any parameter of a scene node, and the camera, can follow a track of keys (see
+// src/cpu/CsgScene.h). sdf::SceneAnimation evaluates all tracks of a frame on the CPU in one pass and writes
+// the changed instructions into the BVH tape, which is uploaded once per frame, and the camera into
+// g_Camera. The shaders only read parameters, so animating more primitives costs no more constants.
+
+// Empty-space skipping: g_OccupancyBits is a pyramid of bit grids over a cube around the scene, built by
+// sdf::OccupancyGrid (src/cpu/OccupancyGrid.h). A bit is set where the surface may pass through its cell,
+// and the cells inside a clear cell are clear. Level l, from the single cell of level 0 to the
+// g_Occupancy.x^3 cells of level g_Occupancy.y - 1, has n = g_Occupancy.x >> (g_Occupancy.y - 1 - l) cells
+// per side; cell (x, y, z) is bit (z * n + y) * n + x of the (n^3 + 31) / 32 words of the level, which
+// follow those of the coarser levels. Instead of sphere tracing through them, raycast() jumps in one
+// step across the coarsest clear cell around its point and the clear cells the ray goes on through, when
+// the ray is known to be empty up to the first.
+
+#define SDF_OCCUPANCY_MAX_SIZE      256     // largest g_Occupancy.x
+#define SDF_OCCUPANCY_MAX_CELLS     64      // clear cells one jump crosses at most
+#define SDF_OCCUPANCY_SKIP_MARGIN   0.001f  // a jump lands this fraction of a finest cell past the clear cell
+
+// Irradiance probes: with g_Probes.x set, the diffuse sky term of render() becomes the irradiance of a grid
+// of probes (after Majercik et al. 2019, "Dynamic Diffuse Global Illumination with Ray-Traced Irradiance
+// Fields"), so surfaces also receive the key and sky light bounced off the scene. sdf::ProbeGrid
+// (src/cpu/ProbeGrid.h) traces the rays of a few probes per frame on the CPU workers and blends them into
+// two octahedral maps per probe: the cosine-weighted irradiance around it and the mean distance and
+// squared distance to the surfaces. render() blends the 8 probes around the point, weighted by the
+// trilinear weights, the side of the surface they are on and how likely they see the point according to
+// their distances, so that light doesn't leak through walls. Probe p has the texels
+// [p * n * n, (p + 1) * n * n) of each map, row by row with n = SIZE + 2: the interior SIZE x SIZE texels
+// cover the octahedron and the border repeats the texels across its edges, so that bilinear lookups need
+// no wrapping. The alpha of g_ProbeIrradiance is 1 for the probes that hold light and 0 for those inside
+// a surface or not traced yet, which get no weight; with none around, render() keeps the fixed sky term.
+
+#define SDF_PROBE_IRRADIANCE_SIZE   6       // interior texels per side of the irradiance map of a probe
+#define SDF_PROBE_DISTANCE_SIZE     14      // interior texels per side of the distance map of a probe
+#define SDF_PROBE_DISTANCE_SHARPNESS 50.0f  // exponent of the cosine weight of a ray in the distance texels
+#define SDF_PROBE_MIN_WEIGHT        0.2f    // probe weights below this are crushed towards 0
+
+// Scene tape: a post-order list of CSG instructions evaluated on a small stack.
+// Primitives push (distance, material), unary operators modify the top entry,
+// binary operators pop two entries and push the result.
+
+#define SDF_TAPE_MAX_STACK 16
+
+#define SDF_OP_PLANE                0   // params: normal.xyz, offset
+#define SDF_OP_SPHERE               1   // params: center.xyz, radius
+#define SDF_OP_BOX                  2   // params: center.xyz, half size.xyz
+#define SDF_OP_BOX_FRAME            3   // params: center.xyz, half size.xyz, edge thickness
+#define SDF_OP_TORUS                4   // params: center.xyz, major radius, minor radius
+#define SDF_OP_CYLINDER             5   // params: center.xyz, radius, half height; flags: axis (0 = Z, 1 = X, 2 = Y)
+#define SDF_OP_OCTAHEDRON           6   // params: center.xyz, size
+#define SDF_OP_UNION                16
+#define SDF_OP_SUBTRACTION          17
+#define SDF_OP_INTERSECTION         18
+#define SDF_OP_SMOOTH_UNION         19  // params: k
+#define SDF_OP_SMOOTH_SUBTRACTION   20  // params: k
+#define SDF_OP_SMOOTH_INTERSECTION  21  // params: k
+#define SDF_OP_ROUND                32  // params: thickness
+#define SDF_OP_DISPLACE             33  // params: amplitude, frequency; flags: SDF_DISPLACE_KEYFRAMED
+#define SDF_OP_DISPLACE_NOISE       34  // params: amplitude, frequency, octaves; adds amplitude * valueFbm(p * frequency)
+#define SDF_OP_REPEAT               48  // params: period.xyz, 0 leaves an axis alone; flags: SDF_REPEAT_MIRROR
+#define SDF_OP_REPEAT_LIMITED       49  // params: period.xyz, cells.xyz on either side of the center cell; flags: SDF_REPEAT_MIRROR
+#define SDF_OP_REPEAT_POLAR         50  // params: center.xyz, sector count; around the Y axis, sector 0 faces +X
+#define SDF_OP_DOMAIN_END           63
+
+#define SDF_OP_FIRST_BINARY         16
+#define SDF_OP_FIRST_UNARY          32
+#define SDF_OP_FIRST_DOMAIN         48
+
+// Domain operators repeat the subtree between them and the matching SDF_OP_DOMAIN_END. The subtree is
+// evaluated in the local frame of the nearest instance and of its neighbour towards the sample on every
+// repeated axis (2 to 8 times), the results are united and clamped to a lower bound of the distance to
+// the instances that were skipped, so the field stays conservative at a constant cost per sample.
+// Every instance has to stay inside its cell: half a period around its center, or its polar sector.
+// The pair has no effect on the stack; domain operators nest up to SDF_TAPE_MAX_DOMAIN deep.
+
+#define SDF_TAPE_MAX_DOMAIN         4
+#define SDF_REPEAT_MIRROR           1   // odd cells are mirrored, so neighbouring instances face each other
+#define SDF_DISPLACE_KEYFRAMED      1   // flag of SDF_OP_DISPLACE: adds the amplitude as it is, animated by a track instead of g_Time
+
+// code packs the opcode (bits 0-7), the flags (bits 8-15) and the material id of primitives (bits 16-31).
+struct TapeInstruction
+{
+    uint code;
+    float params[7];
+};
+
+// Flattened BVH over the bounded top-level objects of a scene, built by sdf::SceneBvh (src/cpu/Bvh.h).
+// Nodes are stored depth first, so the left child of an interior node directly follows it.
+// Every leaf holds one object, a self-contained range of g_Tape.
+
+#define SDF_BVH_MAX_STACK 32
+
+struct BvhNode
+{
+    float3 boundsMin;
+    uint offset;        // interior nodes: index of the right child, leaves: first instruction of the object
+    float3 boundsMax;
+    uint count;         // interior nodes: 0, leaves: number of instructions of the object
+};
+
+#endif // SDF_CB_H
@@ -0,0 +1,56 @@
+// Cone prepass: one thread per g_Cone.x sized screen tile marches a cone that encloses the view rays
+// of the whole tile and stores how far all of them can skip ahead (see sdf_cb.h).
+// Must stay in sync with sdf::ConeMarch (src/cpu/ConePrepass.cpp).
+
+#include "SDF.hlsli"
+
+RWStructuredBuffer<float> u_ConeDepth : register(u0);
+
+// Every ray of the cone is known to be empty up to t. The sphere of radius d around the axis point
+// at t covers each ray up to t * cos(angle) + sqrt(d^2 - (t * sin(angle))^2), smallest on the
+// boundary of the cone, so that is where all rays are empty up to next.
+float coneMarch(float3 ro, float3 axis, float sinAngle, float cosAngle, int maxSteps)
+{
+    float t = SDF_RAY_START;
+    for (int i = 0; i < maxSteps && t < SDF_RAY_END; i++)
+    {
+        float d = map(ro + axis * t).x;
+        float r = t * sinAngle;
+        if (d <= r)
+            break;
+
+        float next = t * cosAngle + sqrt(d * d - r * r);
+        if (next <= t)
+            break;
+        t = next;
+    }
+    return min(t, SDF_RAY_END);
+}
+
+[numthreads(SDF_CONE_GROUP_SIZE, SDF_CONE_GROUP_SIZE, 1)]
+void CS(uint3 tile : SV_DispatchThreadID)
+{
+    uint tileSize = uint(g_Cone.x);
+    uint2 pixelMin = tile.xy * tileSize;
+    if (pixelMin.x >= uint(g_Resolution.x) || pixelMin.y >= uint(g_Resolution.y))
+        return;
+    uint2 pixelMax = min(pixelMin + tileSize, uint2(g_Resolution.xy));
+
+    float3 ro, uu, vv, ww;
+    getCamera(ro, uu, vv, ww);
+
+    // Tile corners in fragCoord, which starts at the bottom of the screen.
+    float2 fragMin = float2(pixelMin.x, g_Resolution.y - pixelMax.y);
+    float2 fragMax = float2(pixelMax.x, g_Resolution.y - pixelMin.y);
+    float3 axis = cameraRay(0.5 * (fragMin + fragMax), uu, vv, ww);
+
+    // The rays through a rectangle of the image plane stay inside the cone through its corners.
+    float cosAngle = 1.0;
+    cosAngle = min(cosAngle, dot(axis, cameraRay(float2(fragMin.x, fragMin.y), uu, vv, ww)));
+    cosAngle = min(cosAngle, dot(axis, cameraRay(float2(fragMax.x, fragMin.y), uu, vv, ww)));
+    cosAngle = min(cosAngle, dot(axis, cameraRay(float2(fragMin.x, fragMax.y), uu, vv, ww)));
+    cosAngle = min(cosAngle, dot(axis, cameraRay(float2(fragMax.x, fragMax.y), uu, vv, ww)));
+    float sinAngle = sqrt(saturate(1.0 - cosAngle * cosAngle));
+
+    u_ConeDepth[tile.y * uint(g_Cone.y) + tile.x] = coneMarch(ro, axis, sinAngle, cosAngle, (int)g_Factor.x);
+}
@@ -0,0 +1,58 @@
+// Reduced-resolution lighting: one thread per g_Lighting.x sized block of pixels casts the ray through
+// the center of the block and stores the soft shadows and the ambient occlusion at its hit, with the
+// hit point and normal PS() needs to upsample them (see sdf_cb.h).
+// Must stay in sync with sdf::RenderLightingPass (src/cpu/LightingPass.cpp).
+
+#include "SDF.hlsli"
+
+StructuredBuffer<float> g_ConeDepth : register(t3);
+RWStructuredBuffer<LightingSample> u_LightingSamples : register(u0);
+
+[numthreads(SDF_LIGHTING_GROUP_SIZE, SDF_LIGHTING_GROUP_SIZE, 1)]
+void CS(uint3 id : SV_DispatchThreadID)
+{
+    uint scale = uint(g_Lighting.x);
+    uint2 count = uint2(g_Lighting.y, (uint(g_Resolution.y) + scale - 1) / scale);
+    if (id.x >= count.x || id.y >= count.y)
+        return;
+
+    // The center of the block, also for the blocks cut by the edges of the screen, so that the
+    // upsample can place every sample on the same grid.
+    float2 pixel = (float2(id.xy) + 0.5) * float(scale);
+
+    float3 ro, uu, vv, ww;
+    getCamera(ro, uu, vv, ww);
+    float3 rd = cameraRay(float2(pixel.x, g_Resolution.y - pixel.y), uu, vv, ww);
+
+    float tmin = SDF_RAY_START;
+    if (g_Cone.x > 0)
+    {
+        uint2 tile = uint2(min(pixel, g_Resolution.xy - 0.5)) / uint(g_Cone.x);
+        tmin = g_ConeDepth[tile.y * uint(g_Cone.y) + tile.x];
+    }
+
+    LightingSample result;
+    result.position = float3(0.0, 0.0, 0.0);
+    result.t = -1.0;
+    result.normal = float3(0.0, 0.0, 0.0);
+    result.occlusion = 0.0;
+    result.keyShadow = 0.0;
+    result.skyShadow = 0.0;
+    result.pad = float2(0.0, 0.0);
+
+    float2 res = raycast(ro, rd, (int)g_Factor.x, tmin);
+    if (res.y >= 0.0)
+    {
+        float3 pos = ro + res.x * rd;
+        float3 nor = (res.y < 1.5) ? float3(0.0, 1.0, 0.0) : calcNormal(pos, res.x);
+        float3 terms = calcLightingTerms(pos, nor, rd);
+        result.position = pos;
+        result.t = res.x;
+        result.normal = nor;
+        result.occlusion = terms.x;
+        result.keyShadow = terms.y;
+        result.skyShadow = terms.z;
+    }
+
+    u_LightingSamples[id.y * count.x + id.x] = result;
+}
@@ -1,7 +1,15 @@
 #include "SDF.hlsli"
+#include "SDFProbes.hlsli"
 
-Texture2D g_Tex : register(t0);
-SamplerState g_SamLinear : register(s0);
+// ׶Ԥͨдÿֿʼн
+StructuredBuffer<float> g_ConeDepth : register(t3);
+// ʱãһ֡ÿص(t, )֡дg_Hitsһ֡ʹ
+StructuredBuffer<float2> g_PrevHits : register(t4);
+RWStructuredBuffer<float2> g_Hits : register(u1);
+// ֱʹͨ(sdf_lighting_cs.hlsl)дӰͻڱ
+StructuredBuffer<LightingSample> g_LightingSamples : register(t5);
+// ۻۻɫֵ
+RWTexture2D<float4> g_Accumulation : register(u2);
 
 struct VertexOut
 {
@@ -11,38 +19,110 @@ struct VertexOut
 
 
 
-// Ͷ
-float2 raycast(float3 ro, float3 rd, int mnum)
+// һ֡УĻʱδ
+float2 prevHit(int2 pixel)
 {
-    float2 res = float2(-1.0, -1.0);
+    int2 size = int2(g_Resolution.xy);
+    if (any(pixel < 0) || any(pixel >= size))
+        return float2(-1.0, -1.0);
+    return g_PrevHits[pixel.y * size.x + pixel.x];
+}
 
-    //н
-    float tmax = 20.0;
-    
-    //н
-    //ʼн
-    float t = 1.0;
-    for (int i = 0; i < mnum && t < tmax; i++)
+// ʱõʼ(CPU汾src/cpu/TemporalReuse.cpp)
+// ñһ֡йƱλãͶӰһ֡ȡе㣬
+// ͶǰϣǰSDF_TEMPORAL_BACKOFFʼн鲻ͨʱtmin
+float temporalStart(float3 ro, float3 rd, float2 pixel, float tmin)
+{
+    if (g_Temporal.x == 0.0)
+        return tmin;
+
+    float2 guess = prevHit(int2(pixel));
+    if (guess.y < 0.0)
+        return tmin;
+
+    float3 pro, puu, pvv, pww;
+    getPreviousCamera(pro, puu, pvv, pww);
+    float2 prevPixel;
+    if (!projectCamera(ro + rd * guess.x, pro, puu, pvv, pww, prevPixel))
+        return tmin;
+    int2 p = int2(floor(prevPixel));
+    float2 hit = prevHit(p);
+    if (hit.y < 0.0)
+        return tmin;
+
+    // ȥڵֻһ֡ıԱߣھӱԲھӹб
+    int2 dirs[4] = { int2(1, 0), int2(0, 1), int2(1, 1), int2(1, -1) };
+    int2 size = int2(g_Resolution.xy);
+    for (int i = 0; i < 4; i++)
+    {
+        float2 na = prevHit(clamp(p + dirs[i], int2(0, 0), size - 1));
+        float2 nb = prevHit(clamp(p - dirs[i], int2(0, 0), size - 1));
+        float a = na.y >= 0.0 ? na.x : hit.x;
+        float b = nb.y >= 0.0 ? nb.x : hit.x;
+        if (min(a, b) < (1.0 - SDF_TEMPORAL_DEPTH_TOLERANCE) * hit.x && a + b < (2.0 - SDF_TEMPORAL_DEPTH_TOLERANCE) * hit.x)
+            return tmin;
+    }
+
+    // һ֡ıͶǰ
+    float3 surface = pro + cameraRay(float2(p.x + 0.5, g_Resolution.y - (p.y + 0.5)), puu, pvv, pww) * hit.x;
+    float seed = dot(surface - ro, rd);
+    float start = seed * (1.0 - SDF_TEMPORAL_BACKOFF);
+    if (start <= tmin || start >= SDF_RAY_END)
+        return tmin;
+
+    // ǰԶҲͬ
+    float2 h = map(ro + rd * start);
+    s_Evaluations.x++;
+    if (h.y != hit.y || h.x <= 0.0 || h.x > 2.0 * SDF_TEMPORAL_BACKOFF * seed)
+        return tmin;
+    return start;
+}
+
+// ˫ϲ(CPU汾src/cpu/LightingPass.cpp)
+// ȡΧ2x2˫Ȩءе㵽ƽľԼߵĽӽ̶ȼȨ
+// ȨعСʱ(ۺ۴)falseԼ
+bool upsampleLighting(float2 pixel, float3 pos, float3 nor, float t, out float3 terms)
+{
+    terms = float3(1.0, 1.0, 1.0);
+    int2 count = int2(g_Lighting.y, (int(g_Resolution.y) + g_Lighting.x - 1) / g_Lighting.x);
+    // λڿģϷĲϷ鴦
+    float2 u = pixel / float(g_Lighting.x) - 0.5;
+    int2 base = int2(floor(u));
+    float2 f = u - float2(base);
+
+    float weightSum = 0.0;
+    float3 sum = float3(0.0, 0.0, 0.0);
+    for (int j = 0; j < 2; j++)
     {
-        float2 h = map(ro + rd * t);
-        if (abs(h.x) < (0.0001 * t))
+        for (int i = 0; i < 2; i++)
         {
-            res = float2(t, h.y);
-            break;
+            int2 s = clamp(base + int2(i, j), int2(0, 0), count - 1);
+            LightingSample ls = g_LightingSamples[s.y * count.x + s.x];
+            if (ls.t < 0.0)
+                continue;
+
+            float weight = (i ? f.x : 1.0 - f.x) * (j ? f.y : 1.0 - f.y);
+            weight *= saturate(1.0 - abs(dot(ls.position - pos, nor)) / (SDF_LIGHTING_DEPTH_TOLERANCE * t));
+            weight *= pow(saturate(dot(ls.normal, nor)), SDF_LIGHTING_NORMAL_POWER);
+            weightSum += weight;
+            sum += weight * float3(ls.occlusion, ls.keyShadow, ls.skyShadow);
         }
-        t += h.x;
     }
-    
-    return res;
+
+    if (weightSum < SDF_LIGHTING_MIN_WEIGHT)
+        return false;
+    terms = sum / weightSum;
+    return true;
 }
 
-float3 render(in float3 ro, in float3 rd)
+float3 render(in float3 ro, in float3 rd, float tmin, float2 pixel, out float2 hit)
 {
     // Ĭɫɫ
     float3 col = float3(0, 0, 0);
     
     // Ͷ
-    float2 res = raycast(ro, rd, (int) g_Factor.x);
+    float2 res = raycast(ro, rd, (int) g_Factor.x, tmin);
+    hit = res;
     // н
     float t = res.x;
     // ʲ
@@ -63,28 +143,27 @@ float3 render(in float3 ro, in float3 rd)
             if (m == 0)
             {
                 col = float3(.3, .0, .0);
-                //
-                col = col * g_Tex.Sample(g_SamLinear, float2(pos.x, pos.z)).rgb;
+                //CPUȾsdf::FloorPattern()һ
+                col = col * floorPattern(float2(pos.x, pos.z));
             }
         }
         
         //ɫ
         float3 lin = float3(0, 0, 0);
 
+        // ӰͻڱΣֱʹʱӲϲ
+        float3 terms;
+        if (g_Lighting.x <= 1 || !upsampleLighting(pixel, pos, nor, t, terms))
+            terms = calcLightingTerms(pos, nor, rd);
+
         // ڱ
-        float occ = float3(1, 1, 1);
-        if (g_Switch.w == 1)
-        {
-            occ = calcAO(pos, nor);
-        }
+        float occ = terms.x;
         
         // 
         if (g_Switch.y == 1)
         {
             // ligΪԵǰposΪԭʱԴλ
-            // ʱƶ
-            // xzƽԲ˶,yƶ
-            float3 lig = normalize(float3(2 * sin(fmod(g_Time.x, 6.28)), 1.5 + cos(fmod(g_Time.x, 6.28)), 2 * cos(fmod(g_Time.x, 6.28))));
+            float3 lig = keyLightDir();
             
             // 
             float3 hal = normalize(lig - rd);
@@ -93,7 +172,7 @@ float3 render(in float3 ro, in float3 rd)
             // ϻڱ
             dif *= occ;
             // Ӱ
-            dif *= calcSoftshadow(pos, lig, 0.02, 2.5, g_Factor.y);
+            dif *= terms.y;
             // blinn-phong߹
             float spe = pow(clamp(dot(nor, hal), 0.0, 1.0), 16.0);
             // 
@@ -112,10 +191,14 @@ float3 render(in float3 ro, in float3 rd)
             // ߹⣬߷䷽ԽԽǿ
             float spe = smoothstep(-0.2, 0.2, ref.y);
             // Ӱ
-            spe *= calcSoftshadow(pos, ref, 0.02, 2.5, g_Factor.y);
+            spe *= terms.z;
             // 
             spe *= 5.0 * pow(clamp(1.0 + dot(nor, rd), 0.0, 1.0), 5.0);
-            lin += col * 0.60 * dif * float3(0.4, 0.6, 1.15);
+            // ն̽ʱȡ̽񣬰Ĺ
+            if (g_Probes.x != 0)
+                lin += col * probeIrradiance(pos, nor, rd) * occ;
+            else
+                lin += col * 0.60 * dif * float3(0.4, 0.6, 1.15);
             lin += spe;
         }
 
@@ -131,40 +214,54 @@ float3 render(in float3 ro, in float3 rd)
 
 float4 PS(VertexOut pIn) : SV_Target
 {
-    float2 fragCoord = pIn.tex * g_Resolution.xy;
- 
-    // ĻΪĻϵԭ㣬xyᵥλһ£õǰϵµλ
-    float2 p = (2.0 * fragCoord - g_Resolution.xy) / g_Resolution.y;
+    uint2 pixel = uint2(pIn.posH.xy);
 
-    // 
-    const float fl = 3;
-        
-// ˶ animaton
-    float an = 0.5 * (g_Time.x - 10.0);
-    // λ ray origin 
-    float3 ro = float3(4.0 * cos(an), 0.4, 4.0 * sin(an));
-    // Ŀλ lookat-target
-    float3 ta = float3(0.0, 0.0, 0.0);
-    // forward vector,ϵZ
-    float3 ww = normalize(ta - ro);
-    // up vectorõϵX
-    float3 uu = normalize(cross(ww, float3(0.0, 1.0, 0.0)));
-    // ϵY
-    float3 vv = normalize(cross(uu, ww));
-
-    float3 tot = float3(0.0, 0.0, 0.0);
-    
+    // ۻĻֻʾ
+    if (g_Accumulate.x != 0 && g_Accumulate.z != 0)
+        return float4(pow(g_Accumulation[pixel].rgb, 0.4545), 1.0);
+
+    // ۻģʽ¹ڶfragCoordԭ½ǣyposH෴
+    float2 jitter = sampleJitter();
+    float2 samplePos = pIn.posH.xy + jitter;
+    float2 fragCoord = pIn.tex * g_Resolution.xy + float2(jitter.x, -jitter.y);
+
+    float3 ro, uu, vv, ww;
+    getCamera(ro, uu, vv, ww);
 
 	// ߷
-    float3 rd = normalize(p.x * uu + p.y * vv + 1.5 * ww);
-    
-    // Ⱦ
-    float3 col = render(ro, rd);
-        
-    // gamma룬ϸ
-    col = pow(col, float3(0.4545, 0.4545, 0.4545));
+    float3 rd = cameraRay(fragCoord, uu, vv, ww);
+
+    // ׶Ԥͨʼ룬posHԭĻϽ
+    float tmin = SDF_RAY_START;
+    if (g_Cone.x > 0)
+    {
+        uint2 tile = uint2(samplePos) / uint(g_Cone.x);
+        tmin = g_ConeDepth[tile.y * uint(g_Cone.y) + tile.x];
+    }
+    // һ֡ͶӰеǰ
+    tmin = temporalStart(ro, rd, samplePos, tmin);
+
+    // Ⱦ¼йһ֡
+    float2 hit;
+    float3 col = render(ro, rd, tmin, samplePos, hit);
+    g_Hits[pixel.y * uint(g_Resolution.x) + pixel.x] = hit;
+
+    // ͼģʽmap()ôһsRGB룬תԿռ
+    if (g_Heatmap.x != SDF_HEATMAP_OFF)
+        col = pow(heatmapColor(selectEvaluations(s_Evaluations), uint(g_Heatmap.y)), 2.2);
+    else
+        // gamma룬ϸ
+        col = pow(col, float3(0.4545, 0.4545, 0.4545));
+
+    // ѱ֡ĲԿռľֵ0¿ʼۻ
+    if (g_Accumulate.x != 0)
+    {
+        float3 mean = g_Accumulate.y == 0 ? float3(0.0, 0.0, 0.0) : g_Accumulation[pixel].rgb;
+        mean += (pow(col, 2.2) - mean) / float(g_Accumulate.y + 1);
+        g_Accumulation[pixel] = float4(mean, 1.0);
+        col = pow(mean, 0.4545);
+    }
 
-    
     float4 fragColor = float4(col, 1.0);
     return fragColor;
    
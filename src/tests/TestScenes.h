@@ -0,0 +1,79 @@
+#pragma once
+
+// Scenes and comparisons shared by the tests.
+
+#include "../cpu/Bvh.h"
+#include "../cpu/Renderer.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+#include <json/reader.h>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+namespace sdf
+{
+	// Relative comparison for results that went through different rounding.
+	inline bool Near(float a, float b, float eps = 1e-5f)
+	{
+		return std::fabs(a - b) <= eps * (1.0f + std::fabs(b));
+	}
+
+	// Null when the text isn't valid JSON or the scene in it is invalid.
+	inline std::unique_ptr<CsgNode> ParseString(const char* text)
+	{
+		Json::Value root;
+		Json::CharReaderBuilder builder;
+		std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+		if (!reader->parse(text, text + std::strlen(text), &root, nullptr))
+			return nullptr;
+		return ParseCsgNode(root);
+	}
+
+	inline Tape Compile(const CsgNode& root)
+	{
+		Tape tape;
+		CHECK(CompileTape(root, tape));
+		return tape;
+	}
+
+	// The tape of a scene file in src/Scene.
+	inline Tape LoadSceneTape(const char* name)
+	{
+		donut::vfs::NativeFileSystem fs;
+		std::unique_ptr<CsgNode> root = LoadCsgScene(fs, std::filesystem::path(SDF_TEST_SOURCE_DIR) / "Scene" / name);
+		CHECK(root != nullptr);
+		return Compile(*root);
+	}
+
+	inline Tape LoadDefaultTape()
+	{
+		return LoadSceneTape("default.json");
+	}
+
+	inline SceneBvh LoadDefaultBvh()
+	{
+		SceneBvh bvh;
+		CHECK(bvh.Build(LoadDefaultTape()));
+		return bvh;
+	}
+
+	// The built-in map() at the time the golden image shows.
+	inline SceneMap GetBuiltinScene()
+	{
+		SceneMap map;
+		map.time = 10.0f;
+		return map;
+	}
+
+	inline SceneMap GetMap(const SceneBvh& bvh, float time)
+	{
+		SceneMap map;
+		map.bvh = &bvh;
+		map.time = time;
+		return map;
+	}
+}
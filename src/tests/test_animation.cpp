@@ -0,0 +1,329 @@
+#include "../cpu/Bvh.h"
+#include "../cpu/Camera.h"
+#include "../cpu/Interval.h"
+#include "../cpu/SceneAnimation.h"
+#include "../cpu/TapePruning.h"
+#include "../cpu/TemporalReuse.h"
+#include "TestScenes.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <json/reader.h>
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	Json::Value ParseJson(const char* text)
+	{
+		Json::Value root;
+		Json::CharReaderBuilder builder;
+		std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+		CHECK(reader->parse(text, text + std::strlen(text), &root, nullptr));
+		return root;
+	}
+
+	// The tape with the parameters of the last Evaluate() written into it.
+	Tape Pose(const Tape& tape, const SceneAnimation& animation)
+	{
+		Tape posed = tape;
+		for (size_t i = 0; i < animation.GetInstructionCount(); i++)
+			std::memcpy(posed.instructions[animation.GetInstruction(i)].params, animation.GetParameters(i), 7 * sizeof(float));
+		return posed;
+	}
+
+	void CheckMatchesTape(const Tape& tape, const SceneBvh& bvh, float time)
+	{
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> dist(-2.5f, 2.5f);
+		for (int i = 0; i < 2000; i++)
+		{
+			Vec3<float> p(dist(rng), dist(rng) * 0.5f + 0.8f, dist(rng));
+			Vec2<float> expected = EvaluateTape(tape, p, time);
+			Vec2<float> actual = EvaluateBvh(bvh, p, time);
+			CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+			CHECK(expected.y == actual.y);
+		}
+	}
+}
+
+void test_animation_tracks()
+{
+	auto node = ParseString(R"({
+		"type": "sphere", "position": [1, 2, 3], "radius": 0.5,
+		"animate": {
+			"radius": { "keys": [[1, 0.5], [3, 1.5]] },
+			"position": { "mode": "step", "loop": true, "keys": [[0, 0, 0, 0], [1, 1, 1, 1], [2, 0, 0, 0]] }
+		}
+	})");
+	CHECK(node != nullptr && node->tracks.size() == 2);
+
+	const CsgTrack* radius = nullptr;
+	const CsgTrack* position = nullptr;
+	for (const CsgTrack& track : node->tracks)
+		(track.param == 3 ? radius : position) = &track;
+	CHECK(radius && radius->components == 1 && !radius->loop);
+	CHECK(position && position->param == 0 && position->components == 3 && position->loop);
+
+	// Linear between the keys, held outside of them.
+	CHECK(Near(radius->Evaluate(2.f).x, 1.0f));
+	CHECK(Near(radius->Evaluate(-5.f).x, 0.5f));
+	CHECK(Near(radius->Evaluate(10.f).x, 1.5f));
+
+	// Steps, repeated every 2 seconds either way.
+	CHECK(position->Evaluate(0.5f).y == 0.f);
+	CHECK(position->Evaluate(1.5f).y == 1.f);
+	CHECK(position->Evaluate(5.5f).z == 1.f);
+	CHECK(position->Evaluate(-0.5f).x == 1.f);
+
+	// An animated amplitude takes over the motion of the displacement.
+	auto displace = ParseString(R"({
+		"type": "displace", "amplitude": 0.2, "animate": { "amplitude": { "keys": [[0, 0], [1, 0.1]] } },
+		"children": [ { "type": "sphere" } ]
+	})");
+	CHECK(displace != nullptr && (displace->flags & SDF_DISPLACE_KEYFRAMED));
+	auto still = ParseString(R"({ "type": "displace", "children": [ { "type": "sphere" } ] })");
+	CHECK(still != nullptr && still->flags == 0);
+
+	// Parameters the node doesn't have, malformed keys, and keys that would break the operator.
+	CHECK(!ParseString(R"({ "type": "sphere", "animate": { "size": { "keys": [[0, 1]] } } })"));
+	CHECK(!ParseString(R"({ "type": "repeat", "animate": { "period": { "keys": [[0, 1, 1, 1]] } }, "children": [ { "type": "sphere" } ] })"));
+	CHECK(!ParseString(R"({ "type": "sphere", "animate": { "radius": { "keys": [[0, 1, 2]] } } })"));
+	CHECK(!ParseString(R"({ "type": "sphere", "animate": { "radius": { "keys": [[1, 1], [0, 2]] } } })"));
+	CHECK(!ParseString(R"({ "type": "sphere", "animate": { "radius": { "keys": [] } } })"));
+	CHECK(!ParseString(R"({ "type": "sphere", "animate": { "radius": { "mode": "cubic", "keys": [[0, 1]] } } })"));
+	CHECK(!ParseString(R"({ "type": "smoothUnion", "animate": { "k": { "keys": [[0, 0.2], [1, 0]] } },
+		"children": [ { "type": "sphere" }, { "type": "box" } ] })"));
+
+	// A spline through these keys of k dips below zero after the second one, the lines between them don't.
+	CHECK(!ParseString(R"({ "type": "smoothUnion", "animate": { "k": { "mode": "spline", "keys": [[0, 1], [1, 0.01], [2, 0.01]] } },
+		"children": [ { "type": "sphere" }, { "type": "box" } ] })"));
+	CHECK(ParseString(R"({ "type": "smoothUnion", "animate": { "k": { "mode": "linear", "keys": [[0, 1], [1, 0.01], [2, 0.01]] } },
+		"children": [ { "type": "sphere" }, { "type": "box" } ] })"));
+}
+
+void test_animation_compile()
+{
+	// The smooth union of three children is two instructions, both follow its track.
+	auto root = ParseString(R"({
+		"type": "union",
+		"children": [
+			{ "type": "plane" },
+			{
+				"type": "smoothUnion", "k": 0.2,
+				"animate": { "k": { "keys": [[0, 0.1], [1, 0.3]] } },
+				"children": [
+					{ "type": "sphere", "position": [0, 0.5, 0], "animate": { "radius": { "keys": [[0, 0.2], [1, 0.4]] } } },
+					{ "type": "box", "position": [0.5, 0.5, 0] },
+					{ "type": "sphere", "position": [-0.5, 0.5, 0] }
+				]
+			}
+		]
+	})");
+	CHECK(root != nullptr);
+
+	Tape tape = Compile(*root);
+	CHECK(tape.tracks.size() == 3);
+	for (size_t i = 0; i < tape.tracks.size(); i++)
+	{
+		const TapeTrack& track = tape.tracks[i];
+		CHECK(i == 0 || tape.tracks[i - 1].instruction < track.instruction);
+		const uint32_t opcode = GetOpcode(tape.instructions[track.instruction]);
+		CHECK(opcode == (track.track.param == 3 ? SDF_OP_SPHERE : SDF_OP_SMOOTH_UNION));
+	}
+
+	// Copies and saved tapes are still.
+	std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_test_animation.tape";
+	CHECK(SaveTape(tape, fileName));
+	vfs::NativeFileSystem fs;
+	Tape loaded;
+	loaded.tracks = tape.tracks;
+	CHECK(LoadTape(fs, fileName, loaded));
+	CHECK(loaded.tracks.empty() && loaded.Size() == tape.Size());
+	std::filesystem::remove(fileName);
+}
+
+void test_animation_pruning()
+{
+	auto root = ParseString(R"({
+		"type": "union",
+		"children": [
+			{ "type": "plane" },
+			{
+				"type": "smoothUnion", "k": 0.2,
+				"animate": { "k": { "keys": [[0, 0.1], [1, 0.3]] } },
+				"children": [
+					{ "type": "sphere", "position": [0, 1.5, 0], "animate": { "radius": { "keys": [[0, 0.2], [1, 0.4]] } } },
+					{ "type": "box", "position": [0.5, 1.5, 0], "size": [0.2, 0.2, 0.2] }
+				]
+			}
+		]
+	})");
+	CHECK(root != nullptr);
+	Tape tape = Compile(*root);
+	CHECK(tape.tracks.size() == 2);
+
+	// Around the objects the plane is dropped, and the tracks move with their instructions.
+	Tape pruned;
+	PruneTape(tape, box3(float3(-0.1f, 1.4f, -0.1f), float3(0.6f, 1.6f, 0.1f)), 0.f, pruned);
+	CHECK(pruned.Size() == tape.Size() - 2 && pruned.tracks.size() == 2);
+	for (size_t i = 0; i < pruned.tracks.size(); i++)
+	{
+		const TapeTrack& track = pruned.tracks[i];
+		const TapeTrack& source = tape.tracks[i];
+		CHECK(track.track.param == source.track.param && track.instruction < pruned.Size());
+		CHECK(std::memcmp(&pruned.instructions[track.instruction], &tape.instructions[source.instruction], sizeof(TapeInstruction)) == 0);
+	}
+
+	// Around the sphere alone the smooth union goes with the track of its k.
+	PruneTape(tape, box3(float3(-0.1f, 1.4f, -0.1f), float3(0.1f, 1.6f, 0.1f)), 0.f, pruned);
+	CHECK(pruned.Size() == 1 && pruned.tracks.size() == 1);
+	CHECK(pruned.tracks[0].instruction == 0 && GetOpcode(pruned.instructions[0]) == SDF_OP_SPHERE);
+
+	// Below the floor the animated objects are dropped with their tracks.
+	PruneTape(tape, box3(float3(-1.f, -3.f, -1.f), float3(1.f, -2.f, 1.f)), 0.f, pruned);
+	CHECK(pruned.Size() == 1 && GetOpcode(pruned.instructions[0]) == SDF_OP_PLANE && pruned.tracks.empty());
+}
+
+void test_animation_evaluate()
+{
+	vfs::NativeFileSystem fs;
+	std::unique_ptr<CsgCamera> camera;
+	std::unique_ptr<CsgNode> root = LoadCsgScene(fs, std::filesystem::path(SDF_TEST_SOURCE_DIR) / "Scene/animated.json", &camera);
+	CHECK(root != nullptr && camera != nullptr);
+
+	Tape tape = Compile(*root);
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+
+	SceneAnimation animation;
+	animation.Bind(tape, camera.get());
+	CHECK(animation.IsAnimated() && animation.HasCamera());
+	CHECK(animation.GetTrackCount() == tape.tracks.size());
+
+	// The first evaluation writes every animated instruction, the same time again none.
+	CHECK(animation.Evaluate(0.3f, bvh) == animation.GetInstructionCount());
+	CHECK(bvh.IsDirty());
+	bvh.Refit();
+	CHECK(animation.Evaluate(0.3f, bvh) == 0 && !bvh.IsDirty());
+	CheckMatchesTape(Pose(tape, animation), bvh, 0.3f);
+
+	// Later frames refit the objects that moved, and the BVH keeps matching the posed tape.
+	for (float time : { 0.8f, 1.7f, 2.9f, 13.1f })
+	{
+		CHECK(animation.Evaluate(time, bvh) > 0);
+		CHECK(bvh.Refit() > 0);
+		CheckMatchesTape(Pose(tape, animation), bvh, time);
+	}
+
+	// The bouncing sphere is at the top of its track after 0.6 seconds, and every 1.2 seconds after.
+	animation.Evaluate(1.8f, bvh);
+	bool found = false;
+	for (size_t i = 0; i < animation.GetInstructionCount(); i++)
+	{
+		const float* params = animation.GetParameters(i);
+		if (GetOpcode(tape.instructions[animation.GetInstruction(i)]) == SDF_OP_SPHERE && params[0] == -1.5f)
+		{
+			CHECK(Near(params[1], 1.2f) && params[3] == 0.3f);
+			found = true;
+		}
+	}
+	CHECK(found);
+
+	// A keyframed displacement adds its amplitude whatever the time.
+	auto displace = ParseString(R"({
+		"type": "displace", "animate": { "amplitude": { "keys": [[0, 0], [1, 0.1]] } },
+		"children": [ { "type": "sphere", "radius": 0.5 } ]
+	})");
+	CHECK(displace != nullptr);
+	Tape displaceTape = Compile(*displace);
+	SceneBvh displaceBvh;
+	CHECK(displaceBvh.Build(displaceTape));
+	SceneAnimation displaceAnimation;
+	displaceAnimation.Bind(displaceTape, nullptr);
+	displaceAnimation.Evaluate(0.5f, displaceBvh);
+	Tape posed = Pose(displaceTape, displaceAnimation);
+	for (float time : { 0.f, 1.f, 7.f })
+	{
+		CHECK(Near(EvaluateTape(posed, Vec3<float>(1.f, 0.f, 0.f), time).x, 0.55f));
+		Interval range = EvaluateTape(posed, box3(float3(0.9f, -0.1f, -0.1f), float3(1.1f, 0.1f, 0.1f)), time);
+		CHECK(range.lo <= 0.55f && 0.55f <= range.hi);
+	}
+}
+
+void test_animation_camera()
+{
+	CsgCamera camera;
+	CHECK(ParseCsgCamera(ParseJson(R"({
+		"target": [0, 0.5, 0],
+		"animate": { "position": { "keys": [[0, 2, 1, 0], [2, 0, 1, 2]] } }
+	})"), camera));
+
+	SceneAnimation animation;
+	Tape still;
+	animation.Bind(still, &camera);
+	CHECK(!animation.IsAnimated() && animation.HasCamera());
+
+	RenderConstants constants = GetDefaultRenderConstants(1.0f, 64, 36);
+	animation.GetCameraConstants(1.0f, constants.g_Camera, constants.g_CameraTarget);
+	CHECK(constants.g_Camera.w == 1.f);
+	CHECK(all(constants.g_Camera.xyz() == float3(1.f, 1.f, 1.f)) && all(constants.g_CameraTarget.xyz() == float3(0.f, 0.5f, 0.f)));
+
+	Camera current = Camera::Current(constants);
+	CHECK(all(current.origin == float3(1.f, 1.f, 1.f)));
+	CHECK(length(current.forward - normalize(float3(-1.f, -0.5f, -1.f))) < 1e-6f);
+
+	// The previous frame keeps orbiting without a keyframed camera of its own.
+	constants.g_Temporal = GetTemporalConstants(true, 9.0f);
+	CHECK(length(Camera::Previous(constants).origin - Camera::Orbit(9.0f).origin) < 1e-6f);
+	constants.g_PrevCamera = float4(2.f, 1.f, 0.f, 1.f);
+	constants.g_PrevCameraTarget = constants.g_CameraTarget;
+	CHECK(all(Camera::Previous(constants).origin == float3(2.f, 1.f, 0.f)));
+
+	// Without a camera the constants select the orbit.
+	SceneAnimation none;
+	none.Bind(still, nullptr);
+	none.GetCameraConstants(1.0f, constants.g_Camera, constants.g_CameraTarget);
+	CHECK(constants.g_Camera.w == 0.f);
+	CHECK(length(Camera::Current(constants).origin - Camera::Orbit(1.0f).origin) < 1e-6f);
+
+	// The renderer hands the camera of a frame on to the next one for the temporal reuse.
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	Image image;
+	animation.GetCameraConstants(0.5f, constants.g_Camera, constants.g_CameraTarget);
+	constants.g_Time.x = 0.5f;
+	renderer.Render(constants, image);
+	CHECK(all(renderer.GetHistory().camera == constants.g_Camera));
+	CHECK(all(renderer.GetHistory().cameraTarget == constants.g_CameraTarget));
+
+	CHECK(!ParseCsgCamera(ParseJson(R"({ "animate": { "target": { "keys": [[0, 1]] } } })"), camera));
+	CHECK(!ParseCsgCamera(ParseJson(R"({ "animate": { "radius": { "keys": [[0, 1]] } } })"), camera));
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_animation_tracks();
+		test_animation_compile();
+		test_animation_pruning();
+		test_animation_evaluate();
+		test_animation_camera();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
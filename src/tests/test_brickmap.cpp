@@ -0,0 +1,137 @@
+#include "../cpu/BrickMap.h"
+#include "TestScenes.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	BrickMapDesc GetTestDesc(int bits)
+	{
+		BrickMapDesc desc;
+		desc.voxelSize = 0.04f;
+		desc.band = 0.1f;
+		desc.bits = bits;
+		return desc;
+	}
+}
+
+void test_brickmap_bake()
+{
+	tf::Executor executor(2);
+	SceneMap map = GetBuiltinScene();
+
+	BrickMap bricks8, bricks16;
+	CHECK(bricks8.Bake(executor, map, GetTestDesc(8)));
+	CHECK(bricks16.Bake(executor, map, GetTestDesc(16)));
+
+	// 5 x 2.5 x 5 in cells of 7 voxels of 0.04, and only the cells along the surfaces get bricks.
+	CHECK(all(bricks8.GetGridSize() == int3(18, 9, 18)));
+	CHECK(bricks8.GetBrickCount() > 0 && bricks8.GetBrickCount() < bricks8.GetCellCount() / 2);
+	CHECK(bricks16.GetBrickCount() == bricks8.GetBrickCount());
+	CHECK(bricks8.GetBrick(int3(0, 8, 0)) == BrickMap::c_EmptyCell);
+
+	// Near the surfaces the filtered samples follow the analytic field.
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> dx(-2.4f, 2.4f), dy(-0.4f, 1.9f);
+	int nearCount = 0;
+	double error8 = 0.0, error16 = 0.0;
+	int farCount = 0;
+	int signMismatches = 0;
+	int overshoots = 0;
+	for (int i = 0; i < 20000; i++)
+	{
+		float3 p(dx(rng), dy(rng), dx(rng));
+		float d = map(p).x;
+		float s8 = bricks8.Sample(p);
+		if (std::fabs(d) < 0.1f)
+		{
+			nearCount++;
+			error8 += std::fabs(s8 - d);
+			error16 += std::fabs(bricks16.Sample(p) - d);
+		}
+		else if (std::fabs(d) > 0.3f)
+		{
+			// Away from them the samples keep the sign and do not overshoot, so they stay safe to step.
+			// The blobs' displacement makes the field jump a little, which the cell distances can't see.
+			farCount++;
+			if (s8 * d <= 0.f)
+				signMismatches++;
+			if (std::fabs(s8) > std::fabs(d) + 0.01f)
+				overshoots++;
+		}
+	}
+
+	CHECK(nearCount > 1000);
+	CHECK(error8 / nearCount < 0.1 * 0.04);
+	CHECK(error16 <= error8);
+	CHECK(signMismatches == 0 && overshoots < farCount / 500);
+
+	// Outside the baked region the distance to it is added.
+	float3 above(0.f, 10.f, 0.f);
+	CHECK(std::fabs(bricks8.Sample(above) - map(above).x) < 0.2f);
+
+	BrickMapDesc invalid = GetTestDesc(12);
+	BrickMap unused;
+	CHECK(!unused.Bake(executor, map, invalid));
+	CHECK(unused.Empty() && unused.Sample(above) > 1e9f);
+}
+
+void test_brickmap_file()
+{
+	tf::Executor executor(2);
+	SceneMap map = GetBuiltinScene();
+	BrickMap bricks;
+	CHECK(bricks.Bake(executor, map, GetTestDesc(16)));
+
+	std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_test_brickmap.bin";
+	CHECK(bricks.Save(fileName));
+
+	vfs::NativeFileSystem fs;
+	BrickMap loaded;
+	CHECK(loaded.Load(fs, fileName));
+	CHECK(all(loaded.GetGridSize() == bricks.GetGridSize()) && loaded.GetBrickCount() == bricks.GetBrickCount());
+	CHECK(loaded.GetBits() == 16 && loaded.GetMemorySize() == bricks.GetMemorySize());
+	CHECK(std::filesystem::file_size(fileName) == sizeof(BrickMapFileHeader) + bricks.GetMemorySize());
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> dist(-2.5f, 2.5f);
+	for (int i = 0; i < 1000; i++)
+	{
+		float3 p(dist(rng), dist(rng), dist(rng));
+		CHECK(loaded.Sample(p) == bricks.Sample(p));
+	}
+
+	// A truncated file is rejected and leaves the brick map as it was.
+	std::filesystem::resize_file(fileName, sizeof(BrickMapFileHeader) + 16);
+	CHECK(!loaded.Load(fs, fileName));
+	CHECK(loaded.GetBrickCount() == bricks.GetBrickCount());
+
+	std::filesystem::remove(fileName);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_brickmap_bake();
+		test_brickmap_file();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
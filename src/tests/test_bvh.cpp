@@ -0,0 +1,133 @@
+#include "../cpu/Bvh.h"
+#include "../cpu/RandomScene.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	void CheckMatchesTape(const Tape& tape, const SceneBvh& bvh, float extent, float time)
+	{
+		std::mt19937 rng(17);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+		for (int i = 0; i < 5000; i++)
+		{
+			Vec3<float> p(dist(rng) * extent, dist(rng) * 0.8f + 0.7f, dist(rng) * extent);
+			Vec2<float> expected = EvaluateTape(tape, p, time);
+			Vec2<float> actual = EvaluateBvh(bvh, p, time);
+
+			CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+			CHECK(expected.y == actual.y);
+		}
+	}
+
+	void CheckNodeBounds(const SceneBvh& bvh)
+	{
+		// Every interior node must contain both children.
+		const std::vector<BvhNode>& nodes = bvh.GetNodes();
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (nodes[i].count > 0)
+				continue;
+
+			box3 parent(nodes[i].boundsMin, nodes[i].boundsMax);
+			for (uint32_t child : { uint32_t(i + 1), nodes[i].offset })
+				CHECK(parent.contains(box3(nodes[child].boundsMin, nodes[child].boundsMax)));
+		}
+	}
+}
+
+void test_bvh_layout()
+{
+	// Must match the structured buffer stride in SDFTape.hlsli.
+	CHECK(sizeof(BvhNode) == 32);
+
+	Tape tape = LoadDefaultTape();
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+
+	// The floor is the only unbounded object. The moebius cube, the frame and the octahedron of
+	// the framed octahedron (a union itself), four blobs, five tori and the hollow box go into the tree.
+	CHECK(bvh.GetGlobalInstructionCount() == 1);
+	CHECK(bvh.GetObjectCount() == 13);
+	CHECK(bvh.GetNodes().size() == 2 * 13 - 1);
+	CHECK(bvh.GetMaxStackDepth() <= tape.maxStackDepth);
+	CheckNodeBounds(bvh);
+}
+
+void test_bvh_matches_tape()
+{
+	Tape defaultScene = LoadDefaultTape();
+	SceneBvh bvh;
+	CHECK(bvh.Build(defaultScene));
+	CheckMatchesTape(defaultScene, bvh, 2.0f, 1.3f);
+
+	Tape randomScene = Compile(*MakeRandomScene(500, 3));
+	CHECK(bvh.Build(randomScene));
+	CheckMatchesTape(randomScene, bvh, 6.0f, 0.0f);
+
+#if defined(SDF_SIMD_AVX2)
+	float x[8] = { -1.f, -0.5f, 0.f, 0.5f, 1.f, 1.5f, 0.2f, -1.2f };
+	float y[8] = { 0.3f, 0.5f, 0.9f, 1.2f, 0.1f, 0.6f, 0.3f, 1.4f };
+	float z[8] = { 0.f, 1.f, -0.5f, 0.5f, 1.5f, -4.5f, 3.2f, 0.1f };
+
+	Vec2<Float8> packet = EvaluateBvh(bvh, Vec3<Float8>(Float8::Load(x), Float8::Load(y), Float8::Load(z)), 0.f);
+	for (int i = 0; i < 8; i++)
+	{
+		Vec2<float> scalar = EvaluateTape(randomScene, Vec3<float>(x[i], y[i], z[i]), 0.f);
+		CHECK(std::fabs(lane(packet.x, i) - scalar.x) < 1e-5f);
+		CHECK(lane(packet.y, i) == scalar.y);
+	}
+#endif
+}
+
+void test_bvh_refit()
+{
+	Tape tape = Compile(*MakeRandomScene(200, 9));
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+
+	// Move every sphere up by half a unit, in the source tape and through the BVH.
+	for (uint32_t i = 0; i < tape.Size(); i++)
+	{
+		TapeInstruction& ins = tape.instructions[i];
+		if (GetOpcode(ins) != SDF_OP_SPHERE)
+			continue;
+
+		ins.params[1] += 0.5f;
+		bvh.SetParameters(i, ins.params);
+		CHECK(std::memcmp(&bvh.GetInstructions()[bvh.GetInstructionIndex(i)], &ins, sizeof(ins)) == 0);
+	}
+
+	CHECK(bvh.IsDirty());
+	CHECK(bvh.Refit() > 0);
+	CHECK(!bvh.IsDirty());
+	CHECK(bvh.Refit() == 0);
+
+	CheckNodeBounds(bvh);
+	CheckMatchesTape(tape, bvh, 4.0f, 0.0f);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_bvh_layout();
+		test_bvh_matches_tape();
+		test_bvh_refit();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
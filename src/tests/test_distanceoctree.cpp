@@ -0,0 +1,178 @@
+#include "../cpu/DistanceOctree.h"
+#include "TestScenes.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	DistanceOctreeDesc GetTestDesc()
+	{
+		DistanceOctreeDesc desc;
+		desc.tolerance = 0.002f;
+		desc.maxDepth = 8;
+		return desc;
+	}
+}
+
+void test_octree_build()
+{
+	tf::Executor executor(2);
+	SceneMap map = GetBuiltinScene();
+
+	DistanceOctree octree;
+	CHECK(octree.Build(executor, map, GetTestDesc()));
+
+	// The root is the cube around the region, and far fewer leaves than the cells of a dense grid of the
+	// finest level cover it.
+	const box3 bounds = octree.GetBounds();
+	CHECK(std::fabs(bounds.diagonal().y - 5.f) < 1e-5f && std::fabs(bounds.center().y - 0.75f) < 1e-5f);
+	std::vector<uint32_t> leafCounts = octree.GetLeafCounts();
+	CHECK(leafCounts.size() == 9 && leafCounts[0] == 0 && leafCounts[8] > 0);
+	uint32_t leafTotal = 0;
+	for (uint32_t count : leafCounts)
+		leafTotal += count;
+	CHECK(leafTotal == octree.GetLeafCount() && octree.GetNodeCount() == (octree.GetLeafCount() - 1) / 7 * 8 + 1);
+	CHECK(octree.GetLeafCount() < (1u << 24) / 20);
+
+	// The ground plane is filtered exactly, so away from the objects it stays in large cells, while the
+	// thin tori get the finest ones.
+	CHECK(octree.GetLeafDepth(float3(-2.2f, 0.f, 2.2f)) <= 4);
+	CHECK(octree.GetLeafDepth(float3(1.27f, 0.3f, -0.5f)) >= 7);
+	CHECK(std::fabs(octree.Sample(float3(1.27f, 0.3f, -0.5f)) - map(float3(1.27f, 0.3f, -0.5f)).x) < 0.002f);
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> dx(-2.4f, 2.4f), dy(-0.4f, 1.9f);
+	int nearCount = 0;
+	double error = 0.0;
+	int farCount = 0;
+	int signMismatches = 0;
+	int overshoots = 0;
+	for (int i = 0; i < 20000; i++)
+	{
+		float3 p(dx(rng), dy(rng), dx(rng));
+		float d = map(p).x;
+		float s = octree.Sample(p);
+		if (std::fabs(d) < 0.1f)
+		{
+			nearCount++;
+			error += std::fabs(s - d);
+		}
+		else if (std::fabs(d) > 0.3f)
+		{
+			// Away from the surfaces the samples keep the sign and do not overshoot, so they stay safe to step.
+			farCount++;
+			if (s * d <= 0.f)
+				signMismatches++;
+			if (std::fabs(s) > std::fabs(d) + 0.01f)
+				overshoots++;
+		}
+	}
+
+	CHECK(nearCount > 1000);
+	CHECK(error / nearCount < 0.002);
+	CHECK(signMismatches == 0 && overshoots < farCount / 500);
+
+	// Outside the root the distance to it is added to the conservative distance of the leaf at the top.
+	float3 above(0.f, 10.f, 0.f);
+	CHECK(octree.Sample(above) <= map(above).x && octree.Sample(above) > map(above).x - 0.5f);
+
+	DistanceOctreeDesc invalid = GetTestDesc();
+	invalid.maxDepth = 17;
+	DistanceOctree unused;
+	CHECK(!unused.Build(executor, map, invalid));
+	invalid = GetTestDesc();
+	invalid.tolerance = 0.f;
+	CHECK(!unused.Build(executor, map, invalid));
+	CHECK(unused.Empty() && unused.Sample(above) > 1e9f);
+}
+
+void test_octree_packets()
+{
+	tf::Executor executor(2);
+	SceneMap map = GetBuiltinScene();
+	DistanceOctree octree;
+	CHECK(octree.Build(executor, map, GetTestDesc()));
+
+	// Packets filter each lane in its own leaf, inside and outside the root.
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-3.5f, 3.5f);
+	for (int i = 0; i < 1000; i++)
+	{
+		alignas(32) float x[WidthOf<FloatN>], y[WidthOf<FloatN>], z[WidthOf<FloatN>], out[WidthOf<FloatN>];
+		for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+		{
+			x[lane] = dist(rng);
+			y[lane] = dist(rng);
+			z[lane] = dist(rng);
+		}
+
+		FloatN s = octree.Sample(Vec3<FloatN>(FloatN::Load(x), FloatN::Load(y), FloatN::Load(z)));
+		s.Store(out);
+		for (int lane = 0; lane < WidthOf<FloatN>; lane++)
+		{
+			float expected = octree.Sample(float3(x[lane], y[lane], z[lane]));
+			CHECK(std::fabs(out[lane] - expected) <= 1e-5f * std::max(1.f, std::fabs(expected)));
+		}
+	}
+}
+
+void test_octree_file()
+{
+	tf::Executor executor(2);
+	SceneMap map = GetBuiltinScene();
+	DistanceOctree octree;
+	CHECK(octree.Build(executor, map, GetTestDesc()));
+
+	std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_test_octree.bin";
+	CHECK(octree.Save(fileName));
+	CHECK(std::filesystem::file_size(fileName) == sizeof(DistanceOctreeFileHeader)
+		+ (octree.GetNodeCount() / 64 + 1) * sizeof(uint64_t) + octree.GetLeafCount() * 8 * sizeof(int16_t));
+
+	vfs::NativeFileSystem fs;
+	DistanceOctree loaded;
+	CHECK(loaded.Load(fs, fileName));
+	CHECK(loaded.GetNodeCount() == octree.GetNodeCount() && loaded.GetLeafCount() == octree.GetLeafCount());
+	CHECK(loaded.GetMaxDepth() == 8 && loaded.GetMemorySize() == octree.GetMemorySize());
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> dist(-2.5f, 2.5f);
+	for (int i = 0; i < 1000; i++)
+	{
+		float3 p(dist(rng), dist(rng), dist(rng));
+		CHECK(loaded.Sample(p) == octree.Sample(p));
+	}
+
+	// A truncated file is rejected and leaves the octree as it was.
+	std::filesystem::resize_file(fileName, sizeof(DistanceOctreeFileHeader) + 16);
+	CHECK(!loaded.Load(fs, fileName));
+	CHECK(loaded.GetLeafCount() == octree.GetLeafCount());
+
+	std::filesystem::remove(fileName);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_octree_build();
+		test_octree_packets();
+		test_octree_file();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include "../cpu/MeshExtraction.h"
+#include "../cpu/Tape.h"
+#include "TestScenes.h"
+
+#include <donut/engine/SceneTypes.h>
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	float3 Gradient(const SceneMap& map, const float3& pos)
+	{
+		const Dual<float> d = map.EvaluateDual(pos);
+		return float3(d.d.x, d.d.y, d.d.z);
+	}
+
+	// A sphere and a box apart from each other, well inside [-2, 2]^3.
+	const float3 c_BoxCenter(0.8f, 0.f, 0.f);
+	const float3 c_BoxSize(0.4f, 0.3f, 0.5f);
+
+	bool BuildTestScene(SceneBvh& bvh)
+	{
+		auto node = ParseString(R"({
+			"type": "union",
+			"children": [
+				{ "type": "sphere", "position": [-0.8, 0.2, 0.1], "radius": 0.6 },
+				{ "type": "box", "position": [0.8, 0, 0], "size": [0.4, 0.3, 0.5] }
+			]
+		})");
+		Tape tape;
+		return node && CompileTape(*node, tape) && bvh.Build(tape);
+	}
+}
+
+void test_extract_mesh()
+{
+	SceneBvh bvh;
+	CHECK(BuildTestScene(bvh));
+	SceneMap map;
+	map.bvh = &bvh;
+
+	MeshExtractionDesc desc;
+	desc.bounds = box3(float3(-2.f), float3(2.f));
+	desc.cellSize = 0.05f;
+
+	tf::Executor executor(4);
+	TriangleMesh mesh;
+	MeshExtractionStats stats;
+	CHECK(ExtractMesh(executor, map, desc, mesh, &stats));
+	CHECK(mesh.GetTriangleCount() > 1000);
+	CHECK(mesh.normals.size() == mesh.positions.size());
+
+	// 10^3 leaves cover the grid, and the octree only keeps those along the surfaces.
+	CHECK(stats.leaves > 0 && stats.leaves < 1000 / 2);
+	CHECK(stats.evaluations < 80ull * 80ull * 80ull);
+
+	// The vertices lie on the surfaces, the box's corners included.
+	float closestCorner = 1e30f;
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		const float3& p = mesh.positions[i];
+		CHECK(std::fabs(map(p).x) < 0.1f * desc.cellSize);
+		const float3 gradient = Gradient(map, p);
+		CHECK(length(gradient) == 0.f || dot(mesh.normals[i], normalize(gradient)) > 0.99f);
+		closestCorner = std::min(closestCorner, length(p - (c_BoxCenter + c_BoxSize)));
+	}
+	CHECK(closestCorner < 1e-3f);
+
+	// Closed and consistently oriented: every edge is shared by exactly two triangles that run it in
+	// opposite directions. Two surfaces of genus 0 make an Euler characteristic of 4.
+	std::map<std::pair<uint32_t, uint32_t>, int> edges;
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		for (size_t j = 0; j < 3; j++)
+			edges[{ mesh.indices[i + j], mesh.indices[i + (j + 1) % 3] }]++;
+
+		const float3& a = mesh.positions[mesh.indices[i]];
+		const float3& b = mesh.positions[mesh.indices[i + 1]];
+		const float3& c = mesh.positions[mesh.indices[i + 2]];
+		// Slivers along the sharp edges aside, the triangles face the way the gradient points.
+		const float3 normal = cross(b - a, c - a);
+		CHECK(length(normal) < 0.1f * desc.cellSize * desc.cellSize || dot(normal, Gradient(map, (a + b + c) / 3.f)) >= 0.f);
+	}
+	for (const auto& [edge, count] : edges)
+	{
+		CHECK(count == 1);
+		auto reverse = edges.find({ edge.second, edge.first });
+		CHECK(reverse != edges.end() && reverse->second == 1);
+	}
+	CHECK(int64_t(mesh.positions.size()) - int64_t(edges.size() / 2) + int64_t(mesh.GetTriangleCount()) == 4);
+
+	// The vertices are numbered by cell, so a single thread gives the same mesh.
+	tf::Executor single(1);
+	TriangleMesh again;
+	CHECK(ExtractMesh(single, map, desc, again));
+	CHECK(again.positions.size() == mesh.positions.size() && again.indices == mesh.indices);
+	for (size_t i = 0; i < again.positions.size(); i++)
+		CHECK(all(again.positions[i] == mesh.positions[i]));
+
+	engine::MeshInfo info;
+	FillMeshInfo(mesh, info);
+	CHECK(info.buffers && info.geometries.size() == 1);
+	CHECK(info.buffers->positionData.size() == mesh.positions.size() && info.buffers->normalData.size() == mesh.positions.size());
+	CHECK(info.buffers->indexData == mesh.indices);
+	CHECK(info.totalIndices == mesh.indices.size() && info.totalVertices == mesh.positions.size());
+	CHECK(all(info.objectSpaceBounds.m_maxs == mesh.GetBounds().m_maxs));
+
+	desc.bounds = box3(float3(0.f), float3(0.f, 1.f, 1.f));
+	CHECK(!ExtractMesh(executor, map, desc, again));
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_extract_mesh();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
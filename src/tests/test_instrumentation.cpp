@@ -0,0 +1,116 @@
+#include "../cpu/Instrumentation.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+using namespace donut;
+using namespace sdf;
+
+void test_instrumentation_distribution()
+{
+	// 100 pixels with 1 ... 100 primary evaluations and 2 normal evaluations each.
+	EvaluationImage evaluations;
+	evaluations.Resize(10, 10);
+	for (int i = 0; i < 100; i++)
+	{
+		evaluations.pixels[i].primary = uint32_t(i + 1);
+		evaluations.pixels[i].normal = 2;
+	}
+
+	EvaluationDistribution primary = GetEvaluationDistribution(evaluations, SDF_HEATMAP_PRIMARY);
+	CHECK(primary.pixels == 100 && primary.sum == 5050);
+	CHECK(primary.p50 == 50 && primary.p95 == 95 && primary.p99 == 99 && primary.max == 100);
+	CHECK(primary.histogram.size() == 101 && primary.histogram[0] == 0 && primary.histogram[100] == 1);
+	CHECK(std::fabs(primary.GetMean() - 50.5) < 1e-9);
+
+	EvaluationDistribution total = GetEvaluationDistribution(evaluations, SDF_HEATMAP_TOTAL);
+	CHECK(total.sum == 5250 && total.p50 == 52 && total.max == 102);
+
+	EvaluationDistribution shadow = GetEvaluationDistribution(evaluations, SDF_HEATMAP_SHADOW);
+	CHECK(shadow.sum == 0 && shadow.p99 == 0 && shadow.histogram[0] == 100);
+}
+
+void test_instrumentation_render()
+{
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 64, 36);
+
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	renderer.SetRecordEvaluations(true);
+	Image image;
+	RenderStats stats = renderer.Render(constants, image);
+
+	// The pixel counts add up to the frame's statistics, apart from the per-tile prepass.
+	const EvaluationImage& evaluations = renderer.GetEvaluations();
+	CHECK(evaluations.width == 64 && evaluations.height == 36);
+	uint64_t primary = 0, normal = 0, ao = 0, shadow = 0;
+	for (const PixelEvaluations& pixel : evaluations.pixels)
+	{
+		primary += pixel.primary;
+		normal += pixel.normal;
+		ao += pixel.ao;
+		shadow += pixel.shadow;
+		CHECK(pixel.normal == 0 || pixel.normal == 4);
+		CHECK(pixel.ao <= 5);
+	}
+	CHECK(primary == stats.primarySteps && shadow == stats.shadowSteps);
+	CHECK(normal == stats.normalEvaluations && ao == stats.aoEvaluations);
+	CHECK(normal > 0 && ao > 0);
+	CHECK(stats.GetEvaluations() == primary + normal + ao + shadow + stats.prepassSteps);
+
+	// In heatmap mode every pixel shows its own count, linearized for the sRGB swap chain like PS().
+	constants.g_Heatmap = int4(SDF_HEATMAP_SHADOW, 100, 0, 0);
+	Image heatmap;
+	renderer.Render(constants, heatmap);
+	for (int y = 0; y < 36; y += 5)
+	{
+		for (int x = 0; x < 64; x += 5)
+		{
+			float3 expected = pow(HeatmapColor(evaluations.At(x, y).shadow, 100), 2.2f);
+			CHECK(length(heatmap.At(x, y) - expected) < 1e-5f);
+		}
+	}
+
+	renderer.SetRecordEvaluations(false);
+	renderer.Render(constants, image);
+	CHECK(renderer.GetEvaluations().pixels.empty());
+}
+
+void test_instrumentation_heatmap()
+{
+	// The color scale runs from almost black over blue, green and yellow to dark red and saturates at the scale.
+	float3 low = HeatmapColor(0, 10);
+	float3 blue = HeatmapColor(2, 10);
+	float3 mid = HeatmapColor(5, 10);
+	float3 high = HeatmapColor(10, 10);
+	CHECK(length(low) < 0.25f && blue.z > blue.x && mid.y > mid.x && mid.y > mid.z && high.x > high.y + high.z);
+	CHECK(length(HeatmapColor(20, 10) - high) == 0.f);
+
+	EvaluationImage evaluations;
+	evaluations.Resize(2, 1);
+	evaluations.pixels[1].ao = 10;
+	Image heatmap;
+	MakeHeatmap(evaluations, SDF_HEATMAP_AO, 10, heatmap);
+	CHECK(heatmap.width == 2 && heatmap.height == 1);
+	CHECK(length(heatmap.pixels[0] - low) == 0.f && length(heatmap.pixels[1] - high) == 0.f);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_instrumentation_distribution();
+		test_instrumentation_render();
+		test_instrumentation_heatmap();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
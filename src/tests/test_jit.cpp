@@ -0,0 +1,272 @@
+#include "../cpu/Dual.h"
+#include "../cpu/RandomScene.h"
+#include "../cpu/Renderer.h"
+#include "../cpu/TapeJit.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	TapeInstruction Instruction(uint32_t opcode, uint32_t flags, uint32_t material, std::initializer_list<float> params)
+	{
+		TapeInstruction ins = {};
+		ins.code = MakeInstructionCode(opcode, flags, material);
+		std::copy(params.begin(), params.end(), ins.params);
+		return ins;
+	}
+
+	// The compiled tape against the interpreter at every width. Materials may only differ where two
+	// distances are within rounding of each other.
+	template<typename F> void CompareWidth(const JitTape& jit, float extent, float time, int& materialMismatches)
+	{
+		constexpr int W = WidthOf<F>;
+		const std::vector<TapeInstruction>& code = jit.GetInstructions();
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> dist(-extent, extent);
+
+		for (int iter = 0; iter < 400; iter++)
+		{
+			alignas(32) float x[W], y[W], z[W];
+			for (int i = 0; i < W; i++)
+			{
+				x[i] = dist(rng);
+				y[i] = dist(rng) * 0.5f + 0.5f;
+				z[i] = dist(rng);
+			}
+
+			Vec3<F> p;
+			if constexpr (W == 1)
+				p = Vec3<F>(x[0], y[0], z[0]);
+			else
+				p = Vec3<F>(F::Load(x), F::Load(y), F::Load(z));
+
+			Vec2<F> expected = EvaluateTape(code.data(), code.size(), p, time);
+			Vec2<F> actual = jit.Evaluate(p, time);
+			for (int i = 0; i < W; i++)
+			{
+				CHECK(Near(lane(actual.x, i), lane(expected.x, i)));
+				if (lane(actual.y, i) != lane(expected.y, i))
+					materialMismatches++;
+			}
+		}
+	}
+
+	void CompareWithInterpreter(const JitTape& jit, float extent, float time)
+	{
+		int materialMismatches = 0;
+		CompareWidth<float>(jit, extent, time, materialMismatches);
+#if defined(SDF_SIMD_SSE)
+		CompareWidth<Float4>(jit, extent, time, materialMismatches);
+#endif
+#if defined(SDF_SIMD_AVX2)
+		CompareWidth<Float8>(jit, extent, time, materialMismatches);
+#endif
+		CHECK(materialMismatches <= 2);
+	}
+
+	void CheckCompiles(const Tape& tape, float extent, float time)
+	{
+		JitTape jit;
+		CHECK(jit.Compile(tape) == JitTape::IsSupported());
+		CHECK(jit.IsCompiled() == JitTape::IsSupported());
+		CompareWithInterpreter(jit, extent, time);
+	}
+}
+
+void test_jit_instructions()
+{
+	std::printf("JIT %s\n", JitTape::IsSupported() ? "supported" : "not supported, testing the fallback");
+
+	const TapeInstruction primitives[] = {
+		Instruction(SDF_OP_PLANE, 0, 1, { 0.f, 0.8f, 0.6f, 0.1f }),
+		Instruction(SDF_OP_SPHERE, 0, 2, { 0.1f, 0.4f, -0.2f, 0.5f }),
+		Instruction(SDF_OP_BOX, 0, 3, { -0.2f, 0.5f, 0.1f, 0.3f, 0.2f, 0.4f }),
+		Instruction(SDF_OP_BOX_FRAME, 0, 4, { 0.f, 0.5f, 0.f, 0.4f, 0.3f, 0.35f, 0.05f }),
+		Instruction(SDF_OP_TORUS, 0, 5, { 0.2f, 0.4f, 0.f, 0.5f, 0.1f }),
+		Instruction(SDF_OP_CYLINDER, 0, 6, { 0.f, 0.5f, 0.f, 0.2f, 0.4f }),
+		Instruction(SDF_OP_CYLINDER, 1, 6, { 0.f, 0.5f, 0.f, 0.2f, 0.4f }),
+		Instruction(SDF_OP_CYLINDER, 2, 6, { 0.f, 0.5f, 0.f, 0.2f, 0.4f }),
+		Instruction(SDF_OP_OCTAHEDRON, 0, 7, { 0.1f, 0.5f, 0.f, 0.45f }),
+	};
+	for (const TapeInstruction& primitive : primitives)
+	{
+		Tape tape;
+		tape.instructions = { primitive };
+		CheckCompiles(tape, 1.5f, 0.f);
+	}
+
+	// Every operator on a sphere and a box that overlap, and the unary ones on top.
+	for (uint32_t opcode = SDF_OP_UNION; opcode <= SDF_OP_SMOOTH_INTERSECTION; opcode++)
+	{
+		Tape tape;
+		tape.instructions = { primitives[1], primitives[2], Instruction(opcode, 0, 0, { 0.2f }) };
+		CheckCompiles(tape, 1.5f, 0.f);
+
+		tape.instructions.push_back(Instruction(SDF_OP_ROUND, 0, 0, { 0.05f }));
+		tape.instructions.push_back(Instruction(SDF_OP_DISPLACE, 0, 0, { 0.2f, 3.f }));
+		tape.instructions.push_back(Instruction(SDF_OP_DISPLACE, SDF_DISPLACE_KEYFRAMED, 0, { -0.07f }));
+		for (float time : { 0.f, 1.3f, 10.f })
+			CheckCompiles(tape, 1.5f, time);
+	}
+
+	// An empty tape is empty space, like the interpreter's.
+	JitTape empty;
+	CHECK(empty.Compile(Tape()) == JitTape::IsSupported());
+	Vec2<float> res = empty.Evaluate(Vec3<float>(0.f, 0.f, 0.f), 0.f);
+	CHECK(res.x == 1e10f && res.y == -1.f);
+}
+
+void test_jit_scenes()
+{
+	// The built-in scene, with its time-dependent displacements.
+	Tape scene = LoadDefaultTape();
+	for (float time : { 0.f, 2.5f, 10.f })
+		CheckCompiles(scene, 4.f, time);
+
+	CheckCompiles(Compile(*MakeRandomScene(100)), 5.f, 0.f);
+
+	// Nested repetitions, limited and mirrored ones are unrolled over their candidates.
+	auto repeated = ParseString(R"({
+		"type": "union",
+		"children": [
+			{ "type": "plane", "normal": [0, 1, 0] },
+			{
+				"type": "repeatLimited", "period": [0.7, 0, 0.9], "count": [2, 0, 1], "mirror": true, "material": 2,
+				"children": [ {
+					"type": "smoothUnion", "k": 0.1,
+					"children": [
+						{ "type": "box", "position": [0.1, 0.2, 0], "size": [0.15, 0.2, 0.1] },
+						{
+							"type": "repeat", "period": [0, 0.3, 0], "material": 3,
+							"children": [ { "type": "sphere", "position": [0, 0, 0.1], "radius": 0.08 } ]
+						}
+					]
+				} ]
+			},
+			{
+				"type": "repeat", "period": [1.1, 0.8, 1.3], "material": 4,
+				"children": [ { "type": "torus", "radii": [0.2, 0.05] } ]
+			}
+		]
+	})");
+	CHECK(repeated != nullptr);
+	CheckCompiles(Compile(*repeated), 4.f, 0.f);
+
+	// Polar repetition and noise displacement aren't compiled; the tape is interpreted instead.
+	Tape props = LoadSceneTape("props.json");
+	JitTape polar;
+	CHECK(!polar.Compile(props) && !polar.IsCompiled());
+	CompareWithInterpreter(polar, 3.f, 0.f);
+
+	auto noise = ParseString(R"({ "type": "noise", "amplitude": 0.1, "children": [ { "type": "sphere" } ] })");
+	CHECK(noise != nullptr);
+	JitTape noisy;
+	CHECK(!noisy.Compile(Compile(*noise)));
+	CompareWithInterpreter(noisy, 2.f, 0.f);
+
+	// Dual numbers are interpreted.
+	JitTape jit;
+	jit.Compile(scene);
+	Vec3<float> p(0.3f, 0.4f, -0.2f);
+	Vec2<Dual<float>> dual = jit.Evaluate(DualPosition(p), 10.f);
+	Vec2<Dual<float>> expected = EvaluateTape(scene, DualPosition(p), 10.f);
+	CHECK(dual.x.v == expected.x.v && dual.x.d.x == expected.x.d.x && dual.y.v == expected.y.v);
+}
+
+void test_jit_cache()
+{
+	Tape a = Compile(*MakeRandomScene(20, 1));
+	Tape b = Compile(*MakeRandomScene(20, 2));
+
+	JitCache cache;
+	auto first = cache.Get(a);
+	CHECK(cache.Get(a) == first);
+	CHECK(cache.Get(b) != first);
+	CHECK(cache.GetSize() == 2 && cache.GetHits() == 1 && cache.GetMisses() == 2);
+
+	// A copy of the instructions elsewhere is the same tape.
+	Tape copy = a;
+	CHECK(cache.Get(copy) == first);
+
+	// Only the tapes nothing else uses are forgotten.
+	CHECK(cache.Trim() == 1);
+	CHECK(cache.GetSize() == 1 && cache.Get(a) == first);
+	first.reset();
+	CHECK(cache.Trim() == 1 && cache.GetSize() == 0);
+}
+
+void test_jit_bvh()
+{
+	Tape tape = LoadDefaultTape();
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+
+	JitCache cache;
+	BvhJit jit;
+	jit.Update(bvh, cache);
+	CHECK(jit.GetTapeCount() == bvh.GetObjectCount() + 1);
+	CHECK(jit.GetCompiledCount() == (JitTape::IsSupported() ? jit.GetTapeCount() : 0));
+
+	std::mt19937 rng(8);
+	std::uniform_real_distribution<float> dist(-4.f, 4.f);
+	for (int i = 0; i < 2000; i++)
+	{
+		Vec3<float> p(dist(rng), dist(rng) * 0.3f + 1.f, dist(rng));
+		Vec2<float> expected = EvaluateBvh(bvh, p, 10.f);
+		Vec2<float> actual = EvaluateBvh(bvh, jit, p, 10.f);
+		CHECK(Near(actual.x, expected.x));
+	}
+
+	// Moving an object compiles its leaf again and reuses the others.
+	const uint64_t misses = cache.GetMisses();
+	uint32_t sphere = 0;
+	while (GetOpcode(tape.instructions[sphere]) != SDF_OP_SPHERE)
+		sphere++;
+	float params[7];
+	std::memcpy(params, tape.instructions[sphere].params, sizeof(params));
+	params[1] += 0.1f;
+	bvh.SetParameters(sphere, params);
+	bvh.Refit();
+	jit.Update(bvh, cache);
+	CHECK(cache.GetMisses() == misses + 1);
+	CHECK(cache.Trim() == 1);
+
+	// The renderer draws the same image with the compiled tapes.
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	const RenderConstants constants = GetDefaultRenderConstants(10.f, 96, 54);
+	Image reference, image;
+	renderer.Render(constants, reference);
+	renderer.SetJit(true);
+	renderer.Render(constants, image);
+	CHECK(ComputePsnr(image, reference) > 50.0);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_jit_instructions();
+		test_jit_scenes();
+		test_jit_cache();
+		test_jit_bvh();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,230 @@
+#include "../cpu/BrickMap.h"
+#include "../cpu/MeshSdf.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	// [-1, 1]^3 with outward facing triangles.
+	TriangleMesh MakeCube()
+	{
+		TriangleMesh mesh;
+		for (int i = 0; i < 8; i++)
+			mesh.positions.push_back(float3(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f));
+
+		mesh.indices = {
+			0, 2, 1, 1, 2, 3,   // -z
+			4, 5, 6, 5, 7, 6,   // +z
+			0, 1, 4, 1, 5, 4,   // -y
+			2, 6, 3, 3, 6, 7,   // +y
+			0, 4, 2, 2, 4, 6,   // -x
+			1, 3, 5, 3, 7, 5,   // +x
+		};
+		return mesh;
+	}
+
+	// Unit sphere of 2 * columns * (rows - 1) triangles.
+	TriangleMesh MakeSphere(int columns, int rows)
+	{
+		TriangleMesh mesh;
+		for (int r = 0; r <= rows; r++)
+		{
+			float theta = float(r) / float(rows) * dm::PI_f;
+			for (int c = 0; c < columns; c++)
+			{
+				float phi = float(c) / float(columns) * 2.f * dm::PI_f;
+				mesh.positions.push_back(float3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+			}
+		}
+
+		for (int r = 0; r < rows; r++)
+		{
+			for (int c = 0; c < columns; c++)
+			{
+				uint32_t i00 = uint32_t(r * columns + c);
+				uint32_t i01 = uint32_t(r * columns + (c + 1) % columns);
+				uint32_t i10 = i00 + uint32_t(columns);
+				uint32_t i11 = i01 + uint32_t(columns);
+				if (r > 0)
+					mesh.indices.insert(mesh.indices.end(), { i00, i01, i10 });
+				if (r < rows - 1)
+					mesh.indices.insert(mesh.indices.end(), { i01, i11, i10 });
+			}
+		}
+		return mesh;
+	}
+
+	float BoxDistance(const float3& p)
+	{
+		float3 q = abs(p) - 1.f;
+		return length(max(q, float3(0.f))) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.f);
+	}
+}
+
+void test_mesh_distance()
+{
+	MeshDistance cube;
+	CHECK(cube.Build(MakeCube()));
+	CHECK(cube.GetTriangleCount() == 12);
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-2.5f, 2.5f);
+	for (int i = 0; i < 2000; i++)
+	{
+		float3 p(dist(rng), dist(rng), dist(rng));
+		CHECK(std::fabs(cube.Distance(p) - BoxDistance(p)) < 1e-4f);
+	}
+
+	CHECK(std::fabs(cube.WindingNumber(float3(0.2f, -0.3f, 0.5f)) - 1.f) < 1e-3f);
+	CHECK(std::fabs(cube.WindingNumber(float3(0.f, 3.f, 0.f))) < 1e-3f);
+
+	// With a face missing the winding number still puts the middle inside.
+	TriangleMesh open = MakeCube();
+	open.indices.resize(open.indices.size() - 6);
+	MeshDistance openCube;
+	CHECK(openCube.Build(open));
+	CHECK(openCube.Distance(float3(0.f)) < 0.f && openCube.Distance(float3(0.f, 0.f, 3.f)) > 0.f);
+
+	// Bad meshes are refused.
+	TriangleMesh broken = MakeCube();
+	broken.indices[5] = 8;
+	MeshDistance unused;
+	CHECK(!unused.Build(broken) && !unused.Build(TriangleMesh()));
+
+	// A finer mesh goes through the dipoles far away and through the triangles near the surface.
+	MeshDistance sphere;
+	CHECK(sphere.Build(MakeSphere(128, 64)));
+	CHECK(sphere.GetNodeCount() > 1000);
+	std::uniform_real_distribution<float> far(-20.f, 20.f);
+	for (int i = 0; i < 2000; i++)
+	{
+		float3 p = i % 2 ? float3(far(rng), far(rng), far(rng)) : float3(dist(rng), dist(rng), dist(rng)) * 0.5f;
+		float expected = length(p) - 1.f;
+		CHECK(std::fabs(sphere.Distance(p) - expected) < 2e-3f);
+	}
+
+	// The blocks take shortcuts but give the same distances, here across the surface.
+	float block[6 * 6 * 6];
+	const float3 origin(0.55f, 0.13f, 0.07f);
+	sphere.DistanceBlock(origin, 0.09f, 6, block);
+	for (int i = 0; i < 6 * 6 * 6; i++)
+		CHECK(std::fabs(block[i] - sphere.Distance(origin + float3(float(i % 6), float(i / 6 % 6), float(i / 36)) * 0.09f)) < 1e-5f);
+}
+
+void test_mesh_brickmap()
+{
+	MeshDistance sphere;
+	CHECK(sphere.Build(MakeSphere(128, 64)));
+
+	tf::Executor executor(2);
+	BrickMapDesc desc;
+	desc.bounds = box3(float3(-1.5f), float3(1.5f));
+	desc.voxelSize = 0.03f;
+	desc.bits = 16;
+
+	BrickMap bricks;
+	CHECK(bricks.Bake(executor, [&sphere](const float3& origin, float step, int count, float* distances)
+	{
+		sphere.DistanceBlock(origin, step, count, distances);
+	}, desc));
+	CHECK(bricks.GetBrickCount() > 0 && bricks.GetBrickCount() < bricks.GetCellCount() / 2);
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> dist(-1.4f, 1.4f);
+	int nearCount = 0;
+	for (int i = 0; i < 5000; i++)
+	{
+		float3 p(dist(rng), dist(rng), dist(rng));
+		float expected = length(p) - 1.f;
+		float sample = bricks.Sample(p);
+		if (std::fabs(expected) < 0.05f)
+		{
+			nearCount++;
+			CHECK(std::fabs(sample - expected) < 0.01f);
+		}
+		CHECK(sample * expected > 0.f || std::fabs(expected) < 0.01f);
+	}
+	CHECK(nearCount > 100);
+}
+
+void test_gltf_mesh()
+{
+	// The cube twice: moved along +x, and mirrored and moved along -x.
+	const TriangleMesh cube = MakeCube();
+	const std::filesystem::path dir = std::filesystem::temp_directory_path();
+	const std::filesystem::path binName = dir / "sdf_test_mesh.bin";
+	const std::filesystem::path gltfName = dir / "sdf_test_mesh.gltf";
+	{
+		std::ofstream bin(binName, std::ios::binary);
+		bin.write(reinterpret_cast<const char*>(cube.positions.data()), cube.positions.size() * sizeof(float3));
+		bin.write(reinterpret_cast<const char*>(cube.indices.data()), cube.indices.size() * sizeof(uint32_t));
+	}
+	{
+		std::ofstream gltf(gltfName);
+		gltf << R"({
+  "asset": { "version": "2.0" },
+  "scene": 0,
+  "scenes": [ { "nodes": [ 0, 1 ] } ],
+  "nodes": [
+    { "mesh": 0, "translation": [ 3, 0, 0 ] },
+    { "mesh": 0, "translation": [ -3, 0, 0 ], "scale": [ -1, 1, 1 ] }
+  ],
+  "meshes": [ { "primitives": [ { "attributes": { "POSITION": 0 }, "indices": 1 } ] } ],
+  "buffers": [ { "uri": "sdf_test_mesh.bin", "byteLength": 240 } ],
+  "bufferViews": [
+    { "buffer": 0, "byteOffset": 0, "byteLength": 96 },
+    { "buffer": 0, "byteOffset": 96, "byteLength": 144 }
+  ],
+  "accessors": [
+    { "bufferView": 0, "componentType": 5126, "count": 8, "type": "VEC3", "min": [ -1, -1, -1 ], "max": [ 1, 1, 1 ] },
+    { "bufferView": 1, "componentType": 5125, "count": 36, "type": "SCALAR" }
+  ]
+})";
+	}
+
+	TriangleMesh mesh;
+	CHECK(LoadGltfMesh(std::make_shared<vfs::NativeFileSystem>(), gltfName, mesh));
+	CHECK(mesh.GetTriangleCount() == 24);
+	CHECK(all(mesh.GetBounds().m_mins == float3(-4.f, -1.f, -1.f)) && all(mesh.GetBounds().m_maxs == float3(4.f, 1.f, 1.f)));
+
+	MeshDistance distance;
+	CHECK(distance.Build(mesh));
+	// Seen from one cube the other is a few dipoles, which is only close to exact.
+	CHECK(std::fabs(distance.WindingNumber(float3(3.f, 0.f, 0.f)) - 1.f) < 1e-2f);
+	CHECK(std::fabs(distance.WindingNumber(float3(-3.f, 0.f, 0.f)) - 1.f) < 1e-2f);
+	CHECK(std::fabs(distance.Distance(float3(0.f)) - 2.f) < 1e-5f);
+
+	TriangleMesh missing;
+	CHECK(!LoadGltfMesh(std::make_shared<vfs::NativeFileSystem>(), dir / "sdf_test_missing.gltf", missing));
+
+	std::filesystem::remove(binName);
+	std::filesystem::remove(gltfName);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_mesh_distance();
+		test_mesh_brickmap();
+		test_gltf_mesh();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,237 @@
+#include "../cpu/Dual.h"
+#include "../cpu/Interval.h"
+#include "../cpu/NoiseVolume.h"
+#include "TestScenes.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	// Every noise of Noise.h at one point, the periodic ones with a period of 5 cells.
+	template<typename F> void EvaluateAll(const Vec3<F>& p, F* out)
+	{
+		Vec2<F> q(p.x, p.z);
+		out[0] = ValueNoise(q);
+		out[1] = ValueNoise(p);
+		out[2] = GradientNoise(q);
+		out[3] = GradientNoise(p);
+		out[4] = ValueFbm(p, 4);
+		out[5] = GradientFbm(q, 5, 5.f);
+		out[6] = GradientFbm(p, 3, 5.f);
+		out[7] = FloorPattern(q);
+		out[8] = NoiseDisplacement(p, 0.1f, 3.f, 3);
+	}
+
+	constexpr int ResultCount = 9;
+
+	template<typename F> void CompareWithScalar()
+	{
+		constexpr int W = WidthOf<F>;
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> dist(-20.0f, 20.0f);
+
+		for (int iter = 0; iter < 500; iter++)
+		{
+			float x[W], y[W], z[W];
+			for (int i = 0; i < W; i++)
+			{
+				x[i] = dist(rng);
+				y[i] = dist(rng);
+				z[i] = dist(rng);
+			}
+
+			F packed[ResultCount];
+			EvaluateAll(Vec3<F>(F::Load(x), F::Load(y), F::Load(z)), packed);
+
+			for (int i = 0; i < W; i++)
+			{
+				float scalar[ResultCount];
+				EvaluateAll(Vec3<float>(x[i], y[i], z[i]), scalar);
+
+				for (int r = 0; r < ResultCount; r++)
+					CHECK(Near(lane(packed[r], i), scalar[r]));
+			}
+		}
+	}
+
+}
+
+void test_noise_values()
+{
+	// The hash is a permutation of the 289 lattice values.
+	bool seen[289] = {};
+	for (int i = 0; i < 289; i++)
+	{
+		float h = NoisePermute(float(i));
+		CHECK(h >= 0.f && h < 289.f && h == std::floor(h));
+		seen[int(h)] = true;
+	}
+	for (bool s : seen)
+		CHECK(s);
+
+	// Gradient noise vanishes on the lattice, value noise takes the lattice values there.
+	CHECK(GradientNoise(Vec3<float>(3.f, -7.f, 12.f)) == 0.f);
+	CHECK(GradientNoise(Vec2<float>(-4.f, 9.f)) == 0.f);
+	CHECK(ValueNoise(Vec2<float>(2.f, 5.f)) == NoiseValue(NoiseHash(2.f, 5.f)));
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-50.0f, 50.0f);
+	double sum = 0.0;
+	for (int i = 0; i < 20000; i++)
+	{
+		Vec3<float> p(dist(rng), dist(rng), dist(rng));
+		float v = ValueFbm(p, 5);
+		float g = GradientNoise(p);
+		float f = FloorPattern(Vec2<float>(p.x, p.z));
+		CHECK(v >= -1.f && v <= 1.f);
+		CHECK(g >= -0.87f && g <= 0.87f);
+		CHECK(f >= 0.02f && f <= 0.62f);
+		CHECK(std::fabs(NoiseDisplacement(p, 0.1f, 2.f, 4)) <= 0.1f);
+		sum += f;
+	}
+	// About the mean of the noise0.jpg texture the floor used to sample.
+	double mean = sum / 20000.0;
+	CHECK(mean > 0.05 && mean < 0.1);
+}
+
+void test_noise_packets()
+{
+	CompareWithScalar<Float4>();
+#if defined(SDF_SIMD_AVX2)
+	CompareWithScalar<Float8>();
+#endif
+}
+
+void test_noise_period()
+{
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> dist(0.0f, 7.0f);
+	for (int i = 0; i < 1000; i++)
+	{
+		Vec3<float> p(dist(rng), dist(rng), dist(rng));
+		Vec3<float> q = p + Vec3<float>(7.f, -14.f, 21.f);
+		CHECK(Near(GradientFbm(p, 4, 7.f), GradientFbm(q, 4, 7.f), 1e-4f));
+		CHECK(Near(ValueFbm(p, 4, 7.f), ValueFbm(q, 4, 7.f), 1e-4f));
+		CHECK(Near(ValueNoise(Vec2<float>(p.x, p.y), 7.f), ValueNoise(Vec2<float>(q.x, q.y), 7.f), 1e-4f));
+	}
+}
+
+void test_noise_volume()
+{
+	tf::Executor executor(2);
+	NoiseVolumeDesc desc;
+	desc.size = 20;
+	desc.period = 5;
+	desc.octaves = 3;
+
+	NoiseVolume volume;
+	CHECK(volume.Build(executor, desc));
+	CHECK(volume.GetMemorySize() == 20 * 20 * 20 * sizeof(float));
+
+	// Voxels hold the fBm at their lattice position, packets and the scalar tail alike.
+	for (int x = 0; x < desc.size; x++)
+		CHECK(Near(volume.At(x, 7, 3), GradientFbm(Vec3<float>(x * 0.25f, 7 * 0.25f, 3 * 0.25f), 3, 5.f)));
+
+	// The volume tiles: one period on is the same lookup, and the border blends into the opposite side.
+	CHECK(Near(volume.Sample(float3(0.3f, 0.6f, 0.1f)), volume.Sample(float3(1.3f, -0.4f, 2.1f)), 1e-4f));
+	CHECK(Near(volume.Sample(float3(0.975f, 0.f, 0.f)), 0.5f * (volume.At(19, 0, 0) + volume.At(0, 0, 0)), 1e-4f));
+
+	NoiseVolumeDesc invalid = desc;
+	invalid.octaves = 0;
+	NoiseVolume empty;
+	CHECK(!empty.Build(executor, invalid) && empty.Empty());
+
+	// The cache is written once and read back afterwards.
+	std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_test_noise.bin";
+	std::filesystem::remove(fileName);
+	vfs::NativeFileSystem fs;
+	NoiseVolume cached;
+	CHECK(cached.LoadOrBuild(executor, fs, fileName, desc));
+	CHECK(std::filesystem::file_size(fileName) == sizeof(NoiseVolumeFileHeader) + volume.GetMemorySize());
+
+	NoiseVolume loaded;
+	CHECK(loaded.Load(fs, fileName));
+	CHECK(loaded.GetDesc().size == 20 && loaded.GetDesc().period == 5 && loaded.GetDesc().octaves == 3 && loaded.GetDesc().gradient);
+	for (int z = 0; z < desc.size; z++)
+		CHECK(loaded.At(4, 11, z) == volume.At(4, 11, z));
+
+	// Another description rebuilds the cache.
+	NoiseVolumeDesc other = desc;
+	other.gradient = false;
+	CHECK(cached.LoadOrBuild(executor, fs, fileName, other));
+	CHECK(!cached.GetDesc().gradient && loaded.Load(fs, fileName) && !loaded.GetDesc().gradient);
+
+	// A truncated file is rejected and leaves the volume as it was.
+	std::filesystem::resize_file(fileName, sizeof(NoiseVolumeFileHeader) + 16);
+	CHECK(!loaded.Load(fs, fileName));
+	CHECK(!loaded.Empty() && loaded.GetMemorySize() == volume.GetMemorySize());
+
+	std::filesystem::remove(fileName);
+}
+
+void test_noise_displacement()
+{
+	auto node = ParseString(R"({
+		"type": "noise", "amplitude": 0.1, "frequency": 3, "octaves": 3,
+		"children": [ { "type": "sphere", "radius": 1.0 } ]
+	})");
+	CHECK(node != nullptr);
+
+	Tape tape;
+	CHECK(CompileTape(*node, tape));
+	CHECK(GetOpcode(tape.instructions[1]) == SDF_OP_DISPLACE_NOISE && tape.instructions[1].params[2] == 3.f);
+
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> dist(-1.5f, 1.5f);
+	for (int i = 0; i < 200; i++)
+	{
+		Vec3<float> p(dist(rng), dist(rng), dist(rng));
+		float d = EvaluateTape(tape, p, 0.f).x;
+		CHECK(Near(d, length(p) - 1.f + NoiseDisplacement(p, 0.1f, 3.f, 3)));
+
+		// The dual numbers carry the gradient of the noise too.
+		Vec2<Dual<float>> dual = EvaluateTape(tape, DualPosition(p), 0.f);
+		const float h = 1e-3f;
+		float dx = EvaluateTape(tape, p + Vec3<float>(h, 0.f, 0.f), 0.f).x - EvaluateTape(tape, p - Vec3<float>(h, 0.f, 0.f), 0.f).x;
+		float dy = EvaluateTape(tape, p + Vec3<float>(0.f, h, 0.f), 0.f).x - EvaluateTape(tape, p - Vec3<float>(0.f, h, 0.f), 0.f).x;
+		CHECK(Near(dual.x.v, d));
+		CHECK(std::fabs(dual.x.d.x - dx / (2.f * h)) < 1e-2f);
+		CHECK(std::fabs(dual.x.d.y - dy / (2.f * h)) < 1e-2f);
+
+		// The interval covers the displaced distances of the region.
+		box3 region(float3(p.x, p.y, p.z) - 0.05f, float3(p.x, p.y, p.z) + 0.05f);
+		Interval range = EvaluateTape(tape, region, 0.f);
+		CHECK(range.lo <= d && d <= range.hi);
+	}
+
+	CHECK(ParseString(R"({ "type": "noise", "octaves": 0, "children": [ { "type": "sphere" } ] })") == nullptr);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_noise_values();
+		test_noise_packets();
+		test_noise_period();
+		test_noise_volume();
+		test_noise_displacement();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
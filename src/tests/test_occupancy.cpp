@@ -0,0 +1,239 @@
+#include "../cpu/ConePrepass.h"
+#include "../cpu/OccupancyGrid.h"
+#include "../cpu/Renderer.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <bitset>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	OccupancyGridDesc GetTestDesc()
+	{
+		OccupancyGridDesc desc;
+		desc.size = 64;
+		return desc;
+	}
+
+	// Checks that the cells inside a clear cell are clear and that no point of a clear cell is inside a
+	// surface of map. Returns how many of the random points were in clear cells.
+	int CheckClearCells(const OccupancyGrid& grid, const SceneMap& map)
+	{
+		for (int level = 1; level < grid.GetLevelCount(); level++)
+		{
+			const int n = 1 << level;
+			for (int z = 0; z < n; z++)
+				for (int y = 0; y < n; y++)
+					for (int x = 0; x < n; x++)
+					{
+						if (grid.IsOccupied(level, int3(x, y, z)))
+							CHECK(grid.IsOccupied(level - 1, int3(x / 2, y / 2, z / 2)));
+					}
+		}
+
+		const box3 bounds = grid.GetBounds();
+		const int finest = grid.GetLevelCount() - 1;
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> dist(0.f, 1.f);
+		int clear = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			const float3 p = bounds.m_mins + float3(dist(rng), dist(rng), dist(rng)) * bounds.diagonal();
+			const int3 cell = min(int3((p - bounds.m_mins) / bounds.diagonal() * float(grid.GetSize())), int3(grid.GetSize() - 1));
+			if (grid.IsOccupied(finest, cell))
+				continue;
+			clear++;
+			CHECK(map(p).x > 0.f);
+		}
+		return clear;
+	}
+
+	uint32_t CountDifferences(const OccupancyGrid& a, const OccupancyGrid& b)
+	{
+		CHECK(a.GetWords().size() == b.GetWords().size());
+		uint32_t count = 0;
+		for (size_t i = 0; i < a.GetWords().size(); i++)
+			count += uint32_t(std::bitset<32>(a.GetWords()[i] ^ b.GetWords()[i]).count());
+		return count;
+	}
+}
+
+void test_occupancy_build()
+{
+	tf::Executor executor(2);
+	const SceneBvh bvh = LoadDefaultBvh();
+	const SceneMap map = GetMap(bvh, 10.f);
+
+	OccupancyGrid grid;
+	CHECK(grid.Build(executor, map, GetTestDesc()));
+	CHECK(grid.GetSize() == 64 && grid.GetLevelCount() == 7);
+	CHECK(std::fabs(grid.GetBounds().diagonal().x - 5.f) < 1e-5f);
+	CHECK(grid.GetOccupiedCount(0) == 1);
+
+	// The solid under the floor is set like the surfaces, which only take a thin layer of the finest level
+	// above it.
+	CHECK(CheckClearCells(grid, map) > 10000);
+	CHECK(grid.GetOccupiedCount(6) > 64 * 64 && grid.GetOccupiedCount(6) < 64 * 64 * 64 / 2);
+
+	// The floor passes through its cells, the sky above the objects doesn't.
+	const box3 bounds = grid.GetBounds();
+	auto cellAt = [&](const float3& p) { return int3((p - bounds.m_mins) / (bounds.diagonal().x / 64.f)); };
+	CHECK(grid.IsOccupied(6, cellAt(float3(2.f, 0.f, 2.f))));
+	CHECK(!grid.IsOccupied(6, cellAt(float3(0.f, 2.f, 0.f))));
+
+	CHECK(grid.GetWords().size() * sizeof(uint32_t) == grid.GetMemorySize());
+	int4 occupancy;
+	float4 constants;
+	grid.GetConstants(occupancy, constants);
+	CHECK(occupancy.x == 64 && occupancy.y == 7 && std::fabs(constants.w - 5.f / 64.f) < 1e-6f);
+}
+
+void test_occupancy_raycast()
+{
+	tf::Executor executor(2);
+	const SceneBvh bvh = LoadDefaultBvh();
+	OccupancyGrid grid;
+	CHECK(grid.Build(executor, GetMap(bvh, 10.f), GetTestDesc()));
+
+	// The jumps land where sphere tracing would go on marching, so the image stays the same with fewer
+	// steps.
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	RenderConstants constants = GetDefaultRenderConstants(10.f, 160, 90);
+	constants.g_Cone = GetConeConstants(0, 160);
+	Image reference;
+	const RenderStats marched = renderer.Render(constants, reference);
+	CHECK(marched.primarySkips == 0);
+
+	renderer.SetOccupancy(&grid);
+	Image image;
+	const RenderStats skipped = renderer.Render(constants, image);
+	CHECK(skipped.primarySkips > 0);
+	CHECK(skipped.primarySteps + skipped.primarySkips < marched.primarySteps);
+	CHECK(ComputePsnr(image, reference) > 40.0);
+
+	// Packets of rays jump the same way.
+	renderer.SetPacketSize(4);
+	const RenderStats packets = renderer.Render(constants, image);
+	CHECK(packets.primarySkips > 0);
+	CHECK(ComputePsnr(image, reference) > 40.0);
+
+	// An empty grid marches every step.
+	OccupancyGrid empty;
+	renderer.SetPacketSize(0);
+	renderer.SetOccupancy(&empty);
+	CHECK(renderer.Render(constants, image).primarySteps == marched.primarySteps);
+}
+
+void test_occupancy_update()
+{
+	tf::Executor executor(2);
+	SceneBvh bvh = LoadDefaultBvh();
+
+	// The blobs are displaced with the time, the floor and the rest of the objects aren't.
+	std::vector<box3> regions;
+	GetTimeDependentRegions(GetMap(bvh, 10.f), regions);
+	CHECK(!regions.empty() && regions.size() < bvh.GetObjectCount());
+	for (const box3& region : regions)
+		CHECK(!region.isempty() && std::isfinite(region.diagonal().x) && region.diagonal().x < 2.f);
+
+	std::vector<box3> everywhere;
+	GetTimeDependentRegions(SceneMap(), everywhere);
+	CHECK(everywhere.size() == 1 && std::isinf(everywhere[0].diagonal().x));
+
+	// Updating the regions at the next time holds the surfaces at that time, for a fraction of the
+	// evaluations of a build. It keeps the bits of the cells outside the regions, where a build may decide
+	// a few of them otherwise as the fields of the blobs change a little beyond their bounds.
+	OccupancyGrid grid;
+	CHECK(grid.Build(executor, GetMap(bvh, 10.f), GetTestDesc()));
+	const uint32_t evaluations = grid.Update(executor, GetMap(bvh, 10.5f), regions);
+	CHECK(CheckClearCells(grid, GetMap(bvh, 10.5f)) > 10000);
+	OccupancyGrid fresh;
+	CHECK(fresh.Build(executor, GetMap(bvh, 10.5f), GetTestDesc()));
+	CHECK(CountDifferences(grid, fresh) < fresh.GetOccupiedCount(6) / 1000);
+	OccupancyGrid rebuilt;
+	CHECK(rebuilt.Update(executor, GetMap(bvh, 10.5f), regions) == 0);
+	CHECK(rebuilt.Build(executor, GetMap(bvh, 10.f), GetTestDesc()));
+	CHECK(evaluations * 4 < rebuilt.Update(executor, GetMap(bvh, 10.5f), { rebuilt.GetBounds() }));
+	CHECK(rebuilt.GetWords() == fresh.GetWords());
+
+	// So does moving an object through the BVH and updating where it was and is.
+	auto isSphere = [&](uint32_t source)
+	{
+		const uint32_t index = bvh.GetInstructionIndex(source);
+		return index != SceneBvh::c_InvalidIndex && GetOpcode(bvh.GetInstructions()[index]) == SDF_OP_SPHERE;
+	};
+	uint32_t sphere = 0;
+	while (!isSphere(sphere))
+		sphere++;
+	TapeInstruction ins = bvh.GetInstructions()[bvh.GetInstructionIndex(sphere)];
+	ins.params[1] += 0.4f;
+	bvh.SetParameters(sphere, ins.params);
+	std::vector<box3> changed;
+	CHECK(bvh.Refit(&changed) > 0);
+	CHECK(changed.size() == 1);
+
+	const uint32_t moved = CountDifferences(grid, fresh);
+	CHECK(grid.Update(executor, GetMap(bvh, 10.5f), changed) < evaluations * 4);
+	CHECK(CheckClearCells(grid, GetMap(bvh, 10.5f)) > 10000);
+	CHECK(CountDifferences(grid, fresh) > moved + 100);
+	CHECK(fresh.Build(executor, GetMap(bvh, 10.5f), GetTestDesc()));
+	CHECK(CountDifferences(grid, fresh) < fresh.GetOccupiedCount(6) / 1000);
+
+	// A region around everything classifies the grid from scratch.
+	grid.Update(executor, GetMap(bvh, 10.5f), everywhere);
+	CHECK(grid.GetWords() == fresh.GetWords());
+}
+
+void test_occupancy_invalid()
+{
+	tf::Executor executor(1);
+	const SceneMap map;
+	OccupancyGrid grid;
+	for (int size : { 0, 48, SDF_OCCUPANCY_MAX_SIZE * 2 })
+	{
+		OccupancyGridDesc desc;
+		desc.size = size;
+		CHECK(!grid.Build(executor, map, desc));
+		CHECK(grid.Empty());
+	}
+
+	OccupancyGridDesc flat;
+	flat.bounds = box3(float3(-1.f, 0.f, -1.f), float3(1.f, 0.f, 1.f));
+	CHECK(!grid.Build(executor, map, flat));
+	CHECK(grid.Empty());
+	CHECK(grid.Update(executor, map, { flat.bounds }) == 0);
+
+	int4 occupancy;
+	float4 constants;
+	grid.GetConstants(occupancy, constants);
+	CHECK(occupancy.x == 0);
+	const float2 span = grid.FindEmptySpan(float3(0.f, 1.f, 0.f), float3(1.f, 0.f, 0.f), 0.f, SDF_RAY_END);
+	CHECK(span.x > span.y);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_occupancy_build();
+		test_occupancy_raycast();
+		test_occupancy_update();
+		test_occupancy_invalid();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
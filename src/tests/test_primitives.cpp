@@ -0,0 +1,165 @@
+#include "../cpu/Dual.h"
+#include "../cpu/Primitives.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <cstdio>
+#include <random>
+
+using namespace sdf;
+
+namespace
+{
+	// Evaluates every primitive and operator at one point.
+	template<typename F> void EvaluateAll(const Vec3<F>& p, F* out)
+	{
+		Vec3<F> b = Splat<F>(0.3f, 0.3f, 0.3f);
+		F s1 = sdSphere(p, F(0.35f));
+		F s2 = sdSphere(p - Splat<F>(0.4f, 0.1f, 0.f), F(0.3f));
+
+		out[0] = sdPlane(p, Splat<F>(0.f, 1.f, 0.f));
+		out[1] = s1;
+		out[2] = sdBox(p, b);
+		out[3] = sdBoxFrame(p, b, F(0.06f));
+		out[4] = sdTorus(p, Vec2<F>(0.27f, 0.03f));
+		out[5] = sdCylinder(p, Vec2<F>(0.3f, 0.3f), 0);
+		out[6] = sdCylinder(p, Vec2<F>(0.3f, 0.3f), 1);
+		out[7] = sdCylinder(p, Vec2<F>(0.3f, 0.3f), 2);
+		out[8] = sdOctahedron(p, F(0.3f));
+		out[9] = opUnion(s1, s2);
+		out[10] = opSubtraction(s1, s2);
+		out[11] = opIntersection(s1, s2);
+		out[12] = opSmoothUnion(s1, s2, F(0.25f));
+		out[13] = opSmoothSubtraction(s1, s2, F(0.25f));
+		out[14] = opSmoothIntersection(s1, s2, F(0.25f));
+		out[15] = opRound(out[2], F(0.1f));
+		out[16] = opDisplace(s1, 2.5f);
+	}
+
+	constexpr int ResultCount = 17;
+
+	template<typename F> void CompareWithScalar()
+	{
+		constexpr int W = WidthOf<F>;
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+		for (int iter = 0; iter < 1000; iter++)
+		{
+			float x[W], y[W], z[W];
+			for (int i = 0; i < W; i++)
+			{
+				x[i] = dist(rng);
+				y[i] = dist(rng);
+				z[i] = dist(rng);
+			}
+
+			F packed[ResultCount];
+			EvaluateAll(Vec3<F>(F::Load(x), F::Load(y), F::Load(z)), packed);
+
+			for (int i = 0; i < W; i++)
+			{
+				float scalar[ResultCount];
+				EvaluateAll(Vec3<float>(x[i], y[i], z[i]), scalar);
+
+				for (int r = 0; r < ResultCount; r++)
+					CHECK(Near(lane(packed[r], i), scalar[r]));
+			}
+		}
+	}
+}
+
+void test_primitive_values()
+{
+	Vec3<float> origin(0.f, 0.f, 0.f);
+
+	CHECK(Near(sdSphere(origin, 0.35f), -0.35f));
+	CHECK(Near(sdSphere(Vec3<float>(1.f, 0.f, 0.f), 0.35f), 0.65f));
+	CHECK(Near(sdBox(Vec3<float>(1.f, 0.f, 0.f), Vec3<float>(0.3f, 0.3f, 0.3f)), 0.7f));
+	CHECK(Near(sdBox(origin, Vec3<float>(0.3f, 0.2f, 0.3f)), -0.2f));
+	CHECK(Near(sdTorus(Vec3<float>(0.27f, 0.f, 0.f), Vec2<float>(0.27f, 0.03f)), -0.03f));
+	CHECK(Near(sdOctahedron(Vec3<float>(0.3f, 0.f, 0.f), 0.3f), 0.0f));
+	CHECK(Near(sdOctahedron(Vec3<float>(1.f, 0.f, 0.f), 0.3f), 0.7f));
+	CHECK(Near(sdCylinder(Vec3<float>(0.f, 0.f, 1.f), Vec2<float>(0.3f, 0.3f), 0), 0.7f));
+	CHECK(Near(sdCylinder(Vec3<float>(1.f, 0.f, 0.f), Vec2<float>(0.3f, 0.3f), 1), 0.7f));
+	CHECK(Near(sdPlane(Vec3<float>(3.f, 2.f, 1.f), Vec3<float>(0.f, 1.f, 0.f)), 2.0f));
+
+	// Far apart the smooth operators must reduce to the hard ones.
+	CHECK(Near(opSmoothUnion(0.1f, 5.0f, 0.25f), opUnion(0.1f, 5.0f)));
+	CHECK(Near(opSmoothIntersection(0.1f, 5.0f, 0.25f), opIntersection(0.1f, 5.0f)));
+
+	Vec2<float> a(1.0f, 3.0f), b(2.0f, 7.0f);
+	CHECK(opU(a, b).y == 3.0f);
+	CHECK(opU(b, a).y == 3.0f);
+}
+
+void test_primitive_packets()
+{
+#if defined(SDF_SIMD_SSE)
+	CompareWithScalar<Float4>();
+#endif
+#if defined(SDF_SIMD_AVX2)
+	CompareWithScalar<Float8>();
+#endif
+}
+
+void test_primitive_gradients()
+{
+	// The dual-number pass must give the distances of the plain one and gradients that match
+	// central differences, except at the few samples that land next to a crease of the field.
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	const float h = 1e-3f;
+	int mismatches[ResultCount] = {};
+
+	const int samples = 1000;
+	for (int iter = 0; iter < samples; iter++)
+	{
+		Vec3<float> p(dist(rng), dist(rng), dist(rng));
+		Dual<float> dual[ResultCount];
+		EvaluateAll(DualPosition(p), dual);
+
+		float value[ResultCount], xp[ResultCount], xm[ResultCount], yp[ResultCount], ym[ResultCount], zp[ResultCount], zm[ResultCount];
+		EvaluateAll(p, value);
+		EvaluateAll(p + Vec3<float>(h, 0.f, 0.f), xp);
+		EvaluateAll(p - Vec3<float>(h, 0.f, 0.f), xm);
+		EvaluateAll(p + Vec3<float>(0.f, h, 0.f), yp);
+		EvaluateAll(p - Vec3<float>(0.f, h, 0.f), ym);
+		EvaluateAll(p + Vec3<float>(0.f, 0.f, h), zp);
+		EvaluateAll(p - Vec3<float>(0.f, 0.f, h), zm);
+
+		for (int r = 0; r < ResultCount; r++)
+		{
+			CHECK(Near(dual[r].v, value[r]));
+			Vec3<float> difference = dual[r].d - Vec3<float>(xp[r] - xm[r], yp[r] - ym[r], zp[r] - zm[r]) * (0.5f / h);
+			if (length(difference) > 1e-2f)
+				mismatches[r]++;
+		}
+	}
+
+	for (int r = 0; r < ResultCount; r++)
+		CHECK(mismatches[r] < samples / 100);
+
+	// Exact where the gradient is known in closed form.
+	Dual<float> sphere = sdSphere(DualPosition(Vec3<float>(0.3f, 0.4f, 0.f)), Dual<float>(0.35f));
+	CHECK(Near(sphere.d.x, 0.6f) && Near(sphere.d.y, 0.8f) && sphere.d.z == 0.f);
+	Dual<float> inside = sdBox(DualPosition(Vec3<float>(0.1f, -0.25f, 0.f)), Splat<Dual<float>>(0.3f, 0.3f, 0.3f));
+	CHECK(inside.d.x == 0.f && inside.d.y == -1.f && inside.d.z == 0.f);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_primitive_values();
+		test_primitive_packets();
+		test_primitive_gradients();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
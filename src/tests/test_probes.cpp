@@ -0,0 +1,207 @@
+#include "../cpu/ProbeGrid.h"
+#include "../cpu/Renderer.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	ProbeGridDesc GetTestDesc()
+	{
+		ProbeGridDesc desc;
+		desc.counts = int3(4, 3, 4);
+		desc.raysPerProbe = 32;
+		return desc;
+	}
+
+	template<typename T> bool SameTexels(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+	}
+
+	// Updates every probe of the grid passes times.
+	void UpdateAll(tf::Executor& executor, ProbeGrid& grid, const SceneMap& map, const RenderConstants& constants, int passes)
+	{
+		for (int i = 0; i < passes; i++)
+			CHECK(grid.Update(executor, map, constants, grid.GetProbeCount()) == grid.GetProbeCount());
+	}
+}
+
+void test_probes_octahedral()
+{
+	std::mt19937 rng(3);
+	std::normal_distribution<float> dist;
+	for (int i = 0; i < 1000; i++)
+	{
+		const float3 dir = normalize(float3(dist(rng), dist(rng), dist(rng)));
+		const float2 p = EncodeOctahedral(dir);
+		CHECK(std::fabs(p.x) <= 1.f && std::fabs(p.y) <= 1.f);
+		CHECK(length(DecodeOctahedral(p) - dir) < 1e-5f);
+	}
+	CHECK(length(DecodeOctahedral(EncodeOctahedral(float3(0.f, 0.f, -1.f))) - float3(0.f, 0.f, -1.f)) < 1e-6f);
+}
+
+void test_probes_update()
+{
+	tf::Executor executor(2);
+	const SceneBvh bvh = LoadDefaultBvh();
+	const SceneMap map = GetMap(bvh, 10.f);
+	const RenderConstants constants = GetDefaultRenderConstants(10.f, 160, 90);
+
+	ProbeGrid grid;
+	CHECK(grid.Init(GetTestDesc()));
+	CHECK(!grid.Empty() && grid.GetProbeCount() == 48);
+	CHECK(grid.GetMemorySize() == 48 * (64 * sizeof(float4) + 256 * sizeof(float2)));
+	CHECK(length(grid.GetProbePosition(47) - float3(2.5f, 2.1f, 2.5f)) < 1e-5f);
+
+	// The budget walks the grid in turn. A probe of it is inside an object, which switches it off.
+	RenderStats stats;
+	uint32_t inside = 0;
+	for (uint32_t probe = 0; probe < 48; probe += 16)
+	{
+		CHECK(!grid.HoldsLight(probe + 1));
+		CHECK(grid.Update(executor, map, constants, 16, &stats) == 16);
+		for (uint32_t i = probe; i < probe + 16; i++)
+		{
+			const bool outside = map(grid.GetProbePosition(i)).x > 0.f;
+			CHECK(grid.HoldsLight(i) == outside);
+			inside += outside ? 0 : 1;
+		}
+	}
+	CHECK(inside == 1);
+	CHECK(stats.primaryRays == (48 - inside) * 32 && stats.primarySteps > stats.primaryRays && stats.shadowRays > 0);
+	CHECK(grid.Update(executor, map, constants, 0) == 0);
+
+	int4 probes;
+	float4 origin, spacing;
+	grid.GetConstants(probes, origin, spacing);
+	CHECK(probes.x == 4 && probes.y == 3 && probes.z == 4);
+	CHECK(std::fabs(spacing.y - 1.f) < 1e-5f && origin.w > spacing.x && spacing.w > 0.f);
+
+	// The borders repeat the texels across the edges of the octahedron, so that bilinear samples wrap.
+	const int n = SDF_PROBE_IRRADIANCE_SIZE + 2;
+	const float4* texels = &grid.GetIrradiance()[5 * n * n];
+	for (int i = 1; i < n - 1; i++)
+	{
+		CHECK(texels[i].x == texels[n + n - 1 - i].x);
+		CHECK(texels[i * n].y == texels[(n - 1 - i) * n + 1].y);
+	}
+	CHECK(texels[0].z == texels[(n - 2) * n + n - 2].z);
+
+	// Grids updated the same way hold the same light.
+	ProbeGrid other;
+	CHECK(other.Init(GetTestDesc()));
+	for (int i = 0; i < 3; i++)
+		other.Update(executor, map, constants, 16);
+	CHECK(SameTexels(other.GetIrradiance(), grid.GetIrradiance()) && SameTexels(other.GetDistance(), grid.GetDistance()));
+
+	grid.Reset();
+	CHECK(!grid.HoldsLight(0) && !grid.Empty());
+}
+
+void test_probes_lighting()
+{
+	tf::Executor executor(2);
+	const SceneBvh bvh = LoadDefaultBvh();
+	const SceneMap map = GetMap(bvh, 10.f);
+
+	// Under the open sky alone, the irradiance of an upward surface is that of the fixed sky term.
+	RenderConstants sky = GetDefaultRenderConstants(10.f, 160, 90);
+	sky.g_Switch.y = 0;
+	ProbeGridDesc desc = GetTestDesc();
+	desc.bounds = box3(float3(-2.5f, 4.f, -2.5f), float3(2.5f, 6.f, 2.5f));
+	ProbeGrid grid;
+	CHECK(grid.Init(desc));
+	UpdateAll(executor, grid, map, sky, 1);
+	const float3 up = grid.Sample(float3(0.f, 5.f, 0.f), float3(0.f, 1.f, 0.f), float3(0.f, -1.f, 0.f));
+	const float3 expected = 0.6f * float3(0.4f, 0.6f, 1.15f);
+	CHECK(length(up - expected) < 0.1f * length(expected));
+
+	// Above the floor, light comes up from its red pattern.
+	const RenderConstants constants = GetDefaultRenderConstants(10.f, 160, 90);
+	CHECK(grid.Init(GetTestDesc()));
+	UpdateAll(executor, grid, map, constants, 3);
+	const float3 down = grid.Sample(float3(2.f, 0.5f, -2.f), float3(0.f, -1.f, 0.f), float3(0.f, 0.f, 1.f));
+	CHECK(down.x > down.y && down.x > down.z && down.x > 0.f);
+
+	// Probes below the floor are inside the solid and don't light anything.
+	desc = GetTestDesc();
+	desc.bounds.m_mins.y = -0.9f;
+	CHECK(grid.Init(desc));
+	UpdateAll(executor, grid, map, constants, 1);
+	CHECK(!grid.HoldsLight(0) && grid.HoldsLight(grid.GetProbeCount() - 1));
+
+	// A render with the grid marches the same primary rays and only changes the diffuse light.
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	Image reference;
+	const RenderStats fixed = renderer.Render(constants, reference);
+	CHECK(grid.Init(GetTestDesc()));
+	UpdateAll(executor, grid, map, constants, 2);
+	renderer.SetProbes(&grid);
+	Image image;
+	const RenderStats probed = renderer.Render(constants, image);
+	CHECK(probed.primarySteps == fixed.primarySteps);
+	const double psnr = ComputePsnr(image, reference);
+	CHECK(psnr > 15.0 && psnr < 60.0);
+
+	// An empty grid keeps the fixed sky.
+	ProbeGrid empty;
+	renderer.SetProbes(&empty);
+	renderer.Render(constants, image);
+	CHECK(std::isinf(ComputePsnr(image, reference)));
+}
+
+void test_probes_invalid()
+{
+	ProbeGrid grid;
+	ProbeGridDesc desc;
+	desc.counts = int3(1, 4, 4);
+	CHECK(!grid.Init(desc));
+	CHECK(grid.Empty());
+
+	desc = ProbeGridDesc();
+	desc.raysPerProbe = 0;
+	CHECK(!grid.Init(desc));
+
+	desc = ProbeGridDesc();
+	desc.bounds = box3(float3(-1.f, 0.f, -1.f), float3(1.f, 0.f, 1.f));
+	CHECK(!grid.Init(desc));
+	CHECK(grid.Empty());
+
+	tf::Executor executor(1);
+	CHECK(grid.Update(executor, SceneMap(), GetDefaultRenderConstants(0.f, 16, 16), 8) == 0);
+	int4 probes;
+	float4 origin, spacing;
+	grid.GetConstants(probes, origin, spacing);
+	CHECK(probes.x == 0);
+	const float3 sky = grid.Sample(float3(0.f), float3(0.f, 1.f, 0.f), float3(0.f, 0.f, 1.f));
+	CHECK(length(sky - 0.6f * float3(0.4f, 0.6f, 1.15f)) < 1e-5f);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_probes_octahedral();
+		test_probes_update();
+		test_probes_lighting();
+		test_probes_invalid();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include "../cpu/RandomScene.h"
+#include "../cpu/TapePruning.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cstdio>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	// Checks that the pruned tape agrees with the full tape everywhere in the region and that the range is conservative.
+	void CheckRegion(const Tape& tape, const box3& region, float time, std::mt19937& rng)
+	{
+		Tape pruned;
+		Interval range = PruneTape(tape, region, time, pruned);
+		CHECK(!pruned.Empty());
+		CHECK(pruned.Size() <= tape.Size());
+		CHECK(pruned.maxStackDepth <= tape.maxStackDepth);
+
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		for (int i = 0; i < 64; i++)
+		{
+			float3 p = region.m_mins + region.diagonal() * float3(unit(rng), unit(rng), unit(rng));
+			Vec3<float> pos(p.x, p.y, p.z);
+
+			Vec2<float> expected = EvaluateTape(tape, pos, time);
+			Vec2<float> actual = EvaluateTape(pruned, pos, time);
+
+			CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+			CHECK(expected.y == actual.y);
+			CHECK(range.Contains(expected.x));
+		}
+	}
+}
+
+void test_pruning_regions()
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	Tape defaultScene = LoadDefaultTape();
+	Tape randomScene = Compile(*MakeRandomScene(400, 11));
+
+	for (const Tape* tape : { &defaultScene, &randomScene })
+	{
+		const float extent = tape == &defaultScene ? 2.0f : 6.0f;
+		for (int i = 0; i < 200; i++)
+		{
+			float3 center((unit(rng) * 2.f - 1.f) * extent, unit(rng) * 1.5f, (unit(rng) * 2.f - 1.f) * extent);
+			float3 size = float3(unit(rng), unit(rng), unit(rng)) * 0.5f + 0.01f;
+			CheckRegion(*tape, box3(center - size, center + size), 1.7f, rng);
+		}
+	}
+}
+
+void test_pruning_shrinks_tape()
+{
+	Tape tape = Compile(*MakeRandomScene(400, 11));
+
+	// A small cell only sees a handful of primitives.
+	Tape pruned;
+	PruneTape(tape, box3(float3(0.f, 0.5f, 0.f), float3(0.1f, 0.6f, 0.1f)), 0.f, pruned);
+	CHECK(pruned.Size() * 10 < tape.Size());
+
+	// The whole scene can't be pruned at all.
+	PruneTape(tape, box3(float3(-20.f), float3(20.f)), 0.f, pruned);
+	CHECK(pruned.Size() == tape.Size());
+}
+
+void test_pruning_tiles()
+{
+	Tape tape = LoadDefaultTape();
+	Camera camera = Camera::Orbit(3.0f);
+	const int2 resolution(160, 90);
+	const float2 fres = float2(resolution);
+
+	tf::Executor executor(4);
+	TileTapes tiles;
+	PruneTiles(executor, tape, camera, resolution, 16, { 0.f, 2.f, 4.f, 8.f, 20.f }, 3.0f, tiles);
+
+	CHECK(all(tiles.tileCount == int2(10, 6)));
+	CHECK(tiles.tapes.size() == size_t(10 * 6 * 4));
+	CHECK(tiles.GetAverageSize() < double(tape.Size()));
+	CHECK(tiles.FindSlab(0.f) == 0 && tiles.FindSlab(3.f) == 1 && tiles.FindSlab(19.f) == 3 && tiles.FindSlab(25.f) == -1);
+	CHECK(tiles.FindSlab(-0.5f) == -1);
+
+	// In front of the first slab, where its tape wasn't pruned for, there is none.
+	TileTapes distant;
+	PruneTiles(executor, tape, camera, resolution, 16, { 2.f, 4.f }, 3.0f, distant);
+	CHECK(distant.FindSlab(1.f) == -1 && distant.FindSlab(2.f) == 0 && distant.FindSlab(3.9f) == 0 && distant.FindSlab(4.f) == -1);
+
+	// Points along the pixel rays must see the same field through their tile's tape.
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	for (int i = 0; i < 5000; i++)
+	{
+		float2 pixel(unit(rng) * fres.x, unit(rng) * fres.y);
+		float t = unit(rng) * 19.99f;
+		float3 p = camera.origin + camera.PixelRay(pixel, fres) * t;
+		Vec3<float> pos(p.x, p.y, p.z);
+
+		const Tape& local = tiles.GetTape(int(pixel.x) / 16, int(pixel.y) / 16, tiles.FindSlab(t));
+		Vec2<float> expected = EvaluateTape(tape, pos, 3.0f);
+		Vec2<float> actual = EvaluateTape(local, pos, 3.0f);
+		CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+		CHECK(expected.y == actual.y);
+	}
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_pruning_regions();
+		test_pruning_shrinks_tape();
+		test_pruning_tiles();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+#include "../cpu/SceneQuery.h"
+#include "../cpu/Tape.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	// A unit sphere of material 3 at the origin and a box of material 5 around (3, 0, 0).
+	bool BuildTestScene(SceneBvh& bvh)
+	{
+		auto node = ParseString(R"({
+			"type": "union",
+			"children": [
+				{ "type": "sphere", "radius": 1.0, "material": 3 },
+				{ "type": "box", "position": [3, 0, 0], "size": [0.5, 0.5, 0.5], "material": 5 }
+			]
+		})");
+		Tape tape;
+		return node && CompileTape(*node, tape) && bvh.Build(tape);
+	}
+}
+
+void test_point_queries()
+{
+	SceneBvh bvh;
+	CHECK(BuildTestScene(bvh));
+	SceneMap map;
+	map.bvh = &bvh;
+
+	tf::Executor executor(4);
+	SceneQuery query(executor, map);
+
+	// Not a whole number of packets, so the last one is partial.
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> dist(-4.f, 4.f);
+	Float3Array positions;
+	positions.Resize(1001);
+	for (size_t i = 0; i < positions.Size(); i++)
+		positions.Set(i, float3(dist(rng), dist(rng), dist(rng)));
+
+	std::vector<float> distances, materials;
+	query.Distance(positions, distances, &materials);
+	CHECK(distances.size() == positions.Size() && materials.size() == positions.Size());
+	for (size_t i = 0; i < positions.Size(); i++)
+	{
+		const float2 expected = map(positions.Get(i));
+		CHECK(std::fabs(distances[i] - expected.x) < 1e-5f);
+		CHECK(materials[i] == expected.y);
+	}
+
+	Float3Array gradients;
+	query.Gradient(positions, gradients);
+	for (size_t i = 0; i < positions.Size(); i++)
+	{
+		const float3 p = positions.Get(i);
+		if (materials[i] == 3.f)
+			CHECK(length(gradients.Get(i) - normalize(p)) < 1e-4f);
+	}
+
+	std::vector<float> radii(positions.Size(), 0.5f);
+	std::vector<float> depths;
+	query.SphereOverlap(positions, radii, depths);
+	for (size_t i = 0; i < positions.Size(); i++)
+		CHECK(std::fabs(depths[i] - (0.5f - distances[i])) < 1e-6f);
+}
+
+void test_ray_queries()
+{
+	SceneBvh bvh;
+	CHECK(BuildTestScene(bvh));
+	SceneMap map;
+	map.bvh = &bvh;
+
+	tf::Executor executor(4);
+	SceneQuery query(executor, map);
+
+	// At the sphere, at the box, away from both, too short to get there, and from inside the sphere.
+	RayQueries rays;
+	const float3 origins[] = { float3(0.f, 0.f, -5.f), float3(3.f, 0.f, -5.f), float3(0.f, 0.f, -5.f), float3(0.f, 0.f, -5.f), float3(0.2f, 0.f, 0.f) };
+	const float3 directions[] = { float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f), float3(0.f, 0.f, -1.f), float3(0.f, 0.f, 1.f), float3(1.f, 0.f, 0.f) };
+	const float maxDistances[] = { 20.f, 20.f, 20.f, 3.f, 20.f };
+	rays.origins.Resize(5);
+	rays.directions.Resize(5);
+	for (size_t i = 0; i < 5; i++)
+	{
+		rays.origins.Set(i, origins[i]);
+		rays.directions.Set(i, directions[i]);
+		rays.maxDistances.push_back(maxDistances[i]);
+	}
+
+	RayHits hits;
+	query.Raycast(rays, hits);
+	CHECK(std::fabs(hits.t[0] - 4.f) < 1e-3f && hits.materials[0] == 3.f);
+	CHECK(std::fabs(hits.t[1] - 4.5f) < 1e-3f && hits.materials[1] == 5.f);
+	CHECK(hits.t[2] == -1.f && hits.materials[2] == -1.f);
+	CHECK(hits.t[3] == -1.f);
+	CHECK(hits.t[4] == 0.f && hits.materials[4] == 3.f);
+
+	// Random rays at the sphere against the analytic intersection, the same with a single thread.
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> dist(-0.9f, 0.9f);
+	RayQueries many;
+	const size_t count = 777;
+	many.origins.Resize(count);
+	many.directions.Resize(count);
+	many.maxDistances.assign(count, 20.f);
+	for (size_t i = 0; i < count; i++)
+	{
+		const float3 target(dist(rng) * 0.6f, dist(rng) * 0.6f, 0.f);
+		const float3 origin(dist(rng) * 2.f, dist(rng) * 2.f, -6.f);
+		many.origins.Set(i, origin);
+		many.directions.Set(i, normalize(target - origin));
+	}
+	query.Raycast(many, hits);
+	for (size_t i = 0; i < count; i++)
+	{
+		const float3 ro = many.origins.Get(i), rd = many.directions.Get(i);
+		const float b = dot(ro, rd);
+		const float expected = -b - std::sqrt(b * b - dot(ro, ro) + 1.f);
+		CHECK(std::fabs(hits.t[i] - expected) < 1e-3f);
+	}
+
+	tf::Executor single(1);
+	RayHits singleHits;
+	SceneQuery(single, map).Raycast(many, singleHits);
+	CHECK(singleHits.t == hits.t && singleHits.materials == hits.materials);
+
+	// Spheres of radius 0.5 stop 1.5 from the origin.
+	SweepQueries sweeps;
+	sweeps.origins.Resize(3);
+	sweeps.directions.Resize(3);
+	sweeps.origins.Set(0, float3(0.f, 0.f, -5.f));
+	sweeps.origins.Set(1, float3(0.5f, 0.f, -5.f));
+	sweeps.origins.Set(2, float3(0.f, 2.f, -5.f));
+	for (size_t i = 0; i < 3; i++)
+		sweeps.directions.Set(i, float3(0.f, 0.f, 1.f));
+	sweeps.radii.assign(3, 0.5f);
+	sweeps.maxDistances.assign(3, 10.f);
+
+	SweepHits contacts;
+	query.SphereSweep(sweeps, contacts);
+	CHECK(std::fabs(contacts.t[0] - 3.5f) < 1e-3f && contacts.materials[0] == 3.f);
+	CHECK(length(contacts.normals.Get(0) - float3(0.f, 0.f, -1.f)) < 1e-3f);
+	const float t1 = 5.f - std::sqrt(2.f);
+	CHECK(std::fabs(contacts.t[1] - t1) < 1e-3f);
+	CHECK(length(contacts.normals.Get(1) - normalize(float3(0.5f, 0.f, -5.f + t1))) < 1e-3f);
+	CHECK(contacts.t[2] == -1.f && all(contacts.normals.Get(2) == float3(0.f)));
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_point_queries();
+		test_ray_queries();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,581 @@
+#include "../cpu/Accumulation.h"
+#include "../cpu/ConePrepass.h"
+#include "../cpu/LightingPass.h"
+#include "../cpu/PacketMarching.h"
+#include "../cpu/TemporalReuse.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace donut;
+using namespace sdf;
+
+void test_renderer_tiles_and_threads()
+{
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 72, 40);
+
+	tf::Executor single(1);
+	CpuRenderer reference(single);
+	reference.SetTileSize(72);
+	Image expected;
+	RenderStats stats = reference.Render(constants, expected);
+
+	CHECK(stats.primaryRays == 72 * 40);
+	CHECK(stats.shadowRays > 0 && stats.primarySteps > stats.primaryRays);
+
+	// Tiles are independent, so any tiling and thread count must give the same image.
+	tf::Executor executor(4);
+	CpuRenderer renderer(executor);
+	renderer.SetTileSize(7);
+	Image image;
+	RenderStats tiledStats = renderer.Render(constants, image);
+
+	CHECK(image.width == 72 && image.height == 40);
+	CHECK(std::memcmp(image.pixels.data(), expected.pixels.data(), image.pixels.size() * sizeof(float3)) == 0);
+	CHECK(tiledStats.GetSteps() == stats.GetSteps());
+}
+
+void test_renderer_scene_matches_builtin()
+{
+	// At g_Time = 0 the tape of Scene/default.json is the built-in scene (see test_tape.cpp).
+	RenderConstants constants = GetDefaultRenderConstants(0.0f, 96, 54);
+	SceneBvh bvh = LoadDefaultBvh();
+
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+
+	Image builtin;
+	renderer.Render(constants, builtin);
+
+	Image scene;
+	renderer.SetScene(&bvh);
+	renderer.Render(constants, scene);
+
+	CHECK(ComputePsnr(builtin, scene) > 60.0);
+
+	// Something other than the background was hit.
+	float3 sum(0.f);
+	for (const float3& c : scene.pixels)
+		sum += c;
+	CHECK(sum.x > 0.f && sum.y > 0.f && sum.z > 0.f);
+}
+
+void test_renderer_cone_prepass()
+{
+	const int width = 160;
+	const int height = 90;
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+	SceneBvh bvh = LoadDefaultBvh();
+
+	SceneMap map;
+	map.bvh = &bvh;
+	map.time = constants.g_Time.x;
+
+	tf::Executor executor(2);
+	std::vector<float> depth;
+	RenderStats prepassStats;
+	RenderConePrepass(executor, constants, map, depth, &prepassStats);
+
+	const int2 tileCount = GetConeTileCount(constants);
+	CHECK(all(tileCount == int2(20, 12)));
+	CHECK(depth.size() == 20 * 12);
+	CHECK(prepassStats.prepassRays == depth.size());
+
+	// The start distance is conservative: nothing is hit in front of it, and the rays that found
+	// a surface from the fixed start distance find the same one.
+	const Camera camera = Camera::Orbit(constants.g_Time.x);
+	const float2 resolution = float2(float(width), float(height));
+	int skipped = 0;
+	int mismatches = 0;
+	RenderStats before;
+	RenderStats after;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float2 pixel(float(x) + 0.5f, float(y) + 0.5f);
+			float3 rd = camera.PixelRay(pixel, resolution);
+			float tmin = GetConeStart(constants, depth, pixel);
+			CHECK(tmin >= SDF_RAY_START && tmin <= SDF_RAY_END);
+			skipped += tmin > SDF_RAY_START;
+
+			for (int i = 0; i < 16 && tmin > SDF_RAY_START; i++)
+			{
+				float t = SDF_RAY_START + (tmin - SDF_RAY_START) * float(i) / 16.0f;
+				CHECK(map(camera.origin + rd * t).x > 0.f);
+			}
+
+			float2 reference = Raycast(map, camera.origin, rd, 256, SDF_RAY_START, 1.0f, &before);
+			float2 res = Raycast(map, camera.origin, rd, 256, tmin, 1.0f, &after);
+			if (reference.y >= 0.f && (res.y != reference.y || std::fabs(res.x - reference.x) > 1e-3f * reference.x))
+				mismatches++;
+		}
+	}
+
+	CHECK(skipped > width * height / 2);
+	CHECK(mismatches < width * height / 200);
+	CHECK(after.primarySteps + prepassStats.prepassSteps < before.primarySteps * 4 / 5);
+
+	// The renderer runs the prepass itself; with g_Cone.x = 0 every ray starts at SDF_RAY_START.
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	Image image;
+	RenderStats stats = renderer.Render(constants, image);
+	CHECK(renderer.GetConeDepth() == depth);
+	CHECK(stats.prepassRays == prepassStats.prepassRays);
+
+	constants.g_Cone = GetConeConstants(0, width);
+	stats = renderer.Render(constants, image);
+	CHECK(renderer.GetConeDepth().empty() && stats.prepassRays == 0);
+	CHECK(stats.primarySteps > after.primarySteps);
+}
+
+void test_renderer_relaxation()
+{
+	// A thin plate across the ray: the first over-relaxed step from t = 1 lands behind it, where the
+	// distance is positive again, and only the overlap test notices that the plate was skipped.
+	CsgNode plate;
+	plate.opcode = SDF_OP_BOX;
+	plate.material = 7;
+	const float params[] = { 0.f, 0.f, 5.f, 2.f, 2.f, 0.01f };
+	std::copy(std::begin(params), std::end(params), plate.params);
+
+	Tape tape;
+	SceneBvh bvh;
+	CHECK(CompileTape(plate, tape) && bvh.Build(tape));
+	SceneMap map;
+	map.bvh = &bvh;
+
+	const float3 ro(0.f);
+	const float3 rd(0.f, 0.f, 1.f);
+	RenderStats plainStats;
+	float2 plain = Raycast(map, ro, rd, 256, SDF_RAY_START, 1.0f, &plainStats);
+	CHECK(plain.y == 7.f && std::fabs(plain.x - 4.99f) < 1e-3f);
+	CHECK(plainStats.primaryFallbacks == 0);
+
+	RenderStats relaxedStats;
+	float2 relaxed = Raycast(map, ro, rd, 256, SDF_RAY_START, 1.6f, &relaxedStats);
+	CHECK(relaxed.y == plain.y && std::fabs(relaxed.x - plain.x) < 1e-3f);
+	CHECK(relaxedStats.primaryFallbacks == 1);
+
+	// On the default scene the relaxed rays find the same surfaces in fewer steps.
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 128, 72);
+	constants.g_Cone = GetConeConstants(0, 128);
+	SceneBvh scene = LoadDefaultBvh();
+	map.bvh = &scene;
+	map.time = constants.g_Time.x;
+
+	const Camera camera = Camera::Orbit(constants.g_Time.x);
+	const float2 resolution = float2(128.f, 72.f);
+	int hits = 0;
+	int mismatches = 0;
+	RenderStats before;
+	RenderStats after;
+	for (int y = 0; y < 72; y++)
+	{
+		for (int x = 0; x < 128; x++)
+		{
+			float3 dir = camera.PixelRay(float2(float(x) + 0.5f, float(y) + 0.5f), resolution);
+			float2 reference = Raycast(map, camera.origin, dir, 256, SDF_RAY_START, 1.0f, &before);
+			float2 res = Raycast(map, camera.origin, dir, 256, SDF_RAY_START, SDF_RAY_RELAXATION, &after);
+			if (reference.y < 0.f)
+				continue;
+			hits++;
+			if (res.y != reference.y || std::fabs(res.x - reference.x) > 1e-3f * reference.x)
+				mismatches++;
+		}
+	}
+
+	CHECK(hits > 128 * 72 / 2);
+	CHECK(mismatches < hits / 200);
+	CHECK(after.primaryFallbacks > 0);
+	CHECK(after.primarySteps < before.primarySteps * 17 / 20);
+}
+
+void test_renderer_normals()
+{
+	// At the surfaces seen by the camera the tetrahedron and the dual numbers agree with central differences,
+	// with fewer map() calls.
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 96, 54);
+	SceneBvh scene = LoadDefaultBvh();
+	SceneMap map;
+	map.bvh = &scene;
+	map.time = constants.g_Time.x;
+
+	const Camera camera = Camera::Orbit(constants.g_Time.x);
+	const float2 resolution = float2(96.f, 54.f);
+	int hits = 0;
+	int tetrahedronMismatches = 0;
+	int dualMismatches = 0;
+	for (int y = 0; y < 54; y++)
+	{
+		for (int x = 0; x < 96; x++)
+		{
+			float3 dir = camera.PixelRay(float2(float(x) + 0.5f, float(y) + 0.5f), resolution);
+			float2 res = Raycast(map, camera.origin, dir, 256, SDF_RAY_START, 1.0f);
+			if (res.y < 1.5f)
+				continue;
+			hits++;
+
+			float3 pos = camera.origin + res.x * dir;
+			RenderStats stats[3];
+			float3 normals[3];
+			for (int mode : { SDF_NORMALS_CENTRAL, SDF_NORMALS_TETRAHEDRON, SDF_NORMALS_DUAL })
+			{
+				map.normals = mode;
+				normals[mode] = CalcNormal(map, pos, res.x, &stats[mode]);
+				CHECK(std::fabs(length(normals[mode]) - 1.f) < 1e-4f);
+			}
+			CHECK(stats[0].normalEvaluations == 6 && stats[1].normalEvaluations == 4 && stats[2].normalEvaluations == 1);
+
+			if (dot(normals[SDF_NORMALS_TETRAHEDRON], normals[SDF_NORMALS_CENTRAL]) < 0.99f)
+				tetrahedronMismatches++;
+			if (dot(normals[SDF_NORMALS_DUAL], normals[SDF_NORMALS_CENTRAL]) < 0.99f)
+				dualMismatches++;
+		}
+	}
+
+	CHECK(hits > 200);
+	CHECK(tetrahedronMismatches < hits / 50);
+	CHECK(dualMismatches < hits / 50);
+
+	// Frames rendered with the cheaper normals look the same.
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	renderer.SetNormals(SDF_NORMALS_CENTRAL);
+	Image reference;
+	RenderStats referenceStats = renderer.Render(constants, reference);
+	for (int normals : { SDF_NORMALS_TETRAHEDRON, SDF_NORMALS_DUAL })
+	{
+		renderer.SetNormals(normals);
+		Image image;
+		RenderStats stats = renderer.Render(constants, image);
+		CHECK(stats.normalEvaluations < referenceStats.normalEvaluations);
+		CHECK(ComputePsnr(image, reference) > 35.0);
+	}
+}
+
+void test_renderer_temporal_reuse()
+{
+	const int width = 160;
+	const int height = 90;
+	const float2 resolution = float2(float(width), float(height));
+
+	// Project() inverts PixelRay().
+	const Camera camera = Camera::Orbit(10.0f);
+	float2 pixel;
+	CHECK(camera.Project(camera.origin + camera.PixelRay(float2(37.5f, 61.5f), resolution) * 3.0f, resolution, pixel));
+	CHECK(length(pixel - float2(37.5f, 61.5f)) < 1e-3f);
+	CHECK(!camera.Project(camera.origin - camera.forward, resolution, pixel));
+
+	SceneBvh bvh = LoadDefaultBvh();
+	tf::Executor executor(2);
+	RenderConstants previous = GetDefaultRenderConstants(10.0f, width, height);
+	RenderConstants current = GetDefaultRenderConstants(10.05f, width, height);
+
+	CpuRenderer reference(executor);
+	reference.SetScene(&bvh);
+	reference.SetRecordEvaluations(true);
+	Image expected;
+	RenderStats referenceStats = reference.Render(current, expected);
+	CHECK(referenceStats.temporalSeeds == 0);
+
+	// The first frame has nothing to reuse, the second one starts many rays at the previous hits. The others
+	// miss, start further along from the cone prepass or are next to silhouettes.
+	previous.g_Temporal = GetTemporalConstants(true, 0.f);
+	current.g_Temporal = GetTemporalConstants(true, 0.f);
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	renderer.SetRecordEvaluations(true);
+	Image image;
+	CHECK(renderer.Render(previous, image).temporalSeeds == 0);
+	CHECK(renderer.GetHistory().time == 10.0f);
+	RenderStats stats = renderer.Render(current, image);
+	CHECK(renderer.GetHistory().time == 10.05f);
+	CHECK(stats.temporalSeeds > uint64_t(width * height / 4));
+	CHECK(stats.primarySteps < referenceStats.primarySteps * 17 / 20);
+
+	// The output is unchanged within tolerance: the same surfaces are found at the same distances.
+	const HitHistory& hits = renderer.GetHistory();
+	const HitHistory& expectedHits = reference.GetHistory();
+	int mismatches = 0;
+	for (size_t i = 0; i < hits.hits.size(); i++)
+	{
+		const float2 a = hits.hits[i];
+		const float2 b = expectedHits.hits[i];
+		if (a.y != b.y || std::fabs(a.x - b.x) > 1e-3f * std::max(b.x, 1.0f))
+			mismatches++;
+	}
+	CHECK(mismatches < width * height / 200);
+	CHECK(ComputePsnr(image, expected) > 40.0);
+
+	// Without a history of the same size every ray starts as before.
+	renderer.ResetHistory();
+	CHECK(renderer.Render(current, image).temporalSeeds == 0);
+	RenderConstants larger = GetDefaultRenderConstants(10.1f, width + 1, height);
+	larger.g_Temporal = GetTemporalConstants(true, 0.f);
+	CHECK(renderer.Render(larger, image).temporalSeeds == 0);
+
+	// Hits at the wrong distance, as left by surfaces that moved, are not reused.
+	SceneMap map;
+	map.bvh = &bvh;
+	map.time = current.g_Time.x;
+	HitHistory moved = expectedHits;
+	for (float2& hit : moved.hits)
+		hit.x *= 0.5f;
+	moved.time = current.g_Time.x;
+	RenderConstants still = current;
+	still.g_Temporal = GetTemporalConstants(true, current.g_Time.x);
+	RenderStats movedStats;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+			GetTemporalStart(still, map, moved, float2(float(x) + 0.5f, float(y) + 0.5f), SDF_RAY_START, &movedStats);
+	}
+	CHECK(movedStats.temporalSeeds < uint64_t(width * height / 100));
+}
+
+void test_renderer_reduced_lighting()
+{
+	// Samples that all match the pixel give their bilinear blend, a sample off the pixel's tangent plane or
+	// with another normal gets no weight.
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 4, 4);
+	constants.g_Lighting = GetLightingConstants(2, 4);
+	CHECK(all(GetLightingSampleCount(constants) == int2(2, 2)));
+	std::vector<LightingSample> samples(4);
+	for (int i = 0; i < 4; i++)
+	{
+		samples[i].normal = float3(0.f, 1.f, 0.f);
+		samples[i].t = 3.f;
+		samples[i].occlusion = float(i);
+		samples[i].keyShadow = 1.f;
+		samples[i].skyShadow = 0.5f;
+	}
+	LightingTerms terms;
+	CHECK(UpsampleLighting(constants, samples, float2(2.0f, 2.0f), float3(0.f), float3(0.f, 1.f, 0.f), 3.f, terms));
+	CHECK(std::fabs(terms.occlusion - 1.5f) < 1e-5f && terms.keyShadow == 1.f && std::fabs(terms.skyShadow - 0.5f) < 1e-6f);
+	samples[3].position = float3(0.f, 0.5f, 0.f);
+	CHECK(UpsampleLighting(constants, samples, float2(2.0f, 2.0f), float3(0.f), float3(0.f, 1.f, 0.f), 3.f, terms));
+	CHECK(std::fabs(terms.occlusion - 1.0f) < 1e-5f);
+	CHECK(!UpsampleLighting(constants, samples, float2(2.0f, 2.0f), float3(0.f), float3(1.f, 0.f, 0.f), 3.f, terms));
+	CHECK(!UpsampleLighting(constants, samples, float2(2.0f, 2.0f), float3(0.f, 1.f, 0.f), float3(0.f, 1.f, 0.f), 3.f, terms));
+
+	// Whole frames: the shadows and AO cost a fraction of the per-pixel ones. Most of the difference is on
+	// the edges of the sharp shadows, which no guide can place between the samples.
+	const int width = 320;
+	const int height = 180;
+	constants = GetDefaultRenderConstants(10.0f, width, height);
+	SceneBvh bvh = LoadDefaultBvh();
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	Image expected;
+	RenderStats referenceStats = renderer.Render(constants, expected);
+	CHECK(renderer.GetLightingSamples().empty() && referenceStats.lightingSamples == 0);
+
+	uint64_t previousSteps = referenceStats.shadowSteps + referenceStats.aoEvaluations;
+	for (int scale : { 2, 4 })
+	{
+		constants.g_Lighting = GetLightingConstants(scale, width);
+		Image image;
+		RenderStats stats = renderer.Render(constants, image);
+		const int2 count = GetLightingSampleCount(constants);
+		CHECK(count.x == (width + scale - 1) / scale && count.y == (height + scale - 1) / scale);
+		CHECK(renderer.GetLightingSamples().size() == size_t(count.x * count.y));
+		CHECK(stats.lightingSamples == uint64_t(count.x * count.y));
+		CHECK(stats.lightingFallbacks < uint64_t(width * height / 50));
+
+		const uint64_t steps = stats.shadowSteps + stats.aoEvaluations;
+		CHECK(steps < previousSteps / 3);
+		CHECK(ComputePsnr(image, expected) > (scale == 2 ? 29.0 : 24.0));
+		previousSteps = steps;
+	}
+}
+
+void test_renderer_accumulation()
+{
+	// Sample 0 is the plain image, the others are jittered inside the pixel and over the light disc.
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, 96, 54);
+	CHECK(all(GetSampleJitter(constants) == float2(0.f)) && all(GetLightJitter(constants) == float2(0.f)));
+	for (int i = 0; i < 64; i++)
+	{
+		constants.g_Accumulate = GetAccumulateConstants(true, i);
+		const float2 jitter = GetSampleJitter(constants);
+		const float2 light = GetLightJitter(constants);
+		CHECK(jitter.x >= -0.5f && jitter.x < 0.5f && jitter.y >= -0.5f && jitter.y < 0.5f);
+		CHECK(dot(light, light) <= 1.0001f);
+		CHECK((i == 0) == (all(jitter == float2(0.f)) && all(light == float2(0.f))));
+	}
+	RenderConstants other = constants;
+	other.g_Temporal = GetTemporalConstants(true, 9.0f);
+	other.g_Accumulate = GetAccumulateConstants(false, 0);
+	CHECK(IsSameImage(constants, other));
+	other.g_Time.x = 10.5f;
+	CHECK(!IsSameImage(constants, other));
+
+	const int width = 96;
+	const int height = 54;
+	constants = GetDefaultRenderConstants(10.0f, width, height);
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	Image single;
+	renderer.Render(constants, single);
+
+	// The first sample is the image without accumulation, the budgets of several calls add up.
+	Image image;
+	RenderStats stats = renderer.Accumulate(constants, 1, image);
+	CHECK(renderer.GetAccumulation().samples == 1 && stats.primaryRays == uint64_t(width * height));
+	CHECK(ComputePsnr(image, single) > 60.0);
+	renderer.Accumulate(constants, 7, image);
+	CHECK(renderer.GetAccumulation().samples == 8);
+
+	CpuRenderer once(executor);
+	Image onceImage;
+	once.Accumulate(constants, 8, onceImage);
+	CHECK(ComputePsnr(image, onceImage) > 60.0);
+
+	// The samples converge: 8 of them are much closer to 64 than a single one.
+	CpuRenderer reference(executor);
+	Image converged;
+	reference.Accumulate(constants, 64, converged);
+	CHECK(ComputePsnr(image, converged) > ComputePsnr(single, converged) + 3.0);
+
+	// The temporal reuse doesn't change the image, any other constant starts over.
+	constants.g_Temporal = GetTemporalConstants(true, 10.0f);
+	renderer.Accumulate(constants, 1, image);
+	CHECK(renderer.GetAccumulation().samples == 9);
+	constants.g_Time.x = 10.5f;
+	renderer.Accumulate(constants, 2, image);
+	CHECK(renderer.GetAccumulation().samples == 2);
+	renderer.SetNormals(SDF_NORMALS_CENTRAL);
+	renderer.Accumulate(constants, 1, image);
+	CHECK(renderer.GetAccumulation().samples == 1);
+
+	// A converged image is only shown.
+	constants = GetDefaultRenderConstants(10.0f, 16, 9);
+	renderer.Accumulate(constants, SDF_ACCUMULATE_MAX_SAMPLES + 10, image);
+	CHECK(renderer.GetAccumulation().samples == SDF_ACCUMULATE_MAX_SAMPLES);
+	Image shown;
+	stats = renderer.Accumulate(constants, 4, shown);
+	CHECK(stats.primaryRays == 0 && renderer.GetAccumulation().samples == SDF_ACCUMULATE_MAX_SAMPLES);
+	CHECK(ComputePsnr(shown, image) > 60.0);
+}
+
+void test_renderer_packets()
+{
+	const int width = 160;
+	const int height = 90;
+	RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+	SceneBvh bvh = LoadDefaultBvh();
+
+	SceneMap map;
+	map.bvh = &bvh;
+	map.time = constants.g_Time.x;
+
+	// Rays marched in packets, including one that starts past SDF_RAY_END, take the steps they take alone.
+	const Camera camera = Camera::Orbit(constants.g_Time.x);
+	const float2 resolution = float2(float(width), float(height));
+	for (float omega : { 1.0f, SDF_RAY_RELAXATION })
+	{
+		std::vector<float3> rd;
+		std::vector<float> tmin;
+		for (int y = 0; y < height; y += 3)
+		{
+			for (int x = 0; x < width; x += 3)
+			{
+				rd.push_back(camera.PixelRay(float2(float(x) + 0.5f, float(y) + 0.5f), resolution));
+				tmin.push_back(rd.size() == 7 ? SDF_RAY_END : SDF_RAY_START);
+			}
+		}
+
+		const int count = int(rd.size());
+		std::vector<float2> res(count);
+		std::vector<RenderStats> stats(count);
+		RaycastPackets(map, camera.origin, rd.data(), tmin.data(), count, 256, omega, res.data(), stats.data());
+
+		int mismatches = 0;
+		for (int i = 0; i < count; i++)
+		{
+			RenderStats rayStats;
+			float2 reference = Raycast(map, camera.origin, rd[i], 256, tmin[i], omega, &rayStats);
+			CHECK(stats[i].primaryRays == 1);
+			if (res[i].y != reference.y || std::fabs(res[i].x - reference.x) > 1e-3f * std::max(reference.x, 1.f)
+				|| stats[i].primarySteps != rayStats.primarySteps)
+				mismatches++;
+		}
+		CHECK(res[6].y < 0.f && stats[6].primarySteps == 0);
+		CHECK(mismatches < count / 100);
+	}
+
+	// Bundles of any size, cut by tiles that don't line up with them, render the image of single rays.
+	// Without the prepass the cones of the bundles save most of the steps it would.
+	constants.g_Cone = GetConeConstants(0, width);
+	tf::Executor executor(2);
+	CpuRenderer renderer(executor);
+	renderer.SetScene(&bvh);
+	renderer.SetTileSize(12);
+	Image expected;
+	RenderStats expectedStats = renderer.Render(constants, expected);
+
+	for (int size : { 2, 8 })
+	{
+		renderer.SetPacketSize(size);
+		renderer.SetRecordEvaluations(true);
+		Image image;
+		RenderStats stats = renderer.Render(constants, image);
+		CHECK(stats.primaryRays == uint64_t(width * height));
+		CHECK(stats.prepassRays >= uint64_t(width * height / (size * size)));
+		CHECK(ComputePsnr(image, expected) > 50.0);
+		CHECK(stats.primarySteps + stats.prepassSteps < expectedStats.primarySteps * 4 / 5);
+
+		uint64_t primary = 0;
+		for (const PixelEvaluations& pixel : renderer.GetEvaluations().pixels)
+			primary += pixel.primary;
+		CHECK(primary == stats.primarySteps);
+		renderer.SetRecordEvaluations(false);
+	}
+}
+
+void test_renderer_texture()
+{
+	Texture texture;
+	texture.width = 2;
+	texture.height = 1;
+	texture.texels = { float3(0.f), float3(1.f) };
+
+	// Texel centers, the midpoint between them and the wrap-around.
+	CHECK(texture.Sample(float2(0.25f, 0.5f)).x == 0.f);
+	CHECK(texture.Sample(float2(0.75f, 0.5f)).x == 1.f);
+	CHECK(std::fabs(texture.Sample(float2(0.5f, 0.5f)).x - 0.5f) < 1e-6f);
+	CHECK(std::fabs(texture.Sample(float2(1.0f, 0.5f)).x - 0.5f) < 1e-6f);
+	CHECK(std::fabs(texture.Sample(float2(-0.75f, 0.5f)).x - 0.0f) < 1e-6f);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_renderer_tiles_and_threads();
+		test_renderer_scene_matches_builtin();
+		test_renderer_cone_prepass();
+		test_renderer_relaxation();
+		test_renderer_normals();
+		test_renderer_temporal_reuse();
+		test_renderer_reduced_lighting();
+		test_renderer_accumulation();
+		test_renderer_packets();
+		test_renderer_texture();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
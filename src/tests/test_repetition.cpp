@@ -0,0 +1,370 @@
+#include "../cpu/Bvh.h"
+#include "../cpu/Dual.h"
+#include "../cpu/TapePruning.h"
+#include "TestScenes.h"
+
+#include <donut/tests/utils.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	std::unique_ptr<CsgNode> Sphere(const float3& center, float radius, int material)
+	{
+		auto node = std::make_unique<CsgNode>();
+		node->opcode = SDF_OP_SPHERE;
+		node->material = material;
+		node->params[0] = center.x;
+		node->params[1] = center.y;
+		node->params[2] = center.z;
+		node->params[3] = radius;
+		return node;
+	}
+
+	std::unique_ptr<CsgNode> Box(const float3& center, const float3& size, int material)
+	{
+		auto node = std::make_unique<CsgNode>();
+		node->opcode = SDF_OP_BOX;
+		node->material = material;
+		node->params[0] = center.x;
+		node->params[1] = center.y;
+		node->params[2] = center.z;
+		node->params[3] = size.x;
+		node->params[4] = size.y;
+		node->params[5] = size.z;
+		return node;
+	}
+
+	// The repeated child of the grid tests: a sphere off the center of the cell and a slab under it.
+	const float3 c_SphereCenter(0.1f, 0.1f, -0.05f);
+	const float c_SphereRadius = 0.2f;
+	const float3 c_BoxCenter(0.f, -0.1f, 0.f);
+	const float3 c_BoxSize(0.3f, 0.1f, 0.2f);
+	const float3 c_Period(1.f, 0.f, 0.8f);
+
+	const char* c_GridChild = R"(
+		"children": [ {
+			"type": "union",
+			"children": [
+				{ "type": "sphere", "position": [0.1, 0.1, -0.05], "radius": 0.2, "material": 3 },
+				{ "type": "box", "position": [0, -0.1, 0], "size": [0.3, 0.1, 0.2], "material": 5 }
+			]
+		} ])";
+
+	// The same instances as a union of primitives, one pair per cell in [-count, count].
+	std::unique_ptr<CsgNode> ExplicitGrid(const int3& count, bool mirror)
+	{
+		auto root = std::make_unique<CsgNode>();
+		root->opcode = SDF_OP_UNION;
+		for (int z = -count.z; z <= count.z; z++)
+		{
+			for (int x = -count.x; x <= count.x; x++)
+			{
+				float3 offset(float(x) * c_Period.x, 0.f, float(z) * c_Period.z);
+				float3 flip(mirror && (x & 1) ? -1.f : 1.f, 1.f, mirror && (z & 1) ? -1.f : 1.f);
+				root->children.push_back(Sphere(offset + c_SphereCenter * flip, c_SphereRadius, 3));
+				root->children.push_back(Box(offset + c_BoxCenter * flip, c_BoxSize, 5));
+			}
+		}
+		return root;
+	}
+
+	// Every point in the region: the repeated field never exceeds the explicit union, and matches it
+	// closer to the surfaces than the bound of the skipped instances.
+	void CheckAgainstExplicit(const Tape& repeated, const Tape& explicitTape, const box3& region, float exactBelow)
+	{
+		std::mt19937 rng(29);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		int exact = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			float3 p = region.m_mins + region.diagonal() * float3(unit(rng), unit(rng), unit(rng));
+			Vec3<float> pos(p.x, p.y, p.z);
+			Vec2<float> actual = EvaluateTape(repeated, pos, 0.f);
+			Vec2<float> expected = EvaluateTape(explicitTape, pos, 0.f);
+
+			CHECK(actual.x <= expected.x + 1e-5f);
+			CHECK(actual.x >= std::min(expected.x, exactBelow) - 1e-5f);
+			if (expected.x < exactBelow - 1e-4f)
+			{
+				CHECK(std::fabs(actual.x - expected.x) < 1e-5f);
+				CHECK(actual.y == expected.y);
+				exact++;
+			}
+		}
+		CHECK(exact > 2000);
+	}
+}
+
+void test_repeat_limited()
+{
+	for (bool mirror : { false, true })
+	{
+		char text[1024];
+		std::snprintf(text, sizeof(text), R"({ "type": "repeatLimited", "period": [1, 0, 0.8], "count": [3, 0, 2], "mirror": %s, %s })",
+			mirror ? "true" : "false", c_GridChild);
+		auto node = ParseString(text);
+		CHECK(node != nullptr);
+		Tape repeated = Compile(*node);
+		Tape explicitTape = Compile(*ExplicitGrid(int3(3, 0, 2), mirror));
+
+		// One instance costs as many instructions as 35: the operator pair and the child.
+		CHECK(repeated.Size() == 5);
+		CHECK(repeated.maxStackDepth == 2);
+
+		CheckAgainstExplicit(repeated, explicitTape, box3(float3(-5.f, -1.f, -3.5f), float3(5.f, 1.f, 3.5f)), 0.4f);
+	}
+}
+
+void test_repeat_infinite()
+{
+	char text[1024];
+	std::snprintf(text, sizeof(text), R"({ "type": "repeat", "period": [1, 0, 0.8], %s })", c_GridChild);
+	auto node = ParseString(text);
+	CHECK(node != nullptr);
+	Tape repeated = Compile(*node);
+
+	// Far enough past the sampled region that the missing instances never matter.
+	Tape explicitTape = Compile(*ExplicitGrid(int3(12, 0, 12), false));
+	CheckAgainstExplicit(repeated, explicitTape, box3(float3(-6.f, -1.f, -5.f), float3(6.f, 1.f, 5.f)), 0.4f);
+
+	// Far from the origin the cells are as accurate as near it.
+	Vec2<float> far = EvaluateTape(repeated, Vec3<float>(1000.1f, 0.1f, 800.f - 0.05f), 0.f);
+	CHECK(std::fabs(far.x + c_SphereRadius) < 1e-3f);
+}
+
+void test_repeat_polar()
+{
+	const float3 center(0.5f, 0.f, -0.3f);
+	const float3 local(1.f, 0.1f, 0.2f);
+	const float radius = 0.25f;
+	const int count = 6;
+
+	for (bool mirror : { false, true })
+	{
+		char text[512];
+		std::snprintf(text, sizeof(text), R"({ "type": "repeatPolar", "position": [0.5, 0, -0.3], "count": %d, "mirror": %s,
+			"children": [ { "type": "sphere", "position": [1, 0.1, 0.2], "radius": 0.25, "material": 2 } ] })",
+			count, mirror ? "true" : "false");
+		auto node = ParseString(text);
+		CHECK(node != nullptr);
+		Tape repeated = Compile(*node);
+
+		auto root = std::make_unique<CsgNode>();
+		root->opcode = SDF_OP_UNION;
+		std::vector<float3> centers;
+		for (int k = 0; k < count; k++)
+		{
+			const float angle = float(k) * c_TwoPi / float(count);
+			const float c = std::cos(angle), s = std::sin(angle);
+			const float z = mirror && (k & 1) ? -local.z : local.z;
+			centers.push_back(center + float3(local.x * c - z * s, local.y, local.x * s + z * c));
+			root->children.push_back(Sphere(centers.back(), radius, 2));
+		}
+		Tape explicitTape = Compile(*root);
+
+		// Sectors are 60 degrees wide, the bound of the skipped ones is half of that from the samples.
+		std::mt19937 rng(31);
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+		int exact = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			float3 p = center + float3(unit(rng) * 2.f, unit(rng), unit(rng) * 2.f);
+			Vec3<float> pos(p.x, p.y, p.z);
+			Vec2<float> actual = EvaluateTape(repeated, pos, 0.f);
+			Vec2<float> expected = EvaluateTape(explicitTape, pos, 0.f);
+			const float skipped = length(float2(p.x - center.x, p.z - center.z)) * 0.5f - 1e-3f;
+
+			CHECK(actual.x <= expected.x + 1e-5f);
+			CHECK(actual.x >= std::min(expected.x, skipped) - 1e-5f);
+			if (expected.x < skipped)
+			{
+				CHECK(std::fabs(actual.x - expected.x) < 1e-5f);
+				exact++;
+			}
+		}
+		CHECK(exact > 2000);
+
+		// The gradients come out of the rotated and mirrored frames.
+		for (const float3& c : centers)
+		{
+			const float3 direction = normalize(float3(0.3f, 0.8f, -0.5f));
+			const float3 p = c + direction * (radius + 0.05f);
+			Dual<float> d = EvaluateTape(repeated, DualPosition(Vec3<float>(p.x, p.y, p.z)), 0.f).x;
+			CHECK(std::fabs(d.v - 0.05f) < 1e-5f);
+			CHECK(std::fabs(d.d.x - direction.x) < 1e-4f && std::fabs(d.d.y - direction.y) < 1e-4f && std::fabs(d.d.z - direction.z) < 1e-4f);
+		}
+	}
+}
+
+void test_repeat_packets()
+{
+	auto node = ParseString(R"({
+		"type": "repeat", "period": [0.7, 0.9, 0],
+		"children": [ { "type": "repeatPolar", "count": 5, "mirror": false,
+			"children": [ { "type": "box", "position": [0.2, 0, 0], "size": [0.05, 0.1, 0.05] } ] } ]
+	})");
+	CHECK(node != nullptr);
+	Tape tape = Compile(*node);
+
+	std::mt19937 rng(37);
+	std::uniform_real_distribution<float> unit(-3.f, 3.f);
+	for (int i = 0; i < 256; i++)
+	{
+		alignas(32) float x[8], y[8], z[8];
+		for (int j = 0; j < 8; j++)
+		{
+			x[j] = unit(rng);
+			y[j] = unit(rng);
+			z[j] = unit(rng);
+		}
+
+#if defined(SDF_SIMD_AVX2)
+		Vec2<Float8> packet = EvaluateTape(tape, Vec3<Float8>(Float8::Load(x), Float8::Load(y), Float8::Load(z)), 0.f);
+		for (int j = 0; j < 8; j++)
+		{
+			Vec2<float> scalar = EvaluateTape(tape, Vec3<float>(x[j], y[j], z[j]), 0.f);
+			CHECK(std::fabs(lane(packet.x, j) - scalar.x) < 1e-5f);
+			CHECK(lane(packet.y, j) == scalar.y);
+		}
+#endif
+	}
+}
+
+void test_repeat_bvh_and_pruning()
+{
+	char text[1024];
+	std::snprintf(text, sizeof(text), R"({ "type": "union", "children": [
+		{ "type": "sphere", "position": [0, 0, 6], "radius": 0.5 },
+		{ "type": "repeatLimited", "period": [1, 0, 0.8], "count": [5, 0, 4], %s },
+		{ "type": "repeatPolar", "position": [0, 0, -5], "count": 96,
+			"children": [ { "type": "box", "position": [1.5, 0, 0], "size": [0.03, 0.3, 0.03] } ] }
+	] })", c_GridChild);
+	auto node = ParseString(text);
+	CHECK(node != nullptr);
+	Tape tape = Compile(*node);
+
+	// All three are bounded: the grid by its outermost cells, the ring by a cylinder around its axis.
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+	CHECK(bvh.GetObjectCount() == 3);
+	CHECK(bvh.GetGlobalInstructionCount() == 0);
+	const BvhNode& root = bvh.GetNodes()[0];
+	CHECK(std::fabs(root.boundsMin.x + 5.3f) < 1e-5f && std::fabs(root.boundsMax.x - 5.3f) < 1e-5f);
+	CHECK(std::fabs(root.boundsMin.z + 5.f + std::sqrt(1.53f * 1.53f + 0.03f * 0.03f)) < 1e-4f);
+
+	std::mt19937 rng(41);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	for (int i = 0; i < 5000; i++)
+	{
+		Vec3<float> p(unit(rng) * 10.f - 5.f, unit(rng) * 2.f - 1.f, unit(rng) * 14.f - 7.f);
+		Vec2<float> expected = EvaluateTape(tape, p, 0.f);
+		Vec2<float> actual = EvaluateBvh(bvh, p, 0.f);
+
+		// Skipping the boxes can only lift the bounds of the skipped instances, which are above the
+		// surfaces' neighbourhood: at least half a sector of the ring at its inner radius.
+		CHECK(actual.x >= expected.x - 1e-5f);
+		if (expected.x < 0.04f)
+		{
+			CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+			CHECK(expected.y == actual.y);
+		}
+	}
+
+	// Regions of a few cells, of more cells than are enumerated, and away from every instance.
+	const box3 regions[] = {
+		box3(float3(-0.7f, -0.2f, -0.5f), float3(0.4f, 0.3f, 0.6f)),
+		box3(float3(-6.f, -1.f, -3.f), float3(6.f, 1.f, 3.f)),
+		box3(float3(0.5f, -0.5f, -6.f), float3(2.f, 0.5f, -4.5f)),
+		box3(float3(-1.f, -1.f, -6.f), float3(1.f, 1.f, -4.f)),
+		box3(float3(-0.4f, -0.4f, 5.6f), float3(0.4f, 0.4f, 6.4f)),
+	};
+	for (const box3& region : regions)
+	{
+		Tape pruned;
+		Interval range = PruneTape(tape, region, 0.f, pruned);
+		CHECK(pruned.maxStackDepth <= tape.maxStackDepth);
+		for (int i = 0; i < 2000; i++)
+		{
+			float3 p = region.m_mins + region.diagonal() * float3(unit(rng), unit(rng), unit(rng));
+			Vec3<float> pos(p.x, p.y, p.z);
+			Vec2<float> expected = EvaluateTape(tape, pos, 0.f);
+			Vec2<float> actual = EvaluateTape(pruned, pos, 0.f);
+			CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+			CHECK(expected.y == actual.y);
+			CHECK(range.Contains(expected.x));
+		}
+	}
+
+	// Next to the lone sphere both repetitions are cut as a whole.
+	Tape pruned;
+	PruneTape(tape, regions[4], 0.f, pruned);
+	CHECK(pruned.Size() == 1);
+}
+
+void test_repeat_unbounded()
+{
+	auto node = ParseString(R"({ "type": "union", "children": [
+		{ "type": "sphere", "position": [0, 0, 6], "radius": 0.5 },
+		{ "type": "repeat", "period": [2, 0, 0], "children": [ { "type": "sphere", "radius": 0.3 } ] }
+	] })");
+	CHECK(node != nullptr);
+	Tape tape = Compile(*node);
+
+	// Infinite repetition goes into the global prefix like the floor plane.
+	SceneBvh bvh;
+	CHECK(bvh.Build(tape));
+	CHECK(bvh.GetObjectCount() == 1);
+	CHECK(bvh.GetGlobalInstructionCount() == 3);
+	CHECK(std::fabs(EvaluateBvh(bvh, Vec3<float>(40.f, 0.f, 0.f), 0.f).x + 0.3f) < 1e-5f);
+}
+
+void test_repeat_errors()
+{
+	CHECK(!ParseString(R"({ "type": "repeat", "period": [0, 0, 0], "children": [ { "type": "sphere" } ] })"));
+	CHECK(!ParseString(R"({ "type": "repeatLimited", "period": [1, 1, 1], "count": [1, -1, 1], "children": [ { "type": "sphere" } ] })"));
+	CHECK(!ParseString(R"({ "type": "repeatPolar", "count": 5, "mirror": true, "children": [ { "type": "sphere" } ] })"));
+	CHECK(!ParseString(R"({ "type": "repeat", "period": [1, 1, 1] })"));
+
+	// Nesting deeper than SDF_TAPE_MAX_DOMAIN.
+	std::string text = R"({ "type": "sphere", "radius": 0.1 })";
+	for (int i = 0; i <= SDF_TAPE_MAX_DOMAIN; i++)
+		text = R"({ "type": "repeat", "period": [1, 1, 1], "children": [ )" + text + " ] }";
+	auto node = ParseString(text.c_str());
+	CHECK(node != nullptr);
+	Tape tape;
+	CHECK(!CompileTape(*node, tape));
+
+	// A tape whose operator pair is cut apart.
+	node = ParseString(R"({ "type": "repeat", "period": [1, 1, 1], "children": [ { "type": "sphere" } ] })");
+	CHECK(node != nullptr);
+	CHECK(CompileTape(*node, tape));
+	tape.instructions.pop_back();
+	SceneBvh bvh;
+	CHECK(!bvh.Build(tape));
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_repeat_limited();
+		test_repeat_infinite();
+		test_repeat_polar();
+		test_repeat_packets();
+		test_repeat_bvh_and_pruning();
+		test_repeat_unbounded();
+		test_repeat_errors();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
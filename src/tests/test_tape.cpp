@@ -0,0 +1,187 @@
+#include "../cpu/DefaultScene.h"
+#include "../cpu/Tape.h"
+#include "TestScenes.h"
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	// Saves a tape of the opcodes, all with the same first parameters and with a header depth that fits
+	// them, and loads it back.
+	bool SaveAndLoad(const std::vector<uint32_t>& opcodes, const std::filesystem::path& fileName,
+		std::initializer_list<float> params = { 1.f, 1.f, 1.f, 1.f })
+	{
+		Tape tape;
+		for (uint32_t opcode : opcodes)
+		{
+			TapeInstruction ins = {};
+			ins.code = MakeInstructionCode(opcode, 0, 0);
+			std::copy(params.begin(), params.end(), ins.params);
+			tape.instructions.push_back(ins);
+		}
+		tape.maxStackDepth = uint32_t(opcodes.size());
+		CHECK(SaveTape(tape, fileName));
+
+		vfs::NativeFileSystem fs;
+		Tape loaded;
+		return LoadTape(fs, fileName, loaded);
+	}
+}
+
+void test_tape_matches_builtin_map()
+{
+	Tape tape = LoadDefaultTape();
+	CHECK(tape.maxStackDepth <= SDF_TAPE_MAX_STACK);
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+
+	// With g_Time = 0 the displacement vanishes and the conditional blob logic in map() has no effect,
+	// so the tape must reproduce the hand-written scene exactly.
+	for (int i = 0; i < 10000; i++)
+	{
+		Vec3<float> p(dist(rng), dist(rng) * 0.5f + 0.8f, dist(rng));
+		Vec2<float> expected = mapDefault(p, 0.0f);
+		Vec2<float> actual = EvaluateTape(tape, p, 0.0f);
+
+		CHECK(std::fabs(expected.x - actual.x) < 1e-5f);
+		CHECK(expected.y == actual.y);
+	}
+}
+
+void test_tape_packets()
+{
+	Tape tape = LoadDefaultTape();
+
+	float x[8] = { -1.f, -0.5f, 0.f, 0.5f, 1.f, 1.5f, 0.2f, -1.2f };
+	float y[8] = { 0.3f, 0.5f, 0.9f, 1.2f, 0.1f, 0.6f, 0.3f, 1.4f };
+	float z[8] = { 0.f, 1.f, -0.5f, 0.5f, 1.5f, -0.5f, 0.2f, 0.1f };
+
+#if defined(SDF_SIMD_AVX2)
+	Vec2<Float8> packet = EvaluateTape(tape, Vec3<Float8>(Float8::Load(x), Float8::Load(y), Float8::Load(z)), 1.3f);
+	for (int i = 0; i < 8; i++)
+	{
+		Vec2<float> scalar = EvaluateTape(tape, Vec3<float>(x[i], y[i], z[i]), 1.3f);
+		CHECK(std::fabs(lane(packet.x, i) - scalar.x) < 1e-5f);
+		CHECK(lane(packet.y, i) == scalar.y);
+	}
+#endif
+}
+
+void test_tape_compile()
+{
+	auto node = ParseString(R"({
+		"type": "union",
+		"children": [
+			{ "type": "sphere", "radius": 1.0, "material": 3 },
+			{ "type": "subtraction", "material": 5, "children": [
+				{ "type": "box", "position": [3, 0, 0], "size": [1, 1, 1] },
+				{ "type": "sphere", "position": [3, 0, 0], "radius": 1.2 }
+			]}
+		]
+	})");
+	CHECK(node != nullptr);
+
+	Tape tape;
+	CHECK(CompileTape(*node, tape));
+	CHECK(tape.Size() == 5);
+	CHECK(tape.maxStackDepth == 2);
+
+	// The deeper subtraction is emitted before the sphere.
+	CHECK(GetOpcode(tape.instructions[0]) == SDF_OP_BOX);
+	CHECK(GetMaterial(tape.instructions[0]) == 5);
+	CHECK(GetOpcode(tape.instructions[3]) == SDF_OP_SPHERE);
+	CHECK(GetMaterial(tape.instructions[3]) == 3);
+	CHECK(GetOpcode(tape.instructions[4]) == SDF_OP_UNION);
+
+	Vec2<float> inside = EvaluateTape(tape, Vec3<float>(0.f, 0.f, 0.f), 0.f);
+	CHECK(std::fabs(inside.x + 1.0f) < 1e-6f && inside.y == 3.0f);
+
+	Vec2<float> hollow = EvaluateTape(tape, Vec3<float>(3.f, 0.f, 0.f), 0.f);
+	CHECK(std::fabs(hollow.x - 1.2f) < 1e-6f && hollow.y == 5.0f);
+
+	CHECK(ParseString(R"({ "type": "teapot" })") == nullptr);
+	CHECK(ParseString(R"({ "type": "round", "children": [] })") == nullptr);
+	CHECK(ParseString(R"({ "type": "union", "children": [ { "type": "sphere" } ] })") == nullptr);
+}
+
+void test_tape_file()
+{
+	Tape tape = LoadDefaultTape();
+
+	std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_test_default.tape";
+	CHECK(SaveTape(tape, fileName));
+
+	vfs::NativeFileSystem fs;
+	Tape loaded;
+	CHECK(LoadTape(fs, fileName, loaded));
+	CHECK(loaded.Size() == tape.Size() && loaded.maxStackDepth == tape.maxStackDepth);
+	CHECK(std::memcmp(loaded.instructions.data(), tape.instructions.data(), tape.Size() * sizeof(TapeInstruction)) == 0);
+
+	// Instructions that would take the interpreters' stacks out of bounds are rejected.
+	const uint32_t sphere = SDF_OP_SPHERE;
+	const uint32_t repeat = SDF_OP_REPEAT;
+	const uint32_t end = SDF_OP_DOMAIN_END;
+	CHECK(SaveAndLoad({ sphere, sphere, SDF_OP_UNION }, fileName));
+	CHECK(SaveAndLoad({ repeat, sphere, end }, fileName));
+	CHECK(SaveAndLoad({}, fileName));
+	CHECK(!SaveAndLoad({ sphere, SDF_OP_UNION }, fileName));
+	CHECK(!SaveAndLoad({ SDF_OP_ROUND, sphere }, fileName));
+	CHECK(!SaveAndLoad({ sphere, sphere }, fileName));
+	CHECK(!SaveAndLoad({ sphere, end }, fileName));
+	CHECK(!SaveAndLoad({ repeat, sphere }, fileName));
+	CHECK(!SaveAndLoad({ sphere, repeat, sphere, sphere, end, SDF_OP_UNION }, fileName));
+	CHECK(!SaveAndLoad({ sphere, repeat, SDF_OP_ROUND, sphere, SDF_OP_UNION, end }, fileName));
+	CHECK(!SaveAndLoad({ sphere, repeat, sphere, SDF_OP_UNION, sphere, end }, fileName));
+	CHECK(!SaveAndLoad({ repeat, repeat, repeat, repeat, repeat, sphere, end, end, end, end, end }, fileName));
+	CHECK(SaveAndLoad({ repeat, repeat, repeat, repeat, sphere, end, end, end, end }, fileName));
+
+	// So are repetitions with parameters a scene file can't give them, which the evaluation divides by.
+	const uint32_t limited = SDF_OP_REPEAT_LIMITED;
+	const uint32_t polar = SDF_OP_REPEAT_POLAR;
+	CHECK(SaveAndLoad({ repeat, sphere, end }, fileName, { 0.f, 0.f, 0.8f }));
+	CHECK(!SaveAndLoad({ repeat, sphere, end }, fileName, { 0.f, 0.f, 0.f }));
+	CHECK(!SaveAndLoad({ repeat, sphere, end }, fileName, { 1.f, -1.f, 1.f }));
+	CHECK(SaveAndLoad({ limited, sphere, end }, fileName, { 1.f, 1.f, 1.f, 0.f, 2.f, 3.f }));
+	CHECK(!SaveAndLoad({ limited, sphere, end }, fileName, { 1.f, 1.f, 1.f, -1.f, 2.f, 3.f }));
+	CHECK(!SaveAndLoad({ limited, sphere, end }, fileName, { 1.f, 1.f, 1.f, 1.f, 2.5f, 3.f }));
+	CHECK(SaveAndLoad({ polar, sphere, end }, fileName, { 0.f, 0.f, 0.f, 6.f }));
+	CHECK(!SaveAndLoad({ polar, sphere, end }, fileName, { 0.f, 0.f, 0.f, 0.f }));
+	CHECK(!SaveAndLoad({ polar, sphere, end }, fileName, { 0.f, 0.f, 0.f, 2.5f }));
+	CHECK(!SaveAndLoad({ polar, sphere, end }, fileName, { 0.f, std::nanf(""), 0.f, 6.f }));
+
+	// As is a header depth below what the instructions need.
+	tape.maxStackDepth--;
+	CHECK(SaveTape(tape, fileName));
+	CHECK(!LoadTape(fs, fileName, loaded));
+
+	std::filesystem::remove(fileName);
+}
+
+int main(int, char**)
+{
+	try
+	{
+		test_tape_compile();
+		test_tape_matches_builtin_map();
+		test_tape_packets();
+		test_tape_file();
+	}
+	catch (const std::runtime_error& err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Command line options that SDFRender and SDFBatchRender share, so both tools describe and check them
+// the same way.
+
+#include "../cpu/ShaderTypes.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace sdf
+{
+	inline const char* const c_NormalsNames[] = { "central", "tetrahedron", "dual" };
+
+	// SDF_NORMALS_* of a name of c_NormalsNames, -1 for an unknown one.
+	inline int FindNormals(const char* name)
+	{
+		for (int normals = SDF_NORMALS_CENTRAL; normals <= SDF_NORMALS_DUAL; normals++)
+		{
+			if (!std::strcmp(name, c_NormalsNames[normals]))
+				return normals;
+		}
+		return -1;
+	}
+
+	// Sizes of the occupancy grid -occupancy accepts, 0 disabling it.
+	inline bool IsOccupancySize(int size)
+	{
+		return size >= 0 && size <= SDF_OCCUPANCY_MAX_SIZE && (size & (size - 1)) == 0;
+	}
+
+	// The usage lines of the shading options, which both tools read into RenderConstants alike.
+	inline void PrintShadingOptions()
+	{
+		std::fprintf(stderr,
+			"  -switch <xyzw>      g_Switch as four digits: base color, key light, sky light, AO (1111)\n"
+			"  -steps <n>          g_Factor.x, maximum march steps (256)\n"
+			"  -shadowk <k>        g_Factor.y, soft shadow sharpness (20)\n"
+			"  -cone <n>           tile size of the cone prepass, 0 disables it (8)\n"
+			"  -relax <w>          g_Relax.x, over-relaxation step factor, 1 for plain sphere tracing (1.6)\n"
+			"  -normals <name>     gradient of calcNormal(): central, tetrahedron or dual (tetrahedron)\n"
+			"  -lighting <n>       soft shadows and AO once per n x n pixels, upsampled; 1 evaluates them per pixel (1)\n"
+			"  -occupancy <n>      cells per side of the occupancy grid to skip empty space with, a power of 2; 0 disables it (0)\n"
+			"  -texture <file>     floor texture instead of the procedural pattern, e.g. src/Texture/noise0.jpg\n");
+	}
+}
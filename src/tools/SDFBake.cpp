@@ -0,0 +1,243 @@
+// Brick map baker: samples the SDF scene, or the meshes of a glTF file, into a sparse brick map (see
+// src/cpu/BrickMap.h), or with -adf into an adaptive distance octree (see src/cpu/DistanceOctree.h), and
+// writes it to a binary file. Reports the occupancy and size of the result and how far its filtered
+// distances are from the exact ones near the surfaces.
+
+#include "../cpu/BrickMap.h"
+#include "../cpu/DistanceOctree.h"
+#include "../cpu/MeshSdf.h"
+
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	void PrintUsage()
+	{
+		std::fprintf(stderr,
+			"usage: SDFBake [options]\n"
+			"  -scene <file>       JSON scene or .tape file, the built-in scene by default\n"
+			"  -mesh <file>        glTF file to bake instead of a scene\n"
+			"  -o <file>           output brick map (sdf.bricks, sdf.adf with -adf)\n"
+			"  -time <t>           g_Time.x the scene is baked at (10)\n"
+			"  -bounds <6 floats>  baked region as min x y z and max x y z (-2.5 -0.5 -2.5 2.5 2 2.5, around the mesh)\n"
+			"  -voxel <size>       distance between samples (0.02, 1/256 of the mesh size)\n"
+			"  -band <d>           distance from the surfaces covered by bricks (0.1, 4 voxels for a mesh)\n"
+			"  -bits <n>           bits per sample, 8 or 16 (8)\n"
+			"  -adf <tolerance>    bake a distance octree whose filtered distances miss by at most tolerance instead\n"
+			"  -depth <n>          levels of the distance octree below its root (10)\n"
+			"  -threads <n>        worker threads (all cores)\n");
+	}
+
+	// Mean and largest difference to the analytic field at random points within the band, also relative to unit.
+	void PrintError(const std::function<float(const float3&)>& sample, const std::function<float(const float3&)>& distance,
+		const box3& bounds, float band, float unit, const char* unitName)
+	{
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dx(bounds.m_mins.x, bounds.m_maxs.x);
+		std::uniform_real_distribution<float> dy(bounds.m_mins.y, bounds.m_maxs.y);
+		std::uniform_real_distribution<float> dz(bounds.m_mins.z, bounds.m_maxs.z);
+
+		int count = 0;
+		double sum = 0.0;
+		double largest = 0.0;
+		for (int i = 0; i < 1000000 && count < 100000; i++)
+		{
+			float3 p(dx(rng), dy(rng), dz(rng));
+			float d = distance(p);
+			if (std::fabs(d) >= band)
+				continue;
+
+			double error = std::fabs(double(sample(p)) - double(d));
+			sum += error;
+			largest = std::max(largest, error);
+			count++;
+		}
+
+		if (count > 0)
+		{
+			std::printf("  error  %.5f mean, %.5f max over %d points within the band (%.2f%% and %.2f%% of %s)\n",
+				sum / count, largest, count, 100.0 * sum / count / unit, 100.0 * largest / unit, unitName);
+		}
+	}
+}
+
+int main(int argc, const char** argv)
+{
+	std::filesystem::path scenePath;
+	std::filesystem::path meshPath;
+	std::filesystem::path outputPath;
+	float time = 10.0f;
+	BrickMapDesc desc;
+	DistanceOctreeDesc octreeDesc;
+	bool octree = false;
+	bool boundsSet = false, voxelSet = false, bandSet = false;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (!std::strcmp(arg, "-bounds") && i + 6 < argc)
+		{
+			desc.bounds = box3(float3(std::stof(argv[i + 1]), std::stof(argv[i + 2]), std::stof(argv[i + 3])),
+				float3(std::stof(argv[i + 4]), std::stof(argv[i + 5]), std::stof(argv[i + 6])));
+			i += 6;
+			boundsSet = true;
+			continue;
+		}
+
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			PrintUsage();
+			return 1;
+		}
+		i++;
+
+		if (!std::strcmp(arg, "-scene")) scenePath = value;
+		else if (!std::strcmp(arg, "-mesh")) meshPath = value;
+		else if (!std::strcmp(arg, "-o")) outputPath = value;
+		else if (!std::strcmp(arg, "-time")) time = std::stof(value);
+		else if (!std::strcmp(arg, "-voxel")) { desc.voxelSize = std::stof(value); voxelSet = true; }
+		else if (!std::strcmp(arg, "-band")) { desc.band = std::stof(value); bandSet = true; }
+		else if (!std::strcmp(arg, "-bits")) desc.bits = std::stoi(value);
+		else if (!std::strcmp(arg, "-adf")) { octreeDesc.tolerance = std::stof(value); octree = true; }
+		else if (!std::strcmp(arg, "-depth")) octreeDesc.maxDepth = std::stoi(value);
+		else if (!std::strcmp(arg, "-threads")) threads = unsigned(std::max(std::stoi(value), 1));
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	auto fs = std::make_shared<vfs::NativeFileSystem>();
+	tf::Executor executor(threads);
+
+	Tape tape;
+	SceneBvh bvh;
+	if (!scenePath.empty())
+	{
+		if (scenePath.extension() == ".tape")
+		{
+			if (!LoadTape(*fs, scenePath, tape))
+				return 1;
+		}
+		else
+		{
+			std::unique_ptr<CsgNode> root = LoadCsgScene(*fs, scenePath);
+			if (!root || !CompileTape(*root, tape))
+				return 1;
+		}
+
+		if (!bvh.Build(tape))
+		{
+			std::fprintf(stderr, "%s has a malformed tape\n", scenePath.generic_string().c_str());
+			return 1;
+		}
+	}
+
+	SceneMap map;
+	map.bvh = scenePath.empty() ? nullptr : &bvh;
+	map.time = time;
+
+	MeshDistance mesh;
+	if (!meshPath.empty())
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		TriangleMesh triangles;
+		if (!LoadGltfMesh(fs, meshPath, triangles, &executor) || !mesh.Build(triangles))
+			return 1;
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		std::printf("%u triangles loaded in %.2f ms\n", mesh.GetTriangleCount(), seconds * 1e3);
+
+		// Unless told otherwise, bake the whole mesh at a resolution that follows its size.
+		const box3 meshBounds = mesh.GetBounds();
+		const float3 extent = meshBounds.diagonal();
+		if (!voxelSet)
+			desc.voxelSize = std::max(extent.x, std::max(extent.y, extent.z)) / 256.f;
+		if (!bandSet)
+			desc.band = 4.f * desc.voxelSize;
+		if (!boundsSet)
+			desc.bounds = meshBounds.grow(desc.band + desc.voxelSize);
+	}
+
+	const BrickMapField meshField = [&mesh](const float3& origin, float step, int count, float* distances)
+	{
+		mesh.DistanceBlock(origin, step, count, distances);
+	};
+	// Only the points within the band count, so the mesh queries can stop there.
+	const std::function<float(const float3&)> distance = meshPath.empty()
+		? std::function<float(const float3&)>([&map](const float3& p) { return map(p).x; })
+		: [&mesh, &desc](const float3& p)
+		{
+			float d = mesh.UnsignedDistance(p, desc.band);
+			return d < desc.band && mesh.WindingNumber(p) > 0.5f ? -d : d;
+		};
+
+	if (outputPath.empty())
+		outputPath = octree ? "sdf.adf" : "sdf.bricks";
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (octree)
+	{
+		octreeDesc.bounds = desc.bounds;
+		octreeDesc.band = desc.band;
+
+		DistanceOctree adf;
+		const bool built = meshPath.empty() ? adf.Build(executor, map, octreeDesc) : adf.Build(executor, meshField, octreeDesc);
+		if (!built)
+			return 1;
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		const float3 extent = adf.GetBounds().diagonal();
+		std::printf("octree of %g with %d levels, cells of %g at the bottom, %u threads, %.2f ms\n", extent.x, adf.GetMaxDepth(),
+			std::ldexp(extent.x, -adf.GetMaxDepth()), threads, seconds * 1e3);
+		std::printf("  leaves %u of %u nodes:", adf.GetLeafCount(), adf.GetNodeCount());
+		const std::vector<uint32_t> leafCounts = adf.GetLeafCounts();
+		for (size_t depth = 0; depth < leafCounts.size(); depth++)
+		{
+			if (leafCounts[depth] > 0)
+				std::printf(" %u at %zu", leafCounts[depth], depth);
+		}
+		std::printf("\n  size   %.2f MB\n", double(adf.GetMemorySize()) / (1 << 20));
+		PrintError([&adf](const float3& p) { return adf.Sample(p); }, distance, desc.bounds, desc.band, octreeDesc.tolerance, "the tolerance");
+
+		return adf.Save(outputPath) ? 0 : 1;
+	}
+
+	BrickMap bricks;
+	const bool baked = meshPath.empty() ? bricks.Bake(executor, map, desc) : bricks.Bake(executor, meshField, desc);
+	if (!baked)
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const int3 grid = bricks.GetGridSize();
+	const size_t voxels = size_t(grid.x) * size_t(grid.y) * size_t(grid.z) * size_t(BrickMap::c_BrickSize - 1) * size_t(BrickMap::c_BrickSize - 1) * size_t(BrickMap::c_BrickSize - 1);
+	std::printf("%dx%dx%d cells of %d^3 voxels of %g, %u threads, %.2f ms\n", grid.x, grid.y, grid.z, BrickMap::c_BrickSize - 1,
+		desc.voxelSize, threads, seconds * 1e3);
+	std::printf("  bricks %u of %u cells (%.1f%%), %d bit samples over +-%.3f\n", bricks.GetBrickCount(), bricks.GetCellCount(),
+		100.0 * double(bricks.GetBrickCount()) / double(bricks.GetCellCount()), bricks.GetBits(), bricks.GetRange());
+	std::printf("  size   %.2f MB, a dense grid would take %.2f MB\n", double(bricks.GetMemorySize()) / (1 << 20),
+		double(voxels * size_t(bricks.GetBits() / 8)) / (1 << 20));
+	PrintError([&bricks](const float3& p) { return bricks.Sample(p); }, distance, desc.bounds, desc.band, desc.voxelSize, "a voxel");
+
+	if (!bricks.Save(outputPath))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,451 @@
+// Offline batch renderer: renders a time range of the animated SDF scene to numbered PNG files with the
+// CPU renderer, without a window or a GPU, e.g. preview clips on render farm nodes.
+// The frames are rendered one after the other by all worker threads while separate threads encode and
+// write the finished ones, so the renderer doesn't wait for the PNG encoder. Consecutive frames reuse
+// each other's primary hits like the application does. At the end it reports the frames per second and
+// how busy the cores were.
+
+#include "../cpu/Accumulation.h"
+#include "../cpu/ConePrepass.h"
+#include "../cpu/LightingPass.h"
+#include "../cpu/OccupancyGrid.h"
+#include "../cpu/ProbeGrid.h"
+#include "../cpu/SceneAnimation.h"
+#include "../cpu/TemporalReuse.h"
+#include "RenderOptions.h"
+
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	void PrintUsage()
+	{
+		std::fprintf(stderr,
+			"usage: SDFBatchRender [options]\n"
+			"  -scene <file>       JSON scene or .tape file, the built-in scene by default; its tracks follow the frames\n"
+			"  -o <pattern>        output files, a pattern with one %%d of the frame number (frames/sdf_%%04d.png)\n"
+			"  -width <n>          image width (1280)\n"
+			"  -height <n>         image height (720)\n"
+			"  -start <t>          g_Time.x of frame 0 (10)\n"
+			"  -end <t>            g_Time.x where the sequence ends, excluded (12)\n"
+			"  -fps <n>            frames per second of g_Time (30)\n"
+			"  -first <n>          first frame number rendered, to split a sequence between nodes (0)\n"
+			"  -last <n>           last frame number rendered (the last frame before -end)\n");
+		PrintShadingOptions();
+		std::fprintf(stderr,
+			"  -temporal <0|1>     reuse the primary hits of the previous frame (1)\n"
+			"  -samples <n>        jittered samples averaged per frame (1)\n"
+			"  -probes <n>         irradiance probes updated per frame for the bounced diffuse light; 0 keeps the fixed sky light (0)\n"
+			"  -threads <n>        render threads (all cores)\n"
+			"  -writers <n>        threads encoding and writing the PNG files (2)\n");
+	}
+
+	// User and kernel time of all threads of the process so far.
+	double GetProcessCpuSeconds()
+	{
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+			return 0.0;
+		auto seconds = [](const FILETIME& t) { return double((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7; };
+		return seconds(kernel) + seconds(user);
+#else
+		rusage usage = {};
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0.0;
+		auto seconds = [](const timeval& t) { return double(t.tv_sec) + double(t.tv_usec) * 1e-6; };
+		return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+	}
+
+	// The pattern is handed to snprintf with the frame number, so it may only hold one %d, with flags and
+	// a width, besides %% for a literal percent sign. Without one all frames would go to the same file.
+	bool IsFramePattern(const std::string& pattern)
+	{
+		int conversions = 0;
+		for (size_t i = 0; i < pattern.size(); i++)
+		{
+			if (pattern[i] != '%')
+				continue;
+			if (++i < pattern.size() && pattern[i] == '%')
+				continue;
+			while (i < pattern.size() && std::strchr("-+ #0", pattern[i]))
+				i++;
+			while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9')
+				i++;
+			if (i == pattern.size() || pattern[i] != 'd')
+				return false;
+			conversions++;
+		}
+		return conversions == 1;
+	}
+
+	std::filesystem::path GetFramePath(const std::string& pattern, int frame)
+	{
+		std::vector<char> name(std::snprintf(nullptr, 0, pattern.c_str(), frame) + 1);
+		std::snprintf(name.data(), name.size(), pattern.c_str(), frame);
+		return std::filesystem::path(name.data());
+	}
+
+	struct PendingFrame
+	{
+		Image image;
+		std::filesystem::path path;
+	};
+
+	// Finished frames waiting for the writer threads. Push() blocks while the queue is full, so the
+	// renderer can't get more than a few frames ahead of slow disks.
+	class FrameQueue
+	{
+	public:
+		explicit FrameQueue(size_t capacity) : m_Capacity(std::max<size_t>(capacity, 1)) { }
+
+		void Push(PendingFrame&& frame)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NotFull.wait(lock, [&] { return m_Frames.size() < m_Capacity; });
+			m_Frames.push_back(std::move(frame));
+			m_NotEmpty.notify_one();
+		}
+
+		// False once the queue is closed and empty.
+		bool Pop(PendingFrame& frame)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NotEmpty.wait(lock, [&] { return !m_Frames.empty() || m_Closed; });
+			if (m_Frames.empty())
+				return false;
+			frame = std::move(m_Frames.front());
+			m_Frames.pop_front();
+			m_NotFull.notify_one();
+			return true;
+		}
+
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Closed = true;
+			m_NotEmpty.notify_all();
+		}
+
+	private:
+		size_t m_Capacity;
+		std::deque<PendingFrame> m_Frames;
+		bool m_Closed = false;
+		std::mutex m_Mutex;
+		std::condition_variable m_NotFull;
+		std::condition_variable m_NotEmpty;
+	};
+}
+
+int main(int argc, const char** argv)
+{
+	std::filesystem::path scenePath;
+	std::filesystem::path texturePath;
+	std::string pattern = "frames/sdf_%04d.png";
+	int width = 1280;
+	int height = 720;
+	float startTime = 10.0f;
+	float endTime = 12.0f;
+	float fps = 30.0f;
+	int first = 0;
+	int last = -1;
+	std::string switches = "1111";
+	float steps = 256.0f;
+	float shadowK = 20.0f;
+	int coneTileSize = SDF_CONE_TILE_SIZE;
+	float relaxation = SDF_RAY_RELAXATION;
+	int normals = SDF_NORMALS_DEFAULT;
+	bool temporal = true;
+	int lightingScale = 1;
+	int samples = 1;
+	int occupancySize = 0;
+	int probeBudget = 0;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+	int writers = 2;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value)
+			{
+				PrintUsage();
+				return 1;
+			}
+			i++;
+
+			if (!std::strcmp(arg, "-scene")) scenePath = value;
+			else if (!std::strcmp(arg, "-o")) pattern = value;
+			else if (!std::strcmp(arg, "-width")) width = std::stoi(value);
+			else if (!std::strcmp(arg, "-height")) height = std::stoi(value);
+			else if (!std::strcmp(arg, "-start")) startTime = std::stof(value);
+			else if (!std::strcmp(arg, "-end")) endTime = std::stof(value);
+			else if (!std::strcmp(arg, "-fps")) fps = std::stof(value);
+			else if (!std::strcmp(arg, "-first")) first = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-last")) last = std::stoi(value);
+			else if (!std::strcmp(arg, "-switch")) switches = value;
+			else if (!std::strcmp(arg, "-steps")) steps = std::stof(value);
+			else if (!std::strcmp(arg, "-shadowk")) shadowK = std::stof(value);
+			else if (!std::strcmp(arg, "-cone")) coneTileSize = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-relax")) relaxation = std::stof(value);
+			else if (!std::strcmp(arg, "-normals")) normals = FindNormals(value);
+			else if (!std::strcmp(arg, "-temporal")) temporal = std::stoi(value) != 0;
+			else if (!std::strcmp(arg, "-lighting")) lightingScale = std::max(std::stoi(value), 1);
+			else if (!std::strcmp(arg, "-samples")) samples = std::clamp(std::stoi(value), 1, SDF_ACCUMULATE_MAX_SAMPLES);
+			else if (!std::strcmp(arg, "-occupancy")) occupancySize = std::stoi(value);
+			else if (!std::strcmp(arg, "-probes")) probeBudget = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-texture")) texturePath = value;
+			else if (!std::strcmp(arg, "-threads")) threads = unsigned(std::max(std::stoi(value), 1));
+			else if (!std::strcmp(arg, "-writers")) writers = std::max(std::stoi(value), 1);
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+	}
+	catch (const std::logic_error&)
+	{
+		// std::stoi and std::stof throw on values that aren't numbers or are out of range.
+		PrintUsage();
+		return 1;
+	}
+
+	if (switches.size() != 4 || width <= 0 || height <= 0 || normals < 0 || fps <= 0.0f || !IsFramePattern(pattern)
+		|| !IsOccupancySize(occupancySize))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// Frame n shows g_Time.x = start + n / fps, up to but excluding the end.
+	const int frameCount = std::max(int(std::ceil((endTime - startTime) * fps - 1e-4f)), 0);
+	if (last < 0 || last >= frameCount)
+		last = frameCount - 1;
+	if (first > last)
+	{
+		std::fprintf(stderr, "No frames between %g and %g at %g fps from frame %d\n", startTime, endTime, fps, first);
+		return 1;
+	}
+
+	vfs::NativeFileSystem fs;
+
+	Tape tape;
+	SceneBvh bvh;
+	std::unique_ptr<CsgCamera> camera;
+	if (!scenePath.empty())
+	{
+		if (scenePath.extension() == ".tape")
+		{
+			if (!LoadTape(fs, scenePath, tape))
+				return 1;
+		}
+		else
+		{
+			std::unique_ptr<CsgNode> root = LoadCsgScene(fs, scenePath, &camera);
+			if (!root || !CompileTape(*root, tape))
+				return 1;
+		}
+
+		if (!bvh.Build(tape))
+		{
+			std::fprintf(stderr, "%s has a malformed tape\n", scenePath.generic_string().c_str());
+			return 1;
+		}
+	}
+
+	Texture texture;
+	if (!texturePath.empty() && !LoadTexture(fs, texturePath, texture))
+		return 1;
+
+	std::error_code ec;
+	const std::filesystem::path directory = GetFramePath(pattern, first).parent_path();
+	if (!directory.empty())
+		std::filesystem::create_directories(directory, ec);
+
+	tf::Executor executor(threads);
+	CpuRenderer renderer(executor);
+	renderer.SetScene(scenePath.empty() ? nullptr : &bvh);
+	renderer.SetTexture(texturePath.empty() ? nullptr : &texture);
+	renderer.SetNormals(normals);
+
+	OccupancyGrid occupancy;
+	std::vector<box3> moved;
+	double occupancySeconds = 0.0;
+	renderer.SetOccupancy(&occupancy);
+
+	ProbeGrid probes;
+	double probeSeconds = 0.0;
+	renderer.SetProbes(&probes);
+
+	SceneAnimation animation;
+	animation.Bind(tape, camera.get());
+
+	FrameQueue queue(size_t(writers) * 2);
+	std::mutex failureMutex;
+	std::filesystem::path failedPath;
+	std::vector<double> encodeSeconds(writers, 0.0);
+	std::vector<std::thread> writerThreads;
+	for (int w = 0; w < writers; w++)
+	{
+		writerThreads.emplace_back([&, w]()
+		{
+			PendingFrame frame;
+			while (queue.Pop(frame))
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				if (!SavePng(frame.image, frame.path))
+				{
+					std::lock_guard<std::mutex> lock(failureMutex);
+					if (failedPath.empty())
+						failedPath = frame.path;
+				}
+				encodeSeconds[w] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+		});
+	}
+
+	std::printf("%d frames of %dx%d from t = %g, %u render threads, %d writers\n", last - first + 1, width, height,
+		startTime + float(first) / fps, threads, writers);
+
+	const double cpuStart = GetProcessCpuSeconds();
+	auto wallStart = std::chrono::high_resolution_clock::now();
+
+	RenderStats total;
+	for (int frame = first; frame <= last; frame++)
+	{
+		RenderConstants constants = GetDefaultRenderConstants(startTime + float(frame) / fps, width, height);
+		constants.g_Switch = int4(switches[0] - '0', switches[1] - '0', switches[2] - '0', switches[3] - '0');
+		constants.g_Factor = float2(steps, shadowK);
+		constants.g_Cone = GetConeConstants(coneTileSize, width);
+		constants.g_Relax = float4(relaxation, 0.f, 0.f, 0.f);
+		constants.g_Temporal = GetTemporalConstants(temporal, 0.f);
+		constants.g_Lighting = GetLightingConstants(lightingScale, width);
+		animation.GetCameraConstants(constants.g_Time.x, constants.g_Camera, constants.g_CameraTarget);
+
+		// The tracks of all animated instructions are evaluated at once, only the objects that moved are refitted.
+		moved.clear();
+		if (animation.Evaluate(constants.g_Time.x, bvh) > 0)
+			bvh.Refit(&moved);
+
+		// The occupancy grid is built for the first frame, then the cells are classified again only where
+		// the objects moved and where the surfaces follow the time.
+		if (occupancySize > 0)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			SceneMap map;
+			map.bvh = scenePath.empty() ? nullptr : &bvh;
+			map.time = constants.g_Time.x;
+			if (occupancy.Empty())
+			{
+				OccupancyGridDesc desc;
+				desc.size = occupancySize;
+				desc.margin = scenePath.empty() ? c_DefaultSceneOvershoot : 0.0f;
+				occupancy.Build(executor, map, desc);
+			}
+			else
+			{
+				GetTimeDependentRegions(map, moved);
+				occupancy.Update(executor, map, moved);
+			}
+			occupancySeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		// Every probe is lit for the first frame, then the budget of them is updated per frame, as in the
+		// window.
+		if (probeBudget > 0)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			SceneMap map;
+			map.bvh = scenePath.empty() ? nullptr : &bvh;
+			map.occupancy = occupancy.Empty() ? nullptr : &occupancy;
+			map.time = constants.g_Time.x;
+			if (probes.Empty() && probes.Init(ProbeGridDesc()))
+				probes.Update(executor, map, constants, probes.GetProbeCount());
+			else
+				probes.Update(executor, map, constants, uint32_t(probeBudget));
+			probeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		PendingFrame pending;
+		pending.path = GetFramePath(pattern, frame);
+		if (samples > 1)
+			total += renderer.Accumulate(constants, samples, pending.image);
+		else
+			total += renderer.Render(constants, pending.image);
+		queue.Push(std::move(pending));
+	}
+
+	queue.Close();
+	for (std::thread& thread : writerThreads)
+		thread.join();
+
+	const double wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - wallStart).count();
+	const double cpuSeconds = GetProcessCpuSeconds() - cpuStart;
+
+	if (!failedPath.empty())
+	{
+		std::fprintf(stderr, "Cannot write %s\n", failedPath.generic_string().c_str());
+		return 1;
+	}
+
+	const int frames = last - first + 1;
+	const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+	double encodeTotal = 0.0;
+	for (double seconds : encodeSeconds)
+		encodeTotal += seconds;
+
+	std::printf("%.2f s, %.2f frames per second\n", wallSeconds, double(frames) / wallSeconds);
+	std::printf("  render %.2f ms per frame, %.1f%% of the time\n", total.seconds * 1e3 / frames,
+		100.0 * total.seconds / wallSeconds);
+	std::printf("  encode %.2f ms per frame on the writers, overlapped with the rendering\n", encodeTotal * 1e3 / frames);
+	std::printf("  cores  %.1f%% busy (%.2f CPU s over %u cores)\n", 100.0 * cpuSeconds / (wallSeconds * double(cores)),
+		cpuSeconds, cores);
+	if (occupancySize > 0)
+	{
+		std::printf("  occupancy %.2f ms per frame updating %d^3 cells, %.2f jumps per primary ray\n",
+			occupancySeconds * 1e3 / frames, occupancySize, double(total.primarySkips) / double(std::max<uint64_t>(total.primaryRays, 1)));
+	}
+	if (probeBudget > 0)
+	{
+		std::printf("  probes %.2f ms per frame updating %d of %u probes, %.1f KB\n", probeSeconds * 1e3 / frames,
+			probeBudget, probes.GetProbeCount(), double(probes.GetMemorySize()) / 1024.0);
+	}
+	if (temporal)
+	{
+		std::printf("  temporal %.2f%% of the primary rays started at the hits of the previous frame\n",
+			100.0 * double(total.temporalSeeds) / double(std::max<uint64_t>(total.primaryRays, 1)));
+	}
+	std::printf("  wrote %s ... %s\n", GetFramePath(pattern, first).generic_string().c_str(),
+		GetFramePath(pattern, last).generic_string().c_str());
+
+	return 0;
+}
@@ -0,0 +1,952 @@
+// Microbenchmark for the CPU SDF evaluator.
+// Reports evaluated points per second for every primitive and operator at each packet width,
+// and the cost of a large tape with and without per-tile pruning.
+// Also compares the march steps of the renderer with and without the cone prepass, over-relaxation and
+// packets of primary rays,
+// the cost of the three ways calcNormal() can take the gradient and the shadows and AO evaluated at
+// reduced resolution against full resolution.
+// Then it compares sampling a baked brick map with evaluating the scene it was baked from, brick maps
+// of the built-in scene with adaptive distance octrees of it, building a noise volume with loading it
+// from its cache, the batched scene queries with the same queries made one at a time, compiled tapes
+// with the interpreter and, for the scene of -scene, with the C++ port of map(), and finally the march
+// steps of the scene of -scene, or the built-in one, with occupancy grids of growing size and the cost of
+// updating an irradiance probe grid per frame against the frame time and the lookups it adds.
+
+#include "../cpu/BrickMap.h"
+#include "../cpu/Bvh.h"
+#include "../cpu/ConePrepass.h"
+#include "../cpu/DistanceOctree.h"
+#include "../cpu/LightingPass.h"
+#include "../cpu/Noise.h"
+#include "../cpu/NoiseVolume.h"
+#include "../cpu/OccupancyGrid.h"
+#include "../cpu/PacketMarching.h"
+#include "../cpu/ProbeGrid.h"
+#include "../cpu/Primitives.h"
+#include "../cpu/RandomScene.h"
+#include "../cpu/SceneQuery.h"
+#include "../cpu/TapeJit.h"
+#include "../cpu/TapePruning.h"
+
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace sdf;
+
+namespace
+{
+	struct PointCloud
+	{
+		std::vector<float> x, y, z;
+		std::vector<float> out;
+
+		explicit PointCloud(size_t count)
+			: x(count), y(count), z(count), out(count)
+		{
+			std::mt19937 rng(1234);
+			std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+			for (size_t i = 0; i < count; i++)
+			{
+				x[i] = dist(rng);
+				y[i] = dist(rng);
+				z[i] = dist(rng);
+			}
+		}
+
+		size_t Size() const { return x.size(); }
+	};
+
+	template<typename F> F LoadPacket(const float* p)
+	{
+		if constexpr (WidthOf<F> == 1)
+			return *p;
+		else
+			return F::Load(p);
+	}
+
+	template<typename F> void StorePacket(float* p, F v)
+	{
+		if constexpr (WidthOf<F> == 1)
+			*p = v;
+		else
+			v.Store(p);
+	}
+
+	// Runs the kernel over the whole cloud until at least minSeconds have passed, returns points per second.
+	template<typename F, typename Kernel> double Measure(PointCloud& cloud, Kernel kernel, double minSeconds)
+	{
+		constexpr int W = WidthOf<F>;
+		const size_t count = cloud.Size() / W * W;
+
+		size_t evaluated = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			for (size_t i = 0; i < count; i += W)
+			{
+				Vec3<F> p(LoadPacket<F>(&cloud.x[i]), LoadPacket<F>(&cloud.y[i]), LoadPacket<F>(&cloud.z[i]));
+				StorePacket<F>(&cloud.out[i], kernel(p));
+			}
+			evaluated += count;
+			elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		} while (elapsed < minSeconds);
+
+		return double(evaluated) / elapsed;
+	}
+
+	template<typename Kernel> void Run(PointCloud& cloud, const char* name, Kernel kernel, double minSeconds)
+	{
+		double scalar = Measure<float>(cloud, kernel, minSeconds);
+		std::printf("%-22s %10.1f", name, scalar * 1e-6);
+
+#if defined(SDF_SIMD_SSE)
+		double sse = Measure<Float4>(cloud, kernel, minSeconds);
+		std::printf(" %10.1f (x%.1f)", sse * 1e-6, sse / scalar);
+#else
+		std::printf(" %17s", "n/a");
+#endif
+
+#if defined(SDF_SIMD_AVX2)
+		double avx = Measure<Float8>(cloud, kernel, minSeconds);
+		std::printf(" %10.1f (x%.1f)", avx * 1e-6, avx / scalar);
+#else
+		std::printf(" %17s", "n/a");
+#endif
+		std::printf("\n");
+	}
+
+	void RunPrimitives(size_t pointCount, double minSeconds)
+	{
+		PointCloud cloud(pointCount);
+
+		std::printf("%-22s %10s %17s %17s\n", "Mpoints/s", "scalar", "sse x4", "avx2 x8");
+
+		Run(cloud, "sdPlane", [](const auto& p) { using F = decltype(p.x); return sdPlane(p, Splat<F>(0.f, 1.f, 0.f)); }, minSeconds);
+		Run(cloud, "sdSphere", [](const auto& p) { using F = decltype(p.x); return sdSphere(p, F(0.35f)); }, minSeconds);
+		Run(cloud, "sdBox", [](const auto& p) { using F = decltype(p.x); return sdBox(p, Splat<F>(0.3f, 0.3f, 0.3f)); }, minSeconds);
+		Run(cloud, "sdBoxFrame", [](const auto& p) { using F = decltype(p.x); return sdBoxFrame(p, Splat<F>(0.3f, 0.3f, 0.3f), F(0.06f)); }, minSeconds);
+		Run(cloud, "sdTorus", [](const auto& p) { using F = decltype(p.x); return sdTorus(p, Vec2<F>(0.27f, 0.03f)); }, minSeconds);
+		Run(cloud, "sdCylinder", [](const auto& p) { using F = decltype(p.x); return sdCylinder(p, Vec2<F>(0.3f, 0.3f), 0); }, minSeconds);
+		Run(cloud, "sdOctahedron", [](const auto& p) { using F = decltype(p.x); return sdOctahedron(p, F(0.3f)); }, minSeconds);
+
+		// Operators are measured on two spheres so the numbers include the operand cost.
+		Run(cloud, "opUnion", [](const auto& p) { using F = decltype(p.x);
+			return opUnion(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f))); }, minSeconds);
+		Run(cloud, "opSubtraction", [](const auto& p) { using F = decltype(p.x);
+			return opSubtraction(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f))); }, minSeconds);
+		Run(cloud, "opIntersection", [](const auto& p) { using F = decltype(p.x);
+			return opIntersection(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f))); }, minSeconds);
+		Run(cloud, "opSmoothUnion", [](const auto& p) { using F = decltype(p.x);
+			return opSmoothUnion(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f)), F(0.25f)); }, minSeconds);
+		Run(cloud, "opSmoothSubtraction", [](const auto& p) { using F = decltype(p.x);
+			return opSmoothSubtraction(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f)), F(0.25f)); }, minSeconds);
+		Run(cloud, "opSmoothIntersection", [](const auto& p) { using F = decltype(p.x);
+			return opSmoothIntersection(sdSphere(p, F(0.35f)), sdSphere(p - Splat<F>(0.5f, 0.f, 0.f), F(0.35f)), F(0.25f)); }, minSeconds);
+		Run(cloud, "opRound", [](const auto& p) { using F = decltype(p.x); return opRound(sdBox(p, Splat<F>(0.3f, 0.3f, 0.3f)), F(0.1f)); }, minSeconds);
+		Run(cloud, "opDisplace", [](const auto& p) { using F = decltype(p.x); return opDisplace(sdSphere(p, F(0.35f)), 1.0f); }, minSeconds);
+
+		// Noise of Noise.h, a single octave and the fractal sums the floor and the noise displacement use.
+		Run(cloud, "ValueNoise", [](const auto& p) { return ValueNoise(p); }, minSeconds);
+		Run(cloud, "GradientNoise", [](const auto& p) { return GradientNoise(p); }, minSeconds);
+		Run(cloud, "ValueFbm x3", [](const auto& p) { return ValueFbm(p, 3); }, minSeconds);
+		Run(cloud, "FloorPattern", [](const auto& p) { using F = decltype(p.x); return FloorPattern(Vec2<F>(p.x, p.z)); }, minSeconds);
+	}
+
+	double Seconds(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Evaluates every packet of points with its own tape until minSeconds have passed, returns points per second.
+	// evaluate(t, p) returns map() of tape t.
+	template<typename Evaluate> double MeasureTapes(size_t tapeCount, const PointCloud& cloud, double minSeconds,
+		const Evaluate& evaluate)
+	{
+		constexpr int W = WidthOf<FloatN>;
+		const size_t pointsPerTape = cloud.Size() / tapeCount / W * W;
+
+		size_t evaluated = 0;
+		float sink = 0.f;
+		auto start = std::chrono::high_resolution_clock::now();
+		do
+		{
+			for (size_t t = 0; t < tapeCount; t++)
+			{
+				for (size_t i = t * pointsPerTape; i < (t + 1) * pointsPerTape; i += W)
+				{
+					Vec3<FloatN> p(LoadPacket<FloatN>(&cloud.x[i]), LoadPacket<FloatN>(&cloud.y[i]), LoadPacket<FloatN>(&cloud.z[i]));
+					sink += lane(evaluate(t, p).x, 0);
+				}
+			}
+			evaluated += tapeCount * pointsPerTape;
+		} while (Seconds(start) < minSeconds);
+
+		if (sink == 12345.f)
+			std::printf(" ");
+
+		return double(evaluated) / Seconds(start);
+	}
+
+	void RunPruning(uint32_t primitiveCount, double minSeconds)
+	{
+		Tape tape;
+		if (!CompileTape(*MakeRandomScene(primitiveCount), tape))
+			return;
+
+		const int2 resolution(480, 270);
+		const int tileSize = 16;
+		// Slabs get longer with distance, like the tiles' footprint.
+		std::vector<float> slabs = { 0.f };
+		for (float t = 1.f; t < 40.f; t *= 1.2f)
+			slabs.push_back(t);
+		const float extent = std::sqrt(float(primitiveCount) / 4.f) * 0.5f;
+		Camera camera = Camera::LookAt(float3(0.f, 2.5f, -extent - 1.f), float3(0.f, 0.5f, 0.f));
+
+		std::printf("\nTape pruning: %u primitives, %zu instructions, %dx%d tiles of %d pixels, %d slabs\n",
+			primitiveCount, tape.Size(), (resolution.x + tileSize - 1) / tileSize, (resolution.y + tileSize - 1) / tileSize,
+			tileSize, int(slabs.size()) - 1);
+
+		TileTapes tiles;
+		const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned threads = 1; threads <= maxThreads; threads = threads < maxThreads ? maxThreads : threads + 1)
+		{
+			tf::Executor executor(threads);
+			auto start = std::chrono::high_resolution_clock::now();
+			PruneTiles(executor, tape, camera, resolution, tileSize, slabs, 1.0f, tiles);
+			std::printf("  prune %2u thread(s)    %8.2f ms\n", threads, Seconds(start) * 1e3);
+		}
+		std::printf("  instructions per tape %8.1f (x%.1f fewer)\n", tiles.GetAverageSize(), double(tape.Size()) / tiles.GetAverageSize());
+
+		// Sample points along the rays of every tile and slab, grouped by the tape that covers them.
+		const int pointsPerTape = 64;
+		PointCloud cloud(tiles.tapes.size() * pointsPerTape);
+		std::mt19937 rng(99);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		std::vector<const Tape*> fullTapes(tiles.tapes.size(), &tape);
+		std::vector<const Tape*> prunedTapes(tiles.tapes.size());
+		for (int ty = 0; ty < tiles.tileCount.y; ty++)
+		{
+			for (int tx = 0; tx < tiles.tileCount.x; tx++)
+			{
+				for (int s = 0; s < tiles.GetSlabCount(); s++)
+				{
+					int index = tiles.GetIndex(tx, ty, s);
+					prunedTapes[index] = &tiles.tapes[index];
+					for (int i = 0; i < pointsPerTape; i++)
+					{
+						float2 pixel = float2(float(tx) + unit(rng), float(ty) + unit(rng)) * float(tileSize);
+						float t = slabs[s] + (slabs[s + 1] - slabs[s]) * unit(rng);
+						float3 p = camera.origin + camera.PixelRay(min(pixel, float2(resolution)), float2(resolution)) * t;
+						size_t j = size_t(index) * pointsPerTape + i;
+						cloud.x[j] = p.x;
+						cloud.y[j] = p.y;
+						cloud.z[j] = p.z;
+					}
+				}
+			}
+		}
+
+		auto interpret = [](const std::vector<const Tape*>& tapes)
+		{
+			return [&tapes](size_t t, const Vec3<FloatN>& p) { return EvaluateTape(*tapes[t], p, 1.0f); };
+		};
+		double full = MeasureTapes(fullTapes.size(), cloud, minSeconds, interpret(fullTapes));
+		double pruned = MeasureTapes(prunedTapes.size(), cloud, minSeconds, interpret(prunedTapes));
+		std::printf("  full tape             %8.2f Mpoints/s\n", full * 1e-6);
+		std::printf("  pruned tapes          %8.2f Mpoints/s (x%.1f)\n", pruned * 1e-6, pruned / full);
+
+		// Tiles and slabs that pruned to the same instructions share their compiled code.
+		JitCache cache;
+		std::vector<std::shared_ptr<const JitTape>> compiledTapes(prunedTapes.size());
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t t = 0; t < prunedTapes.size(); t++)
+			compiledTapes[t] = cache.Get(*prunedTapes[t]);
+		const double compileSeconds = Seconds(start);
+		double compiled = MeasureTapes(compiledTapes.size(), cloud, minSeconds,
+			[&](size_t t, const Vec3<FloatN>& p) { return compiledTapes[t]->Evaluate(p, 1.0f); });
+		std::printf("  compile pruned tapes  %8.2f ms (%zu distinct of %zu)\n", compileSeconds * 1e3, cache.GetSize(),
+			compiledTapes.size());
+		std::printf("  compiled pruned tapes %8.2f Mpoints/s (x%.1f)\n", compiled * 1e-6, compiled / full);
+	}
+
+	// map() cost with and without the BVH as the scene grows at constant density.
+	void RunBvh(double minSeconds)
+	{
+		std::printf("\n%-22s %10s %10s %10s %10s\n", "BVH Mpoints/s", "tape x1", "bvh x1", "tape xN", "bvh xN");
+
+		for (uint32_t primitiveCount : { 25u, 100u, 400u, 1600u, 6400u })
+		{
+			Tape tape;
+			SceneBvh bvh;
+			if (!CompileTape(*MakeRandomScene(primitiveCount), tape) || !bvh.Build(tape))
+				return;
+
+			// Points spread over the whole scene, where the rays of a frame would sample it.
+			const float extent = std::sqrt(float(primitiveCount) / 4.f) * 0.5f;
+			PointCloud cloud(1 << 14);
+			for (size_t i = 0; i < cloud.Size(); i++)
+			{
+				cloud.x[i] *= extent * 0.5f;
+				cloud.y[i] = cloud.y[i] * 0.4f + 0.8f;
+				cloud.z[i] *= extent * 0.5f;
+			}
+
+			auto tapeKernel = [&](const auto& p) { return EvaluateTape(tape, p, 0.f).x; };
+			auto bvhKernel = [&](const auto& p) { return EvaluateBvh(bvh, p, 0.f).x; };
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "%u primitives", primitiveCount);
+			std::printf("%-22s %10.2f %10.2f %10.2f %10.2f\n", name,
+				Measure<float>(cloud, tapeKernel, minSeconds) * 1e-6, Measure<float>(cloud, bvhKernel, minSeconds) * 1e-6,
+				Measure<FloatN>(cloud, tapeKernel, minSeconds) * 1e-6, Measure<FloatN>(cloud, bvhKernel, minSeconds) * 1e-6);
+		}
+	}
+
+	// Primary ray steps of a frame of the built-in scene for several cone prepass tile sizes.
+	void RunConePrepass()
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s\n", "Cone prepass", "ms", "steps/ray", "cone/px", "total/px");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		Image image;
+		for (int tileSize : { 0, 4, 8, 16, 32 })
+		{
+			RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+			constants.g_Cone = GetConeConstants(tileSize, width);
+			constants.g_Relax.x = 1.0f;
+			RenderStats stats = renderer.Render(constants, image);
+
+			char name[64];
+			std::snprintf(name, sizeof(name), tileSize ? "%dx%d tiles" : "off", tileSize, tileSize);
+			double pixels = double(stats.primaryRays);
+			std::printf("%-22s %10.2f %10.2f %10.2f %10.2f\n", name, stats.seconds * 1e3, double(stats.primarySteps) / pixels,
+				double(stats.prepassSteps) / pixels, double(stats.primarySteps + stats.prepassSteps) / pixels);
+		}
+	}
+
+	// Average primary ray steps per pixel of the built-in scene for several over-relaxation factors.
+	void RunRelaxation()
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s\n", "Over-relaxation", "steps/ray", "fallback", "+cone", "fallback");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		Image image;
+		for (float omega : { 1.0f, 1.2f, 1.4f, 1.6f, 1.8f, 2.0f })
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), "omega %.1f", omega);
+			std::printf("%-22s", name);
+
+			for (int tileSize : { 0, SDF_CONE_TILE_SIZE })
+			{
+				RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+				constants.g_Cone = GetConeConstants(tileSize, width);
+				constants.g_Relax.x = omega;
+				RenderStats stats = renderer.Render(constants, image);
+
+				double rays = double(stats.primaryRays);
+				std::printf(" %10.2f %9.1f%%", double(stats.primarySteps) / rays, 100.0 * double(stats.primaryFallbacks) / rays);
+			}
+			std::printf("\n");
+		}
+	}
+
+	// Frame time and primary ray steps, those of the cones included, of the built-in scene with the primary
+	// rays marched one by one and in bundles, without and with the cone prepass.
+	void RunPackets()
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "Packet marching", "ms", "steps/px", "+cone ms", "steps/px", "PSNR");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		Image reference;
+		for (int size : { 0, 2, 4, 8, 16 })
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), size ? "%dx%d packets" : "single rays", size, size);
+			std::printf("%-22s", name);
+
+			renderer.SetPacketSize(size);
+			Image image;
+			for (int tileSize : { 0, SDF_CONE_TILE_SIZE })
+			{
+				RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+				constants.g_Cone = GetConeConstants(tileSize, width);
+				RenderStats stats = renderer.Render(constants, image);
+				if (size == 0 && tileSize == 0)
+					reference = image;
+
+				std::printf(" %10.2f %10.2f", stats.seconds * 1e3, double(stats.primarySteps + stats.prepassSteps) / double(width * height));
+			}
+
+			char psnr[32];
+			std::snprintf(psnr, sizeof(psnr), size ? "%.1f dB" : "-", ComputePsnr(image, reference));
+			std::printf(" %10s\n", psnr);
+		}
+	}
+
+	// Normals of the built-in scene per second and the frame time for each SDF_NORMALS_* mode.
+	void RunNormals(double minSeconds)
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s\n", "Normals", "M/s", "frame ms", "map()/px");
+
+		PointCloud cloud(1 << 16);
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		Image image;
+		const char* names[] = { "central", "tetrahedron", "dual" };
+		for (int normals : { SDF_NORMALS_CENTRAL, SDF_NORMALS_TETRAHEDRON, SDF_NORMALS_DUAL })
+		{
+			SceneMap map;
+			map.time = 10.0f;
+			map.normals = normals;
+			double perSecond = Measure<float>(cloud, [&](const Vec3<float>& p) { return CalcNormal(map, float3(p.x, p.y, p.z), 1.0f).x; },
+				minSeconds);
+
+			renderer.SetNormals(normals);
+			RenderStats stats = renderer.Render(GetDefaultRenderConstants(10.0f, width, height), image);
+
+			std::printf("%-22s %10.2f %10.2f %10.2f\n", names[normals], perSecond * 1e-6, stats.seconds * 1e3,
+				double(stats.GetEvaluations()) / double(width * height));
+		}
+	}
+
+	// Frame time, shadow and AO evaluations and quality of the built-in scene with the lighting terms
+	// evaluated per block of pixels, against evaluating them for every pixel.
+	void RunReducedLighting()
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "Reduced lighting", "ms", "saved", "light/px", "fallback", "PSNR");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		Image reference;
+		double referenceSeconds = 0.0;
+		for (int scale : { 1, 2, 4 })
+		{
+			RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+			constants.g_Lighting = GetLightingConstants(scale, width);
+			Image image;
+			RenderStats stats = renderer.Render(constants, image);
+			if (scale == 1)
+			{
+				reference = image;
+				referenceSeconds = stats.seconds;
+			}
+
+			char name[64];
+			std::snprintf(name, sizeof(name), scale > 1 ? "%dx%d pixels" : "per pixel", scale, scale);
+			double pixels = double(width * height);
+			char psnr[32];
+			std::snprintf(psnr, sizeof(psnr), scale > 1 ? "%.1f dB" : "-", ComputePsnr(image, reference));
+			std::printf("%-22s %10.2f %9.1f%% %10.2f %9.1f%% %10s\n", name, stats.seconds * 1e3,
+				100.0 * (1.0 - stats.seconds / referenceSeconds), double(stats.shadowSteps + stats.aoEvaluations) / pixels,
+				100.0 * double(stats.lightingFallbacks) / pixels, psnr);
+		}
+	}
+
+	// Lookups in a baked brick map against the BVH evaluation of growing random scenes.
+	void RunBrickMap(double minSeconds)
+	{
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "Brick map", "bake ms", "bricks", "MB", "bvh M/s", "bricks M/s");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		for (uint32_t primitiveCount : { 25u, 400u, 1600u })
+		{
+			Tape tape;
+			SceneBvh bvh;
+			if (!CompileTape(*MakeRandomScene(primitiveCount), tape) || !bvh.Build(tape))
+				return;
+
+			SceneMap map;
+			map.bvh = &bvh;
+
+			const float extent = std::sqrt(float(primitiveCount) / 4.f) * 0.5f;
+			BrickMapDesc desc;
+			desc.bounds = box3(float3(-extent, -0.2f, -extent), float3(extent, 1.8f, extent));
+			desc.voxelSize = 0.05f;
+
+			BrickMap bricks;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!bricks.Bake(executor, map, desc))
+				return;
+			double bakeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			PointCloud cloud(1 << 14);
+			for (size_t i = 0; i < cloud.Size(); i++)
+			{
+				cloud.x[i] *= extent * 0.5f;
+				cloud.y[i] = cloud.y[i] * 0.4f + 0.8f;
+				cloud.z[i] *= extent * 0.5f;
+			}
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "%u primitives", primitiveCount);
+			std::printf("%-22s %10.1f %10u %10.2f %10.2f %10.2f\n", name, bakeSeconds * 1e3, bricks.GetBrickCount(),
+				double(bricks.GetMemorySize()) / (1 << 20),
+				Measure<float>(cloud, [&](const Vec3<float>& p) { return map(float3(p.x, p.y, p.z)).x; }, minSeconds) * 1e-6,
+				Measure<float>(cloud, [&](const Vec3<float>& p) { return bricks.Sample(float3(p.x, p.y, p.z)); }, minSeconds) * 1e-6);
+		}
+	}
+
+	// Brick maps and distance octrees of the built-in scene: their size, their mean error within 0.1 of
+	// the surfaces and their lookups, the octree's also in packets.
+	void RunDistanceOctree(double minSeconds)
+	{
+		std::printf("\n%-22s %10s %10s %10s %10s %10s %17s\n", "Distance octree", "build ms", "cells", "MB", "error", "x1 M/s", "xN M/s");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		SceneMap map;
+		map.time = 10.0f;
+
+		PointCloud cloud(1 << 14);
+		for (size_t i = 0; i < cloud.Size(); i++)
+		{
+			cloud.x[i] *= 1.2f;
+			cloud.y[i] = cloud.y[i] * 0.575f + 0.75f;
+			cloud.z[i] *= 1.2f;
+		}
+
+		auto measureError = [&](auto sample)
+		{
+			double sum = 0.0;
+			int count = 0;
+			for (size_t i = 0; i < cloud.Size(); i++)
+			{
+				const float3 p(cloud.x[i], cloud.y[i], cloud.z[i]);
+				const float d = map(p).x;
+				if (std::fabs(d) < 0.1f)
+				{
+					sum += std::fabs(sample(p) - d);
+					count++;
+				}
+			}
+			return count > 0 ? sum / count : 0.0;
+		};
+
+		for (float voxelSize : { 0.02f, 0.01f })
+		{
+			BrickMapDesc desc;
+			desc.voxelSize = voxelSize;
+			desc.bits = 16;
+
+			BrickMap bricks;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!bricks.Bake(executor, map, desc))
+				return;
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "bricks %g", voxelSize);
+			std::printf("%-22s %10.1f %10u %10.2f %10.5f %10.2f %17s\n", name, seconds * 1e3, bricks.GetBrickCount(),
+				double(bricks.GetMemorySize()) / (1 << 20), measureError([&](const float3& p) { return bricks.Sample(p); }),
+				Measure<float>(cloud, [&](const Vec3<float>& p) { return bricks.Sample(float3(p.x, p.y, p.z)); }, minSeconds) * 1e-6, "-");
+		}
+
+		for (float tolerance : { 0.002f, 0.0005f })
+		{
+			DistanceOctreeDesc desc;
+			desc.tolerance = tolerance;
+
+			DistanceOctree octree;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!octree.Build(executor, map, desc))
+				return;
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			const double scalar = Measure<float>(cloud, [&](const Vec3<float>& p) { return octree.Sample(p); }, minSeconds);
+			const double packets = Measure<FloatN>(cloud, [&](const Vec3<FloatN>& p) { return octree.Sample(p); }, minSeconds);
+			char name[64];
+			std::snprintf(name, sizeof(name), "octree %g", tolerance);
+			std::printf("%-22s %10.1f %10u %10.2f %10.5f %10.2f %10.2f (x%.1f)\n", name, seconds * 1e3, octree.GetLeafCount(),
+				double(octree.GetMemorySize()) / (1 << 20), measureError([&](const float3& p) { return octree.Sample(p); }),
+				scalar * 1e-6, packets * 1e-6, packets / scalar);
+		}
+	}
+
+	// A tileable volume of the fBm: building it against reading it from the cache, and a trilinear lookup
+	// against evaluating the octaves.
+	void RunNoiseVolume(double minSeconds)
+	{
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "Noise volume", "build ms", "load ms", "MB", "fbm M/s", "volume M/s");
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		donut::vfs::NativeFileSystem fs;
+		const std::filesystem::path fileName = std::filesystem::temp_directory_path() / "sdf_bench_noise.bin";
+		for (int octaves : { 1, 4, 8 })
+		{
+			NoiseVolumeDesc desc;
+			desc.size = 128;
+			desc.period = 8;
+			desc.octaves = octaves;
+
+			NoiseVolume volume;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!volume.Build(executor, desc) || !volume.Save(fileName))
+				return;
+			const double buildSeconds = Seconds(start);
+
+			NoiseVolume cached;
+			start = std::chrono::high_resolution_clock::now();
+			if (!cached.LoadOrBuild(executor, fs, fileName, desc))
+				return;
+			const double loadSeconds = Seconds(start);
+
+			PointCloud cloud(1 << 14);
+			const float period = float(desc.period);
+			char name[64];
+			std::snprintf(name, sizeof(name), "%d octaves", octaves);
+			std::printf("%-22s %10.1f %10.1f %10.2f %10.2f %10.2f\n", name, buildSeconds * 1e3, loadSeconds * 1e3,
+				double(volume.GetMemorySize()) / (1 << 20),
+				Measure<float>(cloud, [&](const Vec3<float>& p) { return GradientFbm(p * period, octaves, period); }, minSeconds) * 1e-6,
+				Measure<float>(cloud, [&](const Vec3<float>& p) { return cached.Sample(float3(p.x, p.y, p.z)); }, minSeconds) * 1e-6);
+		}
+		std::filesystem::remove(fileName);
+	}
+
+	// Agents spread over a random scene: distances and rays one at a time, against batches of packets
+	// on one thread and on all of them.
+	void RunQueries()
+	{
+		std::printf("\n%-22s %10s %10s %10s\n", "Queries M/s", "single", "batch 1T", "batch");
+
+		Tape tape;
+		SceneBvh bvh;
+		if (!CompileTape(*MakeRandomScene(400), tape) || !bvh.Build(tape))
+			return;
+
+		SceneMap map;
+		map.bvh = &bvh;
+
+		const size_t count = 1 << 16;
+		std::mt19937 rng(77);
+		std::uniform_real_distribution<float> dist(-4.5f, 4.5f);
+		std::uniform_real_distribution<float> angle(0.f, 6.2831853f);
+		RayQueries rays;
+		rays.origins.Resize(count);
+		rays.directions.Resize(count);
+		rays.maxDistances.assign(count, SDF_RAY_END);
+		for (size_t i = 0; i < count; i++)
+		{
+			const float a = angle(rng);
+			rays.origins.Set(i, float3(dist(rng), 0.5f, dist(rng)));
+			rays.directions.Set(i, float3(std::cos(a), -0.1f, std::sin(a)) / std::sqrt(1.01f));
+		}
+
+		tf::Executor single(1);
+		tf::Executor all(std::max(std::thread::hardware_concurrency(), 1u));
+		auto seconds = [](auto&& function)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			function();
+			return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+
+		auto run = [&](const char* suffix)
+		{
+			std::vector<float> distances(count);
+			const double distanceSingle = seconds([&]
+			{
+				for (size_t i = 0; i < count; i++)
+					distances[i] = map(rays.origins.Get(i)).x;
+			});
+			const double distanceBatch1 = seconds([&] { SceneQuery(single, map).Distance(rays.origins, distances); });
+			const double distanceBatch = seconds([&] { SceneQuery(all, map).Distance(rays.origins, distances); });
+			std::printf("%-22s %10.2f %10.2f %10.2f\n", (std::string("distance") + suffix).c_str(), count / distanceSingle * 1e-6,
+				count / distanceBatch1 * 1e-6, count / distanceBatch * 1e-6);
+
+			// The same marching as the batches, without the renderer's over-relaxation.
+			RayHits hits;
+			const double raySingle = seconds([&]
+			{
+				for (size_t i = 0; i < count; i++)
+					distances[i] = Raycast(map, rays.origins.Get(i), rays.directions.Get(i), 256, 0.f, 1.f).x;
+			});
+			const double rayBatch1 = seconds([&] { SceneQuery(single, map).Raycast(rays, hits); });
+			const double rayBatch = seconds([&] { SceneQuery(all, map).Raycast(rays, hits); });
+			std::printf("%-22s %10.2f %10.2f %10.2f\n", (std::string("raycast") + suffix).c_str(), count / raySingle * 1e-6,
+				count / rayBatch1 * 1e-6, count / rayBatch * 1e-6);
+		};
+		run("");
+
+		// Again with the compiled tapes of the objects.
+		JitCache cache;
+		BvhJit jit;
+		jit.Update(bvh, cache);
+		map.jit = &jit;
+		run(" jit");
+	}
+
+	// Whole tapes compiled by TapeJit.h against the interpreter for growing random scenes, and the scene
+	// file, when there is one, against the C++ port of map() as well.
+	void RunJit(double minSeconds, const std::filesystem::path& sceneFile)
+	{
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "JIT Mpoints/s", "tape x1", "jit x1", "tape xN", "jit xN", "compile ms");
+		if (!JitTape::IsSupported())
+		{
+			std::printf("%-22s\n", "not supported");
+			return;
+		}
+
+		auto run = [&](const char* name, const Tape& tape, float extent)
+		{
+			PointCloud cloud(1 << 14);
+			for (size_t i = 0; i < cloud.Size(); i++)
+			{
+				cloud.x[i] *= extent * 0.5f;
+				cloud.y[i] = cloud.y[i] * 0.4f + 0.8f;
+				cloud.z[i] *= extent * 0.5f;
+			}
+
+			JitTape jit;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!jit.Compile(tape))
+			{
+				std::printf("%-22s %10s\n", name, "interpreted");
+				return;
+			}
+			const double compileSeconds = Seconds(start);
+
+			auto tapeKernel = [&](const auto& p) { return EvaluateTape(tape, p, 10.f).x; };
+			auto jitKernel = [&](const auto& p) { return jit.Evaluate(p, 10.f).x; };
+			std::printf("%-22s %10.2f %10.2f %10.2f %10.2f %10.2f\n", name,
+				Measure<float>(cloud, tapeKernel, minSeconds) * 1e-6, Measure<float>(cloud, jitKernel, minSeconds) * 1e-6,
+				Measure<FloatN>(cloud, tapeKernel, minSeconds) * 1e-6, Measure<FloatN>(cloud, jitKernel, minSeconds) * 1e-6,
+				compileSeconds * 1e3);
+		};
+
+		for (uint32_t primitiveCount : { 25u, 100u, 400u })
+		{
+			Tape tape;
+			if (!CompileTape(*MakeRandomScene(primitiveCount), tape))
+				return;
+			char name[64];
+			std::snprintf(name, sizeof(name), "%u primitives", primitiveCount);
+			run(name, tape, std::sqrt(float(primitiveCount) / 4.f) * 0.5f);
+		}
+
+		if (sceneFile.empty())
+			return;
+
+		donut::vfs::NativeFileSystem fs;
+		std::unique_ptr<CsgNode> root = LoadCsgScene(fs, sceneFile);
+		Tape tape;
+		if (!root || !CompileTape(*root, tape))
+			return;
+		const std::string name = sceneFile.filename().generic_string();
+		run(name.c_str(), tape, 8.f);
+
+		// The built-in scene is what default.json describes.
+		PointCloud cloud(1 << 14);
+		for (size_t i = 0; i < cloud.Size(); i++)
+		{
+			cloud.x[i] *= 4.f;
+			cloud.y[i] = cloud.y[i] * 0.4f + 0.8f;
+			cloud.z[i] *= 4.f;
+		}
+		auto mapKernel = [](const auto& p) { return mapDefault(p, 10.f).x; };
+		std::printf("%-22s %10s %10.2f %10s %10.2f\n", "C++ map()", "", Measure<float>(cloud, mapKernel, minSeconds) * 1e-6, "",
+			Measure<FloatN>(cloud, mapKernel, minSeconds) * 1e-6);
+	}
+
+	// Cost of building an occupancy grid and of updating it for the next frame, where the surfaces that
+	// follow the time moved, against the primary ray steps and the frame time it saves, for the scene of
+	// -scene or else the built-in one.
+	void RunOccupancy(const std::filesystem::path& sceneFile)
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "Occupancy grid", "build ms", "update ms", "KB", "steps/ray", "frame ms");
+
+		SceneBvh bvh;
+		if (!sceneFile.empty())
+		{
+			donut::vfs::NativeFileSystem fs;
+			std::unique_ptr<CsgNode> root = LoadCsgScene(fs, sceneFile);
+			Tape tape;
+			if (!root || !CompileTape(*root, tape) || !bvh.Build(tape))
+				return;
+		}
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		renderer.SetScene(sceneFile.empty() ? nullptr : &bvh);
+		RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+		constants.g_Cone = GetConeConstants(0, width);
+
+		SceneMap map;
+		map.bvh = sceneFile.empty() ? nullptr : &bvh;
+		map.time = constants.g_Time.x;
+		for (int size : { 0, 32, 64, 128 })
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), size ? "%d^3 cells" : "no grid", size);
+			std::printf("%-22s", name);
+
+			OccupancyGrid grid;
+			if (size > 0)
+			{
+				OccupancyGridDesc desc;
+				desc.size = size;
+				desc.margin = sceneFile.empty() ? c_DefaultSceneOvershoot : 0.f;
+				auto start = std::chrono::high_resolution_clock::now();
+				grid.Build(executor, map, desc);
+				const double buildSeconds = Seconds(start);
+
+				SceneMap next = map;
+				next.time += 1.f / 30.f;
+				std::vector<box3> regions;
+				GetTimeDependentRegions(next, regions);
+				start = std::chrono::high_resolution_clock::now();
+				grid.Update(executor, next, regions);
+				const double updateSeconds = Seconds(start);
+				grid.Build(executor, map, desc);
+				std::printf(" %10.2f %10.2f %10.1f", buildSeconds * 1e3, updateSeconds * 1e3, double(grid.GetMemorySize()) / 1024.0);
+			}
+			else
+				std::printf(" %10s %10s %10s", "-", "-", "-");
+
+			renderer.SetOccupancy(&grid);
+			Image image;
+			RenderStats stats = renderer.Render(constants, image);
+			std::printf(" %10.2f %10.2f\n", double(stats.primarySteps) / double(std::max<uint64_t>(stats.primaryRays, 1)), stats.seconds * 1e3);
+		}
+	}
+
+	// Cost of updating a budget of irradiance probes per frame, the steps of their rays and the frame time
+	// with the lit grid, against the fixed sky light, then the speed of the lookups of the shading.
+	void RunProbes(const std::filesystem::path& sceneFile)
+	{
+		const int width = 640;
+		const int height = 360;
+		std::printf("\n%-22s %10s %10s %10s %10s\n", "Probe grid", "update ms", "KB", "steps/ray", "frame ms");
+
+		SceneBvh bvh;
+		if (!sceneFile.empty())
+		{
+			donut::vfs::NativeFileSystem fs;
+			std::unique_ptr<CsgNode> root = LoadCsgScene(fs, sceneFile);
+			Tape tape;
+			if (!root || !CompileTape(*root, tape) || !bvh.Build(tape))
+				return;
+		}
+
+		tf::Executor executor(std::max(std::thread::hardware_concurrency(), 1u));
+		CpuRenderer renderer(executor);
+		renderer.SetScene(sceneFile.empty() ? nullptr : &bvh);
+		RenderConstants constants = GetDefaultRenderConstants(10.0f, width, height);
+		constants.g_Cone = GetConeConstants(0, width);
+
+		SceneMap map;
+		map.bvh = sceneFile.empty() ? nullptr : &bvh;
+		map.time = constants.g_Time.x;
+		ProbeGrid grid;
+		for (uint32_t budget : { 0u, 16u, 64u, 256u })
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), budget ? "%u probes/frame" : "fixed sky", budget);
+			std::printf("%-22s", name);
+
+			if (budget > 0)
+			{
+				grid.Init(ProbeGridDesc());
+				grid.Update(executor, map, constants, grid.GetProbeCount());
+				RenderStats stats;
+				auto start = std::chrono::high_resolution_clock::now();
+				const int updates = int(std::max(grid.GetProbeCount() / budget, 1u));
+				for (int i = 0; i < updates; i++)
+					grid.Update(executor, map, constants, budget, &stats);
+				std::printf(" %10.2f %10.1f %10.2f", Seconds(start) * 1e3 / updates, double(grid.GetMemorySize()) / 1024.0,
+					double(stats.primarySteps) / double(std::max<uint64_t>(stats.primaryRays, 1)));
+			}
+			else
+				std::printf(" %10s %10s %10s", "-", "-", "-");
+
+			renderer.SetProbes(&grid);
+			Image image;
+			RenderStats stats = renderer.Render(constants, image);
+			std::printf(" %10.2f\n", stats.seconds * 1e3);
+		}
+
+		// Lookups at random points above the floor, as many as the pixels of a frame.
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(-1.f, 1.f);
+		std::vector<float3> points(size_t(width) * height);
+		for (float3& p : points)
+			p = float3(2.5f * dist(rng), 1.f + dist(rng), 2.5f * dist(rng));
+		float sink = 0.f;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const float3& p : points)
+			sink += grid.Sample(p, normalize(p), float3(0.f, 0.f, 1.f)).x;
+		const double seconds = Seconds(start);
+		if (sink == 12345.f)
+			std::printf(" ");
+		std::printf("%-22s %10.2f M/s\n", "probe lookups", double(points.size()) / seconds * 1e-6);
+	}
+}
+
+int main(int argc, const char** argv)
+{
+	size_t pointCount = 1 << 20;
+	double minSeconds = 0.25;
+	uint32_t primitiveCount = 400;
+	std::filesystem::path sceneFile;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "-points") && i + 1 < argc)
+			pointCount = size_t(std::stoull(argv[++i]));
+		else if (!std::strcmp(argv[i], "-seconds") && i + 1 < argc)
+			minSeconds = std::stod(argv[++i]);
+		else if (!std::strcmp(argv[i], "-primitives") && i + 1 < argc)
+			primitiveCount = uint32_t(std::stoul(argv[++i]));
+		else if (!std::strcmp(argv[i], "-scene") && i + 1 < argc)
+			sceneFile = argv[++i];
+		else
+		{
+			std::fprintf(stderr, "usage: SDFBench [-points N] [-seconds S] [-primitives N] [-scene file.json]\n");
+			return 1;
+		}
+	}
+
+	RunPrimitives(pointCount, minSeconds);
+	RunPruning(primitiveCount, minSeconds);
+	RunBvh(minSeconds);
+	RunConePrepass();
+	RunRelaxation();
+	RunPackets();
+	RunNormals(minSeconds);
+	RunReducedLighting();
+	RunBrickMap(minSeconds);
+	RunDistanceOctree(minSeconds);
+	RunNoiseVolume(minSeconds);
+	RunQueries();
+	RunJit(minSeconds, sceneFile);
+	RunOccupancy(sceneFile);
+	RunProbes(sceneFile);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+// Mesh extractor: polygonizes the SDF scene by dual contouring (see src/cpu/MeshExtraction.h) and
+// writes the triangles to a Wavefront OBJ file, for raster LODs and collision or shadow proxies.
+// Reports how much of the grid the octree skipped and how far the vertices are from the surfaces.
+
+#include "../cpu/MeshExtraction.h"
+
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	void PrintUsage()
+	{
+		std::fprintf(stderr,
+			"usage: SDFMesh [options]\n"
+			"  -scene <file>       JSON scene or .tape file, the built-in scene by default\n"
+			"  -o <file>           output mesh (sdf.obj)\n"
+			"  -time <t>           g_Time.x the scene is extracted at (10)\n"
+			"  -bounds <6 floats>  extracted region as min x y z and max x y z (-2.5 -0.5 -2.5 2.5 2 2.5)\n"
+			"  -cell <size>        edge length of the grid cells (0.02)\n"
+			"  -threads <n>        worker threads (all cores)\n");
+	}
+}
+
+int main(int argc, const char** argv)
+{
+	std::filesystem::path scenePath;
+	std::filesystem::path outputPath = "sdf.obj";
+	float time = 10.0f;
+	MeshExtractionDesc desc;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (!std::strcmp(arg, "-bounds") && i + 6 < argc)
+		{
+			desc.bounds = box3(float3(std::stof(argv[i + 1]), std::stof(argv[i + 2]), std::stof(argv[i + 3])),
+				float3(std::stof(argv[i + 4]), std::stof(argv[i + 5]), std::stof(argv[i + 6])));
+			i += 6;
+			continue;
+		}
+
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			PrintUsage();
+			return 1;
+		}
+		i++;
+
+		if (!std::strcmp(arg, "-scene")) scenePath = value;
+		else if (!std::strcmp(arg, "-o")) outputPath = value;
+		else if (!std::strcmp(arg, "-time")) time = std::stof(value);
+		else if (!std::strcmp(arg, "-cell")) desc.cellSize = std::stof(value);
+		else if (!std::strcmp(arg, "-threads")) threads = unsigned(std::max(std::stoi(value), 1));
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	Tape tape;
+	SceneBvh bvh;
+	if (!scenePath.empty())
+	{
+		vfs::NativeFileSystem fs;
+		if (scenePath.extension() == ".tape")
+		{
+			if (!LoadTape(fs, scenePath, tape))
+				return 1;
+		}
+		else
+		{
+			std::unique_ptr<CsgNode> root = LoadCsgScene(fs, scenePath);
+			if (!root || !CompileTape(*root, tape))
+				return 1;
+		}
+
+		if (!bvh.Build(tape))
+		{
+			std::fprintf(stderr, "%s has a malformed tape\n", scenePath.generic_string().c_str());
+			return 1;
+		}
+	}
+
+	SceneMap map;
+	map.bvh = scenePath.empty() ? nullptr : &bvh;
+	map.time = time;
+
+	tf::Executor executor(threads);
+	TriangleMesh mesh;
+	MeshExtractionStats stats;
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!ExtractMesh(executor, map, desc, mesh, &stats))
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const float3 extent = desc.bounds.diagonal();
+	const double cells = std::ceil(extent.x / desc.cellSize) * std::ceil(extent.y / desc.cellSize) * std::ceil(extent.z / desc.cellSize);
+	std::printf("%zu vertices, %u triangles from cells of %g, %u threads, %.2f ms\n", mesh.positions.size(), mesh.GetTriangleCount(),
+		desc.cellSize, threads, seconds * 1e3);
+	std::printf("  octree %u nodes, %u leaves of %d^3 cells (%.1f%% of the grid)\n", stats.nodes, stats.leaves, c_LeafCells,
+		100.0 * double(stats.leaves) * double(c_LeafCells * c_LeafCells * c_LeafCells) / cells);
+	std::printf("  %.2f M evaluations, %.2f per cell of the grid\n", double(stats.evaluations) * 1e-6, double(stats.evaluations) / cells);
+
+	double sum = 0.0;
+	double largest = 0.0;
+	for (const float3& p : mesh.positions)
+	{
+		double error = std::fabs(double(map(p).x));
+		sum += error;
+		largest = std::max(largest, error);
+	}
+	if (!mesh.positions.empty())
+	{
+		std::printf("  error  %.5f mean, %.5f max distance of the vertices to the surfaces (%.2f%% and %.2f%% of a cell)\n",
+			sum / double(mesh.positions.size()), largest, 100.0 * sum / double(mesh.positions.size()) / desc.cellSize,
+			100.0 * largest / desc.cellSize);
+	}
+
+	if (!SaveObj(mesh, outputPath))
+		return 1;
+
+	return 0;
+}
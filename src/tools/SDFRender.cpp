@@ -0,0 +1,404 @@
+// Headless CPU renderer: renders one frame of the SDF scene exactly like the shader and writes a PNG.
+// With -compare it checks the result against a golden image, for regression tests on machines without a GPU.
+// It also reports how many map() evaluations every pixel needed, optionally as a heatmap and a histogram.
+// With -samples it averages jittered samples like the progressive accumulation of a still frame.
+
+#include "../cpu/Accumulation.h"
+#include "../cpu/ConePrepass.h"
+#include "../cpu/Instrumentation.h"
+#include "../cpu/LightingPass.h"
+#include "../cpu/OccupancyGrid.h"
+#include "../cpu/ProbeGrid.h"
+#include "../cpu/SceneAnimation.h"
+#include "../cpu/TemporalReuse.h"
+#include "RenderOptions.h"
+
+#include <donut/core/vfs/VFS.h>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace donut;
+using namespace sdf;
+
+namespace
+{
+	void PrintUsage()
+	{
+		std::fprintf(stderr,
+			"usage: SDFRender [options]\n"
+			"  -scene <file>       JSON scene or .tape file, the built-in scene by default; animated scenes at -time\n"
+			"  -o <file>           output PNG (sdf.png)\n"
+			"  -width <n>          image width (1280)\n"
+			"  -height <n>         image height (720)\n"
+			"  -time <t>           g_Time.x (10)\n");
+		PrintShadingOptions();
+		std::fprintf(stderr,
+			"  -temporal <dt>      render the frame at time - dt first and reuse its primary hits, 0 disables it (0)\n"
+			"  -samples <n>        average n jittered samples per pixel, antialiased with area light shadows (1)\n"
+			"  -jit <0|1>          evaluate the -scene with tapes compiled to native code (0)\n"
+			"  -packets <n>        march the primary rays of n x n pixel bundles together, e.g. 2 or 8; 0 disables it (0)\n"
+			"  -probes <n>         full updates of the irradiance probe grid for the bounced diffuse light; 0 keeps the fixed sky light (0)\n"
+			"  -threads <n>        worker threads (all cores)\n"
+			"  -tile <n>           tile size in pixels (16)\n"
+			"  -frames <n>         render the frame n times and report the average speed (1)\n"
+			"  -compare <file>     golden PNG to compare against, fails below -psnr\n"
+			"  -psnr <db>          minimum PSNR for -compare (40)\n"
+			"  -heatmap <file>     PNG heatmap of the map() evaluations per pixel\n"
+			"  -heatmapof <name>   count shown by the heatmap: total, primary, normal, ao or shadow (total)\n"
+			"  -heatmapscale <n>   evaluations at the top of the color scale, 0 for the 99th percentile (0)\n"
+			"  -histogram <file>   CSV histogram of the map() evaluations per pixel\n");
+	}
+
+	const char* const c_HeatmapNames[] = { "off", "total", "primary", "normal", "ao", "shadow" };
+
+	int FindHeatmapMode(const char* name)
+	{
+		for (int mode = SDF_HEATMAP_TOTAL; mode <= SDF_HEATMAP_SHADOW; mode++)
+		{
+			if (!std::strcmp(name, c_HeatmapNames[mode]))
+				return mode;
+		}
+		return -1;
+	}
+
+	void PrintEvaluations(const EvaluationImage& evaluations, const RenderStats& stats, unsigned threads, int frames)
+	{
+		const EvaluationDistribution total = GetEvaluationDistribution(evaluations, SDF_HEATMAP_TOTAL);
+
+		std::printf("  map() per pixel      mean    p50    p95    p99    max   share\n");
+		for (int mode = SDF_HEATMAP_TOTAL; mode <= SDF_HEATMAP_SHADOW; mode++)
+		{
+			const EvaluationDistribution d = GetEvaluationDistribution(evaluations, mode);
+			std::printf("    %-12s %9.2f %6u %6u %6u %6u %6.1f%%\n", c_HeatmapNames[mode], d.GetMean(), d.p50, d.p95, d.p99, d.max,
+				100.0 * double(d.sum) / double(std::max<uint64_t>(total.sum, 1)));
+		}
+
+		// Wall time of all threads spread over every map() call, including the shading around them.
+		uint64_t calls = stats.GetEvaluations() / uint64_t(frames);
+		std::printf("  %.2f M map() calls per frame (%.2f per pixel with the prepass), %.1f ns per call and thread\n",
+			double(calls) * 1e-6, double(calls) / double(std::max<uint64_t>(total.pixels, 1)),
+			stats.seconds * double(threads) * 1e9 / double(std::max<uint64_t>(stats.GetEvaluations(), 1)));
+	}
+}
+
+int main(int argc, const char** argv)
+{
+	std::filesystem::path scenePath;
+	std::filesystem::path outputPath = "sdf.png";
+	std::filesystem::path texturePath;
+	std::filesystem::path goldenPath;
+	std::filesystem::path heatmapPath;
+	std::filesystem::path histogramPath;
+	int heatmapMode = SDF_HEATMAP_TOTAL;
+	uint32_t heatmapScale = 0;
+	int width = 1280;
+	int height = 720;
+	float time = 10.0f;
+	std::string switches = "1111";
+	float steps = 256.0f;
+	float shadowK = 20.0f;
+	int coneTileSize = SDF_CONE_TILE_SIZE;
+	float relaxation = SDF_RAY_RELAXATION;
+	int normals = SDF_NORMALS_DEFAULT;
+	float temporalDt = 0.0f;
+	int lightingScale = 1;
+	int samples = 1;
+	bool jit = false;
+	int packetSize = 0;
+	int occupancySize = 0;
+	int probePasses = 0;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+	int tileSize = 16;
+	int frames = 1;
+	double minPsnr = 40.0;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value)
+			{
+				PrintUsage();
+				return 1;
+			}
+			i++;
+
+			if (!std::strcmp(arg, "-scene")) scenePath = value;
+			else if (!std::strcmp(arg, "-o")) outputPath = value;
+			else if (!std::strcmp(arg, "-width")) width = std::stoi(value);
+			else if (!std::strcmp(arg, "-height")) height = std::stoi(value);
+			else if (!std::strcmp(arg, "-time")) time = std::stof(value);
+			else if (!std::strcmp(arg, "-switch")) switches = value;
+			else if (!std::strcmp(arg, "-steps")) steps = std::stof(value);
+			else if (!std::strcmp(arg, "-shadowk")) shadowK = std::stof(value);
+			else if (!std::strcmp(arg, "-cone")) coneTileSize = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-relax")) relaxation = std::stof(value);
+			else if (!std::strcmp(arg, "-normals")) normals = FindNormals(value);
+			else if (!std::strcmp(arg, "-temporal")) temporalDt = std::max(std::stof(value), 0.0f);
+			else if (!std::strcmp(arg, "-lighting")) lightingScale = std::max(std::stoi(value), 1);
+			else if (!std::strcmp(arg, "-samples")) samples = std::clamp(std::stoi(value), 1, SDF_ACCUMULATE_MAX_SAMPLES);
+			else if (!std::strcmp(arg, "-jit")) jit = std::stoi(value) != 0;
+			else if (!std::strcmp(arg, "-packets")) packetSize = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-occupancy")) occupancySize = std::stoi(value);
+			else if (!std::strcmp(arg, "-probes")) probePasses = std::max(std::stoi(value), 0);
+			else if (!std::strcmp(arg, "-texture")) texturePath = value;
+			else if (!std::strcmp(arg, "-threads")) threads = unsigned(std::max(std::stoi(value), 1));
+			else if (!std::strcmp(arg, "-tile")) tileSize = std::max(std::stoi(value), 1);
+			else if (!std::strcmp(arg, "-frames")) frames = std::max(std::stoi(value), 1);
+			else if (!std::strcmp(arg, "-compare")) goldenPath = value;
+			else if (!std::strcmp(arg, "-psnr")) minPsnr = std::stod(value);
+			else if (!std::strcmp(arg, "-heatmap")) heatmapPath = value;
+			else if (!std::strcmp(arg, "-heatmapof")) heatmapMode = FindHeatmapMode(value);
+			else if (!std::strcmp(arg, "-heatmapscale")) heatmapScale = uint32_t(std::max(std::stoi(value), 0));
+			else if (!std::strcmp(arg, "-histogram")) histogramPath = value;
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+	}
+	catch (const std::logic_error&)
+	{
+		// std::stoi and std::stof throw on values that aren't numbers or are out of range.
+		PrintUsage();
+		return 1;
+	}
+
+	if (switches.size() != 4 || width <= 0 || height <= 0 || heatmapMode < 0 || normals < 0 || !IsOccupancySize(occupancySize))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	vfs::NativeFileSystem fs;
+
+	Tape tape;
+	SceneBvh bvh;
+	std::unique_ptr<CsgCamera> camera;
+	if (!scenePath.empty())
+	{
+		if (scenePath.extension() == ".tape")
+		{
+			if (!LoadTape(fs, scenePath, tape))
+				return 1;
+		}
+		else
+		{
+			std::unique_ptr<CsgNode> root = LoadCsgScene(fs, scenePath, &camera);
+			if (!root || !CompileTape(*root, tape))
+				return 1;
+		}
+
+		if (!bvh.Build(tape))
+		{
+			std::fprintf(stderr, "%s has a malformed tape\n", scenePath.generic_string().c_str());
+			return 1;
+		}
+	}
+
+	Texture texture;
+	if (!texturePath.empty() && !LoadTexture(fs, texturePath, texture))
+		return 1;
+
+	RenderConstants constants = GetDefaultRenderConstants(time, width, height);
+	constants.g_Switch = int4(switches[0] - '0', switches[1] - '0', switches[2] - '0', switches[3] - '0');
+	constants.g_Factor = float2(steps, shadowK);
+	constants.g_Cone = GetConeConstants(coneTileSize, width);
+	constants.g_Relax = float4(relaxation, 0.f, 0.f, 0.f);
+	constants.g_Temporal = GetTemporalConstants(temporalDt > 0.0f, time - temporalDt);
+	constants.g_Lighting = GetLightingConstants(lightingScale, width);
+	RenderConstants previous = constants;
+	previous.g_Time.x = time - temporalDt;
+
+	SceneAnimation animation;
+	animation.Bind(tape, camera.get());
+	animation.GetCameraConstants(constants.g_Time.x, constants.g_Camera, constants.g_CameraTarget);
+	animation.GetCameraConstants(previous.g_Time.x, previous.g_Camera, previous.g_CameraTarget);
+	tf::Executor executor(threads);
+	OccupancyGrid occupancy;
+	float occupancyTime = 0.0f;
+	std::vector<box3> moved;
+	// Poses the scene at the time of a frame, and the occupancy grid with it: built the first time, then
+	// updated where the objects moved and where the surfaces follow the time.
+	auto animate = [&](const RenderConstants& frame)
+	{
+		moved.clear();
+		if (animation.Evaluate(frame.g_Time.x, bvh) > 0)
+			bvh.Refit(&moved);
+		if (occupancySize == 0)
+			return;
+
+		SceneMap map;
+		map.bvh = scenePath.empty() ? nullptr : &bvh;
+		map.time = frame.g_Time.x;
+		if (occupancy.Empty())
+		{
+			OccupancyGridDesc desc;
+			desc.size = occupancySize;
+			desc.margin = scenePath.empty() ? c_DefaultSceneOvershoot : 0.0f;
+			occupancy.Build(executor, map, desc);
+		}
+		else
+		{
+			if (frame.g_Time.x != occupancyTime)
+				GetTimeDependentRegions(map, moved);
+			occupancy.Update(executor, map, moved);
+		}
+		occupancyTime = frame.g_Time.x;
+	};
+
+	CpuRenderer renderer(executor);
+	renderer.SetScene(scenePath.empty() ? nullptr : &bvh);
+	renderer.SetTexture(texturePath.empty() ? nullptr : &texture);
+	renderer.SetTileSize(tileSize);
+	renderer.SetRecordEvaluations(true);
+	renderer.SetNormals(normals);
+	renderer.SetJit(jit);
+	renderer.SetPacketSize(packetSize);
+	renderer.SetOccupancy(&occupancy);
+
+	// The probes are lit by full updates at the time of the frame before it is rendered, each adding a
+	// bounce of the light.
+	ProbeGrid probes;
+	RenderStats probeStats;
+	double probeSeconds = 0.0;
+	if (probePasses > 0)
+	{
+		animate(constants);
+		SceneMap map;
+		map.bvh = scenePath.empty() ? nullptr : &bvh;
+		map.occupancy = occupancy.Empty() ? nullptr : &occupancy;
+		map.time = constants.g_Time.x;
+		probes.Init(ProbeGridDesc());
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int pass = 0; pass < probePasses; pass++)
+			probes.Update(executor, map, constants, probes.GetProbeCount(), &probeStats);
+		probeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		renderer.SetProbes(&probes);
+	}
+
+	Image image;
+	RenderStats total;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// The previous frame is not timed, only the one that reuses its hits.
+		if (temporalDt > 0.0f)
+		{
+			animate(previous);
+			renderer.Render(previous, image);
+		}
+		animate(constants);
+		if (samples > 1)
+		{
+			renderer.ResetAccumulation();
+			total += renderer.Accumulate(constants, samples, image);
+		}
+		else
+			total += renderer.Render(constants, image);
+	}
+
+	std::printf("%dx%d, %u threads, %.2f ms per frame\n", width, height, threads, total.seconds * 1e3 / frames);
+	std::printf("  rays   %10.2f M/s (%llu primary, %llu shadow per frame)\n", total.GetRaysPerSecond() * 1e-6,
+		(unsigned long long)(total.primaryRays / frames), (unsigned long long)(total.shadowRays / frames));
+	std::printf("  steps  %10.2f M/s (%.1f per primary ray, %.1f per shadow ray)\n", total.GetStepsPerSecond() * 1e-6,
+		double(total.primarySteps) / double(std::max<uint64_t>(total.primaryRays, 1)),
+		double(total.shadowSteps) / double(std::max<uint64_t>(total.shadowRays, 1)));
+	if (relaxation > 1.0f)
+	{
+		std::printf("  relax  %.2f, %.2f%% of the primary rays fell back to plain steps\n", relaxation,
+			100.0 * double(total.primaryFallbacks) / double(std::max<uint64_t>(total.primaryRays, 1)));
+	}
+	if (total.prepassRays > 0 && packetSize > 0)
+	{
+		std::printf("  cones  %llu of the prepass and the %dx%d packets, %.1f steps per cone, %.2f per pixel\n",
+			(unsigned long long)(total.prepassRays / frames), packetSize, packetSize,
+			double(total.prepassSteps) / double(total.prepassRays), double(total.prepassSteps) / double(total.primaryRays));
+	}
+	else if (total.prepassRays > 0)
+	{
+		std::printf("  prepass %llu cones of %d pixels, %.1f steps per cone, %.2f per pixel\n",
+			(unsigned long long)(total.prepassRays / frames), coneTileSize,
+			double(total.prepassSteps) / double(total.prepassRays), double(total.prepassSteps) / double(total.primaryRays));
+	}
+	if (occupancySize > 0)
+	{
+		std::printf("  occupancy %d^3 cells in %d levels, %.1f KB, %.2f jumps per primary ray\n", occupancySize,
+			occupancy.GetLevelCount(), double(occupancy.GetMemorySize()) / 1024.0,
+			double(total.primarySkips) / double(std::max<uint64_t>(total.primaryRays, 1)));
+	}
+	if (probePasses > 0)
+	{
+		const int3 counts = probes.GetCounts();
+		std::printf("  probes %dx%dx%d, %.1f KB, %.2f ms per full update, %.1f steps per probe ray\n", counts.x, counts.y, counts.z,
+			double(probes.GetMemorySize()) / 1024.0, probeSeconds * 1e3 / probePasses,
+			double(probeStats.primarySteps) / double(std::max<uint64_t>(probeStats.primaryRays, 1)));
+	}
+	if (temporalDt > 0.0f)
+	{
+		std::printf("  temporal %.2f%% of the primary rays started at the hits of the frame %g earlier\n",
+			100.0 * double(total.temporalSeeds) / double(std::max<uint64_t>(total.primaryRays, 1)), temporalDt);
+	}
+	if (total.lightingSamples > 0)
+	{
+		std::printf("  lighting %llu samples of %dx%d pixels, %.2f%% of the pixels evaluated their own terms\n",
+			(unsigned long long)(total.lightingSamples / frames), lightingScale, lightingScale,
+			100.0 * double(total.lightingFallbacks) / double(std::max<uint64_t>(uint64_t(width) * uint64_t(height) * uint64_t(frames), 1)));
+	}
+	if (samples > 1)
+	{
+		std::printf("  accumulation %d jittered samples per pixel, the evaluations below are of the last one\n",
+			renderer.GetAccumulation().samples);
+	}
+	PrintEvaluations(renderer.GetEvaluations(), total, threads, frames);
+
+	if (!SavePng(image, outputPath))
+		return 1;
+
+	if (!heatmapPath.empty())
+	{
+		if (heatmapScale == 0)
+			heatmapScale = GetEvaluationDistribution(renderer.GetEvaluations(), heatmapMode).p99;
+
+		Image heatmap;
+		MakeHeatmap(renderer.GetEvaluations(), heatmapMode, heatmapScale, heatmap);
+		if (!SavePng(heatmap, heatmapPath, false))
+			return 1;
+		std::printf("  heatmap of %s evaluations, %u at the top of the scale\n", c_HeatmapNames[heatmapMode], heatmapScale);
+	}
+
+	if (!histogramPath.empty() && !SaveEvaluationHistogram(renderer.GetEvaluations(), histogramPath))
+		return 1;
+
+	if (!goldenPath.empty())
+	{
+		// Compare the 8-bit encoded values, as they are stored in both files.
+		Image golden;
+		if (!LoadPng(fs, goldenPath, golden, false))
+			return 1;
+
+		Image encoded = image;
+		for (float3& c : encoded.pixels)
+			c = float3(uint3(toSRGB(saturate(c)) * 255.f + 0.5f)) / 255.f;
+
+		double psnr = ComputePsnr(encoded, golden);
+		std::printf("  PSNR against %s: %.2f dB\n", goldenPath.generic_string().c_str(), psnr);
+		if (psnr < minPsnr)
+		{
+			std::fprintf(stderr, "Image differs from the golden image (%.2f dB < %.2f dB)\n", psnr, minPsnr);
+			return 2;
+		}
+	}
+
+	return 0;
+}